@@ -0,0 +1,57 @@
+#include <iostream>
+#include <string>
+#include <exception>
+
+#include "evtol_benchmarks.h"
+
+
+// a count greater than 0, or 0 if the argument isn't one
+size_t countArgument(const std::string& arg)
+{
+	if (arg.empty() || arg.find_first_not_of("0123456789") != std::string::npos || arg.size() > 18) return 0;
+	return static_cast<size_t>(std::stoull(arg));
+}
+
+// Benchmarks of the simulation core, separate from the simulation itself.
+// Usage:
+//     benchmark.out [--json results.json] [--repetitions 3] [--max-fleet 1000000]
+int main(int argc, char* argv[])
+{
+	std::string json_file;
+	size_t repetitions = 3;
+	eVTOLBenchmarkOptions options;
+	bool usage = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--json" && i + 1 < argc) json_file = argv[++i];
+		else if (arg == "--repetitions" && i + 1 < argc) usage = usage || !(repetitions = countArgument(argv[++i]));
+		else if (arg == "--max-fleet" && i + 1 < argc) usage = usage || !(options.max_fleet_size = countArgument(argv[++i]));
+		else usage = true;
+	}
+
+	if (usage)
+	{
+		std::cerr << "usage: " << argv[0] << " [--json results.json] [--repetitions 3] [--max-fleet 1000000]" << std::endl;
+		return 1;
+	}
+
+	try
+	{
+		SimulationBenchmark benchmark(repetitions);
+		addeVTOLBenchmarks(benchmark, options);
+		benchmark.run();
+		if (!json_file.empty())
+		{
+			benchmark.writeJson(json_file);
+			std::cout << "Results written to " << json_file << std::endl;
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,464 @@
+#ifndef CHARGE_NETWORK
+#define CHARGE_NETWORK
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <limits>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+#include <algorithm>
+#include <thread>
+
+#include "sim_types.h"
+#include "sim_event_scheduler.h"
+#include "sim_thread_pool.h"
+#include "charge_station.h"
+#include "sim_memory.h"
+
+
+// Position of a charging station, in miles from an arbitrary origin
+struct ChargingLocation
+{
+	double x;
+	double y;
+};
+
+inline double distanceBetween(const ChargingLocation& a, const ChargingLocation& b)
+{
+	return std::sqrt((a.x - b.x) * (a.x - b.x) + (a.y - b.y) * (a.y - b.y));
+}
+
+
+class ChargingNetwork;
+
+// Decides which station of a ChargingNetwork a device in need of charge goes to.
+class ChargingStationPolicy
+{
+public:
+	virtual ~ChargingStationPolicy() {}
+
+	// returns the index of the station the device should go to
+	virtual size_t selectStation(ChargingNetwork& network, ChargeableDevice* device) = 0;
+
+	virtual std::string name() = 0;
+};
+
+
+// A network of charging stations, each with its own location, number of bays and charge rate limit.
+// The network is itself where devices go to be charged, it hands each device to one of
+// its stations as chosen by its ChargingStationPolicy.  Once at a station a device stays there until charged.
+// Stations share no state, so a timestep updates them in parallel on the threads of an optional
+// SimulationThreadPool, each thread updating a fixed shard of the stations.
+// A network of a single station behaves exactly as that station.
+// Usage:
+//     ChargingNetwork network;
+//     network.addStation(3, 0.0, { 0.0, 0.0 });
+//     network.addStation(2, 150.0, { 10.0, 5.0 });
+//     network.setPolicy(std::unique_ptr<ChargingStationPolicy>(new ShortestQueuePolicy()));
+//     eVTOL evtol(alpha_config, &network);
+class ChargingNetwork : public SimulationAgent, public ChargingService
+{
+public:
+	// a network with no stations, the policy defaults to ShortestQueuePolicy
+	ChargingNetwork();
+
+	// adds a station to the network and returns its index
+	// max_charge_rate_kw of 0 places no limit on the charge rate
+	size_t addStation(size_t number_of_bays, double max_charge_rate_kw = 0.0, ChargingLocation location = ChargingLocation())
+	{
+		stations_.push_back(std::unique_ptr<ChargingStation>(new ChargingStation(number_of_bays, max_charge_rate_kw)));
+		locations_.push_back(location);
+		if (scheduler_) stations_.back()->attachScheduler(scheduler_);
+		return stations_.size() - 1;
+	}
+
+	void setPolicy(std::unique_ptr<ChargingStationPolicy> policy)
+	{
+		if (!policy) throw std::invalid_argument("a charging station policy is required.");
+		policy_ = std::move(policy);
+	}
+
+	// stations are updated in parallel across the pool, nullptr updates them on the calling thread
+	void setThreadPool(SimulationThreadPool* thread_pool)
+	{
+		thread_pool_ = thread_pool;
+	}
+
+	// makes room at every station for number_of_devices waiting, see ChargingStation::reserveWaiting
+	void reserveWaiting(size_t number_of_devices)
+	{
+		for (auto& station : stations_)
+		{
+			station->reserveWaiting(number_of_devices);
+		}
+	}
+
+	// records the bays of every station to trace, a station is identified by its index
+	void setTrace(EventTraceSink* trace)
+	{
+		for (size_t i = 0; i < stations_.size(); i++)
+		{
+			stations_[i]->setTrace(trace, static_cast<uint32_t>(i));
+		}
+	}
+
+	// every station runs on variable timesteps, see ChargingStation::setVariableTimesteps
+	void setVariableTimesteps(bool variable_timesteps)
+	{
+		for (auto& station : stations_)
+		{
+			station->setVariableTimesteps(variable_timesteps);
+		}
+	}
+
+	// variable timesteps only, the first time a device charging at any station will be fully charged
+	unsigned long long nextFullChargeTime(unsigned long long now)
+	{
+		unsigned long long next_time = std::numeric_limits<unsigned long long>::max();
+		for (auto& station : stations_)
+		{
+			next_time = std::min(next_time, station->nextFullChargeTime(now));
+		}
+		return next_time;
+	}
+
+	// makes every station event driven, must be attached before any devices are added
+	void attachScheduler(SimulationEventScheduler* scheduler)
+	{
+		scheduler_ = scheduler;
+		for (auto& station : stations_)
+		{
+			station->attachScheduler(scheduler);
+		}
+	}
+
+	void begin() override
+	{
+		for (auto& station : stations_)
+		{
+			station->begin();
+		}
+	}
+
+	void timestepUpdate(size_t prev_time, size_t cur_time) override
+	{
+		if (!thread_pool_ || stations_.size() < 2)
+		{
+			for (auto& station : stations_)
+			{
+				station->timestepUpdate(prev_time, cur_time);
+			}
+			return;
+		}
+
+		thread_pool_->parallelFor(stations_.size(), [this, prev_time, cur_time](size_t begin, size_t end, size_t shard) {
+			for (size_t i = begin; i < end; i++)
+			{
+				stations_[i]->timestepUpdate(prev_time, cur_time);
+			}
+			});
+	}
+
+	// routes the device to the station chosen by the policy
+	void addDevice(ChargeableDevice* device) override
+	{
+		if (stations_.empty()) throw std::logic_error("a charging network needs at least one station.");
+		size_t index = stations_.size() == 1 ? 0 : policy_->selectStation(*this, device);
+		stations_[index]->addDevice(device);
+	}
+
+	// Event driven only.  Called once the scheduler has finished, see ChargingStation::finishEvents.
+	void finishEvents()
+	{
+		for (auto& station : stations_)
+		{
+			station->finishEvents();
+		}
+	}
+
+	size_t numberOfStations() { return stations_.size(); }
+
+	ChargingStation& station(size_t index) { return *stations_[index]; }
+
+	ChargingLocation location(size_t index) { return locations_[index]; }
+
+	ChargingStationPolicy& policy() { return *policy_; }
+
+	// the counters of every station added up, high water marks are of the busiest station
+	ChargingStationCounters counters()
+	{
+		ChargingStationCounters counters = {};
+		for (auto& station : stations_) accumulateCounters(counters, station->counters());
+		return counters;
+	}
+
+	size_t numberOfBays()
+	{
+		size_t total = 0;
+		for (auto& station : stations_) total += station->numberOfBays();
+		return total;
+	}
+
+	size_t numberCharging()
+	{
+		size_t total = 0;
+		for (auto& station : stations_) total += station->numberCharging();
+		return total;
+	}
+
+	size_t numberWaiting()
+	{
+		size_t total = 0;
+		for (auto& station : stations_) total += station->numberWaiting();
+		return total;
+	}
+
+private:
+	std::vector<std::unique_ptr<ChargingStation> > stations_;
+	std::vector<ChargingLocation> locations_;          // one entry per station
+	std::unique_ptr<ChargingStationPolicy> policy_;
+	SimulationThreadPool* thread_pool_;                // optional, not owned
+	SimulationEventScheduler* scheduler_;              // event driven only, nullptr for timestep updates
+};
+
+
+// Sends each device to the station with the fewest devices waiting, then the fewest bays occupied.
+// Ties go to the station added first.
+class ShortestQueuePolicy : public ChargingStationPolicy
+{
+public:
+	size_t selectStation(ChargingNetwork& network, ChargeableDevice* device) override
+	{
+		size_t best = 0;
+		for (size_t i = 1; i < network.numberOfStations(); i++)
+		{
+			ChargingStation& station = network.station(i);
+			ChargingStation& best_station = network.station(best);
+			if (station.numberWaiting() < best_station.numberWaiting() ||
+				(station.numberWaiting() == best_station.numberWaiting() && station.numberCharging() < best_station.numberCharging()))
+			{
+				best = i;
+			}
+		}
+		return best;
+	}
+
+	std::string name() override { return "SHORTEST_QUEUE"; }
+};
+
+
+// Sends each device to the station where it is predicted to get a bay soonest,
+// see ChargingStation::predictedWaitTime.  Unlike ShortestQueuePolicy this accounts for the
+// charge still needed by the devices ahead of it and the charge rate limit of each station.
+// Ties go to the station added first.
+class PredictedWaitPolicy : public ChargingStationPolicy
+{
+public:
+	size_t selectStation(ChargingNetwork& network, ChargeableDevice* device) override
+	{
+		size_t best = 0;
+		double best_wait = std::numeric_limits<double>::max();
+		for (size_t i = 0; i < network.numberOfStations(); i++)
+		{
+			double wait = network.station(i).predictedWaitTime();
+			if (wait < best_wait)
+			{
+				best = i;
+				best_wait = wait;
+			}
+		}
+		return best;
+	}
+
+	std::string name() override { return "PREDICTED_WAIT"; }
+};
+
+
+// Sends each device to the nearest station.
+// Devices have no position of their own, so the locator supplies the position of a device when it needs charge.
+// Ties go to the station added first.
+class NearestStationPolicy : public ChargingStationPolicy
+{
+public:
+	NearestStationPolicy(std::function<ChargingLocation(ChargeableDevice*)> locator)
+	{
+		if (!locator) throw std::invalid_argument("a device locator is required.");
+		locator_ = locator;
+	}
+
+	size_t selectStation(ChargingNetwork& network, ChargeableDevice* device) override
+	{
+		ChargingLocation device_location = locator_(device);
+		size_t best = 0;
+		double best_distance = std::numeric_limits<double>::max();
+		for (size_t i = 0; i < network.numberOfStations(); i++)
+		{
+			double distance = distanceBetween(device_location, network.location(i));
+			if (distance < best_distance)
+			{
+				best = i;
+				best_distance = distance;
+			}
+		}
+		return best;
+	}
+
+	std::string name() override { return "NEAREST"; }
+
+private:
+	std::function<ChargingLocation(ChargeableDevice*)> locator_;
+};
+
+
+inline ChargingNetwork::ChargingNetwork()
+{
+	policy_ = std::unique_ptr<ChargingStationPolicy>(new ShortestQueuePolicy());
+	thread_pool_ = nullptr;
+	scheduler_ = nullptr;
+}
+
+
+
+// A charging front end that any number of threads can hand devices to at once, without locks.
+// Devices go into a BoundedMPSCQueue and are passed on to the charging service when the queue is flushed,
+// by a single thread once the producers are done, so a shared station sees one caller however many threads update
+// agents.  Sized for every device that can arrive between flushes, e.g. the whole fleet, a full queue throws.
+// flush() passes devices on in the order they arrived, which varies from run to run with more than one thread,
+// flushSorted() in an order of the caller's choosing, so that the results don't.
+// Usage:
+//     ConcurrentChargingQueue arrivals(number_of_evtols);
+//     eVTOL evtol(alpha_config, &arrivals);
+//     ...
+//     arrivals.flush(&charging_network);
+class ConcurrentChargingQueue : public ChargingService
+{
+public:
+	explicit ConcurrentChargingQueue(size_t capacity) : queue_(capacity) {}
+
+	// any thread
+	void addDevice(ChargeableDevice* device) override
+	{
+		if (!queue_.tryPush(device)) throw std::length_error("the charging queue is full.");
+	}
+
+	// hands every device, in the order received, to the charging service
+	void flush(ChargingService* charging_service)
+	{
+		ChargeableDevice* device;
+		while (queue_.tryPop(device))
+		{
+			charging_service->addDevice(device);
+		}
+	}
+
+	// hands every device to the charging service, ordered by less
+	template <typename Less>
+	void flushSorted(ChargingService* charging_service, Less less)
+	{
+		ChargeableDevice* device;
+		while (queue_.tryPop(device))
+		{
+			sorted_.push_back(device);
+		}
+		std::sort(sorted_.begin(), sorted_.end(), less);
+		for (ChargeableDevice* sorted_device : sorted_)
+		{
+			charging_service->addDevice(sorted_device);
+		}
+		sorted_.clear();
+	}
+
+	size_t capacity() const { return queue_.capacity(); }
+
+private:
+	BoundedMPSCQueue<ChargeableDevice*> queue_;
+	std::vector<ChargeableDevice*> sorted_;   // kept between flushes so it seldom allocates
+};
+
+
+
+void test_ChargingNetwork()
+{
+	using namespace std;
+
+	class MockChargeableDevice : public ChargeableDevice
+	{
+	public:
+		MockChargeableDevice(double needed = 3) : needed_(needed) {}
+		virtual void addCharge(double charge) override { total_charge += charge; }
+		virtual double chargeRate() override { return 1; }
+		virtual bool hasFullCharge() override { return total_charge >= needed_; }
+		virtual double chargeNeeded() override { return std::max(needed_ - total_charge, 0.0); }
+	private:
+		double needed_;
+		double total_charge = 0;
+	};
+
+	ChargingNetwork empty_network;
+	MockChargeableDevice dev0;
+	try { empty_network.addDevice(&dev0); }
+	catch (const std::logic_error& le) { cout << le.what() << endl; }
+
+	// shortest queue spreads devices across stations
+	MockChargeableDevice devs[6];
+	ChargingNetwork network;
+	network.addStation(1, 0.0, { 0.0, 0.0 });
+	network.addStation(2, 0.0, { 10.0, 0.0 });
+	network.begin();
+	for (auto& dev : devs) network.addDevice(&dev);
+	cout << network.policy().name() << "  " << network.station(0).numberCharging() << network.station(0).numberWaiting() << "  " << network.station(1).numberCharging() << network.station(1).numberWaiting() << endl;
+
+	// updating on a thread pool gives the same result as updating on the calling thread
+	SimulationThreadPool pool(2);
+	network.setThreadPool(&pool);
+	for (size_t t = 0; t < 20; t++) network.timestepUpdate(t, t + 1);
+	bool all_full = true;
+	for (auto& dev : devs) all_full = all_full && dev.hasFullCharge();
+	cout << all_full << "  " << network.numberCharging() << "  " << network.numberWaiting() << endl;
+
+	// predicted wait prefers the station whose queue will clear soonest
+	MockChargeableDevice long_dev(100);
+	MockChargeableDevice short_dev(2);
+	MockChargeableDevice next_dev;
+	ChargingNetwork wait_network;
+	wait_network.addStation(1);
+	wait_network.addStation(1);
+	wait_network.setPolicy(std::unique_ptr<ChargingStationPolicy>(new PredictedWaitPolicy()));
+	wait_network.addDevice(&long_dev);
+	wait_network.addDevice(&short_dev);
+	wait_network.addDevice(&next_dev);
+	cout << wait_network.policy().name() << "  " << wait_network.station(0).numberWaiting() << wait_network.station(1).numberWaiting() << endl;
+
+	// nearest station
+	MockChargeableDevice near_dev;
+	ChargingNetwork near_network;
+	near_network.addStation(1, 0.0, { 0.0, 0.0 });
+	near_network.addStation(1, 0.0, { 10.0, 0.0 });
+	near_network.setPolicy(std::unique_ptr<ChargingStationPolicy>(new NearestStationPolicy([](ChargeableDevice* device) { return ChargingLocation{ 8.0, 1.0 }; })));
+	near_network.addDevice(&near_dev);
+	cout << near_network.policy().name() << "  " << near_network.station(0).numberCharging() << near_network.station(1).numberCharging() << endl;
+
+	// devices queued from two threads at once reach the station in the order asked for
+	MockChargeableDevice queued_devs[4];
+	ConcurrentChargingQueue arrivals(3);
+	ChargingStation arrivals_cs(4);
+	arrivals_cs.begin();
+	std::thread other([&arrivals, &queued_devs]() { arrivals.addDevice(&queued_devs[3]); arrivals.addDevice(&queued_devs[1]); });
+	arrivals.addDevice(&queued_devs[2]);
+	arrivals.addDevice(&queued_devs[0]);
+	other.join();
+	arrivals.flushSorted(&arrivals_cs, std::less<ChargeableDevice*>());
+	ChargingStationOccupancy arrived = arrivals_cs.occupancy();
+	cout << arrivals.capacity() << "  " << arrivals_cs.numberCharging() << "  ";
+	for (size_t bay = 0; bay < arrived.bay_devices.size(); bay++) cout << (arrived.bay_devices[bay] == &queued_devs[bay]);
+	cout << "  ";
+	arrivals.addDevice(&queued_devs[0]);
+	try { for (int i = 0; i < 4; i++) arrivals.addDevice(&queued_devs[0]); }
+	catch (const std::length_error& le) { cout << le.what() << endl; }
+}
+
+
+#endif  // CHARGE_NETWORK
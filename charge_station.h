@@ -2,78 +2,391 @@
 #define CHARGE_STATION
 
 #include <vector>
-#include <deque>
+#include <string>
+#include <limits>
+#include <functional>
 #include <algorithm>
+#include <stdexcept>
 #include "sim_types.h"
+#include "sim_event_scheduler.h"
+#include "sim_memory.h"
+#include "sim_trace.h"
+#include "sim_instrumentation.h"
 
 
 
+// Who is in each bay of a station and who is waiting, everything needed to put a station back as it was
+struct ChargingStationOccupancy
+{
+	std::vector<size_t> occupied_bays;             // in the station's order of occupied bays
+	std::vector<ChargeableDevice*> bay_devices;    // the device in each of occupied_bays
+	std::vector<size_t> free_bays;                 // in the station's order of free bays
+	std::vector<ChargeableDevice*> waiting;        // first in, first out
+};
+
+
 // Models a charging station where eVTOLs can get their batteries recharged.
 // The station has a fixed number of bays for charging.  If all charging bays are occupied,
 // an eVTOL must queue up and wait in line for next available charging bay.
 // A charging station is a SimulationAgent and participates in a simulation
 // and therefore, updates its state at each timestep of the simulation.
-class ChargingStation : public SimulationAgent
+// Alternatively, a station attached to a SimulationEventScheduler is event driven.
+// It receives no timestep updates, instead it schedules the time each device
+// will finish charging and frees the bay at exactly that time.
+// Bays are fixed slots with a free list of empty slots and a compact list of occupied ones,
+// so giving out or freeing a bay is O(1) and a timestep only visits the occupied bays.
+// The waiting queue is a ring buffer, so once it is reserved for the whole fleet with reserveWaiting(),
+// a timestep makes no heap allocations.
+// A station may limit the charge rate of each bay, a device then charges at the lower of its own rate and the limit.
+// Given an EventTraceSink, every bay given to or freed by a device is recorded to it.
+// The occupancy of a timestep driven station can be saved and restored, e.g. to checkpoint a simulation.
+// Unless instrumentation is compiled out, the station counts arrivals, bays assigned and released, and the high water marks of its queue and bays.
+class ChargingStation : public SimulationAgent, public ChargingService
 {
 public:
-	ChargingStation(size_t max_number_charging_devices)
+	// max_charge_rate_kw of 0 places no limit on the charge rate
+	ChargingStation(size_t max_number_charging_devices, double max_charge_rate_kw = 0.0)
 	{
+		if (max_charge_rate_kw < 0.0) throw std::invalid_argument("max_charge_rate_kw must not be negative.");
+
 		this->max_number_charging_devices_ = max_number_charging_devices;
+		max_charge_rate_ = max_charge_rate_kw / (60.0 * 60.0 * 1000.0); // converting kW to kWh per millisecond
+		scheduler_ = nullptr;
+		variable_timesteps_ = false;
+		trace_ = nullptr;
+		trace_id_ = TRACE_NO_ID;
+		counters_ = ChargingStationCounters();
+		bays_.assign(max_number_charging_devices, nullptr);
+		charge_start_times_.assign(max_number_charging_devices, 0);
+		arrived_.assign(max_number_charging_devices, false);
+		occupied_position_.assign(max_number_charging_devices, 0);
+		occupied_bays_.reserve(max_number_charging_devices);
+		bay_free_times_.reserve(max_number_charging_devices);
+		for (size_t bay = max_number_charging_devices; bay-- > 0;)
+		{
+			free_bays_.push_back(bay);
+		}
 	}
 
-	void begin() override
+	// makes room for number_of_devices waiting, so adding a device never allocates
+	void reserveWaiting(size_t number_of_devices)
 	{
-		// no op
+		devices_waiting_.reserve(number_of_devices);
 	}
 
-	void timestepUpdate(size_t prev_time, size_t cur_time) override
+	// records bays given out and freed to trace, identified by trace_id, nullptr stops tracing
+	void setTrace(EventTraceSink* trace, uint32_t trace_id)
+	{
+		trace_ = trace;
+		trace_id_ = trace_id;
+	}
+
+	// makes the station event driven, must be attached before any devices are added
+	void attachScheduler(SimulationEventScheduler* scheduler)
+	{
+		scheduler_ = scheduler;
+	}
+
+	// Variable timesteps only.  A device given a bay starts charging at once. One given a bay as it arrives, at the end of
+	// a timestep, is charged from the next timestep on, rather than for the whole of the timestep it arrived in as with fixed timesteps.
+	void setVariableTimesteps(bool variable_timesteps)
+	{
+		variable_timesteps_ = variable_timesteps;
+	}
+
+	// Variable timesteps only.  The first whole millisecond a device charging will be fully charged, the largest time there is when none are.
+	unsigned long long nextFullChargeTime(unsigned long long now)
 	{
-		// update each device currently charging
-		for (auto device : devices_charging_)
+		unsigned long long next_time = std::numeric_limits<unsigned long long>::max();
+		for (size_t bay : occupied_bays_)
 		{
-			device->addCharge(device->chargeRate() * (cur_time - prev_time));
+			ChargeableDevice* device = bays_[bay];
+			unsigned long long charge_time = static_cast<unsigned long long>(device->chargeNeeded() / effectiveChargeRate(device)) + 1;
+			next_time = std::min(next_time, now + charge_time);
 		}
+		return next_time;
+	}
 
-		// See if any devices currently charging are done charging
-		// and therefore need to come out of the devices_charging list 
-		while (true)
+	void begin() override
+	{
+		// no op
+	}
+
+	void timestepUpdate(size_t prev_time, size_t cur_time) override
+	{
+		// update each device currently charging,
+		// devices that are done charging come out of their bay right away
+		size_t i = 0;
+		while (i < occupied_bays_.size())
 		{
-			auto itr = std::find_if(devices_charging_.begin(), devices_charging_.end(), 
-				[](ChargeableDevice* device) {return device->hasFullCharge(); });
-			if (itr == devices_charging_.end()) break;
-			devices_charging_.erase(itr);
+			size_t bay = occupied_bays_[i];
+			ChargeableDevice* device = bays_[bay];
+			if (arrived_[bay])
+			{
+				// variable timesteps only, arrived at the end of this timestep
+				arrived_[bay] = false;
+				i++;
+				continue;
+			}
+			device->addCharge(effectiveChargeRate(device) * (cur_time - prev_time));
+			if (device->hasFullCharge())
+			{
+				// the last occupied bay moves into position i, it has not been updated yet so don't advance
+				releaseBay(bay);
+			}
+			else
+			{
+				i++;
+			}
 		}
 
 		// See if any devices are waiting for a charging bay and if a charge bay is available.
-		// If so, pop the next waiting device and add it to the charging devices list.
-		while (devices_charging_.size() < max_number_charging_devices_ && devices_waiting_.size() > 0)
+		// If so, pop the next waiting device and give it a bay.
+		while (!free_bays_.empty() && !devices_waiting_.empty())
 		{
-			ChargeableDevice* device = devices_waiting_.back();
-			devices_waiting_.pop_back();
-			devices_charging_.push_back(device);
+			ChargeableDevice* device = devices_waiting_.front();
+			devices_waiting_.popFront();
+			occupyBay(device);
+			if (variable_timesteps_) device->addCharge(0.0);
 		}
 	}
 
 	// A new chargeable device is entering the charging station.
-	// If there is an open charging bay, add it to the charging devices list.
+	// If there is an open charging bay, the device gets it.
 	// If not, add it to the waiting queue.
-	void addDevice(ChargeableDevice* chargeableDevice)
+	void addDevice(ChargeableDevice* chargeableDevice) override
 	{
-		if (devices_charging_.size() < max_number_charging_devices_)
+		EVTOL_INSTRUMENT(counters_.arrivals++);
+		if (!free_bays_.empty())
 		{
-			devices_charging_.push_back(chargeableDevice);
+			size_t bay = occupyBay(chargeableDevice);
+			if (scheduler_)
+			{
+				startCharging(bay);
+			}
+			else if (variable_timesteps_)
+			{
+				arrived_[bay] = true;
+				chargeableDevice->addCharge(0.0);
+			}
 		}
 		else
 		{
-			// new devices enter the waiting queue at the front
-			devices_waiting_.push_front(chargeableDevice);
+			// new devices join the back of the waiting queue
+			devices_waiting_.pushBack(chargeableDevice);
+			EVTOL_INSTRUMENT(counters_.max_queue_length = std::max(counters_.max_queue_length, devices_waiting_.size()));
+		}
+	}
+
+	// Event driven only.  Called once the scheduler has finished so that devices still
+	// charging receive the charge accumulated between the start of their charge and the end of the simulation.
+	void finishEvents()
+	{
+		if (!scheduler_) return;
+		for (size_t bay : occupied_bays_)
+		{
+			bays_[bay]->addCharge(effectiveChargeRate(bays_[bay]) * (scheduler_->endTime() - charge_start_times_[bay]));
 		}
 	}
 
+	size_t numberOfBays() { return max_number_charging_devices_; }
+
+	// the bays and queue as they are now, in the order the station holds them
+	ChargingStationOccupancy occupancy()
+	{
+		ChargingStationOccupancy occupancy;
+		occupancy.occupied_bays = occupied_bays_;
+		for (size_t bay : occupied_bays_)
+		{
+			occupancy.bay_devices.push_back(bays_[bay]);
+		}
+		occupancy.free_bays = free_bays_;
+		for (size_t i = 0; i < devices_waiting_.size(); i++)
+		{
+			occupancy.waiting.push_back(devices_waiting_[i]);
+		}
+		return occupancy;
+	}
+
+	// puts the bays and queue back as they were, every bay must be either occupied or free
+	// timestep driven only, an event driven station would have no charging events scheduled
+	void setOccupancy(const ChargingStationOccupancy& occupancy)
+	{
+		if (scheduler_) throw std::logic_error("the occupancy of an event driven station can't be set.");
+		if (occupancy.bay_devices.size() != occupancy.occupied_bays.size()) throw std::invalid_argument("every occupied bay needs a device.");
+		std::vector<bool> seen(max_number_charging_devices_, false);
+		for (size_t bay : occupancy.occupied_bays) markBay(seen, bay);
+		for (size_t bay : occupancy.free_bays) markBay(seen, bay);
+		if (occupancy.occupied_bays.size() + occupancy.free_bays.size() != max_number_charging_devices_) throw std::invalid_argument("every bay must be occupied or free.");
+
+		bays_.assign(max_number_charging_devices_, nullptr);
+		occupied_bays_ = occupancy.occupied_bays;
+		for (size_t i = 0; i < occupied_bays_.size(); i++)
+		{
+			bays_[occupied_bays_[i]] = occupancy.bay_devices[i];
+			occupied_position_[occupied_bays_[i]] = i;
+		}
+		free_bays_ = occupancy.free_bays;
+		devices_waiting_.clear();
+		for (ChargeableDevice* device : occupancy.waiting)
+		{
+			devices_waiting_.pushBack(device);
+		}
+	}
+
+	size_t numberCharging() { return occupied_bays_.size(); }
+
+	// what has happened at the station so far, all zero when instrumentation is compiled out
+	const ChargingStationCounters& counters() { return counters_; }
+
+	size_t numberWaiting() { return devices_waiting_.size(); }
+
+	// in kW, 0 when there is no limit
+	double maxChargeRate() { return max_charge_rate_ * (60.0 * 60.0 * 1000.0); }
+
+	// Predicts the milliseconds a device added now would wait for a bay.
+	// Each occupied bay is free once its device is fully charged, the waiting devices
+	// then take the earliest free bay in order, and the new device gets the first bay free after them.
+	double predictedWaitTime()
+	{
+		if (!free_bays_.empty()) return 0.0;
+		if (occupied_bays_.empty()) return std::numeric_limits<double>::max();  // a station with no bays
+
+		// min-heap of the times, from now, each bay will be free
+		std::vector<double>& bay_free_times = bay_free_times_;
+		bay_free_times.clear();
+		for (size_t bay : occupied_bays_)
+		{
+			ChargeableDevice* device = bays_[bay];
+			double charge_needed = device->chargeNeeded();
+			if (scheduler_)
+			{
+				// event driven devices only receive their charge once they finish
+				charge_needed -= effectiveChargeRate(device) * (scheduler_->now() - charge_start_times_[bay]);
+			}
+			bay_free_times.push_back(std::max(charge_needed, 0.0) / effectiveChargeRate(device));
+		}
+		std::make_heap(bay_free_times.begin(), bay_free_times.end(), std::greater<double>());
+		for (size_t i = 0; i < devices_waiting_.size(); i++)
+		{
+			// the earliest free bay goes to the next device waiting, and is free again once it is charged
+			ChargeableDevice* device = devices_waiting_[i];
+			std::pop_heap(bay_free_times.begin(), bay_free_times.end(), std::greater<double>());
+			bay_free_times.back() += device->chargeNeeded() / effectiveChargeRate(device);
+			std::push_heap(bay_free_times.begin(), bay_free_times.end(), std::greater<double>());
+		}
+		return bay_free_times.front();
+	}
+
 private:
+	// the rate the device charges at in this station, in kWh per millisecond
+	double effectiveChargeRate(ChargeableDevice* device)
+	{
+		double rate = device->chargeRate();
+		return max_charge_rate_ > 0.0 ? std::min(rate, max_charge_rate_) : rate;
+	}
+
+	// puts the device into a free bay and returns the bay
+	size_t occupyBay(ChargeableDevice* device)
+	{
+		size_t bay = free_bays_.back();
+		free_bays_.pop_back();
+		bays_[bay] = device;
+		occupied_position_[bay] = occupied_bays_.size();
+		occupied_bays_.push_back(bay);
+		EVTOL_INSTRUMENT(counters_.bays_assigned++);
+		EVTOL_INSTRUMENT(counters_.max_bays_occupied = std::max(counters_.max_bays_occupied, occupied_bays_.size()));
+		if (trace_) trace_->recordBay(TraceEvent::BAY_ASSIGNED, device->traceId(), trace_id_, static_cast<uint32_t>(bay), traceTime());
+		return bay;
+	}
+
+	// empties the bay, the last occupied bay takes its place in the occupied list
+	void releaseBay(size_t bay)
+	{
+		if (trace_) trace_->recordBay(TraceEvent::BAY_RELEASED, bays_[bay]->traceId(), trace_id_, static_cast<uint32_t>(bay), traceTime());
+		size_t position = occupied_position_[bay];
+		size_t last_bay = occupied_bays_.back();
+		occupied_bays_[position] = last_bay;
+		occupied_position_[last_bay] = position;
+		occupied_bays_.pop_back();
+		bays_[bay] = nullptr;
+		free_bays_.push_back(bay);
+		EVTOL_INSTRUMENT(counters_.bays_released++);
+	}
+
+	// setOccupancy() only, checks the bay is valid and listed once
+	void markBay(std::vector<bool>& seen, size_t bay)
+	{
+		if (bay >= max_number_charging_devices_ || seen[bay]) throw std::invalid_argument("bay " + std::to_string(bay) + " is not a bay of the station or is listed twice.");
+		seen[bay] = true;
+	}
+
+	// the time of a trace record, the time of the event when event driven, otherwise of the timestep
+	unsigned long long traceTime()
+	{
+		return scheduler_ ? scheduler_->now() : trace_->time();
+	}
+
+	// Event driven only.  Device has just been given a charging bay.
+	// Let the device know it is now charging and schedule the time it will be fully charged.
+	void startCharging(size_t bay)
+	{
+		charge_start_times_[bay] = scheduler_->now();
+		bays_[bay]->addCharge(0.0);
+		scheduleFullCharge(bay);
+	}
+
+	// Event driven only.  Schedules the time the device in the bay will be fully charged.
+	// The scheduler is itself a min-heap of completion times, so the next device to finish is always found in O(log n).
+	void scheduleFullCharge(size_t bay)
+	{
+		// round up to the next whole millisecond so the device is never short of a full charge
+		ChargeableDevice* device = bays_[bay];
+		unsigned long long charge_time = static_cast<unsigned long long>(device->chargeNeeded() / effectiveChargeRate(device)) + 1;
+		unsigned long long full_charge_time = scheduler_->now() + charge_time;
+		scheduler_->schedule(full_charge_time, [this, bay](unsigned long long event_time) {
+			finishCharging(bay, event_time);
+			});
+	}
+
+	// Event driven only.  Device should now be fully charged, free up its bay for the next waiting device.
+	void finishCharging(size_t bay, unsigned long long event_time)
+	{
+		ChargeableDevice* device = bays_[bay];
+		device->addCharge(effectiveChargeRate(device) * (event_time - charge_start_times_[bay]));
+		charge_start_times_[bay] = event_time;
+		if (!device->hasFullCharge())
+		{
+			// rounding left the device just short of a full charge, keep charging
+			scheduleFullCharge(bay);
+			return;
+		}
+
+		releaseBay(bay);
+
+		if (!devices_waiting_.empty())
+		{
+			ChargeableDevice* next_device = devices_waiting_.front();
+			devices_waiting_.popFront();
+			startCharging(occupyBay(next_device));
+		}
+	}
+
 	size_t max_number_charging_devices_;
-	std::deque<ChargeableDevice*> devices_waiting_;
-	std::vector<ChargeableDevice*> devices_charging_;
+	double max_charge_rate_;                              // in kWh per millisecond, 0 for no limit
+	RingBuffer<ChargeableDevice*> devices_waiting_;        // first in, first out
+	std::vector<double> bay_free_times_;                  // scratch space of predictedWaitTime()
+	std::vector<ChargeableDevice*> bays_;                // one entry per bay, nullptr when the bay is free
+	std::vector<size_t> free_bays_;                       // stack of free bays
+	std::vector<size_t> occupied_bays_;                   // compact list of occupied bays
+	std::vector<size_t> occupied_position_;               // position of each occupied bay in occupied_bays_
+	std::vector<unsigned long long> charge_start_times_;  // event driven only, one entry per bay
+	SimulationEventScheduler* scheduler_;                // event driven only, nullptr for timestep updates
+	bool variable_timesteps_;
+	std::vector<bool> arrived_;                            // variable timesteps only, bays given out since the last timestep update
+	EventTraceSink* trace_;                               // nullptr when not traced
+	uint32_t trace_id_;                                   // identifies the station in the trace
+	ChargingStationCounters counters_;                    // written only by the thread updating the station
 };
 
 
@@ -88,6 +401,7 @@ void test_ChargingStation()
 		virtual void addCharge(double charge) override { total_charge += charge; }
 		virtual double chargeRate() override { return 1; }
 		virtual bool hasFullCharge() override { return total_charge >= 3; }
+		virtual double chargeNeeded() override { return std::max(3 - total_charge, 0.0); }
 	private:
 		double total_charge = 0;
 	};
@@ -108,7 +422,55 @@ void test_ChargingStation()
 	cs.addDevice(&dev4);
 	cs.timestepUpdate(3, 4);
 	cs.timestepUpdate(4, 5);
+	cout << cs.numberCharging() << "  " << cs.numberWaiting() << "  " << dev1.hasFullCharge() << dev2.hasFullCharge() << dev3.hasFullCharge() << dev4.hasFullCharge() << endl;
+
+	// event driven, devices are fully charged 4 milliseconds after getting a bay
+	MockChargeableDevice dev5;
+	MockChargeableDevice dev6;
+	MockChargeableDevice dev7;
+	SimulationEventScheduler scheduler(1);
+	ChargingStation event_cs(2);
+	event_cs.attachScheduler(&scheduler);
+	event_cs.begin();
+	event_cs.addDevice(&dev5);
+	event_cs.addDevice(&dev6);
+	event_cs.addDevice(&dev7);
+	scheduler.start();
+	event_cs.finishEvents();
+	cout << dev5.hasFullCharge() << dev6.hasFullCharge() << dev7.hasFullCharge() << "  " << scheduler.eventsProcessed() << endl;
+
+	// a station limited to half the charge rate takes twice as long, a third device waits for the first to finish
+	MockChargeableDevice dev8;
+	MockChargeableDevice dev9;
+	MockChargeableDevice dev10;
+	ChargingStation slow_cs(2, 0.5 * 60 * 60 * 1000);
+	slow_cs.addDevice(&dev8);
+	slow_cs.addDevice(&dev9);
+	cout << slow_cs.predictedWaitTime() << "  ";
+	slow_cs.addDevice(&dev10);
+	cout << slow_cs.predictedWaitTime() << "  ";
+	for (size_t t = 0; t < 6; t++) slow_cs.timestepUpdate(t, t + 1);
+	cout << dev8.hasFullCharge() << dev10.hasFullCharge() << "  " << slow_cs.numberWaiting() << endl;
+
+	// a copy of a station's occupancy carries on just as the station does
+	MockChargeableDevice dev11;
+	MockChargeableDevice dev12;
+	MockChargeableDevice dev13;
+	ChargingStation busy_cs(2);
+	busy_cs.addDevice(&dev11);
+	busy_cs.addDevice(&dev12);
+	busy_cs.addDevice(&dev13);
+	ChargingStation copy_cs(2);
+	copy_cs.setOccupancy(busy_cs.occupancy());
+	copy_cs.timestepUpdate(0, 3);
+	cout << copy_cs.numberCharging() << copy_cs.numberWaiting() << "  " << (copy_cs.occupancy().bay_devices.back() == &dev13) << "  ";
+	ChargingStationOccupancy bad_occupancy = busy_cs.occupancy();
+	bad_occupancy.free_bays.push_back(0);
+	try { copy_cs.setOccupancy(bad_occupancy); }
+	catch (const std::invalid_argument& ia) { cout << ia.what() << endl; }
 
+	try { ChargingStation bad_cs(1, -1.0); }
+	catch (const std::invalid_argument& ia) { cout << ia.what() << endl; }
 }
 
 
@@ -5,15 +5,23 @@
 #include <string>
 #include <stdexcept>
 #include <random>
-#include <chrono>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+#include <limits>
 
 #include "sim_types.h"
+#include "sim_random.h"
+#include "sim_event_scheduler.h"
+#include "sim_trace.h"
 #include "charge_station.h"
+#include "evtol_faults.h"
 
 
 // Describes the configuration of an eVTOL
 // Validates all of the entries.
-// Provides some simple calculations for compound properties.
+// Provides some simple calculations for compound properties, computed once on construction.
 // Provides following configuration values:
 //   company_name
 //   cruise_speed in mph
@@ -38,6 +46,8 @@ struct eVTOLConfiguration
 		passenger_count_ = 1;
 		battery_capacity_ = 1;
 		prob_fault_per_hour_ = 1.0;
+		id_ = UNINTERNED;
+		computeDerivedConstants();
 	}
 	eVTOLConfiguration(std::string company_name, double cruise_speed, double battery_capacity,
 		double time_to_charge, double energy_use_at_cruise, size_t passenger_count,
@@ -59,35 +69,64 @@ struct eVTOLConfiguration
 		passenger_count_ = passenger_count;
 		battery_capacity_ = battery_capacity;
 		prob_fault_per_hour_ = prob_fault_per_hour;
+		id_ = UNINTERNED;
+		computeDerivedConstants();
 	}
 
-	std::string company_name() { return company_name_; }
+	// id of a configuration that is not held by the eVTOLConfigurationRegistry
+	static const uint32_t UNINTERNED = 0xffffffffU;
 
-	double cruise_speed() { return cruise_speed_; }
+	const std::string& company_name() const { return company_name_; }
 
-	double battery_capacity() { return battery_capacity_; }
+	double cruise_speed() const { return cruise_speed_; }
 
-	double time_to_charge() { return time_to_charge_; }
+	double battery_capacity() const { return battery_capacity_; }
 
-	double energy_use_at_cruise() { return energy_use_at_cruise_; }
+	double time_to_charge() const { return time_to_charge_; }
 
-	size_t passenger_count() { return passenger_count_; }
+	double energy_use_at_cruise() const { return energy_use_at_cruise_; }
 
-	double prob_fault_per_hour() { return prob_fault_per_hour_; }
+	size_t passenger_count() const { return passenger_count_; }
+
+	double prob_fault_per_hour() const { return prob_fault_per_hour_; }
 
 	// returns rate of charge for the batteries in kWh / ms
-	double chargeRate()
-	{
-		return battery_capacity_ / (time_to_charge_ * 60.0 * 60.0 * 1000.0); // converting hours to milliseconds
-	}
+	double chargeRate() const { return charge_rate_; }
 
 	// returns rate of energy consumption in kWh per millisecond when flying at cruise speed
-	double energyUsePerMillisecond()
+	double energyUsePerMillisecond() const { return energy_use_per_millisecond_; }
+
+	// returns the probability of a fault during any one millisecond of flight
+	double probFaultPerMillisecond() const { return prob_fault_per_millisecond_; }
+
+	// returns the charge in kWh at 0.5% remaining, when an eVTOL needs to recharge
+	double lowBatteryCharge() const { return low_battery_charge_; }
+
+	// id given by the eVTOLConfigurationRegistry, UNINTERNED if not held by the registry
+	uint32_t id() const { return id_; }
+
+	// same configuration values, ignores the id
+	bool operator==(const eVTOLConfiguration& other) const
 	{
-		return energy_use_at_cruise_ * cruise_speed_ / (60.0 * 60.0 * 1000.0);
-	} 
+		return company_name_ == other.company_name_ && cruise_speed_ == other.cruise_speed_ &&
+			battery_capacity_ == other.battery_capacity_ && time_to_charge_ == other.time_to_charge_ &&
+			energy_use_at_cruise_ == other.energy_use_at_cruise_ && passenger_count_ == other.passenger_count_ &&
+			prob_fault_per_hour_ == other.prob_fault_per_hour_;
+	}
+
+	bool operator!=(const eVTOLConfiguration& other) const { return !(*this == other); }
 
 private:
+	friend class eVTOLConfigurationRegistry;
+
+	void computeDerivedConstants()
+	{
+		charge_rate_ = battery_capacity_ / (time_to_charge_ * 60.0 * 60.0 * 1000.0); // converting hours to milliseconds
+		energy_use_per_millisecond_ = energy_use_at_cruise_ * cruise_speed_ / (60.0 * 60.0 * 1000.0);
+		prob_fault_per_millisecond_ = prob_fault_per_hour_ / (60.0 * 60.0 * 1000.0);
+		low_battery_charge_ = battery_capacity_ * 0.5 / 100.0;
+	}
+
 	std::string company_name_;
 	double cruise_speed_;					// in mph
 	double battery_capacity_;			// in kWh
@@ -95,6 +134,67 @@ private:
 	double energy_use_at_cruise_;	// in kWh/mile
 	size_t passenger_count_;
 	double prob_fault_per_hour_;  
+	// derived constants
+	double charge_rate_;                  // in kWh/ms
+	double energy_use_per_millisecond_;   // in kWh/ms
+	double prob_fault_per_millisecond_;
+	double low_battery_charge_;           // in kWh
+	uint32_t id_;
+};
+
+
+// Holds a single, immutable copy of each distinct eVTOLConfiguration for the life of the program.
+// eVTOLs refer to their configuration in the registry rather than each holding a copy,
+// so an eVTOL is small and copying one, e.g. by eVTOLFactory, copies a pointer rather than a string.
+// Each configuration in the registry has a compact id, its position in the registry.
+// Interning is thread safe, interned configurations never move or change, so can be read from any thread.
+// Usage:
+//     const eVTOLConfiguration* config = eVTOLConfigurationRegistry::instance().intern(alpha_config);
+//     uint32_t id = config->id();
+class eVTOLConfigurationRegistry
+{
+public:
+	static eVTOLConfigurationRegistry& instance()
+	{
+		static eVTOLConfigurationRegistry registry;
+		return registry;
+	}
+
+	// returns the registry's copy of the configuration, adding it if there is no equal configuration yet
+	const eVTOLConfiguration* intern(const eVTOLConfiguration& config)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (config.id() < configurations_.size() && *configurations_[config.id()] == config)
+		{
+			return configurations_[config.id()].get();
+		}
+		for (auto& interned : configurations_)
+		{
+			if (*interned == config) return interned.get();
+		}
+		configurations_.push_back(std::unique_ptr<eVTOLConfiguration>(new eVTOLConfiguration(config)));
+		configurations_.back()->id_ = static_cast<uint32_t>(configurations_.size() - 1);
+		return configurations_.back().get();
+	}
+
+	const eVTOLConfiguration& configuration(uint32_t id)
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		if (id >= configurations_.size()) throw std::out_of_range("unknown eVTOL configuration id.");
+		return *configurations_[id];
+	}
+
+	size_t size()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return configurations_.size();
+	}
+
+private:
+	eVTOLConfigurationRegistry() {}
+
+	std::mutex mutex_;
+	std::vector<std::unique_ptr<eVTOLConfiguration> > configurations_;  // indexed by id
 };
 
 
@@ -107,10 +207,42 @@ enum class eVTOLState
 	WAITING
 };
 
+inline std::string eVTOLStateName(eVTOLState state)
+{
+	if (state == eVTOLState::FLYING)
+	{
+		return "FLYING";
+	}
+	else if (state == eVTOLState::CHARGING)
+	{
+		return "CHARGING";
+	}
+	else if (state == eVTOLState::WAITING)
+	{
+		return "WAITING";
+	}
+	else
+	{
+		return "UNKNOWN";
+	}
+}
+
+// The changing state of an eVTOL, everything but its configuration.
+// Used to move an eVTOL's state in and out of other representations of it.
+struct eVTOLAgentState
+{
+	size_t total_flight_time;  // in milliseconds
+	size_t total_charge_time;  // in milliseconds
+	size_t total_wait_time;    // in milliseconds
+	double current_charge;     // in kWh
+	size_t number_of_faults;
+	eVTOLState state;
+};
+
 // Simulates an eVTOL.
 // An eVTOLConfiguration describes the eVTOL.
 // Is a ChargeableDevice and can get its batteries recharged in a ChargingStation.
-// The ChargingStation is shared among all eVTOLs.
+// The ChargingStation, or ChargingNetwork of stations, is shared among all eVTOLs.
 // Is a SimulationAgent and receives timestep updates to update its internal state.
 // Can be in one of 3 states, FLYING, CHARGING, or WAITING.
 // Keeps track of total time spent in each of these states.
@@ -122,21 +254,31 @@ enum class eVTOLState
 // Once fully charged, it goes back into FLYING mode.
 // The simulation is conducted in time units of milliseconds.
 // These values are converted to seconds, minutes, hours as needed.
+// An eVTOL attached to a SimulationEventScheduler is event driven and receives no timestep updates.
+// Instead, on entering FLYING it schedules the exact time its battery runs low, and samples
+// the time of each fault as exponentially distributed inter-arrival times.
+// Time spent in each state is accumulated whenever it changes state.
+// Given an EventTraceSink, every change of state and every fault is recorded to it.
 class eVTOL : public SimulationAgent, public ChargeableDevice
 {
 public:
-	eVTOL(const eVTOLConfiguration& config, ChargingStation* charging_station)
+	eVTOL(const eVTOLConfiguration& config, ChargingService* charging_station, RandomSeed seed = RandomSeed())
 	{
-		configuration_ = config;
+		configuration_ = eVTOLConfigurationRegistry::instance().intern(config);
 		this->charging_station_ = charging_station;
 		total_flight_time_ = 0.0;
 		total_charge_time_ = 0.0;
 		total_wait_time_ = 0.0;
 		number_of_faults_ = 0;
-		current_charge_ = configuration_.battery_capacity();
+		current_charge_ = configuration_->battery_capacity();
 		state_ = eVTOLState::UNKNOWN;
-		unsigned seed = std::chrono::steady_clock::now().time_since_epoch().count();
-		random_engine_ = std::default_random_engine(seed);
+		scheduler_ = nullptr;
+		state_start_time_ = 0;
+		low_battery_time_ = 0;
+		trace_ = nullptr;
+		trace_id_ = TRACE_NO_ID;
+		fault_sampler_ = FaultSampler(configuration_->probFaultPerMillisecond());
+		this->seed(seed);
 	}
 
 	eVTOL(const eVTOL& source_evtol)
@@ -149,14 +291,79 @@ public:
 		current_charge_ = source_evtol.current_charge_;
 		number_of_faults_ = source_evtol.number_of_faults_;
 		state_ = source_evtol.state_;
-		// don't copy the random engine, just create a new one
-		unsigned seed = std::chrono::steady_clock::now().time_since_epoch().count();
-		random_engine_ = std::default_random_engine(seed);
+		scheduler_ = source_evtol.scheduler_;
+		state_start_time_ = source_evtol.state_start_time_;
+		low_battery_time_ = source_evtol.low_battery_time_;
+		trace_ = source_evtol.trace_;
+		trace_id_ = source_evtol.trace_id_;
+		fault_sampler_ = source_evtol.fault_sampler_;
+		// don't copy the random stream, derive a new one from the source's seed
+		// copies of the same source share this stream until reseeded, eVTOLFactory reseeds every eVTOL it creates
+		seed(source_evtol.seed_.child(0));
+	}
+
+	// reseeds the random numbers used for faults, the same seed always gives the same faults
+	void seed(RandomSeed seed)
+	{
+		seed_ = seed;
+		random_engine_.seed(seed);
+		fault_sampler_.reset();
+	}
+
+	// the state of the random numbers used for faults, restoring it carries on the same sequence of faults
+	uint64_t randomState() { return random_engine_.state(); }
+
+	void setRandomState(uint64_t state)
+	{
+		random_engine_.setState(state);
+		fault_sampler_.reset();
+	}
+
+	// Variable timesteps only.  The time of the next change of state the eVTOL makes itself, the first whole millisecond
+	// its charge is below 0.5%, or the largest time there is when waiting or charging, the station decides when those end.
+	unsigned long long nextTransitionTime(unsigned long long now)
+	{
+		if (state_ != eVTOLState::FLYING) return std::numeric_limits<unsigned long long>::max();
+		double flight_time = std::max(current_charge_ - configuration_->lowBatteryCharge(), 0.0) / energyUsePerMillisecond();
+		return now + static_cast<unsigned long long>(flight_time) + 1;
+	}
+
+	// changes where the eVTOL goes to get recharged
+	void setChargingStation(ChargingService* charging_station)
+	{
+		charging_station_ = charging_station;
+	}
+
+	// records the eVTOL's changes of state and faults to trace, identified by trace_id, nullptr stops tracing
+	void setTrace(EventTraceSink* trace, uint32_t trace_id)
+	{
+		trace_ = trace;
+		trace_id_ = trace_id;
+	}
+
+	// how faults are sampled by timestep updates, see FaultSampling, an event driven eVTOL samples the time of each fault
+	void setFaultSampling(FaultSampling sampling)
+	{
+		fault_sampler_.setSampling(sampling);
+	}
+
+	const FaultSampler& faultSampler() { return fault_sampler_; }
+
+	// makes the eVTOL event driven, must be attached before begin()
+	void attachScheduler(SimulationEventScheduler* scheduler)
+	{
+		scheduler_ = scheduler;
 	}
 
 	void begin() override
 	{
+		traceStateChange(eVTOLState::FLYING);
 		state_ = eVTOLState::FLYING;
+		if (scheduler_)
+		{
+			state_start_time_ = scheduler_->now();
+			scheduleFlightEvents();
+		}
 	}
 
 	void timestepUpdate(size_t prev_time, size_t cur_time) override
@@ -165,10 +372,15 @@ public:
 		{
 			total_flight_time_ += (cur_time - prev_time);
 			current_charge_ -= energyUsePerMillisecond() * (cur_time - prev_time);
-			number_of_faults_ += didFaultOccur(cur_time - prev_time);
+			if (didFaultOccur(cur_time - prev_time))
+			{
+				number_of_faults_++;
+				if (trace_) trace_->record(TraceEvent::FAULT, trace_id_, traceTime());
+			}
 			// if low on battery charge, plug into charging station
 			if (percentChargeRemaining() < 0.5)
 			{
+				traceStateChange(eVTOLState::WAITING);
 				state_ = eVTOLState::WAITING;
 				if (charging_station_)
 				{
@@ -185,6 +397,7 @@ public:
 			total_charge_time_ += (cur_time - prev_time);
 			if (hasFullCharge())
 			{
+				traceStateChange(eVTOLState::FLYING);
 				state_ = eVTOLState::FLYING;
 			}
 		}
@@ -198,86 +411,79 @@ public:
 	// returns true if a fault occured during the time interval specified
 	bool didFaultOccur(size_t interval_milliseconds)
 	{
-		double prob_fault_per_millisecond = configuration_.prob_fault_per_hour() / (60.0 * 60.0 * 1000.0);
-		double prob_fault_during_interval = prob_fault_per_millisecond * interval_milliseconds;
-		std::uniform_real_distribution<double> dist(0.0, 1.0);
-		double observation = dist(random_engine_);
-		bool fault_occured = observation < prob_fault_during_interval;
-		return fault_occured;
+		return fault_sampler_.sample(interval_milliseconds, random_engine_);
 	}
 
 	// charge is in kWh
 	void addCharge(double charge) override
 	{
 		current_charge_ += charge;
-		current_charge_ = std::min(current_charge_, configuration_.battery_capacity());
+		current_charge_ = std::min(current_charge_, configuration_->battery_capacity());
 		if (hasFullCharge())
 		{
-			state_ = eVTOLState::FLYING;
+			changeState(eVTOLState::FLYING);
 		}
 		else
 		{
-			state_ = eVTOLState::CHARGING;
+			changeState(eVTOLState::CHARGING);
 		}
 	}
 
 	bool hasFullCharge() override
 	{
-		return current_charge_ == configuration_.battery_capacity();
+		return current_charge_ == configuration_->battery_capacity();
+	}
+
+	double chargeNeeded() override
+	{
+		return configuration_->battery_capacity() - current_charge_;
+	}
+
+	// Event driven only.  Called once the scheduler has finished to account for
+	// the time spent in the current state up to the end of the simulation.
+	void finishEvents()
+	{
+		if (!scheduler_) return;
+		accumulateStateTime(scheduler_->endTime());
 	}
 
 	// returns the name of the state
 	std::string stateName()
 	{
-		if (state_ == eVTOLState::FLYING)
-		{
-			return "FLYING";
-		}
-		else if (state_ == eVTOLState::CHARGING)
-		{
-			return "CHARGING";
-		}
-		else if (state_ == eVTOLState::WAITING)
-		{
-			return "WAITING";
-		}
-		else
-		{
-			return "UNKNOWN";
-		}
+		return eVTOLStateName(state_);
 	}
 
 	// return amount of charge remaining as a percent of max charge
 	double percentChargeRemaining()
 	{
-		return current_charge_ / configuration_.battery_capacity() * 100.0;
+		return current_charge_ / configuration_->battery_capacity() * 100.0;
 	}
 
 	// returns the charge rate in kWh / milliseconds
 	double chargeRate() override
 	{
-		return configuration_.chargeRate();
+		return configuration_->chargeRate();
 	}
 
 	// returns the cruising speed energy used in kWh / milliseconds
 	double energyUsePerMillisecond()
 	{
-		return configuration_.energyUsePerMillisecond();
+		return configuration_->energyUsePerMillisecond();
 	}
 
-	std::string company_name()
+	const std::string& company_name()
 	{
-		return configuration_.company_name();
+		return configuration_->company_name();
 	}
 
 	size_t passenger_count()
 	{
-		return configuration_.passenger_count();
+		return configuration_->passenger_count();
 	}
 
 	size_t cruise_speed()
 	{
-		return configuration_.cruise_speed();
+		return configuration_->cruise_speed();
 	}
 
 	eVTOLState state() { return state_; }
@@ -292,18 +498,168 @@ public:
 
 	size_t number_of_faults() {	return number_of_faults_; }
 
-	eVTOLConfiguration configuration() { return configuration_; }
+	const eVTOLConfiguration& configuration() { return *configuration_; }
+
+	uint32_t traceId() override { return trace_id_; }
+
+	// id of the configuration in the eVTOLConfigurationRegistry
+	uint32_t configurationId() { return configuration_->id(); }
+
+	eVTOLAgentState agentState()
+	{
+		eVTOLAgentState agent_state;
+		agent_state.total_flight_time = total_flight_time_;
+		agent_state.total_charge_time = total_charge_time_;
+		agent_state.total_wait_time = total_wait_time_;
+		agent_state.current_charge = current_charge_;
+		agent_state.number_of_faults = number_of_faults_;
+		agent_state.state = state_;
+		return agent_state;
+	}
+
+	// The state as of the given time, e.g. for a snapshot part way through a simulation.
+	// An event driven eVTOL only accumulates time when it changes state, so this includes
+	// the time spent in its current state since it was entered.  Flight time is included but not the charge it used.
+	eVTOLAgentState agentStateAt(unsigned long long time)
+	{
+		eVTOLAgentState agent_state = agentState();
+		if (!scheduler_ || time <= state_start_time_) return agent_state;
+
+		size_t interval = static_cast<size_t>(time - state_start_time_);
+		if (state_ == eVTOLState::FLYING) agent_state.total_flight_time += interval;
+		else if (state_ == eVTOLState::WAITING) agent_state.total_wait_time += interval;
+		else if (state_ == eVTOLState::CHARGING) agent_state.total_charge_time += interval;
+		return agent_state;
+	}
+
+	void setAgentState(const eVTOLAgentState& agent_state)
+	{
+		total_flight_time_ = agent_state.total_flight_time;
+		total_charge_time_ = agent_state.total_charge_time;
+		total_wait_time_ = agent_state.total_wait_time;
+		current_charge_ = agent_state.current_charge;
+		number_of_faults_ = agent_state.number_of_faults;
+		state_ = agent_state.state;
+	}
 
 private:
-	eVTOLConfiguration configuration_;
+	// Moves the eVTOL into a new state.
+	// When event driven, first accumulates the time spent in the state being left
+	// and, when taking off, schedules the events of the new flight.
+	void changeState(eVTOLState new_state)
+	{
+		traceStateChange(new_state);
+		if (!scheduler_)
+		{
+			state_ = new_state;
+			return;
+		}
+		if (new_state == state_) return;
+
+		accumulateStateTime(scheduler_->now());
+		state_ = new_state;
+		if (state_ == eVTOLState::FLYING)
+		{
+			scheduleFlightEvents();
+		}
+	}
+
+	// records a change from the current state to new_state, if traced and the state does change
+	void traceStateChange(eVTOLState new_state)
+	{
+		if (!trace_ || new_state == state_) return;
+		trace_->record(TraceEvent::STATE_CHANGE, trace_id_, traceTime(), static_cast<uint8_t>(state_), static_cast<uint8_t>(new_state));
+	}
+
+	// the time of a trace record, the time of the event when event driven, otherwise of the timestep
+	unsigned long long traceTime()
+	{
+		return scheduler_ ? scheduler_->now() : trace_->time();
+	}
+
+	// Event driven only.  Adds the time from when the current state was entered up to
+	// cur_time to the total for that state.  When flying, battery charge is drained as well.
+	void accumulateStateTime(unsigned long long cur_time)
+	{
+		size_t interval = cur_time - state_start_time_;
+		if (state_ == eVTOLState::FLYING)
+		{
+			total_flight_time_ += interval;
+			current_charge_ -= energyUsePerMillisecond() * interval;
+		}
+		else if (state_ == eVTOLState::WAITING)
+		{
+			total_wait_time_ += interval;
+		}
+		else if (state_ == eVTOLState::CHARGING)
+		{
+			total_charge_time_ += interval;
+		}
+		state_start_time_ = cur_time;
+	}
+
+	// Event driven only.  Schedules the time the battery will run low and the first fault of the flight.
+	void scheduleFlightEvents()
+	{
+		// the first whole millisecond at which charge remaining drops below 0.5%
+		double flight_time = std::max(current_charge_ - configuration_->lowBatteryCharge(), 0.0) / energyUsePerMillisecond();
+		low_battery_time_ = scheduler_->now() + static_cast<unsigned long long>(flight_time) + 1;
+		scheduler_->schedule(low_battery_time_, [this](unsigned long long event_time) { lowBatteryEvent(event_time); });
+		scheduleNextFault();
+	}
+
+	// Event driven only.  Samples the time until the next fault, faults are a Poisson process
+	// so the time between faults is exponentially distributed.
+	// Only a fault occuring before the battery runs low is scheduled.
+	void scheduleNextFault()
+	{
+		double faults_per_millisecond = configuration_->probFaultPerMillisecond();
+		if (faults_per_millisecond <= 0.0) return;
+		std::exponential_distribution<double> dist(faults_per_millisecond);
+		double time_to_fault = dist(random_engine_);
+		if (time_to_fault >= low_battery_time_ - scheduler_->now()) return;
+		unsigned long long fault_time = scheduler_->now() + static_cast<unsigned long long>(time_to_fault);
+		scheduler_->schedule(fault_time, [this](unsigned long long event_time) {
+			number_of_faults_++;
+			if (trace_) trace_->record(TraceEvent::FAULT, trace_id_, event_time);
+			scheduleNextFault();
+			});
+	}
+
+	// Event driven only.  The battery has run low, plug into the charging station.
+	void lowBatteryEvent(unsigned long long event_time)
+	{
+		accumulateStateTime(event_time);
+		if (percentChargeRemaining() >= 0.5)
+		{
+			// rounding left the eVTOL just above the threshold, keep flying
+			scheduleFlightEvents();
+			return;
+		}
+		traceStateChange(eVTOLState::WAITING);
+		state_ = eVTOLState::WAITING;
+		if (charging_station_)
+		{
+			charging_station_->addDevice(this);
+		}
+	}
+
+	const eVTOLConfiguration* configuration_;  // held by the eVTOLConfigurationRegistry
 	size_t total_flight_time_;  // in milliseconds
 	size_t total_charge_time_;  // in milliseconds
 	size_t total_wait_time_;    // in milliseconds
 	double current_charge_;     // in kWh
 	size_t number_of_faults_;
 	eVTOLState state_;
-	ChargingStation* charging_station_; // where eVTOLs get their batteries recharged
-	std::default_random_engine random_engine_;
+	uint32_t trace_id_;                 // identifies the eVTOL in the trace
+	ChargingService* charging_station_; // where eVTOLs get their batteries recharged, a station or a network of them
+	RandomSeed seed_;
+	SplitMix64 random_engine_;
+	FaultSampler fault_sampler_;              // timestep updates only, draws from random_engine_
+	SimulationEventScheduler* scheduler_;     // event driven only, nullptr for timestep updates
+	unsigned long long state_start_time_;     // event driven only, time current state was entered in milliseconds
+	unsigned long long low_battery_time_;     // event driven only, time current flight ends in milliseconds
+	EventTraceSink* trace_;                   // nullptr when not traced
 };
 
 
@@ -343,6 +699,31 @@ void test_eVTOLConfiguration()
 }
 
 
+
+void test_eVTOLConfigurationRegistry()
+{
+	using namespace std;
+
+	eVTOLConfigurationRegistry& registry = eVTOLConfigurationRegistry::instance();
+	eVTOLConfiguration alpha("Registry Alpha", 120, 320, 0.6, 1.6, 4, 0.25);
+	eVTOLConfiguration beta("Registry Beta", 100, 100, 0.2, 1.5, 5, 0.10);
+
+	// equal configurations are interned once, the registry's copy has an id
+	const eVTOLConfiguration* interned_alpha = registry.intern(alpha);
+	const eVTOLConfiguration* interned_beta = registry.intern(beta);
+	cout << (alpha.id() == eVTOLConfiguration::UNINTERNED) << (interned_alpha == registry.intern(eVTOLConfiguration(alpha))) << (interned_alpha != interned_beta);
+	cout << (&registry.configuration(interned_beta->id()) == interned_beta) << endl;
+
+	// eVTOLs and their copies all share the registry's copy
+	eVTOL vtol(alpha, nullptr);
+	eVTOL copy(vtol);
+	cout << (&vtol.configuration() == interned_alpha) << (&copy.configuration() == interned_alpha) << "  " << copy.company_name() << "  " << sizeof(eVTOL) << endl;
+
+	try { registry.configuration(eVTOLConfiguration::UNINTERNED); }
+	catch (const std::out_of_range& oor) { cout << oor.what() << endl; }
+}
+
+
 void test_eVTOL()
 {
 	using namespace std;
@@ -367,6 +748,19 @@ void test_eVTOL()
 	cout << vtol.percentChargeRemaining() << endl;
 	vtol.timestepUpdate(30000, 100000);
 	cout << vtol.percentChargeRemaining() << endl;
+
+	// event driven, flies until battery runs low then charges and flies again
+	SimulationEventScheduler scheduler(180);
+	ChargingStation cs(1);
+	cs.attachScheduler(&scheduler);
+	eVTOL event_vtol(vtol_config, &cs);
+	event_vtol.attachScheduler(&scheduler);
+	event_vtol.begin();
+	scheduler.start();
+	cs.finishEvents();
+	event_vtol.finishEvents();
+	cout << event_vtol.stateName() << "  " << event_vtol.total_flight_time() << "  " << event_vtol.total_charge_time() << "  ";
+	cout << event_vtol.total_wait_time() << "  " << event_vtol.number_of_faults() << "  " << scheduler.eventsProcessed() << endl;
 }
 
 
@@ -0,0 +1,158 @@
+#ifndef EVTOL_ANALYTIC
+#define EVTOL_ANALYTIC
+
+#include <iostream>
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <random>
+#include <limits>
+#include <stdexcept>
+
+#include "evtol.h"
+#include "sim_random.h"
+
+
+// The flight and charge cycle, in closed form, of an eVTOL that never waits for a bay.
+// Every eVTOL takes off fully charged, flies until its charge is below 0.5%, charges back to full
+// and takes off again, so with no waiting its life is the same cycle over and over, known from its configuration alone.
+// Times are whole milliseconds, as with the discrete event engine: a flight ends the first millisecond the charge is
+// below 0.5%, a charge the first millisecond it is full.  Faults are a Poisson process over the time flying.
+// Usage:
+//     eVTOLAnalyticCycle cycle(alpha_config, 0.0);
+//     eVTOLAgentState state = cycle.stateAt(3 * 60 * 60 * 1000);
+//     state.number_of_faults = cycle.sampleFaults(state.total_flight_time, random_engine);
+class eVTOLAnalyticCycle
+{
+public:
+	// max_charge_rate_kw of 0 places no limit on the charge rate, as with ChargingStation
+	eVTOLAnalyticCycle(const eVTOLConfiguration& config, double max_charge_rate_kw)
+	{
+		if (max_charge_rate_kw < 0.0) throw std::invalid_argument("max_charge_rate_kw must not be negative.");
+		double max_charge_rate = max_charge_rate_kw / (60.0 * 60.0 * 1000.0);
+		charge_rate_ = max_charge_rate > 0.0 ? std::min(config.chargeRate(), max_charge_rate) : config.chargeRate();
+		battery_capacity_ = config.battery_capacity();
+		energy_use_ = config.energyUsePerMillisecond();
+		prob_fault_per_millisecond_ = config.probFaultPerMillisecond();
+		flight_milliseconds_ = static_cast<unsigned long long>(std::max(battery_capacity_ - config.lowBatteryCharge(), 0.0) / energy_use_) + 1;
+		landing_charge_ = std::max(battery_capacity_ - energy_use_ * flight_milliseconds_, 0.0);
+		charge_milliseconds_ = static_cast<unsigned long long>((battery_capacity_ - landing_charge_) / charge_rate_) + 1;
+	}
+
+	unsigned long long flightMilliseconds() const { return flight_milliseconds_; }
+
+	unsigned long long chargeMilliseconds() const { return charge_milliseconds_; }
+
+	unsigned long long cycleMilliseconds() const { return flight_milliseconds_ + charge_milliseconds_; }
+
+	// the state at the given time, with no faults, an eVTOL lands and starts charging at the same millisecond
+	eVTOLAgentState stateAt(unsigned long long time) const
+	{
+		unsigned long long cycles = time / cycleMilliseconds();
+		unsigned long long into_cycle = time % cycleMilliseconds();
+		eVTOLAgentState state = {};
+		state.total_flight_time = static_cast<size_t>(cycles * flight_milliseconds_ + std::min(into_cycle, flight_milliseconds_));
+		state.total_charge_time = static_cast<size_t>(cycles * charge_milliseconds_ + (into_cycle > flight_milliseconds_ ? into_cycle - flight_milliseconds_ : 0));
+		state.total_wait_time = 0;
+		if (into_cycle < flight_milliseconds_)
+		{
+			state.state = eVTOLState::FLYING;
+			state.current_charge = battery_capacity_ - energy_use_ * into_cycle;
+		}
+		else
+		{
+			state.state = eVTOLState::CHARGING;
+			state.current_charge = std::min(landing_charge_ + charge_rate_ * (into_cycle - flight_milliseconds_), battery_capacity_);
+		}
+		return state;
+	}
+
+	// calls handler(start, end) for every charge started before end_time, end may be after end_time
+	template <typename Handler>
+	void forEachCharge(unsigned long long end_time, Handler handler) const
+	{
+		for (unsigned long long start = flight_milliseconds_; start < end_time; start += cycleMilliseconds())
+		{
+			handler(start, start + charge_milliseconds_);
+		}
+	}
+
+	// the number of faults in the given time flying
+	size_t sampleFaults(unsigned long long flight_milliseconds, SplitMix64& random_engine) const
+	{
+		double mean = prob_fault_per_millisecond_ * flight_milliseconds;
+		if (mean <= 0.0) return 0;
+		std::poisson_distribution<size_t> dist(mean);
+		return dist(random_engine);
+	}
+
+private:
+	double charge_rate_;                        // in kWh per millisecond, limited by the station
+	double battery_capacity_;                   // in kWh
+	double energy_use_;                         // in kWh per millisecond
+	double prob_fault_per_millisecond_;
+	double landing_charge_;                     // in kWh
+	unsigned long long flight_milliseconds_;
+	unsigned long long charge_milliseconds_;
+};
+
+
+// Returns the first time an eVTOL would land to find every one of number_of_bays bays taken, had none ever waited,
+// or the largest time there is when, up to end_time, there are always enough bays.
+// Before that time no eVTOL waits, so every cycle is exactly as eVTOLAnalyticCycle has it.
+// A bay freed at the same millisecond as an eVTOL lands is free for it.
+inline unsigned long long firstContendedTime(const std::vector<eVTOLAnalyticCycle>& cycles, size_t number_of_bays, unsigned long long end_time)
+{
+	if (cycles.size() <= number_of_bays) return std::numeric_limits<unsigned long long>::max();
+
+	// (time, +1 for a charge starting or -1 for one ending), ends sort before starts at the same time
+	std::vector<std::pair<unsigned long long, int>> changes;
+	for (auto& cycle : cycles)
+	{
+		cycle.forEachCharge(end_time, [&changes](unsigned long long start, unsigned long long end) {
+			changes.push_back(std::make_pair(start, 1));
+			changes.push_back(std::make_pair(end, -1));
+			});
+	}
+	std::sort(changes.begin(), changes.end());
+
+	size_t charging = 0;
+	for (auto& change : changes)
+	{
+		if (change.second < 0)
+		{
+			charging--;
+			continue;
+		}
+		if (++charging > number_of_bays) return change.first;
+	}
+	return std::numeric_limits<unsigned long long>::max();
+}
+
+
+
+void test_eVTOLAnalyticCycle()
+{
+	using namespace std;
+
+	// 320 kWh used at 1.6 kWh per mile and 120 mph, 0.6 hours to charge
+	eVTOLConfiguration config("Alpha Company", 120, 320, 0.60, 1.6, 4, 0.25);
+	eVTOLAnalyticCycle cycle(config, 0.0);
+	cout << cycle.flightMilliseconds() << "  " << cycle.chargeMilliseconds() << "  ";
+	eVTOLAgentState state = cycle.stateAt(cycle.flightMilliseconds() + 1000);
+	cout << eVTOLStateName(state.state) << "  " << state.total_flight_time << "  " << state.total_charge_time << "  ";
+	state = cycle.stateAt(cycle.cycleMilliseconds());
+	cout << eVTOLStateName(state.state) << "  " << state.current_charge << endl;
+
+	// three eVTOLs and two bays, the third to land waits
+	std::vector<eVTOLAnalyticCycle> cycles(3, cycle);
+	cout << firstContendedTime(cycles, 3, 10800000) << "  " << (firstContendedTime(cycles, 2, 10800000) == cycle.flightMilliseconds()) << endl;
+
+	SplitMix64 random_engine(RandomSeed(42));
+	size_t faults = 0;
+	for (int i = 0; i < 1000; i++) faults += cycle.sampleFaults(3600000, random_engine);
+	cout << faults << endl;
+}
+
+
+#endif  // EVTOL_ANALYTIC
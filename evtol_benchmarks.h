@@ -0,0 +1,428 @@
+#ifndef EVTOL_BENCHMARKS
+#define EVTOL_BENCHMARKS
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <memory>
+#include <cstdio>
+#include <thread>
+
+#include "sim_benchmark.h"
+#include "sim_types.h"
+#include "charge_station.h"
+#include "charge_network.h"
+#include "evtol.h"
+#include "evtol_factory.h"
+#include "evtol_fleet_kernel.h"
+#include "evtol_simulation.h"
+#include "sim_memory.h"
+#include "sim_trace.h"
+
+
+// What to benchmark and how big
+struct eVTOLBenchmarkOptions
+{
+	eVTOLBenchmarkOptions()
+	{
+		max_fleet_size = 1000000;
+		aircraft_timesteps = 20000000;
+		seed = 1234;
+	}
+
+	size_t max_fleet_size;                 // end to end benchmarks run fleets of 20, 100, 1000, ... up to this size
+	unsigned long long aircraft_timesteps; // approximate work of each end to end run, bigger fleets run for fewer timesteps
+	uint64_t seed;                         // every benchmark is seeded so runs are comparable
+};
+
+
+// A device that never finishes charging, keeps a station's bays occupied for its whole benchmark
+class BenchmarkChargeableDevice : public ChargeableDevice
+{
+public:
+	void addCharge(double charge) override { total_charge_ += charge; }
+	double chargeRate() override { return 1.0e-6; }
+	bool hasFullCharge() override { return false; }
+	double chargeNeeded() override { return 1.0e9; }
+private:
+	double total_charge_ = 0.0;
+};
+
+
+// A charging service that only counts the devices it is given
+class BenchmarkChargingService : public ChargingService
+{
+public:
+	void addDevice(ChargeableDevice*) override { number_of_devices_++; }
+	size_t numberOfDevices() const { return number_of_devices_; }
+private:
+	size_t number_of_devices_ = 0;
+};
+
+
+// ns per aircraft-timestep of eVTOL::timestepUpdate.
+// The eVTOLs fly, charge and wait as in the simulation, with enough bays that none wait,
+// only the eVTOL updates are timed, not the station.
+inline BenchmarkMeasurement benchmarkeVTOLTimestepUpdate(size_t number_of_evtols, size_t number_of_timesteps, uint64_t seed)
+{
+	ChargingStation station(number_of_evtols);
+	eVTOLFactory factory{ RandomSeed(seed) };
+	for (auto& config : eVTOLSimulationParameters().configurations)
+	{
+		factory.addPrototype(eVTOL(config, &station));
+	}
+	std::vector<eVTOL*> evtols;
+	for (size_t i = 0; i < number_of_evtols; i++)
+	{
+		evtols.push_back(factory.create_eVTOL());
+		evtols.back()->begin();
+	}
+
+	BenchmarkStopwatch stopwatch;
+	for (size_t t = 0; t < number_of_timesteps; t++)
+	{
+		size_t prev_time = t * 1000;
+		size_t cur_time = prev_time + 1000;
+		stopwatch.start();
+		for (eVTOL* evtol : evtols)
+		{
+			evtol->timestepUpdate(prev_time, cur_time);
+		}
+		stopwatch.stop();
+		station.timestepUpdate(prev_time, cur_time);
+	}
+
+	for (eVTOL* evtol : evtols) delete evtol;
+	return BenchmarkMeasurement{ static_cast<unsigned long long>(number_of_evtols) * number_of_timesteps, stopwatch.nanoseconds() };
+}
+
+
+// ns per ChargingStation::timestepUpdate with every bay occupied and a queue of devices waiting
+inline BenchmarkMeasurement benchmarkChargingStationUpdate(size_t number_of_bays, size_t queue_depth, size_t number_of_timesteps)
+{
+	std::vector<BenchmarkChargeableDevice> devices(number_of_bays + queue_depth);
+	ChargingStation station(number_of_bays);
+	station.begin();
+	for (auto& device : devices)
+	{
+		station.addDevice(&device);
+	}
+
+	BenchmarkStopwatch stopwatch;
+	stopwatch.start();
+	for (size_t t = 0; t < number_of_timesteps; t++)
+	{
+		station.timestepUpdate(t * 1000, t * 1000 + 1000);
+	}
+	stopwatch.stop();
+	return BenchmarkMeasurement{ number_of_timesteps, stopwatch.nanoseconds() };
+}
+
+
+// ns per device handed to a ConcurrentChargingQueue by number_of_threads threads at once, flushing included.
+// Every round each thread queues devices_per_thread devices, then the queue is flushed in address order
+// to a service that only counts them, as the parallel fixed timestep engine does at the end of each timestep.
+inline BenchmarkMeasurement benchmarkConcurrentChargingQueue(size_t number_of_threads, size_t devices_per_thread, size_t number_of_rounds)
+{
+	std::vector<BenchmarkChargeableDevice> devices(number_of_threads * devices_per_thread);
+	ConcurrentChargingQueue arrivals(devices.size());
+	BenchmarkChargingService received;
+
+	BenchmarkStopwatch stopwatch;
+	stopwatch.start();
+	for (size_t round = 0; round < number_of_rounds; round++)
+	{
+		std::vector<std::thread> threads;
+		for (size_t thread = 0; thread < number_of_threads; thread++)
+		{
+			threads.push_back(std::thread([&devices, &arrivals, thread, devices_per_thread]() {
+				for (size_t i = thread * devices_per_thread; i < (thread + 1) * devices_per_thread; i++) arrivals.addDevice(&devices[i]);
+				}));
+		}
+		for (auto& thread : threads) thread.join();
+		arrivals.flushSorted(&received, std::less<ChargeableDevice*>());
+	}
+	stopwatch.stop();
+	return BenchmarkMeasurement{ static_cast<unsigned long long>(devices.size()) * number_of_rounds, stopwatch.nanoseconds() };
+}
+
+
+// ns per timestep flying of FaultSampler::sample, at Alpha Company's 0.25 faults per hour and one second timesteps
+inline BenchmarkMeasurement benchmarkFaultSampler(FaultSampling sampling, size_t number_of_timesteps, uint64_t seed)
+{
+	FaultSampler faults(0.25 / (60.0 * 60.0 * 1000.0), sampling);
+	SplitMix64 random_engine{ RandomSeed(seed) };
+	// volatile so the samples are not optimized away
+	volatile size_t number_of_faults = 0;
+
+	BenchmarkStopwatch stopwatch;
+	stopwatch.start();
+	for (size_t t = 0; t < number_of_timesteps; t++)
+	{
+		number_of_faults = number_of_faults + faults.sample(1000, random_engine);
+	}
+	stopwatch.stop();
+	return BenchmarkMeasurement{ number_of_timesteps, stopwatch.nanoseconds() };
+}
+
+
+// ns per eVTOL created by eVTOLFactory::create_eVTOL, including deleting it again
+inline BenchmarkMeasurement benchmarkCreateeVTOL(size_t number_to_create, uint64_t seed)
+{
+	eVTOLFactory factory{ RandomSeed(seed) };
+	for (auto& config : eVTOLSimulationParameters().configurations)
+	{
+		factory.addPrototype(eVTOL(config, nullptr));
+	}
+	std::vector<eVTOL*> evtols(number_to_create);
+
+	BenchmarkStopwatch stopwatch;
+	stopwatch.start();
+	for (size_t i = 0; i < number_to_create; i++)
+	{
+		evtols[i] = factory.create_eVTOL();
+	}
+	for (size_t i = 0; i < number_to_create; i++)
+	{
+		delete evtols[i];
+	}
+	stopwatch.stop();
+	return BenchmarkMeasurement{ number_to_create, stopwatch.nanoseconds() };
+}
+
+
+// ns per eVTOL created by eVTOLFactory::create_eVTOLs in an arena, including clearing the arena again
+inline BenchmarkMeasurement benchmarkCreateeVTOLArena(size_t number_to_create, uint64_t seed)
+{
+	eVTOLFactory factory{ RandomSeed(seed) };
+	for (auto& config : eVTOLSimulationParameters().configurations)
+	{
+		factory.addPrototype(eVTOL(config, nullptr));
+	}
+	std::vector<eVTOL*> evtols;
+
+	BenchmarkStopwatch stopwatch;
+	stopwatch.start();
+	{
+		ObjectArena<eVTOL> arena(number_to_create);
+		factory.create_eVTOLs(number_to_create, arena, evtols);
+	}
+	stopwatch.stop();
+	return BenchmarkMeasurement{ number_to_create, stopwatch.nanoseconds() };
+}
+
+
+// ns per aircraft-timestep of a whole free running eVTOLSimulation, construction and reporting included.
+// Bays scale with the fleet at the default 3 bays per 20 eVTOLs.
+// Given a trace_file_name, every event is traced to that file, which is removed afterwards.
+inline BenchmarkMeasurement benchmarkSimulation(SimulationEngine engine, size_t number_of_evtols, size_t simulation_time_minutes, uint64_t seed,
+	const std::string& trace_file_name = "")
+{
+	eVTOLSimulationParameters parameters;
+	parameters.number_of_evtols = number_of_evtols;
+	parameters.number_of_charging_bays = std::max<size_t>(MAX_NUMBER_CHARGING_STALLS, number_of_evtols * MAX_NUMBER_CHARGING_STALLS / TOTAL_NUMBER_EVTOLS);
+	parameters.simulation_time_minutes = simulation_time_minutes;
+	parameters.timer_mode = SimulationTimerMode::FREE_RUNNING;
+	parameters.engine = engine;
+	parameters.seed = seed;
+	parameters.verbose = false;
+
+	BenchmarkStopwatch stopwatch;
+	stopwatch.start();
+	{
+		std::unique_ptr<EventTraceSink> trace(trace_file_name.empty() ? nullptr : new EventTraceSink(trace_file_name));
+		eVTOLSimulation simulation(parameters);
+		simulation.setTrace(trace.get());
+		simulation.run();
+		simulation.companyResults();
+	}
+	stopwatch.stop();
+	if (!trace_file_name.empty()) std::remove(trace_file_name.c_str());
+
+	unsigned long long timesteps = simulation_time_minutes * 60 * 1000 / parameters.timestep_milliseconds;
+	return BenchmarkMeasurement{ number_of_evtols * timesteps, stopwatch.nanoseconds() };
+}
+
+
+// A REGIONAL simulation of a fixed fleet split into regions, each with a station, on number_of_threads threads,
+// ns per aircraft-timestep end to end, for the strong scaling of the regions across threads
+inline BenchmarkMeasurement benchmarkRegionalSimulation(size_t number_of_regions, size_t number_of_threads, size_t number_of_evtols, size_t simulation_time_minutes, uint64_t seed)
+{
+	eVTOLSimulationParameters parameters;
+	parameters.number_of_evtols = number_of_evtols;
+	parameters.number_of_charging_stations = number_of_regions;
+	parameters.number_of_charging_bays = std::max<size_t>(MAX_NUMBER_CHARGING_STALLS, number_of_evtols * MAX_NUMBER_CHARGING_STALLS / TOTAL_NUMBER_EVTOLS / number_of_regions);
+	parameters.number_of_regions = number_of_regions;
+	parameters.cross_region_leg_probability = 0.2;
+	parameters.number_of_fleet_threads = number_of_threads;
+	parameters.simulation_time_minutes = simulation_time_minutes;
+	parameters.timer_mode = SimulationTimerMode::FREE_RUNNING;
+	parameters.engine = SimulationEngine::REGIONAL;
+	parameters.seed = seed;
+	parameters.verbose = false;
+
+	BenchmarkStopwatch stopwatch;
+	stopwatch.start();
+	{
+		eVTOLSimulation simulation(parameters);
+		simulation.run();
+		simulation.companyResults();
+	}
+	stopwatch.stop();
+
+	unsigned long long timesteps = simulation_time_minutes * 60 * 1000 / parameters.timestep_milliseconds;
+	return BenchmarkMeasurement{ number_of_evtols * timesteps, stopwatch.nanoseconds() };
+}
+
+
+// ns per eVTOL to write the results of a finished simulation to memory, as CSV or as a columnar file,
+// only the writing is timed, not the simulation of a minute before it
+inline BenchmarkMeasurement benchmarkResultsExport(SimulationEngine engine, bool columnar, size_t number_of_evtols, uint64_t seed)
+{
+	eVTOLSimulationParameters parameters;
+	parameters.number_of_evtols = number_of_evtols;
+	parameters.number_of_charging_bays = std::max<size_t>(MAX_NUMBER_CHARGING_STALLS, number_of_evtols * MAX_NUMBER_CHARGING_STALLS / TOTAL_NUMBER_EVTOLS);
+	parameters.simulation_time_minutes = 1;
+	parameters.timer_mode = SimulationTimerMode::FREE_RUNNING;
+	parameters.engine = engine;
+	parameters.seed = seed;
+	parameters.verbose = false;
+	eVTOLSimulation simulation(parameters);
+	simulation.run();
+
+	BenchmarkStopwatch stopwatch;
+	std::ostringstream out;
+	stopwatch.start();
+	if (columnar) simulation.writeResultsColumnar(out);
+	else simulation.writeResultsCsv(out);
+	stopwatch.stop();
+	if (out.tellp() <= 0) throw std::runtime_error("the results export wrote nothing.");
+	return BenchmarkMeasurement{ number_of_evtols, stopwatch.nanoseconds() };
+}
+
+
+// Adds the benchmarks of the simulation core:
+//   evtol_timestep_update/N            ns per aircraft-timestep of eVTOL::timestepUpdate for N eVTOLs
+//   station_update/bays:B/queue:Q      ns per ChargingStation::timestepUpdate with B bays occupied and Q waiting
+//   charging_queue/threads:T           ns per device handed to a ConcurrentChargingQueue by T threads at once
+//   fault_sampler/SAMPLING             ns per timestep flying to sample a fault, see FaultSampling
+//   factory_create_evtol               ns per eVTOL created on the heap
+//   factory_create_evtol_arena         ns per eVTOL created in an arena
+//   simulation/ENGINE/N                ns per aircraft-timestep end to end, fleets of 20 up to max_fleet_size
+//   simulation_traced/ENGINE/N         the same with every event traced, for the largest fleet only
+//   simulation_regional/threads:T      ns per aircraft-timestep of a REGIONAL simulation of 8 regions on T threads
+//   results_export/FORMAT/ENGINE       ns per eVTOL to write the results of the largest fleet as csv or columnar
+inline void addeVTOLBenchmarks(SimulationBenchmark& benchmark, const eVTOLBenchmarkOptions& options)
+{
+	uint64_t seed = options.seed;
+
+	for (size_t number_of_evtols : { 20, 1000 })
+	{
+		benchmark.add("evtol_timestep_update/" + std::to_string(number_of_evtols), "aircraft-timestep", [number_of_evtols, seed]() {
+			return benchmarkeVTOLTimestepUpdate(number_of_evtols, 2000000 / number_of_evtols, seed);
+			});
+	}
+
+	for (size_t number_of_bays : { 3, 30, 300 })
+	{
+		for (size_t queue_depth : { 0, 1000 })
+		{
+			std::string name = "station_update/bays:" + std::to_string(number_of_bays) + "/queue:" + std::to_string(queue_depth);
+			benchmark.add(name, "station-timestep", [number_of_bays, queue_depth]() {
+				return benchmarkChargingStationUpdate(number_of_bays, queue_depth, 100000);
+				});
+		}
+	}
+
+	for (size_t number_of_threads : { 1, 4 })
+	{
+		benchmark.add("charging_queue/threads:" + std::to_string(number_of_threads), "device", [number_of_threads]() {
+			return benchmarkConcurrentChargingQueue(number_of_threads, 100000 / number_of_threads, 20);
+			});
+	}
+
+	for (FaultSampling sampling : { FaultSampling::PER_TIMESTEP, FaultSampling::GEOMETRIC_SKIP })
+	{
+		benchmark.add("fault_sampler/" + faultSamplingName(sampling), "timestep", [sampling, seed]() {
+			return benchmarkFaultSampler(sampling, 10000000, seed);
+			});
+	}
+
+	benchmark.add("factory_create_evtol", "eVTOL", [seed]() {
+		return benchmarkCreateeVTOL(100000, seed);
+		});
+	benchmark.add("factory_create_evtol_arena", "eVTOL", [seed]() {
+		return benchmarkCreateeVTOLArena(100000, seed);
+		});
+
+	for (SimulationEngine engine : { SimulationEngine::FIXED_TIMESTEP, SimulationEngine::BATCHED_FLEET, SimulationEngine::DISCRETE_EVENT, SimulationEngine::ADAPTIVE_TIMESTEP, SimulationEngine::COHORT, SimulationEngine::SPECIALIZED, SimulationEngine::REGIONAL })
+	{
+		for (size_t number_of_evtols : { 20, 100, 1000, 10000, 100000, 1000000 })
+		{
+			if (number_of_evtols > options.max_fleet_size) break;
+			// a minute at least, no more than the default simulation time
+			unsigned long long timesteps = options.aircraft_timesteps / number_of_evtols;
+			size_t minutes = static_cast<size_t>(std::min<unsigned long long>(std::max<unsigned long long>(timesteps * TIMESTEP_IN_MILLISECONDS / (60 * 1000), 1), TOTAL_MINUTES_SIMULATION_TIME));
+			std::string name = "simulation/" + simulationEngineName(engine) + "/" + std::to_string(number_of_evtols);
+			benchmark.add(name, "aircraft-timestep", [engine, number_of_evtols, minutes, seed]() {
+				return benchmarkSimulation(engine, number_of_evtols, minutes, seed);
+				});
+			// the cohort engine's eVTOLs have no identity to trace, the specialized and regional engines' are not traced
+			if (number_of_evtols * 10 > options.max_fleet_size && engine != SimulationEngine::COHORT && engine != SimulationEngine::SPECIALIZED && engine != SimulationEngine::REGIONAL)
+			{
+				benchmark.add("simulation_traced/" + simulationEngineName(engine) + "/" + std::to_string(number_of_evtols), "aircraft-timestep", [engine, number_of_evtols, minutes, seed]() {
+					return benchmarkSimulation(engine, number_of_evtols, minutes, seed, "benchmark_trace.bin");
+					});
+			}
+		}
+	}
+
+	// the same fleet however many threads
+	size_t regional_fleet = std::min<size_t>(options.max_fleet_size, 100000);
+	size_t regional_minutes = static_cast<size_t>(std::min<unsigned long long>(std::max<unsigned long long>(options.aircraft_timesteps / regional_fleet * TIMESTEP_IN_MILLISECONDS / (60 * 1000), 1), TOTAL_MINUTES_SIMULATION_TIME));
+	for (size_t number_of_threads : { 1, 2, 4, 8 })
+	{
+		benchmark.add("simulation_regional/threads:" + std::to_string(number_of_threads), "aircraft-timestep", [number_of_threads, regional_fleet, regional_minutes, seed]() {
+			return benchmarkRegionalSimulation(8, number_of_threads, regional_fleet, regional_minutes, seed);
+			});
+	}
+
+	// columnar from the eVTOLs and from the batched fleet's arrays, against the CSV of the same results
+	size_t export_fleet = options.max_fleet_size;
+	for (SimulationEngine engine : { SimulationEngine::FIXED_TIMESTEP, SimulationEngine::BATCHED_FLEET })
+	{
+		for (bool columnar : { false, true })
+		{
+			benchmark.add("results_export/" + std::string(columnar ? "columnar/" : "csv/") + simulationEngineName(engine), "eVTOL", [engine, columnar, export_fleet, seed]() {
+				return benchmarkResultsExport(engine, columnar, export_fleet, seed);
+				});
+		}
+	}
+
+	benchmark.addContext("fleet_kernel", flyingKernelInstructionSet());
+	benchmark.addContext("max_fleet_size", std::to_string(options.max_fleet_size));
+}
+
+
+
+void test_eVTOLBenchmarks()
+{
+	using namespace std;
+
+	// tiny versions of each benchmark, checks the measured work rather than the timings
+	cout << benchmarkeVTOLTimestepUpdate(20, 100, 1).items << "  ";
+	cout << benchmarkChargingStationUpdate(3, 10, 100).items << "  ";
+	cout << benchmarkConcurrentChargingQueue(2, 50, 3).items << "  ";
+	cout << benchmarkFaultSampler(FaultSampling::GEOMETRIC_SKIP, 100, 1).items << "  ";
+	cout << benchmarkCreateeVTOL(100, 1).items << "  ";
+	cout << benchmarkCreateeVTOLArena(100, 1).items << "  ";
+	cout << benchmarkSimulation(SimulationEngine::BATCHED_FLEET, 20, 1, 1).items << "  ";
+	cout << benchmarkRegionalSimulation(8, 2, 80, 1, 1).items << "  ";
+	cout << benchmarkResultsExport(SimulationEngine::BATCHED_FLEET, true, 20, 1).items << "  ";
+	cout << benchmarkSimulation(SimulationEngine::FIXED_TIMESTEP, 20, 1, 1, "test_benchmark_trace.bin").items << endl;
+}
+
+
+#endif  // EVTOL_BENCHMARKS
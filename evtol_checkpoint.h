@@ -0,0 +1,152 @@
+#ifndef EVTOL_CHECKPOINT
+#define EVTOL_CHECKPOINT
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+
+#include "sim_random.h"
+
+
+// The state of one eVTOL in a checkpoint
+struct eVTOLCheckpointRecord
+{
+	uint64_t total_flight_time;   // in milliseconds
+	uint64_t total_charge_time;   // in milliseconds
+	uint64_t total_wait_time;     // in milliseconds
+	double current_charge;        // in kWh
+	uint64_t number_of_faults;
+	uint64_t random_state;        // state of the eVTOL's fault random numbers, fixed timestep engine only
+	uint32_t state;               // an eVTOLState
+	uint32_t configuration;       // index into the simulation's list of configurations
+};
+
+const char CHECKPOINT_FILE_MAGIC[8] = { 'E', 'V', 'T', 'O', 'L', 'C', 'K', 'P' };
+const uint32_t CHECKPOINT_FILE_VERSION = 1;
+
+struct SimulationCheckpointHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t engine;                    // a SimulationEngine
+	uint64_t time;                      // simulation time of the checkpoint in milliseconds, the end of a timestep
+	uint64_t timestep_milliseconds;
+	uint32_t fleet_random_key;          // batched fleet engine only, state of the fleet's counter based random numbers
+	uint32_t fleet_timestep_count;
+	uint64_t number_of_evtols;
+	uint64_t number_of_stations;
+	uint64_t number_of_charging_bays;   // per station
+	uint64_t number_of_station_words;
+	uint64_t checksum;                  // of everything after the header
+};
+
+
+// The whole state of an eVTOLSimulation between two timesteps.
+// One record per eVTOL, in order of creation, then the occupancy of each charging station as a list of words:
+//     number of occupied bays, then (bay, eVTOL) for each, in the station's order
+//     number of free bays, then each free bay, in the station's order
+//     number of eVTOLs waiting, then each eVTOL, first in line first
+// eVTOLs are referred to by their index, so a checkpoint has no pointers and the file is a flat image,
+// a header followed by the arrays as they are in memory, that loads with a single read.
+// The layout is native byte order, a checkpoint is meant to be resumed on the kind of machine that wrote it.
+// Usage:
+//     eVTOLSimulationCheckpoint checkpoint = warm_up.checkpoint();
+//     saveCheckpoint("warm_up.checkpoint", checkpoint);
+//     branch.resumeFrom(loadCheckpoint("warm_up.checkpoint"));
+struct eVTOLSimulationCheckpoint
+{
+	SimulationCheckpointHeader header;
+	std::vector<eVTOLCheckpointRecord> evtols;
+	std::vector<uint64_t> stations;
+};
+
+
+inline void writeCheckpoint(std::ostream& out, const eVTOLSimulationCheckpoint& checkpoint)
+{
+	SimulationCheckpointHeader header = checkpoint.header;
+	std::memcpy(header.magic, CHECKPOINT_FILE_MAGIC, sizeof(header.magic));
+	header.version = CHECKPOINT_FILE_VERSION;
+	header.number_of_evtols = checkpoint.evtols.size();
+	header.number_of_station_words = checkpoint.stations.size();
+
+	std::string payload(checkpoint.evtols.size() * sizeof(eVTOLCheckpointRecord) + checkpoint.stations.size() * sizeof(uint64_t), '\0');
+	if (!checkpoint.evtols.empty()) std::memcpy(&payload[0], checkpoint.evtols.data(), checkpoint.evtols.size() * sizeof(eVTOLCheckpointRecord));
+	if (!checkpoint.stations.empty()) std::memcpy(&payload[checkpoint.evtols.size() * sizeof(eVTOLCheckpointRecord)], checkpoint.stations.data(), checkpoint.stations.size() * sizeof(uint64_t));
+	header.checksum = fnv1a64(payload.data(), payload.size());
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(payload.data(), payload.size());
+}
+
+// reads a checkpoint from its image in memory, e.g. read or mapped from a file
+inline eVTOLSimulationCheckpoint readCheckpoint(const char* data, size_t size)
+{
+	eVTOLSimulationCheckpoint checkpoint;
+	if (size < sizeof(SimulationCheckpointHeader)) throw std::invalid_argument("checkpoint is truncated.");
+	std::memcpy(&checkpoint.header, data, sizeof(checkpoint.header));
+	const SimulationCheckpointHeader& header = checkpoint.header;
+	if (std::memcmp(header.magic, CHECKPOINT_FILE_MAGIC, sizeof(header.magic)) != 0) throw std::invalid_argument("not a checkpoint.");
+	if (header.version != CHECKPOINT_FILE_VERSION) throw std::invalid_argument("unsupported checkpoint version.");
+
+	size_t evtols_size = header.number_of_evtols * sizeof(eVTOLCheckpointRecord);
+	size_t stations_size = header.number_of_station_words * sizeof(uint64_t);
+	if (size - sizeof(header) != evtols_size + stations_size) throw std::invalid_argument("checkpoint is the wrong size.");
+	const char* payload = data + sizeof(header);
+	if (fnv1a64(payload, evtols_size + stations_size) != header.checksum) throw std::invalid_argument("checkpoint checksum does not match.");
+
+	checkpoint.evtols.resize(header.number_of_evtols);
+	checkpoint.stations.resize(header.number_of_station_words);
+	if (evtols_size) std::memcpy(checkpoint.evtols.data(), payload, evtols_size);
+	if (stations_size) std::memcpy(checkpoint.stations.data(), payload + evtols_size, stations_size);
+	return checkpoint;
+}
+
+inline void saveCheckpoint(const std::string& file_name, const eVTOLSimulationCheckpoint& checkpoint)
+{
+	std::ofstream out(file_name, std::ios::binary);
+	if (!out) throw std::runtime_error("unable to open " + file_name + " for writing.");
+	writeCheckpoint(out, checkpoint);
+}
+
+inline eVTOLSimulationCheckpoint loadCheckpoint(const std::string& file_name)
+{
+	std::ifstream in(file_name, std::ios::binary | std::ios::ate);
+	if (!in) throw std::runtime_error("unable to open " + file_name + ".");
+	std::string contents(static_cast<size_t>(in.tellg()), '\0');
+	in.seekg(0);
+	if (!contents.empty()) in.read(&contents[0], contents.size());
+	return readCheckpoint(contents.data(), contents.size());
+}
+
+
+
+void test_eVTOLSimulationCheckpointFile()
+{
+	using namespace std;
+
+	eVTOLSimulationCheckpoint checkpoint = {};
+	checkpoint.header.time = 60000;
+	checkpoint.header.number_of_stations = 1;
+	checkpoint.evtols.resize(2);
+	checkpoint.evtols[1].current_charge = 12.5;
+	checkpoint.evtols[1].random_state = 0x123456789abcdefULL;
+	checkpoint.stations = { 1, 0, 1, 1, 1, 0 };  // eVTOL 1 in bay 0, bay 1 free, none waiting
+
+	std::stringstream image;
+	writeCheckpoint(image, checkpoint);
+	std::string contents = image.str();
+	eVTOLSimulationCheckpoint loaded = readCheckpoint(contents.data(), contents.size());
+	cout << sizeof(eVTOLCheckpointRecord) << "  " << loaded.header.time << "  " << loaded.evtols.size() << "  " << loaded.evtols[1].current_charge;
+	cout << "  " << (loaded.evtols[1].random_state == checkpoint.evtols[1].random_state) << "  " << loaded.stations.size() << endl;
+
+	contents[contents.size() - 3] ^= 1;
+	try { readCheckpoint(contents.data(), contents.size()); }
+	catch (const std::invalid_argument& ia) { cout << ia.what() << endl; }
+}
+
+
+#endif  // EVTOL_CHECKPOINT
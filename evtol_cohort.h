@@ -0,0 +1,379 @@
+#ifndef EVTOL_COHORT
+#define EVTOL_COHORT
+
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <map>
+#include <tuple>
+#include <random>
+#include <algorithm>
+#include <stdexcept>
+
+#include "sim_types.h"
+#include "sim_random.h"
+#include "sim_instrumentation.h"
+#include "evtol.h"
+
+
+// Any number of identical eVTOLs in lockstep: same configuration, same state, same charge, same times and faults.
+// in_bay cohorts hold one bay per member, a cohort WAITING but not in_bay is in the queue, its members side by side.
+struct eVTOLCohort
+{
+	size_t config_index;
+	size_t count;           // 0 once merged into another cohort
+	eVTOLAgentState state;
+	bool in_bay;
+};
+
+
+// Simulates a fleet of eVTOLs, and the one charging station they share, as cohorts of identical eVTOLs.
+// eVTOLFactory clones a handful of prototypes and every eVTOL takes off fully charged, so a large fleet is
+// a few groups of eVTOLs that do exactly the same thing.  A cohort is updated once for all its members,
+// so a timestep is work per cohort rather than per eVTOL.
+// Exactly the fixed timestep engine's rules, a cohort only splits once its members go different ways:
+//   a fault, drawn from a binomial distribution for the whole cohort, splits those that fault from those that don't
+//   landing to find fewer free bays than members splits those given a bay from those that join the queue
+//   a bay coming free part way through a cohort waiting in the queue splits those given a bay from those still waiting
+// After a timestep with splits, cohorts identical again, e.g. once the rest of a cohort has the same faults as those
+// split off, are merged back, except those in the queue, which hold their place.
+// Members are interchangeable, so eVTOLs are only matched to cohorts, in order of configuration, by agentStates().
+// The station's bays and queue are counted in members, so it has the counters of a ChargingStation.
+// Usage:
+//     eVTOLCohortFleet fleet(3, 0.0, RandomSeed(42));
+//     fleet.add(evtol);
+//     fleet.begin();
+//     fleet.timestepUpdate(0, 1000);
+//     fleet.agentStates(agent_states);
+class eVTOLCohortFleet : public SimulationAgent
+{
+public:
+	// max_charge_rate_kw of 0 places no limit on the charge rate of a bay, as with ChargingStation
+	eVTOLCohortFleet(size_t number_of_bays, double max_charge_rate_kw = 0.0, RandomSeed seed = RandomSeed())
+	{
+		if (max_charge_rate_kw < 0.0) throw std::invalid_argument("max_charge_rate_kw must not be negative.");
+		number_of_bays_ = number_of_bays;
+		free_bays_ = number_of_bays;
+		max_charge_rate_ = max_charge_rate_kw / (60.0 * 60.0 * 1000.0);  // converting kW to kWh per millisecond
+		random_engine_.seed(seed);
+		has_begun_ = false;
+		split_since_merge_ = false;
+		max_cohorts_ = 0;
+		splits_ = 0;
+		merges_ = 0;
+		members_waiting_ = 0;
+		counters_ = ChargingStationCounters();
+	}
+
+	// adds an eVTOL in its current state, eVTOLs must be added in order, see agentStates()
+	void add(eVTOL& evtol)
+	{
+		if (has_begun_) throw std::logic_error("eVTOLs cannot be added to a cohort fleet after begin().");
+		size_t config_index = configurationIndex(evtol.configuration());
+		member_configs_.push_back(config_index);
+		eVTOLCohort cohort = { config_index, 1, evtol.agentState(), false };
+		cohorts_.push_back(cohort);
+	}
+
+	// every eVTOL takes off, identical eVTOLs are gathered into cohorts
+	void begin() override
+	{
+		has_begun_ = true;
+		for (auto& cohort : cohorts_) cohort.state.state = eVTOLState::FLYING;
+		merge();
+		max_cohorts_ = cohorts_.size();
+	}
+
+	void timestepUpdate(size_t prev_time, size_t cur_time) override
+	{
+		size_t interval = cur_time - prev_time;
+
+		// the eVTOLs, cohorts split off in this pass are appended and already up to date
+		size_t number_of_cohorts = cohorts_.size();
+		for (size_t c = 0; c < number_of_cohorts; c++)
+		{
+			eVTOLAgentState& state = cohorts_[c].state;
+			if (cohorts_[c].count == 0) continue;
+			if (state.state == eVTOLState::FLYING)
+			{
+				fly(c, interval);
+			}
+			else if (state.state == eVTOLState::WAITING)
+			{
+				state.total_wait_time += interval;
+			}
+			else if (state.state == eVTOLState::CHARGING)
+			{
+				state.total_charge_time += interval;
+			}
+		}
+
+		// the station, cohorts in a bay charge, those fully charged fly off, then the queue takes the free bays
+		for (auto& cohort : cohorts_)
+		{
+			if (cohort.count == 0 || !cohort.in_bay) continue;
+			const eVTOLConfiguration& config = *configurations_[cohort.config_index];
+			cohort.state.current_charge = std::min(cohort.state.current_charge + effectiveChargeRate(config) * interval, config.battery_capacity());
+			if (cohort.state.current_charge == config.battery_capacity())
+			{
+				cohort.state.state = eVTOLState::FLYING;
+				cohort.in_bay = false;
+				free_bays_ += cohort.count;
+				EVTOL_INSTRUMENT(counters_.bays_released += cohort.count);
+			}
+			else
+			{
+				cohort.state.state = eVTOLState::CHARGING;
+			}
+		}
+		while (free_bays_ > 0 && !queue_.empty())
+		{
+			size_t front = queue_.front();
+			if (cohorts_[front].count <= free_bays_)
+			{
+				queue_.pop_front();
+				members_waiting_ -= cohorts_[front].count;
+				occupyBays(front);
+			}
+			else
+			{
+				// the first in the cohort take the free bays, the rest keep their place at the front
+				members_waiting_ -= free_bays_;
+				occupyBays(split(front, free_bays_));
+			}
+		}
+
+		if (split_since_merge_) merge();
+	}
+
+	// Fills agent_states with the state of each eVTOL in the order added.
+	// The members of each configuration's cohorts are handed out, cohort by cohort, to that configuration's eVTOLs in order.
+	void agentStates(std::vector<eVTOLAgentState>& agent_states)
+	{
+		agent_states.resize(member_configs_.size());
+		std::vector<size_t> next_member(configurations_.size(), 0);
+		std::vector<std::vector<size_t>> members(configurations_.size());
+		for (size_t i = 0; i < member_configs_.size(); i++) members[member_configs_[i]].push_back(i);
+		for (auto& cohort : cohorts_)
+		{
+			for (size_t m = 0; m < cohort.count; m++)
+			{
+				agent_states[members[cohort.config_index][next_member[cohort.config_index]++]] = cohort.state;
+			}
+		}
+	}
+
+	size_t size() { return member_configs_.size(); }
+
+	size_t numberOfCohorts() { return cohorts_.size(); }
+
+	// the most cohorts at the end of any timestep
+	size_t maxCohorts() { return max_cohorts_; }
+
+	unsigned long long splits() { return splits_; }
+
+	unsigned long long merges() { return merges_; }
+
+	const std::vector<eVTOLCohort>& cohorts() { return cohorts_; }
+
+	size_t numberWaiting() { return members_waiting_; }
+
+	size_t numberCharging() { return number_of_bays_ - free_bays_; }
+
+	// the station's counters, counted in eVTOLs, all zero when instrumentation is compiled out
+	const ChargingStationCounters& counters() { return counters_; }
+
+private:
+	// the FLYING branch of eVTOL::timestepUpdate for every member of cohort c at once
+	void fly(size_t c, size_t interval)
+	{
+		const eVTOLConfiguration& config = *configurations_[cohorts_[c].config_index];
+		eVTOLAgentState& state = cohorts_[c].state;
+		state.total_flight_time += interval;
+		state.current_charge -= config.energyUsePerMillisecond() * interval;
+
+		size_t faulted = sampleFaults(cohorts_[c].count, config.probFaultPerMillisecond() * interval);
+		size_t sibling = NO_COHORT;
+		if (faulted == cohorts_[c].count)
+		{
+			cohorts_[c].state.number_of_faults++;
+		}
+		else if (faulted > 0)
+		{
+			sibling = split(c, faulted);
+			cohorts_[sibling].state.number_of_faults++;
+		}
+
+		// if low on battery charge, plug into charging station
+		if (cohorts_[c].state.current_charge / config.battery_capacity() * 100.0 < 0.5)
+		{
+			arrive(c);
+			if (sibling != NO_COHORT) arrive(sibling);
+		}
+	}
+
+	// the number of count members that fault, each with the given probability
+	size_t sampleFaults(size_t count, double probability)
+	{
+		if (probability <= 0.0) return 0;
+		if (count == 1)
+		{
+			std::uniform_real_distribution<double> dist(0.0, 1.0);
+			return dist(random_engine_) < probability;
+		}
+		std::binomial_distribution<size_t> dist(count, std::min(probability, 1.0));
+		return dist(random_engine_);
+	}
+
+	// cohort c lands, members take the free bays and the rest join the back of the queue
+	void arrive(size_t c)
+	{
+		cohorts_[c].state.state = eVTOLState::WAITING;
+		EVTOL_INSTRUMENT(counters_.arrivals += cohorts_[c].count);
+		size_t queued = c;
+		if (free_bays_ >= cohorts_[c].count)
+		{
+			occupyBays(c);
+			return;
+		}
+		if (free_bays_ > 0)
+		{
+			queued = split(c, cohorts_[c].count - free_bays_);
+			occupyBays(c);
+		}
+		queue_.push_back(queued);
+		members_waiting_ += cohorts_[queued].count;
+		EVTOL_INSTRUMENT(counters_.max_queue_length = std::max(counters_.max_queue_length, members_waiting_));
+	}
+
+	// the members of cohort c take a bay each
+	void occupyBays(size_t c)
+	{
+		eVTOLCohort& cohort = cohorts_[c];
+		cohort.in_bay = true;
+		free_bays_ -= cohort.count;
+		EVTOL_INSTRUMENT(counters_.bays_assigned += cohort.count);
+		EVTOL_INSTRUMENT(counters_.max_bays_occupied = std::max(counters_.max_bays_occupied, number_of_bays_ - free_bays_));
+	}
+
+	// moves count members of cohort c into a new cohort, appended to the cohorts, and returns it
+	size_t split(size_t c, size_t count)
+	{
+		eVTOLCohort cohort = cohorts_[c];
+		cohort.count = count;
+		cohorts_[c].count -= count;
+		cohorts_.push_back(cohort);
+		split_since_merge_ = true;
+		splits_++;
+		return cohorts_.size() - 1;
+	}
+
+	// merges cohorts that are identical again, other than those queued, and drops empty cohorts
+	void merge()
+	{
+		typedef std::tuple<size_t, int, bool, double, size_t, size_t, size_t, size_t> CohortKey;
+		std::map<CohortKey, size_t> first_with_key;
+		std::vector<bool> queued(cohorts_.size(), false);
+		for (size_t c : queue_) queued[c] = true;
+		for (size_t c = 0; c < cohorts_.size(); c++)
+		{
+			eVTOLCohort& cohort = cohorts_[c];
+			if (cohort.count == 0 || queued[c]) continue;
+			const eVTOLAgentState& s = cohort.state;
+			CohortKey key(cohort.config_index, static_cast<int>(s.state), cohort.in_bay, s.current_charge,
+				s.total_flight_time, s.total_charge_time, s.total_wait_time, s.number_of_faults);
+			auto found = first_with_key.find(key);
+			if (found == first_with_key.end())
+			{
+				first_with_key[key] = c;
+				continue;
+			}
+			cohorts_[found->second].count += cohort.count;
+			cohort.count = 0;
+			merges_++;
+		}
+
+		// compact, keeping the order of the cohorts, and renumber the queue
+		std::vector<size_t> renumbered(cohorts_.size(), NO_COHORT);
+		size_t kept = 0;
+		for (size_t c = 0; c < cohorts_.size(); c++)
+		{
+			if (cohorts_[c].count == 0) continue;
+			renumbered[c] = kept;
+			cohorts_[kept++] = cohorts_[c];
+		}
+		cohorts_.resize(kept);
+		for (size_t& c : queue_) c = renumbered[c];
+		split_since_merge_ = false;
+		max_cohorts_ = std::max(max_cohorts_, cohorts_.size());
+	}
+
+	// the rate a configuration charges at in the station, in kWh per millisecond
+	double effectiveChargeRate(const eVTOLConfiguration& config)
+	{
+		return max_charge_rate_ > 0.0 ? std::min(config.chargeRate(), max_charge_rate_) : config.chargeRate();
+	}
+
+	// returns the index of the configuration in the configuration table, adding it if necessary
+	size_t configurationIndex(const eVTOLConfiguration& config)
+	{
+		for (size_t i = 0; i < configurations_.size(); i++)
+		{
+			if (*configurations_[i] == config) return i;
+		}
+		configurations_.push_back(&config);
+		return configurations_.size() - 1;
+	}
+
+	enum : size_t { NO_COHORT = static_cast<size_t>(-1) };  // a cohort index that is no cohort, e.g. when none split off or one was merged away
+
+	std::vector<const eVTOLConfiguration*> configurations_;  // one entry per distinct configuration, held by the eVTOLs added
+	std::vector<size_t> member_configs_;      // configuration of each eVTOL added, only used by agentStates()
+	std::vector<eVTOLCohort> cohorts_;
+	std::deque<size_t> queue_;                // cohorts waiting for a bay, first in line first
+	size_t members_waiting_;                  // eVTOLs in the queue
+	size_t number_of_bays_;
+	size_t free_bays_;
+	double max_charge_rate_;                  // in kWh per millisecond, 0 for no limit
+	SplitMix64 random_engine_;                // faults of every cohort
+	ChargingStationCounters counters_;
+	size_t max_cohorts_;
+	unsigned long long splits_;
+	unsigned long long merges_;
+	bool split_since_merge_;
+	bool has_begun_;
+};
+
+
+
+void test_eVTOLCohortFleet()
+{
+	using namespace std;
+
+	// a thousand identical eVTOLs and 100 bays, one cohort until they land
+	eVTOLConfiguration config("Alpha Company", 120, 320, 0.60, 1.6, 4, 0.25);
+	eVTOL prototype(config, nullptr);
+	eVTOLCohortFleet fleet(100, 0.0, RandomSeed(42));
+	for (int i = 0; i < 1000; i++) fleet.add(prototype);
+	fleet.begin();
+	cout << fleet.numberOfCohorts() << "  ";
+	for (size_t t = 0; t < 3 * 60 * 60 * 1000; t += 1000)
+	{
+		fleet.timestepUpdate(t, t + 1000);
+	}
+
+	std::vector<eVTOLAgentState> agent_states;
+	fleet.agentStates(agent_states);
+	unsigned long long flight_time = 0;
+	size_t faults = 0;
+	for (auto& state : agent_states)
+	{
+		flight_time += state.total_flight_time;
+		faults += state.number_of_faults;
+	}
+	cout << agent_states.size() << "  " << fleet.numberOfCohorts() << "  " << (fleet.maxCohorts() < 100) << "  " << flight_time / agent_states.size() << "  ";
+	cout << fleet.numberCharging() << "  " << fleet.numberWaiting() << "  " << faults << endl;
+}
+
+
+#endif  // EVTOL_COHORT
@@ -0,0 +1,601 @@
+#ifndef EVTOL_DISTRIBUTED
+#define EVTOL_DISTRIBUTED
+
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <deque>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <stdexcept>
+#include <utility>
+#include <memory>
+
+#include "sim_random.h"
+#include "sim_socket.h"
+#include "evtol_results.h"
+#include "evtol_simulation.h"
+#include "evtol_replication.h"
+#include "evtol_scenario.h"
+
+
+// The messages between a coordinator and its workers, each a SocketConnection message.
+//   worker -> coordinator  HELLO      DistributedHello, once on connecting
+//   coordinator -> worker  WORK       WorkUnitHeader then the unit's parameters as a one scenario binary scenario
+//   worker -> coordinator  HEARTBEAT  nothing, every heartbeat_milliseconds while a unit runs
+//   worker -> coordinator  RESULT     WorkResultsHeader then a CompanyResultsRecord per company
+//   worker -> coordinator  FAILED     WorkUnitHeader then the message of the simulation's exception
+//   coordinator -> worker  DONE       nothing, there is no more work
+// Records are written as they are in memory, so the byte order is checked on HELLO as it is for binary scenarios.
+const uint32_t DISTRIBUTED_HELLO = 1;
+const uint32_t DISTRIBUTED_WORK = 2;
+const uint32_t DISTRIBUTED_HEARTBEAT = 3;
+const uint32_t DISTRIBUTED_RESULT = 4;
+const uint32_t DISTRIBUTED_FAILED = 5;
+const uint32_t DISTRIBUTED_DONE = 6;
+
+const char DISTRIBUTED_MAGIC[8] = { 'E', 'V', 'T', 'O', 'L', 'W', 'R', 'K' };
+const uint32_t DISTRIBUTED_VERSION = 1;
+
+struct DistributedHello
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t scenario_version;  // SCENARIO_BINARY_VERSION, the form work units are sent in
+	uint32_t byte_order;
+	uint32_t reserved;
+};
+
+struct WorkUnitHeader
+{
+	uint64_t unit;
+	uint64_t heartbeat_milliseconds;
+};
+
+struct WorkResultsHeader
+{
+	uint64_t unit;
+	uint32_t number_of_companies;
+	uint32_t reserved;
+	uint64_t checksum;  // of the records
+};
+
+struct CompanyResultsRecord
+{
+	char company[64];  // nul terminated
+	uint64_t count;
+	double avg_flight_time_minutes;
+	double avg_charge_time_minutes;
+	double avg_wait_time_minutes;
+	uint64_t max_faults;
+	uint64_t total_passenger_miles;
+};
+
+
+inline std::string distributedHello()
+{
+	DistributedHello hello = {};
+	std::memcpy(hello.magic, DISTRIBUTED_MAGIC, sizeof(hello.magic));
+	hello.version = DISTRIBUTED_VERSION;
+	hello.scenario_version = SCENARIO_BINARY_VERSION;
+	hello.byte_order = SCENARIO_BINARY_BYTE_ORDER;
+	return std::string(reinterpret_cast<const char*>(&hello), sizeof(hello));
+}
+
+inline bool isDistributedHello(const std::string& payload)
+{
+	DistributedHello hello;
+	if (payload.size() != sizeof(hello)) return false;
+	std::memcpy(&hello, payload.data(), sizeof(hello));
+	return std::memcmp(hello.magic, DISTRIBUTED_MAGIC, sizeof(hello.magic)) == 0 && hello.version == DISTRIBUTED_VERSION &&
+		hello.scenario_version == SCENARIO_BINARY_VERSION && hello.byte_order == SCENARIO_BINARY_BYTE_ORDER;
+}
+
+// the per company results of a unit, some 100 bytes a company
+inline std::string encodeWorkResults(uint64_t unit, const std::vector<eVTOLCompanyResults>& company_results)
+{
+	std::vector<CompanyResultsRecord> records;
+	for (auto& results : company_results)
+	{
+		if (results.company.size() >= sizeof(CompanyResultsRecord().company)) throw std::invalid_argument("company " + results.company + " is too long.");
+		CompanyResultsRecord record = {};
+		std::strncpy(record.company, results.company.c_str(), sizeof(record.company) - 1);
+		record.count = results.count;
+		record.avg_flight_time_minutes = results.avg_flight_time_minutes;
+		record.avg_charge_time_minutes = results.avg_charge_time_minutes;
+		record.avg_wait_time_minutes = results.avg_wait_time_minutes;
+		record.max_faults = results.max_faults;
+		record.total_passenger_miles = results.total_passenger_miles;
+		records.push_back(record);
+	}
+
+	WorkResultsHeader header = {};
+	header.unit = unit;
+	header.number_of_companies = static_cast<uint32_t>(records.size());
+	header.checksum = fnv1a64(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(CompanyResultsRecord));
+	std::string payload(reinterpret_cast<const char*>(&header), sizeof(header));
+	payload.append(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(CompanyResultsRecord));
+	return payload;
+}
+
+// the unit and its per company results, throws std::runtime_error for a payload that isn't one
+inline uint64_t decodeWorkResults(const std::string& payload, std::vector<eVTOLCompanyResults>& company_results)
+{
+	WorkResultsHeader header;
+	if (payload.size() < sizeof(header)) throw std::runtime_error("work results are truncated.");
+	std::memcpy(&header, payload.data(), sizeof(header));
+	const char* data = payload.data() + sizeof(header);
+	if (payload.size() - sizeof(header) != header.number_of_companies * sizeof(CompanyResultsRecord)) throw std::runtime_error("work results are the wrong size.");
+	if (fnv1a64(data, payload.size() - sizeof(header)) != header.checksum) throw std::runtime_error("work results checksum does not match.");
+
+	company_results.resize(header.number_of_companies);
+	for (size_t i = 0; i < company_results.size(); i++)
+	{
+		CompanyResultsRecord record;
+		std::memcpy(&record, data + i * sizeof(record), sizeof(record));
+		record.company[sizeof(record.company) - 1] = '\0';
+		eVTOLCompanyResults& results = company_results[i];
+		results.company = record.company;
+		results.count = static_cast<size_t>(record.count);
+		results.avg_flight_time_minutes = record.avg_flight_time_minutes;
+		results.avg_charge_time_minutes = record.avg_charge_time_minutes;
+		results.avg_wait_time_minutes = record.avg_wait_time_minutes;
+		results.max_faults = static_cast<size_t>(record.max_faults);
+		results.total_passenger_miles = static_cast<size_t>(record.total_passenger_miles);
+	}
+	return header.unit;
+}
+
+
+// How a coordinator serves its workers
+struct eVTOLDistributedOptions
+{
+	eVTOLDistributedOptions()
+	{
+		port = 0;
+		heartbeat_milliseconds = 1000;
+		worker_timeout_milliseconds = 10000;
+		max_unit_attempts = 3;
+	}
+
+	uint16_t port;                        // listened on for workers, 0 picks a free port, see eVTOLDistributedCoordinator::port
+	size_t heartbeat_milliseconds;        // how often a worker running a unit says it is still alive
+	size_t worker_timeout_milliseconds;   // a worker silent this long is lost and its unit is given to another
+	size_t max_unit_attempts;             // a unit whose worker is lost this many times fails the run
+};
+
+
+// Hands simulations out as work units to workers on any number of nodes and gathers their per company results.
+// Each worker connection runs one unit at a time, so a node runs as many at once as it opens connections,
+// and as units are taken as workers free up the run scales with the number of workers while there are units to spare.
+// A worker that disconnects, sends something it shouldn't or is silent for worker_timeout_milliseconds is lost,
+// and the unit it was running goes back to the front of the queue for the next free worker. A unit whose simulation
+// throws is not retried, the same parameters would throw again, and the run fails with the worker's message.
+// Results are returned in the order of the simulations, whichever worker ran each, and as every unit carries its own
+// seed they are exactly those of running the simulations locally.  Workers may connect and leave at any time,
+// runAll waits for as long as it takes some worker to run every unit.
+// Usage:
+//     eVTOLDistributedCoordinator coordinator(options);
+//     eVTOLReplicationRunner runner(parameters, 1000);
+//     runner.run(coordinator.batchRunner());
+//     runner.printResults();
+class eVTOLDistributedCoordinator
+{
+public:
+	explicit eVTOLDistributedCoordinator(const eVTOLDistributedOptions& options = eVTOLDistributedOptions()) : listener_(options.port)
+	{
+		if (options.heartbeat_milliseconds == 0) throw std::invalid_argument("heartbeat_milliseconds must be greater than 0.");
+		if (options.worker_timeout_milliseconds <= options.heartbeat_milliseconds) throw std::invalid_argument("worker_timeout_milliseconds must be greater than heartbeat_milliseconds.");
+		if (options.max_unit_attempts == 0) throw std::invalid_argument("max_unit_attempts must be greater than 0.");
+		options_ = options;
+		stopping_ = false;
+		round_ = 0;
+		results_ = nullptr;
+		completed_ = 0;
+		connected_workers_ = 0;
+		units_reassigned_ = 0;
+		acceptor_ = std::thread(&eVTOLDistributedCoordinator::acceptWorkers, this);
+	}
+
+	eVTOLDistributedCoordinator(const eVTOLDistributedCoordinator&) = delete;
+	eVTOLDistributedCoordinator& operator=(const eVTOLDistributedCoordinator&) = delete;
+
+	// tells the connected workers there is no more work
+	~eVTOLDistributedCoordinator()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stopping_ = true;
+		}
+		work_available_.notify_all();
+		acceptor_.join();
+		for (auto& worker : workers_)
+		{
+			worker.join();
+		}
+	}
+
+	uint16_t port() const { return listener_.port(); }
+
+	// runs every simulation on the workers, the results of each in the order of the simulations
+	std::vector<std::vector<eVTOLCompanyResults> > runAll(const std::vector<eVTOLSimulationParameters>& simulations)
+	{
+		std::vector<std::vector<eVTOLCompanyResults> > results(simulations.size());
+		if (simulations.empty()) return results;
+
+		// each unit is encoded once, up front, which also validates it before any is handed out
+		std::vector<std::string> units(simulations.size());
+		for (size_t unit = 0; unit < simulations.size(); unit++)
+		{
+			WorkUnitHeader header = {};
+			header.unit = unit;
+			header.heartbeat_milliseconds = options_.heartbeat_milliseconds;
+			std::ostringstream out;
+			writeScenariosBinary(out, std::vector<eVTOLSimulationParameters>(1, simulations[unit]));
+			units[unit] = std::string(reinterpret_cast<const char*>(&header), sizeof(header)) + out.str();
+		}
+
+		std::unique_lock<std::mutex> lock(mutex_);
+		round_++;
+		units_.swap(units);
+		results_ = &results;
+		attempts_.assign(simulations.size(), 0);
+		completed_ = 0;
+		error_.clear();
+		pending_.clear();
+		for (size_t unit = 0; unit < simulations.size(); unit++)
+		{
+			pending_.push_back(unit);
+		}
+		work_available_.notify_all();
+		round_done_.wait(lock, [this, &simulations] { return completed_ == simulations.size() || !error_.empty(); });
+
+		// units still running belong to a finished round, their results are dropped
+		round_++;
+		pending_.clear();
+		results_ = nullptr;
+		units_.clear();
+		if (!error_.empty()) throw std::runtime_error(error_);
+		return results;
+	}
+
+	// runAll as a SimulationBatchRunner, for eVTOLReplicationRunner::run and eVTOLParameterSweep::run
+	SimulationBatchRunner batchRunner()
+	{
+		return [this](const std::vector<eVTOLSimulationParameters>& simulations) { return runAll(simulations); };
+	}
+
+	// workers connected now
+	size_t numberOfWorkers()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return connected_workers_;
+	}
+
+	// units given to another worker after theirs was lost, over every runAll
+	size_t unitsReassigned()
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		return units_reassigned_;
+	}
+
+private:
+	void acceptWorkers()
+	{
+		while (!stopping_)
+		{
+			SocketConnection connection;
+			try { connection = listener_.accept(100); }
+			catch (const std::runtime_error&) { continue; }
+			if (!connection.isOpen()) continue;
+			std::lock_guard<std::mutex> lock(mutex_);
+			workers_.push_back(std::thread(&eVTOLDistributedCoordinator::serveWorker, this, std::move(connection)));
+		}
+	}
+
+	// gives the worker one unit at a time until the coordinator stops or the worker is lost
+	void serveWorker(SocketConnection connection)
+	{
+		try
+		{
+			uint32_t type;
+			std::string payload;
+			if (!connection.receiveMessage(type, payload, static_cast<int>(options_.worker_timeout_milliseconds))) return;
+			if (type != DISTRIBUTED_HELLO || !isDistributedHello(payload)) return;
+		}
+		catch (const std::runtime_error&)
+		{
+			return;
+		}
+
+		std::unique_lock<std::mutex> lock(mutex_);
+		connected_workers_++;
+		bool lost = false;
+		while (!lost)
+		{
+			work_available_.wait(lock, [this] { return stopping_ || !pending_.empty(); });
+			if (stopping_) break;
+			size_t unit = pending_.front();
+			pending_.pop_front();
+			attempts_[unit]++;
+			size_t round = round_;
+			std::string work = units_[unit];
+			lock.unlock();
+
+			std::vector<eVTOLCompanyResults> results;
+			std::string failure;
+			try
+			{
+				connection.sendMessage(DISTRIBUTED_WORK, work);
+				lost = !awaitResults(connection, unit, results, failure);
+			}
+			catch (const std::runtime_error&)
+			{
+				lost = true;
+			}
+
+			lock.lock();
+			if (round != round_) continue;
+			if (lost)
+			{
+				// it goes to the front so a lost unit doesn't hold up the end of the round
+				if (attempts_[unit] >= options_.max_unit_attempts)
+				{
+					error_ = "work unit " + std::to_string(unit) + " was lost by " + std::to_string(attempts_[unit]) + " workers.";
+				}
+				else
+				{
+					pending_.push_front(unit);
+					units_reassigned_++;
+					work_available_.notify_one();
+				}
+			}
+			else if (!failure.empty())
+			{
+				error_ = "work unit " + std::to_string(unit) + " failed: " + failure;
+			}
+			else
+			{
+				(*results_)[unit].swap(results);
+				completed_++;
+			}
+			round_done_.notify_all();
+		}
+		connected_workers_--;
+		lock.unlock();
+
+		if (lost) return;
+		try { connection.sendMessage(DISTRIBUTED_DONE, ""); }
+		catch (const std::runtime_error&) {}
+	}
+
+	// false if the worker is lost, or the coordinator stops, before it sends the unit's results or failure
+	bool awaitResults(SocketConnection& connection, size_t unit, std::vector<eVTOLCompanyResults>& results, std::string& failure)
+	{
+		typedef std::chrono::steady_clock Clock;
+		Clock::time_point last_heard = Clock::now();
+		while (!stopping_)
+		{
+			uint32_t type;
+			std::string payload;
+			if (!connection.receiveMessage(type, payload, 100))
+			{
+				if (Clock::now() - last_heard > std::chrono::milliseconds(options_.worker_timeout_milliseconds)) return false;
+				continue;
+			}
+			last_heard = Clock::now();
+			if (type == DISTRIBUTED_HEARTBEAT) continue;
+			if (type == DISTRIBUTED_RESULT) return decodeWorkResults(payload, results) == unit;
+			if (type == DISTRIBUTED_FAILED && payload.size() >= sizeof(WorkUnitHeader))
+			{
+				failure = payload.substr(sizeof(WorkUnitHeader));
+				if (failure.empty()) failure = "unknown error.";
+				return true;
+			}
+			return false;
+		}
+		return false;
+	}
+
+	eVTOLDistributedOptions options_;
+	SocketListener listener_;
+	std::thread acceptor_;
+	std::vector<std::thread> workers_;                        // one per worker connection, guarded by mutex_
+
+	// the round of work, one per runAll, all guarded by mutex_
+	std::mutex mutex_;
+	std::condition_variable work_available_;
+	std::condition_variable round_done_;
+	std::atomic<bool> stopping_;                             // only set with mutex_ held, read without it by acceptWorkers
+	size_t round_;                                           // changes at the start and end of each runAll
+	std::vector<std::string> units_;                         // the WORK messages of the round
+	std::deque<size_t> pending_;                             // units not yet given to a worker
+	std::vector<size_t> attempts_;                           // workers given each unit
+	std::vector<std::vector<eVTOLCompanyResults> >* results_;
+	size_t completed_;
+	std::string error_;                                      // why the round failed, empty while it hasn't
+	size_t connected_workers_;
+	size_t units_reassigned_;
+};
+
+
+// Runs the work units of a coordinator until it has no more.  Each connection to the coordinator runs one unit
+// at a time, so a node with many cores opens many connections.  While a unit runs a heartbeat is sent as often as
+// the coordinator asks, so a long simulation is not mistaken for a lost worker.
+// Usage:
+//     eVTOLDistributedWorker worker("coordinator-host", 5400);
+//     size_t units_run = worker.run();
+class eVTOLDistributedWorker
+{
+public:
+	eVTOLDistributedWorker(const std::string& host, uint16_t port)
+	{
+		host_ = host;
+		port_ = port;
+	}
+
+	// runs units over number_of_connections connections at once, 0 uses one per hardware thread,
+	// returns the number of units run once the coordinator says it is done or goes away
+	size_t run(size_t number_of_connections = 0)
+	{
+		if (number_of_connections == 0) number_of_connections = std::max(1u, std::thread::hardware_concurrency());
+		std::vector<size_t> units_run(number_of_connections, 0);
+		std::vector<std::exception_ptr> errors(number_of_connections);
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < number_of_connections; i++)
+		{
+			threads.push_back(std::thread([this, i, &units_run, &errors] {
+				try { units_run[i] = runConnection(); }
+				catch (...) { errors[i] = std::current_exception(); }
+				}));
+		}
+		size_t total = 0;
+		for (size_t i = 0; i < number_of_connections; i++)
+		{
+			threads[i].join();
+			total += units_run[i];
+		}
+		for (auto& error : errors)
+		{
+			if (error) std::rethrow_exception(error);
+		}
+		return total;
+	}
+
+private:
+	size_t runConnection()
+	{
+		SocketConnection connection = SocketConnection::connect(host_, port_);
+		connection.sendMessage(DISTRIBUTED_HELLO, distributedHello());
+		size_t units_run = 0;
+		try
+		{
+			uint32_t type;
+			std::string payload;
+			while (connection.receiveMessage(type, payload) && type == DISTRIBUTED_WORK)
+			{
+				WorkUnitHeader header = {};
+				if (payload.size() >= sizeof(header)) std::memcpy(&header, payload.data(), sizeof(header));
+
+				// heartbeats go out on their own thread until the unit is finished
+				std::mutex send_mutex;
+				std::condition_variable finished_changed;
+				bool finished = false;
+				std::thread heartbeat([&] {
+					std::unique_lock<std::mutex> lock(send_mutex);
+					while (!finished_changed.wait_for(lock, std::chrono::milliseconds(std::max<uint64_t>(header.heartbeat_milliseconds, 1)), [&finished] { return finished; }))
+					{
+						try { connection.sendMessage(DISTRIBUTED_HEARTBEAT, ""); }
+						catch (const std::runtime_error&) { return; }
+					}
+					});
+
+				std::string reply;
+				uint32_t reply_type = DISTRIBUTED_RESULT;
+				try
+				{
+					if (payload.size() < sizeof(header)) throw std::invalid_argument("work unit is truncated.");
+					std::vector<eVTOLSimulationParameters> scenarios = readScenariosBinary(payload.data() + sizeof(header), payload.size() - sizeof(header));
+					if (scenarios.size() != 1) throw std::invalid_argument("a work unit is a single simulation.");
+					eVTOLSimulation simulation(scenarios[0]);
+					simulation.run();
+					reply = encodeWorkResults(header.unit, simulation.companyResults());
+				}
+				catch (const std::exception& e)
+				{
+					reply_type = DISTRIBUTED_FAILED;
+					reply = std::string(reinterpret_cast<const char*>(&header), sizeof(header)) + e.what();
+				}
+
+				{
+					std::lock_guard<std::mutex> lock(send_mutex);
+					finished = true;
+				}
+				finished_changed.notify_all();
+				heartbeat.join();
+				connection.sendMessage(reply_type, reply);
+				units_run++;
+			}
+		}
+		catch (const std::runtime_error&)
+		{
+			// the coordinator is gone, its units are its own to reassign
+		}
+		return units_run;
+	}
+
+	std::string host_;
+	uint16_t port_;
+};
+
+
+
+void test_eVTOLDistributed()
+{
+	using namespace std;
+
+	eVTOLSimulationParameters parameters;
+	parameters.seed = 1234;
+	parameters.simulation_time_minutes = 60;
+	parameters.number_of_evtols = 20;
+	parameters.engine = SimulationEngine::DISCRETE_EVENT;
+	eVTOLReplicationRunner local(parameters, 12, 2);
+	local.run();
+
+	eVTOLDistributedOptions options;
+	options.heartbeat_milliseconds = 50;
+	options.worker_timeout_milliseconds = 500;
+	std::unique_ptr<eVTOLDistributedCoordinator> coordinator(new eVTOLDistributedCoordinator(options));
+
+	// a worker that takes a unit and vanishes, and one that takes a unit and says nothing until it times out,
+	// both units are run by the workers that connect once they are reassigned
+	auto unreliable_worker = [&coordinator](int silent_milliseconds) {
+		SocketConnection connection = SocketConnection::connect("127.0.0.1", coordinator->port());
+		connection.sendMessage(DISTRIBUTED_HELLO, distributedHello());
+		uint32_t type;
+		std::string payload;
+		connection.receiveMessage(type, payload, 5000);
+		std::this_thread::sleep_for(std::chrono::milliseconds(silent_milliseconds));
+	};
+	std::thread lost(unreliable_worker, 0);
+	std::thread silent(unreliable_worker, 1500);
+	while (coordinator->numberOfWorkers() < 2) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	size_t units_run = 0;
+	std::thread workers([&coordinator, &units_run] {
+		while (coordinator->unitsReassigned() < 2) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		units_run = eVTOLDistributedWorker("127.0.0.1", coordinator->port()).run(2);
+		});
+
+	eVTOLReplicationRunner distributed(parameters, 12);
+	distributed.run(coordinator->batchRunner());
+	cout << (distributed.replicationResults()[11][0].total_passenger_miles == local.replicationResults()[11][0].total_passenger_miles) << "  ";
+	cout << (distributed.companyResults()[2].avg_wait_time_minutes.mean == local.companyResults()[2].avg_wait_time_minutes.mean) << "  ";
+	cout << coordinator->unitsReassigned() << "  ";
+	lost.join();
+	silent.join();
+
+	// a simulation that throws on its worker fails the run, and the workers stay for the next
+	eVTOLSimulationParameters unknown_model = parameters;
+	unknown_model.engine = SimulationEngine::SPECIALIZED;
+	unknown_model.configurations.assign(1, eVTOLConfiguration("Zulu Company", 100, 100, 0.5, 1.5, 2, 0.1));
+	try { coordinator->runAll(std::vector<eVTOLSimulationParameters>(1, unknown_model)); }
+	catch (const std::runtime_error& re) { cout << re.what() << endl; }
+	std::vector<std::vector<eVTOLCompanyResults> > again = coordinator->runAll(std::vector<eVTOLSimulationParameters>(1, distributed.replicationParameters(11)));
+	cout << (again[0][0].total_passenger_miles == local.replicationResults()[11][0].total_passenger_miles) << "  " << coordinator->numberOfWorkers() << "  ";
+	cout << decodeWorkResults(encodeWorkResults(7, again[0]), again[0]) << "  " << again[0].size() << "  ";
+
+	// the workers are told there is no more work when the coordinator goes
+	coordinator.reset();
+	workers.join();
+	cout << units_run << endl;
+}
+
+
+#endif  // EVTOL_DISTRIBUTED
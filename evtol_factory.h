@@ -2,20 +2,26 @@
 #define EVTOL_FACTORY
 
 #include <vector>
-#include <chrono>
 #include <random>
+#include "sim_random.h"
+#include "sim_memory.h"
 #include "evtol.h"
 
 
 // Maintains a list of prototype eVTOLs.
 // Returns a pointer to a heap allocated copy of one of the prototypes selected at random.
+// The factory's seed determines both the sequence of prototypes selected and the seed
+// of each eVTOL created, the n'th eVTOL created is seeded with seed.child(AIRCRAFT).child(n).
+// eVTOLs can instead be created in an ObjectArena, e.g. a whole fleet in a single allocation,
+// either way the same seed gives the same sequence of eVTOLs.
 class eVTOLFactory
 {
 public:
-	eVTOLFactory()
+	eVTOLFactory(RandomSeed seed = RandomSeed())
 	{
-		unsigned seed = std::chrono::steady_clock::now().time_since_epoch().count();
-		random_engine_ = std::default_random_engine(seed);
+		random_engine_.seed(seed.child(RandomStream::FACTORY));
+		evtol_seeds_ = seed.child(RandomStream::AIRCRAFT);
+		number_created_ = 0;
 	}
 
 	void addPrototype(eVTOL evtol)
@@ -26,15 +32,41 @@ public:
 	// pick randomly one of the prototypes and return a copy of it
 	eVTOL* create_eVTOL()
 	{
-		std::uniform_int_distribution<int> uniform_distr(0, prototypes_.size()-1);  // [0,size-1]
-		int index = uniform_distr(random_engine_);
-		eVTOL* evtol = new eVTOL(prototypes_[index]);
+		eVTOL* evtol = new eVTOL(prototypes_[nextPrototype()]);
+		evtol->seed(evtol_seeds_.child(number_created_++));
+		return evtol;
+	}
+
+	// as create_eVTOL() but the copy is constructed in the arena, which owns it
+	eVTOL* create_eVTOL(ObjectArena<eVTOL>& arena)
+	{
+		eVTOL* evtol = arena.create(prototypes_[nextPrototype()]);
+		evtol->seed(evtol_seeds_.child(number_created_++));
 		return evtol;
 	}
 
+	// creates number_of_evtols in the arena, appending them to evtols
+	void create_eVTOLs(size_t number_of_evtols, ObjectArena<eVTOL>& arena, std::vector<eVTOL*>& evtols)
+	{
+		evtols.reserve(evtols.size() + number_of_evtols);
+		while (number_of_evtols-- > 0)
+		{
+			evtols.push_back(create_eVTOL(arena));
+		}
+	}
+
 private:
+	// index of a randomly picked prototype
+	size_t nextPrototype()
+	{
+		std::uniform_int_distribution<int> uniform_distr(0, prototypes_.size()-1);  // [0,size-1]
+		return uniform_distr(random_engine_);
+	}
+
 	std::vector<eVTOL> prototypes_; // list of prototype eVTOLs
-	std::default_random_engine random_engine_;  
+	SplitMix64 random_engine_;
+	RandomSeed evtol_seeds_;        // parent of the seeds of created eVTOLs
+	uint64_t number_created_;
 };
 
 
@@ -54,7 +86,26 @@ void test_eVTOLFactory()
 	{
 		cout << factory.create_eVTOL()->company_name() << endl;
 	}
-	
+
+	// the same seed gives the same eVTOLs whether created on the heap or in an arena
+	eVTOLFactory heap_factory{ RandomSeed(7) };
+	eVTOLFactory arena_factory{ RandomSeed(7) };
+	heap_factory.addPrototype(eVTOL(eVTOLConfiguration("one", 1, 1, 1, 1, 1, 1), &cs));
+	heap_factory.addPrototype(eVTOL(eVTOLConfiguration("two", 1, 1, 1, 1, 1, 1), &cs));
+	arena_factory.addPrototype(eVTOL(eVTOLConfiguration("one", 1, 1, 1, 1, 1, 1), &cs));
+	arena_factory.addPrototype(eVTOL(eVTOLConfiguration("two", 1, 1, 1, 1, 1, 1), &cs));
+	ObjectArena<eVTOL> arena(10);
+	std::vector<eVTOL*> evtols;
+	arena_factory.create_eVTOLs(10, arena, evtols);
+	bool same = true;
+	for (eVTOL* evtol : evtols)
+	{
+		eVTOL* heap_evtol = heap_factory.create_eVTOL();
+		same = same && heap_evtol->company_name() == evtol->company_name() && heap_evtol->didFaultOccur(3600000) == evtol->didFaultOccur(3600000);
+		delete heap_evtol;
+	}
+	cout << evtols.size() << "  " << arena.size() << "  " << same << endl;
+
 }
 
 
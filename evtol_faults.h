@@ -0,0 +1,200 @@
+#ifndef EVTOL_FAULTS
+#define EVTOL_FAULTS
+
+#include <iostream>
+#include <string>
+#include <random>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+#include <cstdint>
+
+#include "sim_random.h"
+
+
+// How an eVTOL updated by timesteps samples its faults, at most one fault per timestep either way.
+//   PER_TIMESTEP - a random number is drawn every timestep flying and compared with an integer threshold,
+//                  the same faults as comparing a uniform double in [0, 1) with the probability of a fault
+//   GEOMETRIC_SKIP - the number of timesteps to the next fault is drawn, geometrically distributed, and counted down,
+//                    a random number is only drawn per fault, or whenever the timestep interval changes.
+//                    The same distribution of faults, but different faults.  The countdown is not checkpointed,
+//                    a resumed run draws it afresh, which as the distribution is memoryless changes no odds,
+//                    but the faults after resuming are not those of the run that was checkpointed.
+enum class FaultSampling
+{
+	PER_TIMESTEP,
+	GEOMETRIC_SKIP
+};
+
+inline std::string faultSamplingName(FaultSampling sampling)
+{
+	return sampling == FaultSampling::GEOMETRIC_SKIP ? "GEOMETRIC_SKIP" : "PER_TIMESTEP";
+}
+
+inline FaultSampling faultSamplingFromName(const std::string& name)
+{
+	if (name == "PER_TIMESTEP") return FaultSampling::PER_TIMESTEP;
+	if (name == "GEOMETRIC_SKIP") return FaultSampling::GEOMETRIC_SKIP;
+	throw std::invalid_argument("unknown fault sampling " + name + ".");
+}
+
+
+// The smallest 64 bit random number that is not a fault, at the given probability of a fault.
+// std::generate_canonical makes a uniform double in [0, 1) from one 64 bit number x as double(x) / 2^64,
+// so it is below probability exactly when double(x) < probability * 2^64, and double(x) only grows with x:
+// there is a threshold below which every x is a fault.  ceil(probability * 2^64) is at or after it,
+// and no more than half the spacing of doubles that size, 2^10, after it, a short binary search finds it.
+// A probability of 1 or more is a fault for every x, the returned threshold is then the largest number there is
+// but always_fault is set, as no threshold is past every 64 bit number.
+inline uint64_t faultThreshold64(double probability, bool& always_fault)
+{
+	always_fault = probability >= 1.0;
+	if (always_fault) return std::numeric_limits<uint64_t>::max();
+	if (!(probability > 0.0)) return 0;
+
+	double limit = std::ldexp(probability, 64);
+	uint64_t high = static_cast<uint64_t>(std::ceil(limit));
+	uint64_t low = high > 2048 ? high - 2048 : 0;
+	while (low < high)
+	{
+		uint64_t middle = low + (high - low) / 2;
+		if (static_cast<double>(middle) < limit) low = middle + 1;
+		else high = middle;
+	}
+	return low;
+}
+
+
+// Samples whether an eVTOL has a fault in each timestep it flies, see FaultSampling.
+// The threshold, or for GEOMETRIC_SKIP the log of the chance of no fault, is worked out once per
+// timestep interval, so a fixed timestep pays for it once, and the random numbers come from the eVTOL's own engine.
+// Usage:
+//     FaultSampler faults(config.probFaultPerMillisecond(), FaultSampling::GEOMETRIC_SKIP);
+//     if (faults.sample(1000, random_engine)) number_of_faults++;
+class FaultSampler
+{
+public:
+	explicit FaultSampler(double prob_fault_per_millisecond = 0.0, FaultSampling sampling = FaultSampling::PER_TIMESTEP)
+	{
+		if (prob_fault_per_millisecond < 0.0) throw std::invalid_argument("prob_fault_per_millisecond must not be negative.");
+		prob_fault_per_millisecond_ = prob_fault_per_millisecond;
+		sampling_ = sampling;
+		interval_ = 0;
+		threshold_ = 0;
+		always_fault_ = false;
+		log_no_fault_ = 0.0;
+		timesteps_to_fault_ = 0;
+	}
+
+	void setSampling(FaultSampling sampling)
+	{
+		sampling_ = sampling;
+		reset();
+	}
+
+	// the countdown to the next fault is drawn afresh at the next sample, as it is on any change of interval,
+	// e.g. when the random engine is reseeded
+	void reset()
+	{
+		interval_ = 0;
+	}
+
+	FaultSampling sampling() const { return sampling_; }
+
+	// true if there is a fault in the timestep of interval_milliseconds
+	bool sample(size_t interval_milliseconds, SplitMix64& random_engine)
+	{
+		if (interval_milliseconds != interval_) setInterval(interval_milliseconds, random_engine);
+		if (sampling_ == FaultSampling::PER_TIMESTEP)
+		{
+			return random_engine() < threshold_ || always_fault_;
+		}
+		if (timesteps_to_fault_ > 0)
+		{
+			timesteps_to_fault_--;
+			return false;
+		}
+		timesteps_to_fault_ = drawTimestepsToFault(random_engine);
+		return true;
+	}
+
+private:
+	void setInterval(size_t interval_milliseconds, SplitMix64& random_engine)
+	{
+		interval_ = interval_milliseconds;
+		double probability = prob_fault_per_millisecond_ * interval_milliseconds;
+		threshold_ = faultThreshold64(probability, always_fault_);
+		if (sampling_ == FaultSampling::GEOMETRIC_SKIP)
+		{
+			log_no_fault_ = always_fault_ ? -std::numeric_limits<double>::infinity() : std::log1p(-probability);
+			timesteps_to_fault_ = drawTimestepsToFault(random_engine);
+		}
+	}
+
+	// the number of timesteps with no fault before the next, by inverting the geometric distribution
+	unsigned long long drawTimestepsToFault(SplitMix64& random_engine)
+	{
+		if (always_fault_) return 0;
+		if (log_no_fault_ == 0.0) return std::numeric_limits<unsigned long long>::max();
+		// uniform in (0, 1], never 0 so its log is finite
+		double u = std::ldexp(static_cast<double>((random_engine() >> 11) + 1), -53);
+		double timesteps = std::floor(std::log(u) / log_no_fault_);
+		if (timesteps >= static_cast<double>(std::numeric_limits<unsigned long long>::max())) return std::numeric_limits<unsigned long long>::max();
+		return static_cast<unsigned long long>(timesteps);
+	}
+
+	double prob_fault_per_millisecond_;
+	FaultSampling sampling_;
+	size_t interval_;                          // the interval the threshold was worked out for, 0 before the first
+	uint64_t threshold_;                       // a fault when a random number is below it
+	bool always_fault_;                        // a fault every timestep, the threshold can't say so
+	double log_no_fault_;                      // GEOMETRIC_SKIP only, log of the chance of no fault in a timestep
+	unsigned long long timesteps_to_fault_;    // GEOMETRIC_SKIP only, timesteps flying with no fault before the next
+};
+
+
+
+void test_FaultSampler()
+{
+	using namespace std;
+
+	// the integer threshold draws exactly the faults of a uniform double, at large, small and boundary probabilities
+	bool same = true;
+	for (double probability : { 0.5, 0.25 / 3600.0, 1.0e-12, std::ldexp(1.0, -60), std::nextafter(1.0, 0.0) })
+	{
+		bool always_fault;
+		uint64_t threshold = faultThreshold64(probability, always_fault);
+		same = same && static_cast<double>(threshold) / 18446744073709551616.0 >= probability;
+		same = same && (threshold == 0 || static_cast<double>(threshold - 1) / 18446744073709551616.0 < probability);
+		SplitMix64 engine(RandomSeed(3)), threshold_engine(RandomSeed(3));
+		std::uniform_real_distribution<double> dist(0.0, 1.0);
+		for (int i = 0; i < 100000; i++) same = same && ((dist(engine) < probability) == (threshold_engine() < threshold));
+	}
+	cout << same << "  ";
+
+	// both samplers fault at the same rate, 0.25 per hour at one second timesteps
+	for (FaultSampling sampling : { FaultSampling::PER_TIMESTEP, FaultSampling::GEOMETRIC_SKIP })
+	{
+		FaultSampler faults(0.25 / 3600000.0, sampling);
+		SplitMix64 engine(RandomSeed(42));
+		size_t number_of_faults = 0;
+		for (size_t t = 0; t < 100000000; t++) number_of_faults += faults.sample(1000, engine);
+		cout << faultSamplingName(faults.sampling()) << ":" << number_of_faults << "  ";
+	}
+
+	FaultSampler always(1.0, FaultSampling::GEOMETRIC_SKIP);
+	FaultSampler never(0.0, FaultSampling::GEOMETRIC_SKIP);
+	SplitMix64 engine(RandomSeed(1));
+	size_t always_faults = 0, never_faults = 0;
+	for (int t = 0; t < 10; t++)
+	{
+		always_faults += always.sample(1000, engine);
+		never_faults += never.sample(1000, engine);
+	}
+	cout << always_faults << never_faults << endl;
+	try { faultSamplingFromName("SOMETIMES"); }
+	catch (const std::invalid_argument& ia) { cout << ia.what() << endl; }
+}
+
+
+#endif  // EVTOL_FAULTS
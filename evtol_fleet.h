@@ -0,0 +1,358 @@
+#ifndef EVTOL_FLEET
+#define EVTOL_FLEET
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <cstdint>
+
+#include "sim_types.h"
+#include "sim_random.h"
+#include "charge_station.h"
+#include "evtol.h"
+#include "evtol_fleet_kernel.h"
+
+
+// Simulates a whole fleet of eVTOLs at once.
+// Behaves exactly as a collection of eVTOL agents but stores the fleet as a structure of arrays,
+// so that each piece of eVTOL state (charge, state, time accumulators, configuration index)
+// is contiguous in memory across the fleet.
+// A single timestep update advances every eVTOL in the fleet with no virtual dispatch.
+// Wait and charge times are updated in one branch free loop the compiler can auto-vectorize,
+// flying eVTOLs are advanced by the SIMD flying kernel of evtol_fleet_kernel.h, which reports
+// those low on battery in a bitmask.  Only those eVTOLs are then visited to plug into the charging station.
+// Faults are drawn from counter based random numbers, stream is the eVTOL index, counter is the timestep count.
+// Each eVTOL is identified by its index in the fleet, in the order it was added.
+// Each distinct eVTOLConfiguration, identified by its eVTOLConfigurationRegistry id, is referred to once.
+// eVTOLs in the fleet are represented to the ChargingStation by a lightweight ChargeableDevice
+// that forwards to the fleet arrays.
+// Given an EventTraceSink, changes of state and faults are recorded to it, an eVTOL's trace id is its index.
+// Faults are found by comparing fault counts after each timestep, a pass over the fleet paid only when traced.
+// Usage:
+//     eVTOLFleet fleet(&charging_station);
+//     fleet.add(eVTOL(alpha_config, &charging_station));
+//     fleet.begin();
+//     fleet.timestepUpdate(0, 1000);
+//     fleet.store(0, evtol);
+class eVTOLFleet : public SimulationAgent
+{
+public:
+	eVTOLFleet(ChargingService* charging_station, RandomSeed seed = RandomSeed())
+	{
+		charging_station_ = charging_station;
+		has_begun_ = false;
+		random_key_ = seed.value32();
+		timestep_count_ = 0;
+		fault_threshold_interval_ = 0;
+		trace_ = nullptr;
+	}
+
+	// adds a copy of the eVTOL, configuration and current state, to the end of the fleet
+	void add(eVTOL evtol)
+	{
+		if (has_begun_) throw std::logic_error("eVTOLs cannot be added to a fleet after begin().");
+
+		size_t config_index = configurationIndex(evtol.configuration());
+		eVTOLAgentState agent_state = evtol.agentState();
+
+		config_index_.push_back(config_index);
+		current_charge_.push_back(agent_state.current_charge);
+		state_.push_back(agent_state.state);
+		total_flight_time_.push_back(agent_state.total_flight_time);
+		total_charge_time_.push_back(agent_state.total_charge_time);
+		total_wait_time_.push_back(agent_state.total_wait_time);
+		number_of_faults_.push_back(agent_state.number_of_faults);
+		energy_use_per_millisecond_.push_back(configurations_[config_index]->energyUsePerMillisecond());
+		low_battery_charge_.push_back(configurations_[config_index]->lowBatteryCharge());
+		fault_threshold_.push_back(0);
+	}
+
+	// reseeds the random numbers used for faults, the same seed always gives the same faults
+	void seed(RandomSeed seed)
+	{
+		random_key_ = seed.value32();
+	}
+
+	// records changes of state and faults to trace, nullptr stops tracing
+	void setTrace(EventTraceSink* trace)
+	{
+		trace_ = trace;
+	}
+
+	// the counter based random numbers used for faults, restoring them carries on the same sequence of faults
+	uint32_t randomKey() { return random_key_; }
+
+	uint32_t timestepCount() { return timestep_count_; }
+
+	void setRandomState(uint32_t random_key, uint32_t timestep_count)
+	{
+		random_key_ = random_key;
+		timestep_count_ = timestep_count;
+	}
+
+	// copies the current state of the eVTOL at index back into an eVTOL
+	void store(size_t index, eVTOL& evtol)
+	{
+		evtol.setAgentState(agentState(index));
+	}
+
+	void begin() override
+	{
+		has_begun_ = true;
+
+		// devices are created once the fleet is complete so their addresses are stable
+		devices_.clear();
+		devices_.reserve(size());
+		for (size_t i = 0; i < size(); i++)
+		{
+			devices_.push_back(FleetDevice(this, i));
+			traceStateChange(i, eVTOLState::FLYING);
+			state_[i] = eVTOLState::FLYING;
+		}
+		if (trace_) traced_faults_ = number_of_faults_;
+		low_battery_mask_.assign((size() + 63) / 64, 0);
+	}
+
+	void timestepUpdate(size_t prev_time, size_t cur_time) override
+	{
+		size_t interval = cur_time - prev_time;
+		size_t count = size();
+		const eVTOLState* state = state_.data();
+		size_t* total_charge_time = total_charge_time_.data();
+		size_t* total_wait_time = total_wait_time_.data();
+
+		// accumulate time waiting and charging
+		// branch free so the compiler can vectorize it
+		for (size_t i = 0; i < count; i++)
+		{
+			size_t charging = state[i] == eVTOLState::CHARGING;
+			size_t waiting = state[i] == eVTOLState::WAITING;
+			total_charge_time[i] += charging * interval;
+			total_wait_time[i] += waiting * interval;
+		}
+
+		// fly, drain batteries and sample faults
+		if (interval != fault_threshold_interval_)
+		{
+			updateFaultThresholds(interval);
+		}
+		std::fill(low_battery_mask_.begin(), low_battery_mask_.end(), 0);
+		FlyingKernelData data;
+		data.count = count;
+		data.state = state_.data();
+		data.energy_use_per_millisecond = energy_use_per_millisecond_.data();
+		data.low_battery_charge = low_battery_charge_.data();
+		data.fault_threshold = fault_threshold_.data();
+		data.current_charge = current_charge_.data();
+		data.total_flight_time = total_flight_time_.data();
+		data.number_of_faults = number_of_faults_.data();
+		data.low_battery_mask = low_battery_mask_.data();
+		flyingKernel(data, interval, random_key_, timestep_count_++);
+		if (trace_) traceFaults();
+
+		// if low on battery charge, plug into charging station
+		for (size_t word = 0; word < low_battery_mask_.size(); word++)
+		{
+			uint64_t bits = low_battery_mask_[word];
+			for (size_t bit = 0; bits != 0; bit++, bits >>= 1)
+			{
+				if ((bits & 1) == 0) continue;
+				size_t i = word * 64 + bit;
+				traceStateChange(i, eVTOLState::WAITING);
+				state_[i] = eVTOLState::WAITING;
+				if (charging_station_)
+				{
+					charging_station_->addDevice(&devices_[i]);
+				}
+			}
+		}
+	}
+
+	size_t size() { return state_.size(); }
+
+	eVTOLState state(size_t index) { return state_[index]; }
+
+	double current_charge(size_t index) { return current_charge_[index]; }
+
+	const eVTOLConfiguration& configuration(size_t index) { return *configurations_[config_index_[index]]; }
+
+	double percentChargeRemaining(size_t index)
+	{
+		return current_charge_[index] / configuration(index).battery_capacity() * 100.0;
+	}
+
+	// replaces the state of the eVTOL at index, e.g. restoring it after begin()
+	void setAgentState(size_t index, const eVTOLAgentState& agent_state)
+	{
+		current_charge_[index] = agent_state.current_charge;
+		state_[index] = agent_state.state;
+		total_flight_time_[index] = agent_state.total_flight_time;
+		total_charge_time_[index] = agent_state.total_charge_time;
+		total_wait_time_[index] = agent_state.total_wait_time;
+		number_of_faults_[index] = agent_state.number_of_faults;
+		if (trace_) traced_faults_[index] = agent_state.number_of_faults;
+	}
+
+	// the ChargeableDevice representing the eVTOL at index to the charging station, available after begin()
+	ChargeableDevice* device(size_t index) { return &devices_[index]; }
+
+	// the fleet's arrays of totals, one entry per eVTOL in order, to read every eVTOL at once with no copies
+	const size_t* totalFlightTimes() { return total_flight_time_.data(); }
+	const size_t* totalChargeTimes() { return total_charge_time_.data(); }
+	const size_t* totalWaitTimes() { return total_wait_time_.data(); }
+	const size_t* numberOfFaults() { return number_of_faults_.data(); }
+
+	eVTOLAgentState agentState(size_t index)
+	{
+		eVTOLAgentState agent_state;
+		agent_state.total_flight_time = total_flight_time_[index];
+		agent_state.total_charge_time = total_charge_time_[index];
+		agent_state.total_wait_time = total_wait_time_[index];
+		agent_state.current_charge = current_charge_[index];
+		agent_state.number_of_faults = number_of_faults_[index];
+		agent_state.state = state_[index];
+		return agent_state;
+	}
+
+private:
+	// Represents a single eVTOL of the fleet to the charging station
+	class FleetDevice : public ChargeableDevice
+	{
+	public:
+		FleetDevice(eVTOLFleet* fleet, size_t index) : fleet_(fleet), index_(index) {}
+
+		void addCharge(double kWh) override { fleet_->addCharge(index_, kWh); }
+
+		double chargeRate() override { return fleet_->configuration(index_).chargeRate(); }
+
+		bool hasFullCharge() override { return fleet_->hasFullCharge(index_); }
+
+		double chargeNeeded() override { return fleet_->configuration(index_).battery_capacity() - fleet_->current_charge_[index_]; }
+
+		uint32_t traceId() override { return static_cast<uint32_t>(index_); }
+
+	private:
+		eVTOLFleet* fleet_;
+		size_t index_;
+	};
+
+	// charge is in kWh
+	void addCharge(size_t index, double charge)
+	{
+		double battery_capacity = configuration(index).battery_capacity();
+		current_charge_[index] = std::min(current_charge_[index] + charge, battery_capacity);
+		eVTOLState new_state = hasFullCharge(index) ? eVTOLState::FLYING : eVTOLState::CHARGING;
+		traceStateChange(index, new_state);
+		state_[index] = new_state;
+	}
+
+	// records a change from the current state of the eVTOL at index to new_state, if traced and the state does change
+	void traceStateChange(size_t index, eVTOLState new_state)
+	{
+		if (!trace_ || new_state == state_[index]) return;
+		trace_->record(TraceEvent::STATE_CHANGE, static_cast<uint32_t>(index), trace_->time(), static_cast<uint8_t>(state_[index]), static_cast<uint8_t>(new_state));
+	}
+
+	// records a fault for every eVTOL whose fault count has gone up since it was last traced
+	void traceFaults()
+	{
+		for (size_t i = 0; i < size(); i++)
+		{
+			for (; traced_faults_[i] < number_of_faults_[i]; traced_faults_[i]++)
+			{
+				trace_->record(TraceEvent::FAULT, static_cast<uint32_t>(i), trace_->time());
+			}
+		}
+	}
+
+	bool hasFullCharge(size_t index)
+	{
+		return current_charge_[index] == configuration(index).battery_capacity();
+	}
+
+	// the probability of a fault during a timestep, as a threshold for counterRandom32(), depends on the timestep interval
+	void updateFaultThresholds(size_t interval_milliseconds)
+	{
+		for (size_t i = 0; i < size(); i++)
+		{
+			fault_threshold_[i] = probabilityThreshold32(configuration(i).probFaultPerMillisecond() * interval_milliseconds);
+		}
+		fault_threshold_interval_ = interval_milliseconds;
+	}
+
+	// returns the index of the configuration in the configuration table, adding it if necessary
+	size_t configurationIndex(const eVTOLConfiguration& config)
+	{
+		for (size_t i = 0; i < configurations_.size(); i++)
+		{
+			if (configurations_[i]->id() == config.id()) return i;
+		}
+		configurations_.push_back(&config);
+		return configurations_.size() - 1;
+	}
+
+	std::vector<const eVTOLConfiguration*> configurations_;  // one entry per distinct configuration, held by the eVTOLConfigurationRegistry
+
+	// one entry per eVTOL
+	std::vector<size_t> config_index_;
+	std::vector<double> current_charge_;              // in kWh
+	std::vector<eVTOLState> state_;
+	std::vector<size_t> total_flight_time_;           // in milliseconds
+	std::vector<size_t> total_charge_time_;           // in milliseconds
+	std::vector<size_t> total_wait_time_;             // in milliseconds
+	std::vector<size_t> number_of_faults_;
+	std::vector<double> energy_use_per_millisecond_;  // copied from configuration so the update loop is contiguous
+	std::vector<double> low_battery_charge_;          // in kWh, charge at 0.5% remaining
+	std::vector<uint32_t> fault_threshold_;           // fault occurs when counterRandom32() < threshold
+	std::vector<FleetDevice> devices_;
+	std::vector<uint64_t> low_battery_mask_;          // one bit per eVTOL, set by the flying kernel
+	std::vector<size_t> traced_faults_;               // traced only, faults already recorded
+
+	ChargingService* charging_station_; // where eVTOLs get their batteries recharged, a station or a network of them
+	uint32_t random_key_;               // key of the counter based random numbers used for faults
+	uint32_t timestep_count_;           // counter of the counter based random numbers used for faults
+	size_t fault_threshold_interval_;   // timestep interval the fault thresholds were computed for
+	EventTraceSink* trace_;             // nullptr when not traced
+	bool has_begun_;
+};
+
+
+
+void test_eVTOLFleet()
+{
+	using namespace std;
+
+	eVTOLConfiguration alpha("Alpha", 120, 320, 0.6, 1.6, 4, 0.0);
+	eVTOLConfiguration beta("Beta", 100, 100, 0.2, 1.5, 5, 0.0);
+	ChargingStation cs(1);
+	eVTOLFleet fleet(&cs);
+	fleet.add(eVTOL(alpha, &cs));
+	fleet.add(eVTOL(beta, &cs));
+	fleet.add(eVTOL(alpha, &cs));
+
+	try { fleet.begin(); fleet.add(eVTOL(alpha, &cs)); }
+	catch (const std::logic_error& le) { cout << le.what() << endl; }
+
+	// fleet should track an individual eVTOL exactly
+	eVTOL vtol(beta, nullptr);
+	vtol.begin();
+	cs.begin();
+	for (size_t t = 0; t < 60 * 60 * 1000; t += 1000)
+	{
+		fleet.timestepUpdate(t, t + 1000);
+		cs.timestepUpdate(t, t + 1000);
+		vtol.timestepUpdate(t, t + 1000);
+		if (vtol.state() == eVTOLState::WAITING) break;
+	}
+	cout << fleet.size() << "  " << fleet.percentChargeRemaining(1) << "  " << vtol.percentChargeRemaining() << endl;
+	cout << fleet.agentState(1).total_flight_time << "  " << vtol.total_flight_time() << endl;
+	cout << (fleet.state(0) == eVTOLState::FLYING) << (fleet.state(1) == eVTOLState::CHARGING) << endl;
+
+	eVTOL stored(alpha, nullptr);
+	fleet.store(0, stored);
+	cout << stored.company_name() << "  " << stored.percentChargeRemaining() << "  " << stored.stateName() << endl;
+}
+
+
+#endif  // EVTOL_FLEET
@@ -0,0 +1,249 @@
+#ifndef EVTOL_FLEET_KERNEL
+#define EVTOL_FLEET_KERNEL
+
+#include <iostream>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#include "sim_random.h"
+#include "evtol.h"
+
+// The kernel is compiled for the best instruction set the compiler has been told it may use,
+// e.g. g++ -mavx2 or MSVC /arch:AVX2 for AVX2, NEON is always available on 64 bit ARM.
+// Define EVTOL_FLEET_KERNEL_SCALAR to force the scalar implementation.
+#if !defined(EVTOL_FLEET_KERNEL_SCALAR) && defined(__AVX2__) && (SIZE_MAX == UINT64_MAX)
+#define EVTOL_FLEET_KERNEL_AVX2
+#include <immintrin.h>
+#elif !defined(EVTOL_FLEET_KERNEL_SCALAR) && (defined(__ARM_NEON) || defined(__aarch64__)) && (SIZE_MAX == UINT64_MAX)
+#define EVTOL_FLEET_KERNEL_NEON
+#include <arm_neon.h>
+#endif
+
+
+// The arrays of an eVTOLFleet that are read and written by the flying kernel.
+// All arrays have count entries except low_battery_mask which has one bit per eVTOL,
+// (count + 63) / 64 words.
+struct FlyingKernelData
+{
+	size_t count;
+	const eVTOLState* state;
+	const double* energy_use_per_millisecond;  // in kWh per millisecond
+	const double* low_battery_charge;          // in kWh
+	const uint32_t* fault_threshold;           // fault occurs when counterRandom32() < threshold
+	double* current_charge;                    // in kWh
+	size_t* total_flight_time;                 // in milliseconds
+	size_t* number_of_faults;
+	uint64_t* low_battery_mask;                // output, bit set for each eVTOL that must now go to WAITING
+};
+
+
+// Advances every FLYING eVTOL of a fleet by one timestep of interval milliseconds.
+// Exactly the FLYING branch of eVTOL::timestepUpdate:  accumulates flight time, drains the battery,
+// samples a fault and checks for low battery, dropping below 0.5% charge remaining.
+// Faults are drawn from the counter based random numbers of sim_random.h,
+// the stream is the eVTOL index and the counter is the timestep count.
+// The scalar, AVX2 and NEON implementations produce identical results.
+// Does not change state, eVTOLs that must transition to WAITING are reported in low_battery_mask.
+inline void flyingKernelScalar(const FlyingKernelData& data, size_t begin, size_t interval, uint32_t random_key, uint32_t random_counter)
+{
+	uint32_t key_term = counterRandomKeyTerm(random_key);
+	uint32_t counter_term = counterRandomCounterTerm(random_counter);
+	for (size_t i = begin; i < data.count; i++)
+	{
+		if (data.state[i] != eVTOLState::FLYING) continue;
+		data.total_flight_time[i] += interval;
+		data.current_charge[i] -= data.energy_use_per_millisecond[i] * interval;
+		uint32_t bits = mix32(mix32(static_cast<uint32_t>(i) ^ key_term) ^ counter_term);
+		data.number_of_faults[i] += bits < data.fault_threshold[i];
+		if (data.current_charge[i] < data.low_battery_charge[i])
+		{
+			data.low_battery_mask[i / 64] |= uint64_t(1) << (i % 64);
+		}
+	}
+}
+
+
+#if defined(EVTOL_FLEET_KERNEL_AVX2)
+
+// 4 lanes of mix32
+inline __m128i mix32x4(__m128i h)
+{
+	h = _mm_xor_si128(h, _mm_srli_epi32(h, 16));
+	h = _mm_mullo_epi32(h, _mm_set1_epi32(static_cast<int>(0x85ebca6bU)));
+	h = _mm_xor_si128(h, _mm_srli_epi32(h, 13));
+	h = _mm_mullo_epi32(h, _mm_set1_epi32(static_cast<int>(0xc2b2ae35U)));
+	h = _mm_xor_si128(h, _mm_srli_epi32(h, 16));
+	return h;
+}
+
+// 4 eVTOLs per instruction, 64 bit lanes for charge and time, 32 bit lanes for state and random numbers
+inline void flyingKernel(const FlyingKernelData& data, size_t interval, uint32_t random_key, uint32_t random_counter)
+{
+	const __m128i flying = _mm_set1_epi32(static_cast<int>(eVTOLState::FLYING));
+	const __m128i sign_bit = _mm_set1_epi32(static_cast<int>(0x80000000U));
+	const __m128i key = _mm_set1_epi32(static_cast<int>(counterRandomKeyTerm(random_key)));
+	const __m128i counter_term = _mm_set1_epi32(static_cast<int>(counterRandomCounterTerm(random_counter)));
+	const __m256i interval_epi64 = _mm256_set1_epi64x(static_cast<long long>(interval));
+	const __m256d interval_pd = _mm256_set1_pd(static_cast<double>(interval));
+	__m128i index = _mm_setr_epi32(0, 1, 2, 3);
+	const __m128i four = _mm_set1_epi32(4);
+
+	size_t i = 0;
+	for (; i + 4 <= data.count; i += 4)
+	{
+		__m128i state = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data.state + i));
+		__m128i is_flying = _mm_cmpeq_epi32(state, flying);
+		__m256i is_flying_epi64 = _mm256_cvtepi32_epi64(is_flying);
+
+		// flight time
+		__m256i flight_time = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data.total_flight_time + i));
+		flight_time = _mm256_add_epi64(flight_time, _mm256_and_si256(is_flying_epi64, interval_epi64));
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(data.total_flight_time + i), flight_time);
+
+		// battery drain
+		__m256d charge = _mm256_loadu_pd(data.current_charge + i);
+		__m256d drain = _mm256_mul_pd(_mm256_loadu_pd(data.energy_use_per_millisecond + i), interval_pd);
+		charge = _mm256_sub_pd(charge, _mm256_and_pd(drain, _mm256_castsi256_pd(is_flying_epi64)));
+		_mm256_storeu_pd(data.current_charge + i, charge);
+
+		// faults, unsigned compare by flipping the sign bit
+		__m128i bits = mix32x4(_mm_xor_si128(mix32x4(_mm_xor_si128(index, key)), counter_term));
+		__m128i threshold = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data.fault_threshold + i));
+		__m128i is_fault = _mm_and_si128(is_flying, _mm_cmpgt_epi32(_mm_xor_si128(threshold, sign_bit), _mm_xor_si128(bits, sign_bit)));
+		__m256i faults = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data.number_of_faults + i));
+		faults = _mm256_sub_epi64(faults, _mm256_cvtepi32_epi64(is_fault));  // true lanes are -1
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(data.number_of_faults + i), faults);
+
+		// low battery
+		__m256d is_low = _mm256_and_pd(_mm256_cmp_pd(charge, _mm256_loadu_pd(data.low_battery_charge + i), _CMP_LT_OQ), _mm256_castsi256_pd(is_flying_epi64));
+		uint64_t low_bits = static_cast<uint64_t>(_mm256_movemask_pd(is_low));
+		data.low_battery_mask[i / 64] |= low_bits << (i % 64);
+
+		index = _mm_add_epi32(index, four);
+	}
+	flyingKernelScalar(data, i, interval, random_key, random_counter);
+}
+
+#elif defined(EVTOL_FLEET_KERNEL_NEON)
+
+// 4 lanes of mix32
+inline uint32x4_t mix32x4(uint32x4_t h)
+{
+	h = veorq_u32(h, vshrq_n_u32(h, 16));
+	h = vmulq_u32(h, vdupq_n_u32(0x85ebca6bU));
+	h = veorq_u32(h, vshrq_n_u32(h, 13));
+	h = vmulq_u32(h, vdupq_n_u32(0xc2b2ae35U));
+	h = veorq_u32(h, vshrq_n_u32(h, 16));
+	return h;
+}
+
+// 4 eVTOLs per iteration, 2 x 64 bit lanes for charge and time, 4 x 32 bit lanes for state and random numbers
+inline void flyingKernel(const FlyingKernelData& data, size_t interval, uint32_t random_key, uint32_t random_counter)
+{
+	const uint32x4_t flying = vdupq_n_u32(static_cast<uint32_t>(eVTOLState::FLYING));
+	const uint32x4_t key = vdupq_n_u32(counterRandomKeyTerm(random_key));
+	const uint32x4_t counter_term = vdupq_n_u32(counterRandomCounterTerm(random_counter));
+	const uint64x2_t interval_u64 = vdupq_n_u64(static_cast<uint64_t>(interval));
+	const float64x2_t interval_f64 = vdupq_n_f64(static_cast<double>(interval));
+	const uint32_t index_init[4] = { 0, 1, 2, 3 };
+	uint32x4_t index = vld1q_u32(index_init);
+	const uint32x4_t four = vdupq_n_u32(4);
+
+	size_t i = 0;
+	for (; i + 4 <= data.count; i += 4)
+	{
+		uint32x4_t is_flying = vceqq_u32(vld1q_u32(reinterpret_cast<const uint32_t*>(data.state + i)), flying);
+		uint64x2_t is_flying_lo = vreinterpretq_u64_s64(vmovl_s32(vreinterpret_s32_u32(vget_low_u32(is_flying))));
+		uint64x2_t is_flying_hi = vreinterpretq_u64_s64(vmovl_s32(vreinterpret_s32_u32(vget_high_u32(is_flying))));
+
+		// flight time
+		uint64_t* flight_time = reinterpret_cast<uint64_t*>(data.total_flight_time + i);
+		vst1q_u64(flight_time, vaddq_u64(vld1q_u64(flight_time), vandq_u64(is_flying_lo, interval_u64)));
+		vst1q_u64(flight_time + 2, vaddq_u64(vld1q_u64(flight_time + 2), vandq_u64(is_flying_hi, interval_u64)));
+
+		// battery drain
+		float64x2_t drain_lo = vmulq_f64(vld1q_f64(data.energy_use_per_millisecond + i), interval_f64);
+		float64x2_t drain_hi = vmulq_f64(vld1q_f64(data.energy_use_per_millisecond + i + 2), interval_f64);
+		drain_lo = vreinterpretq_f64_u64(vandq_u64(vreinterpretq_u64_f64(drain_lo), is_flying_lo));
+		drain_hi = vreinterpretq_f64_u64(vandq_u64(vreinterpretq_u64_f64(drain_hi), is_flying_hi));
+		float64x2_t charge_lo = vsubq_f64(vld1q_f64(data.current_charge + i), drain_lo);
+		float64x2_t charge_hi = vsubq_f64(vld1q_f64(data.current_charge + i + 2), drain_hi);
+		vst1q_f64(data.current_charge + i, charge_lo);
+		vst1q_f64(data.current_charge + i + 2, charge_hi);
+
+		// faults
+		uint32x4_t bits = mix32x4(veorq_u32(mix32x4(veorq_u32(index, key)), counter_term));
+		uint32x4_t is_fault = vandq_u32(is_flying, vcltq_u32(bits, vld1q_u32(data.fault_threshold + i)));
+		uint64_t* faults = reinterpret_cast<uint64_t*>(data.number_of_faults + i);
+		vst1q_u64(faults, vaddq_u64(vld1q_u64(faults), vshrq_n_u64(vreinterpretq_u64_s64(vmovl_s32(vreinterpret_s32_u32(vget_low_u32(is_fault)))), 63)));
+		vst1q_u64(faults + 2, vaddq_u64(vld1q_u64(faults + 2), vshrq_n_u64(vreinterpretq_u64_s64(vmovl_s32(vreinterpret_s32_u32(vget_high_u32(is_fault)))), 63)));
+
+		// low battery
+		uint64x2_t is_low_lo = vandq_u64(vcltq_f64(charge_lo, vld1q_f64(data.low_battery_charge + i)), is_flying_lo);
+		uint64x2_t is_low_hi = vandq_u64(vcltq_f64(charge_hi, vld1q_f64(data.low_battery_charge + i + 2)), is_flying_hi);
+		uint64_t low_bits = (vgetq_lane_u64(is_low_lo, 0) & 1) | ((vgetq_lane_u64(is_low_lo, 1) & 1) << 1)
+			| ((vgetq_lane_u64(is_low_hi, 0) & 1) << 2) | ((vgetq_lane_u64(is_low_hi, 1) & 1) << 3);
+		data.low_battery_mask[i / 64] |= low_bits << (i % 64);
+
+		index = vaddq_u32(index, four);
+	}
+	flyingKernelScalar(data, i, interval, random_key, random_counter);
+}
+
+#else
+
+inline void flyingKernel(const FlyingKernelData& data, size_t interval, uint32_t random_key, uint32_t random_counter)
+{
+	flyingKernelScalar(data, 0, interval, random_key, random_counter);
+}
+
+#endif
+
+
+// returns the name of the instruction set the flying kernel was compiled for
+inline const char* flyingKernelInstructionSet()
+{
+#if defined(EVTOL_FLEET_KERNEL_AVX2)
+	return "AVX2";
+#elif defined(EVTOL_FLEET_KERNEL_NEON)
+	return "NEON";
+#else
+	return "SCALAR";
+#endif
+}
+
+
+
+void test_flyingKernel()
+{
+	using namespace std;
+
+	// a small fleet with a mix of states, run through both the compiled kernel and the scalar kernel
+	const size_t count = 11;
+	std::vector<eVTOLState> state(count, eVTOLState::FLYING);
+	state[1] = eVTOLState::CHARGING;
+	state[6] = eVTOLState::WAITING;
+	std::vector<double> energy_use(count, 0.001);
+	std::vector<double> low_battery(count, 0.5);
+	std::vector<uint32_t> threshold(count, probabilityThreshold32(0.5));
+	std::vector<double> charge(count), charge_scalar(count);
+	for (size_t i = 0; i < count; i++) charge[i] = charge_scalar[i] = 0.5 + i * 0.25;
+	std::vector<size_t> flight(count, 0), flight_scalar(count, 0);
+	std::vector<size_t> faults(count, 0), faults_scalar(count, 0);
+	std::vector<uint64_t> mask(1, 0), mask_scalar(1, 0);
+
+	FlyingKernelData data = { count, state.data(), energy_use.data(), low_battery.data(), threshold.data(), charge.data(), flight.data(), faults.data(), mask.data() };
+	FlyingKernelData data_scalar = { count, state.data(), energy_use.data(), low_battery.data(), threshold.data(), charge_scalar.data(), flight_scalar.data(), faults_scalar.data(), mask_scalar.data() };
+	for (uint32_t step = 0; step < 10; step++)
+	{
+		flyingKernel(data, 1000, 1234, step);
+		flyingKernelScalar(data_scalar, 0, 1000, 1234, step);
+	}
+
+	cout << flyingKernelInstructionSet() << "  " << (charge == charge_scalar) << (flight == flight_scalar) << (faults == faults_scalar) << (mask == mask_scalar) << endl;
+	cout << hex << mask[0] << dec << "  " << flight[0] << "  " << flight[1] << "  " << faults[0] << endl;
+}
+
+
+#endif  // EVTOL_FLEET_KERNEL
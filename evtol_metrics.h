@@ -0,0 +1,351 @@
+#ifndef EVTOL_METRICS
+#define EVTOL_METRICS
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <stdexcept>
+
+#include "sim_socket.h"
+#include "sim_shared_memory.h"
+#include "evtol_results.h"
+
+
+// the most companies a metrics snapshot has room for, and the longest company name it keeps, less its nul
+const size_t METRICS_MAX_COMPANIES = 16;
+const size_t METRICS_COMPANY_NAME_SIZE = 48;
+
+// The totals of every eVTOL of one company, as of a metrics snapshot
+struct eVTOLCompanyMetrics
+{
+	char company[METRICS_COMPANY_NAME_SIZE];   // nul terminated, cut short when longer
+	uint64_t evtols;
+	double flight_time_minutes;
+	double charge_time_minutes;
+	double wait_time_minutes;
+	uint64_t max_faults;                       // most faults of any one eVTOL
+	uint64_t passenger_miles;
+};
+
+// The aggregate state of a running simulation, fixed size and free of pointers so it is copied
+// as it is into shared memory and read by another process built from the same source.
+struct eVTOLMetricsSnapshot
+{
+	uint64_t simulation_time_milliseconds;
+	uint64_t finished;                // 1 for the snapshot taken once the simulation has run to its end
+	uint64_t number_of_bays;          // of every station
+	uint64_t bays_occupied;
+	uint64_t queue_depth;             // eVTOLs waiting for a bay at every station
+	uint64_t number_of_companies;
+	eVTOLCompanyMetrics companies[METRICS_MAX_COMPANIES];   // in order of company name
+};
+
+
+// a snapshot of the station load and per company results, which hold averages, turned back into totals
+inline eVTOLMetricsSnapshot makeMetricsSnapshot(unsigned long long time, bool finished, size_t number_of_bays, size_t bays_occupied, size_t queue_depth,
+	const std::vector<eVTOLCompanyResults>& company_results)
+{
+	if (company_results.size() > METRICS_MAX_COMPANIES) throw std::invalid_argument("metrics have room for " + std::to_string(METRICS_MAX_COMPANIES) + " companies.");
+	eVTOLMetricsSnapshot snapshot;
+	std::memset(&snapshot, 0, sizeof(snapshot));
+	snapshot.simulation_time_milliseconds = time;
+	snapshot.finished = finished;
+	snapshot.number_of_bays = number_of_bays;
+	snapshot.bays_occupied = bays_occupied;
+	snapshot.queue_depth = queue_depth;
+	snapshot.number_of_companies = company_results.size();
+	for (size_t c = 0; c < company_results.size(); c++)
+	{
+		const eVTOLCompanyResults& results = company_results[c];
+		eVTOLCompanyMetrics& metrics = snapshot.companies[c];
+		std::strncpy(metrics.company, results.company.c_str(), METRICS_COMPANY_NAME_SIZE - 1);
+		metrics.evtols = results.count;
+		metrics.flight_time_minutes = results.avg_flight_time_minutes * results.count;
+		metrics.charge_time_minutes = results.avg_charge_time_minutes * results.count;
+		metrics.wait_time_minutes = results.avg_wait_time_minutes * results.count;
+		metrics.max_faults = results.max_faults;
+		metrics.passenger_miles = results.total_passenger_miles;
+	}
+	return snapshot;
+}
+
+
+// writes the snapshot in the Prometheus text exposition format, snapshots is how many have been published
+inline void writePrometheusMetrics(std::ostream& out, const eVTOLMetricsSnapshot& snapshot, uint64_t snapshots)
+{
+	auto metric = [&out](const char* name, const char* type, const char* help) {
+		out << "# HELP " << name << ' ' << help << "\n# TYPE " << name << ' ' << type << '\n';
+	};
+	// label values escape backslashes, quotes and new lines
+	auto label = [](const char* company) {
+		std::string escaped;
+		for (const char* c = company; *c; c++)
+		{
+			if (*c == '\n') { escaped += "\\n"; continue; }
+			if (*c == '"' || *c == '\\') escaped += '\\';
+			escaped += *c;
+		}
+		return "{company=\"" + escaped + "\"}";
+	};
+	size_t companies = static_cast<size_t>(std::min<uint64_t>(snapshot.number_of_companies, METRICS_MAX_COMPANIES));
+
+	out << std::setprecision(15);
+	metric("evtol_metrics_snapshots_total", "counter", "Metrics snapshots published by the simulation.");
+	out << "evtol_metrics_snapshots_total " << snapshots << '\n';
+	metric("evtol_simulation_time_seconds", "gauge", "Simulation time of the latest snapshot.");
+	out << "evtol_simulation_time_seconds " << snapshot.simulation_time_milliseconds / 1000.0 << '\n';
+	metric("evtol_simulation_finished", "gauge", "1 once the simulation has run to its end.");
+	out << "evtol_simulation_finished " << snapshot.finished << '\n';
+	metric("evtol_charging_bays", "gauge", "Charging bays of every station.");
+	out << "evtol_charging_bays " << snapshot.number_of_bays << '\n';
+	metric("evtol_charging_bays_occupied", "gauge", "Charging bays with an eVTOL charging.");
+	out << "evtol_charging_bays_occupied " << snapshot.bays_occupied << '\n';
+	metric("evtol_charging_bay_utilization", "gauge", "Fraction of the charging bays occupied.");
+	out << "evtol_charging_bay_utilization " << (snapshot.number_of_bays ? double(snapshot.bays_occupied) / snapshot.number_of_bays : 0.0) << '\n';
+	metric("evtol_charging_queue_depth", "gauge", "eVTOLs waiting for a charging bay.");
+	out << "evtol_charging_queue_depth " << snapshot.queue_depth << '\n';
+
+	metric("evtol_company_evtols", "gauge", "eVTOLs of the company.");
+	for (size_t c = 0; c < companies; c++) out << "evtol_company_evtols" << label(snapshot.companies[c].company) << ' ' << snapshot.companies[c].evtols << '\n';
+	metric("evtol_company_flight_minutes_total", "counter", "Minutes flown by every eVTOL of the company.");
+	for (size_t c = 0; c < companies; c++) out << "evtol_company_flight_minutes_total" << label(snapshot.companies[c].company) << ' ' << snapshot.companies[c].flight_time_minutes << '\n';
+	metric("evtol_company_charge_minutes_total", "counter", "Minutes charged by every eVTOL of the company.");
+	for (size_t c = 0; c < companies; c++) out << "evtol_company_charge_minutes_total" << label(snapshot.companies[c].company) << ' ' << snapshot.companies[c].charge_time_minutes << '\n';
+	metric("evtol_company_wait_minutes_total", "counter", "Minutes waited for a bay by every eVTOL of the company.");
+	for (size_t c = 0; c < companies; c++) out << "evtol_company_wait_minutes_total" << label(snapshot.companies[c].company) << ' ' << snapshot.companies[c].wait_time_minutes << '\n';
+	metric("evtol_company_max_faults", "gauge", "Most faults of any one eVTOL of the company.");
+	for (size_t c = 0; c < companies; c++) out << "evtol_company_max_faults" << label(snapshot.companies[c].company) << ' ' << snapshot.companies[c].max_faults << '\n';
+	metric("evtol_company_passenger_miles_total", "counter", "Passenger miles flown by every eVTOL of the company.");
+	for (size_t c = 0; c < companies; c++) out << "evtol_company_passenger_miles_total" << label(snapshot.companies[c].company) << ' ' << snapshot.companies[c].passenger_miles << '\n';
+}
+
+
+// Publishes metrics snapshots to a named shared memory region, see SeqlockBuffer.
+// Publishing is a copy of the snapshot into the region, it never waits on readers, so the simulation
+// can publish as often as it likes and any number of readers, in this process or others, see the latest.
+// The region goes with the publisher.
+// Usage:
+//     eVTOLMetricsPublisher publisher("evtol_metrics");
+//     simulation.setMetricsPublisher(60 * 1000, publisher);
+//     simulation.run();
+class eVTOLMetricsPublisher
+{
+public:
+	explicit eVTOLMetricsPublisher(const std::string& name) :
+		region_(SharedMemoryRegion::create(name, SeqlockBuffer<eVTOLMetricsSnapshot>::bytes())),
+		buffer_(region_.data(), true)
+	{
+	}
+
+	void publish(const eVTOLMetricsSnapshot& snapshot)
+	{
+		buffer_.write(snapshot);
+	}
+
+	// how many snapshots have been published
+	uint64_t snapshots() const { return buffer_.writes(); }
+
+	const std::string& name() const { return region_.name(); }
+
+private:
+	SharedMemoryRegion region_;
+	SeqlockBuffer<eVTOLMetricsSnapshot> buffer_;
+};
+
+
+// Reads the latest snapshot of an eVTOLMetricsPublisher, in this process or another, by the name of its region.
+// Usage:
+//     eVTOLMetricsReader reader("evtol_metrics");
+//     eVTOLMetricsSnapshot snapshot;
+//     if (reader.read(snapshot)) writePrometheusMetrics(std::cout, snapshot, reader.snapshots());
+class eVTOLMetricsReader
+{
+public:
+	explicit eVTOLMetricsReader(const std::string& name) :
+		region_(SharedMemoryRegion::open(name)),
+		buffer_(checkedData(region_), false)
+	{
+	}
+
+	// the latest snapshot, false with snapshot untouched when none has been published
+	bool read(eVTOLMetricsSnapshot& snapshot) const
+	{
+		return buffer_.read(snapshot) != 0;
+	}
+
+	uint64_t snapshots() const { return buffer_.writes(); }
+
+private:
+	static void* checkedData(const SharedMemoryRegion& region)
+	{
+		if (region.size() < SeqlockBuffer<eVTOLMetricsSnapshot>::bytes()) throw std::runtime_error("shared memory " + region.name() + " is too small to hold metrics.");
+		return region.data();
+	}
+
+	SharedMemoryRegion region_;
+	SeqlockBuffer<eVTOLMetricsSnapshot> buffer_;
+};
+
+
+// A lightweight HTTP server for Prometheus, on a thread of its own, that answers GET /metrics with the latest
+// snapshot of a metrics region in the text exposition format.  Requests are served one at a time, each read
+// of the region is a copy out of shared memory, so scraping never slows the simulation publishing to it.
+// Anything else is answered 404, before the first snapshot /metrics is answered 503.
+// Usage:
+//     eVTOLMetricsExporter exporter("evtol_metrics", 9464);
+//     ... curl http://localhost:9464/metrics
+class eVTOLMetricsExporter
+{
+public:
+	// a port of 0 listens on any free port, see port()
+	eVTOLMetricsExporter(const std::string& name, uint16_t port) :
+		reader_(name),
+		listener_(port),
+		stopping_(false),
+		requests_served_(0)
+	{
+		thread_ = std::thread([this]() { serveRequests(); });
+	}
+
+	eVTOLMetricsExporter(const eVTOLMetricsExporter&) = delete;
+	eVTOLMetricsExporter& operator=(const eVTOLMetricsExporter&) = delete;
+
+	~eVTOLMetricsExporter()
+	{
+		stopping_ = true;
+		thread_.join();
+	}
+
+	uint16_t port() const { return listener_.port(); }
+
+	unsigned long long requestsServed() const { return requests_served_.load(); }
+
+private:
+	// how long to wait for a client to send its request, and the most of it that is read
+	static const int REQUEST_TIMEOUT_MILLISECONDS = 1000;
+	static const size_t MAX_REQUEST_BYTES = 8192;
+
+	void serveRequests()
+	{
+		while (!stopping_)
+		{
+			SocketConnection connection = listener_.accept(100);
+			if (!connection.isOpen()) continue;
+			// a client that goes away part way through is its own problem
+			try { serve(connection); }
+			catch (const std::runtime_error&) {}
+		}
+	}
+
+	void serve(SocketConnection& connection)
+	{
+		std::string request;
+		while (request.find("\r\n\r\n") == std::string::npos && request.size() < MAX_REQUEST_BYTES)
+		{
+			if (!connection.receiveBytes(request, REQUEST_TIMEOUT_MILLISECONDS)) return;
+		}
+
+		// the request line is METHOD PATH VERSION, the query is ignored
+		std::istringstream request_line(request.substr(0, request.find("\r\n")));
+		std::string method, path;
+		request_line >> method >> path;
+		path = path.substr(0, path.find('?'));
+
+		eVTOLMetricsSnapshot snapshot;
+		if (method != "GET" || path != "/metrics")
+		{
+			respond(connection, "404 Not Found", "not found, metrics are at /metrics\n");
+		}
+		else if (!reader_.read(snapshot))
+		{
+			respond(connection, "503 Service Unavailable", "no metrics have been published yet\n");
+		}
+		else
+		{
+			std::ostringstream body;
+			writePrometheusMetrics(body, snapshot, reader_.snapshots());
+			respond(connection, "200 OK", body.str());
+		}
+		requests_served_++;
+	}
+
+	static void respond(SocketConnection& connection, const std::string& status, const std::string& body)
+	{
+		std::ostringstream response;
+		response << "HTTP/1.0 " << status << "\r\n";
+		response << "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n";
+		response << "Content-Length: " << body.size() << "\r\n";
+		response << "Connection: close\r\n\r\n";
+		connection.sendBytes(response.str() + body);
+	}
+
+	eVTOLMetricsReader reader_;
+	SocketListener listener_;
+	std::atomic<bool> stopping_;
+	std::atomic<unsigned long long> requests_served_;
+	std::thread thread_;
+};
+
+
+
+void test_eVTOLMetrics()
+{
+	using namespace std;
+
+	// a whole response, the exporter closes the connection once it has answered
+	auto http_get = [](uint16_t port, const std::string& path) {
+		SocketConnection connection = SocketConnection::connect("127.0.0.1", port);
+		connection.sendBytes("GET " + path + " HTTP/1.0\r\n\r\n");
+		std::string response;
+		try { while (connection.receiveBytes(response, 1000)) {} }
+		catch (const std::runtime_error&) {}
+		return response;
+	};
+
+	eVTOLMetricsPublisher publisher("evtol_test_metrics");
+	eVTOLMetricsExporter exporter("evtol_test_metrics", 0);
+	cout << http_get(exporter.port(), "/metrics").substr(0, 12) << "  ";
+
+	std::vector<eVTOLCompanyResults> results(2);
+	results[0].company = "Alpha \"A\" Company";
+	results[0].count = 4;
+	results[0].avg_flight_time_minutes = 30;
+	results[0].avg_charge_time_minutes = 10;
+	results[0].avg_wait_time_minutes = 2.5;
+	results[0].max_faults = 1;
+	results[0].total_passenger_miles = 480;
+	results[1] = results[0];
+	results[1].company = "Beta Company";
+	publisher.publish(makeMetricsSnapshot(90 * 1000, false, 3, 2, 5, results));
+	publisher.publish(makeMetricsSnapshot(120 * 1000, false, 3, 3, 6, results));
+
+	// the second snapshot, a few of its lines
+	eVTOLMetricsReader reader("evtol_test_metrics");
+	eVTOLMetricsSnapshot snapshot;
+	cout << reader.read(snapshot) << " " << snapshot.queue_depth << " " << snapshot.companies[1].company << "  ";
+	std::string response = http_get(exporter.port(), "/metrics");
+	std::istringstream lines(response);
+	std::string line;
+	cout << response.substr(0, 15) << "  ";
+	while (std::getline(lines, line))
+	{
+		if (line == "evtol_metrics_snapshots_total 2" || line == "evtol_charging_bay_utilization 1" || line == "evtol_charging_queue_depth 6" ||
+			line == "evtol_company_wait_minutes_total{company=\"Alpha \\\"A\\\" Company\"} 10") cout << line << "  ";
+	}
+	cout << http_get(exporter.port(), "/other").substr(0, 12) << "  " << exporter.requestsServed() << endl;
+
+	try { makeMetricsSnapshot(0, false, 1, 0, 0, std::vector<eVTOLCompanyResults>(17)); }
+	catch (const std::invalid_argument& ia) { cout << ia.what() << endl; }
+	try { eVTOLMetricsReader missing("evtol_test_no_metrics"); }
+	catch (const std::runtime_error& re) { cout << re.what() << endl; }
+}
+
+
+#endif  // EVTOL_METRICS
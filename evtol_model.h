@@ -0,0 +1,382 @@
+#ifndef EVTOL_MODEL
+#define EVTOL_MODEL
+
+#include <iostream>
+#include <vector>
+#include <tuple>
+#include <utility>
+#include <algorithm>
+#include <random>
+#include <type_traits>
+#include <stdexcept>
+#include <cstdint>
+
+#include "sim_types.h"
+#include "sim_random.h"
+#include "evtol.h"
+
+
+// The constants of an eVTOL model known at compile time, derived from a parameter set such as
+//     struct AlphaCompanyModel
+//     {
+//         static constexpr const char* company_name() { return "Alpha Company"; }
+//         static constexpr double cruise_speed() { return 120; }          // in mph
+//         static constexpr double battery_capacity() { return 320; }      // in kWh
+//         static constexpr double time_to_charge() { return 0.60; }       // in hours
+//         static constexpr double energy_use_at_cruise() { return 1.6; }  // in kWh/mile
+//         static constexpr size_t passenger_count() { return 4; }
+//         static constexpr double prob_fault_per_hour() { return 0.25; }
+//     };
+// The derived constants are worked out exactly as eVTOLConfiguration works them out, so are the same doubles.
+// Usage:
+//     eVTOLConfiguration alpha_config = eVTOLModel<AlphaCompanyModel>::configuration();
+//     double charge_rate = eVTOLModel<AlphaCompanyModel>::chargeRate();
+template <typename Parameters>
+struct eVTOLModel
+{
+	// in kWh/ms
+	static constexpr double chargeRate() { return Parameters::battery_capacity() / (Parameters::time_to_charge() * 60.0 * 60.0 * 1000.0); }
+
+	// in kWh/ms
+	static constexpr double energyUsePerMillisecond() { return Parameters::energy_use_at_cruise() * Parameters::cruise_speed() / (60.0 * 60.0 * 1000.0); }
+
+	static constexpr double probFaultPerMillisecond() { return Parameters::prob_fault_per_hour() / (60.0 * 60.0 * 1000.0); }
+
+	static constexpr double batteryCapacity() { return Parameters::battery_capacity(); }
+
+	// the same, validated, configuration at run time
+	static eVTOLConfiguration configuration()
+	{
+		return eVTOLConfiguration(Parameters::company_name(), Parameters::cruise_speed(), Parameters::battery_capacity(),
+			Parameters::time_to_charge(), Parameters::energy_use_at_cruise(), Parameters::passenger_count(), Parameters::prob_fault_per_hour());
+	}
+};
+
+
+// An eVTOL of a model fixed at compile time, behaves exactly as an eVTOL of the same configuration
+// updated by fixed timesteps, and draws the same faults given the same random state and FaultSampler.
+// Its update is not virtual and every constant of the model is known to the compiler, so a loop over
+// many of them is inlined and constant folded.  Only the charging station calls it through ChargeableDevice.
+// Arriving at the station goes through the fleet, see eVTOLModelFleet, which keeps the order of arrivals.
+// Not traced, not event driven.
+// Usage:
+//     eVTOLModelAircraft<AlphaCompanyModel> aircraft(index, evtol);
+//     if (aircraft.update(interval)) charging_station.addDevice(&aircraft);
+template <typename Parameters>
+class eVTOLModelAircraft final : public ChargeableDevice
+{
+public:
+	typedef eVTOLModel<Parameters> Model;
+
+	// takes over the state and random state of the eVTOL, index is its order in the fleet
+	eVTOLModelAircraft(size_t index, eVTOL& evtol)
+	{
+		index_ = index;
+		eVTOLAgentState agent_state = evtol.agentState();
+		total_flight_time_ = agent_state.total_flight_time;
+		total_charge_time_ = agent_state.total_charge_time;
+		total_wait_time_ = agent_state.total_wait_time;
+		current_charge_ = agent_state.current_charge;
+		number_of_faults_ = agent_state.number_of_faults;
+		state_ = agent_state.state;
+		random_engine_.setState(evtol.randomState());
+		fault_sampler_ = evtol.faultSampler();
+	}
+
+	void begin()
+	{
+		state_ = eVTOLState::FLYING;
+	}
+
+	// advances the eVTOL by one timestep of interval milliseconds, true when it has just run low and needs a charging bay
+	bool update(size_t interval)
+	{
+		if (state_ == eVTOLState::FLYING)
+		{
+			total_flight_time_ += interval;
+			current_charge_ -= Model::energyUsePerMillisecond() * interval;
+			if (fault_sampler_.sample(interval, random_engine_)) number_of_faults_++;
+			if (current_charge_ / Model::batteryCapacity() * 100.0 < 0.5)
+			{
+				state_ = eVTOLState::WAITING;
+				return true;
+			}
+		}
+		else if (state_ == eVTOLState::WAITING)
+		{
+			total_wait_time_ += interval;
+		}
+		else if (state_ == eVTOLState::CHARGING)
+		{
+			total_charge_time_ += interval;
+			if (current_charge_ == Model::batteryCapacity()) state_ = eVTOLState::FLYING;
+		}
+		else
+		{
+			throw std::logic_error("VTOL in a bad state.");
+		}
+		return false;
+	}
+
+	void addCharge(double charge) override
+	{
+		current_charge_ = std::min(current_charge_ + charge, Model::batteryCapacity());
+		state_ = current_charge_ == Model::batteryCapacity() ? eVTOLState::FLYING : eVTOLState::CHARGING;
+	}
+
+	double chargeRate() override { return Model::chargeRate(); }
+
+	bool hasFullCharge() override { return current_charge_ == Model::batteryCapacity(); }
+
+	double chargeNeeded() override { return Model::batteryCapacity() - current_charge_; }
+
+	size_t index() const { return index_; }
+
+	eVTOLAgentState agentState() const
+	{
+		eVTOLAgentState agent_state;
+		agent_state.total_flight_time = total_flight_time_;
+		agent_state.total_charge_time = total_charge_time_;
+		agent_state.total_wait_time = total_wait_time_;
+		agent_state.current_charge = current_charge_;
+		agent_state.number_of_faults = number_of_faults_;
+		agent_state.state = state_;
+		return agent_state;
+	}
+
+	// copies the state and random state back to the eVTOL
+	void store(eVTOL& evtol) const
+	{
+		evtol.setAgentState(agentState());
+		evtol.setRandomState(random_engine_.state());
+	}
+
+private:
+	size_t index_;              // order in the fleet
+	size_t total_flight_time_;  // in milliseconds
+	size_t total_charge_time_;  // in milliseconds
+	size_t total_wait_time_;    // in milliseconds
+	double current_charge_;     // in kWh
+	size_t number_of_faults_;
+	eVTOLState state_;
+	SplitMix64 random_engine_;
+	FaultSampler fault_sampler_;   // the eVTOL's, draws from random_engine_
+};
+
+
+// A fleet of eVTOLs of models fixed at compile time, held as a tuple of vectors, one vector per model,
+// so each model is updated by its own loop with no virtual dispatch and the model's constants folded in.
+// Behaves exactly as the same eVTOLs updated one after another in their order in the fleet:
+// eVTOLs low on battery are handed to the charging station in fleet order, whatever model they are.
+// Only eVTOLs whose configuration is that of one of the models can be added.
+// The charging station holds pointers into the vectors, so nothing is added after begin().
+// Usage:
+//     eVTOLModelFleet<AlphaCompanyModel, BetaCompanyModel> fleet(&charging_station);
+//     fleet.add(evtol);
+//     fleet.begin();
+//     fleet.timestepUpdate(0, 1000);
+//     fleet.store(0, evtol);
+template <typename... Models>
+class eVTOLModelFleet : public SimulationAgent
+{
+public:
+	explicit eVTOLModelFleet(ChargingService* charging_station)
+	{
+		charging_station_ = charging_station;
+		has_begun_ = false;
+		configurations_ = { eVTOLModel<Models>::configuration()... };
+	}
+
+	static bool hasModel(const eVTOLConfiguration& config)
+	{
+		std::vector<eVTOLConfiguration> configurations = { eVTOLModel<Models>::configuration()... };
+		return std::find(configurations.begin(), configurations.end(), config) != configurations.end();
+	}
+
+	// adds a copy of the eVTOL, state and random state, to the end of the fleet
+	void add(eVTOL& evtol)
+	{
+		if (has_begun_) throw std::logic_error("eVTOLs cannot be added to a fleet after begin().");
+		size_t model = std::find(configurations_.begin(), configurations_.end(), evtol.configuration()) - configurations_.begin();
+		if (model == configurations_.size()) throw std::invalid_argument("the eVTOL's configuration is not one of the fleet's models.");
+		locations_.push_back(Location{ static_cast<uint32_t>(model), static_cast<uint32_t>(addTo(ModelTag<0>(), model, evtol)) });
+	}
+
+	void begin() override
+	{
+		has_begun_ = true;
+		arrivals_.reserve(locations_.size());
+		beginModels(ModelTag<0>());
+	}
+
+	void timestepUpdate(size_t prev_time, size_t cur_time) override
+	{
+		updateModels(ModelTag<0>(), cur_time - prev_time);
+		// in fleet order, as a serial update would have them arrive
+		std::sort(arrivals_.begin(), arrivals_.end());
+		for (auto& arrival : arrivals_)
+		{
+			charging_station_->addDevice(arrival.second);
+		}
+		arrivals_.clear();
+	}
+
+	size_t size() const { return locations_.size(); }
+
+	// the number of eVTOLs of the model, the position of the model in Models
+	template <size_t Model>
+	size_t numberOfModel() const { return std::get<Model>(aircraft_).size(); }
+
+	// index is the eVTOL's order in the fleet
+	eVTOLAgentState agentState(size_t index) const
+	{
+		const Location& location = locations_.at(index);
+		return agentStateOf(ModelTag<0>(), location.model, location.position);
+	}
+
+	// copies the state of the eVTOL at index back to evtol
+	void store(size_t index, eVTOL& evtol) const
+	{
+		const Location& location = locations_.at(index);
+		storeTo(ModelTag<0>(), location.model, location.position, evtol);
+	}
+
+private:
+	// where in aircraft_ an eVTOL in fleet order is
+	struct Location
+	{
+		uint32_t model;
+		uint32_t position;
+	};
+
+	// each of the functions below walks the models from ModelTag<0>, the overload for one past the last model ends the walk
+	template <size_t Model>
+	struct ModelTag {};
+
+	typedef ModelTag<sizeof...(Models)> EndTag;
+
+	size_t addTo(EndTag, size_t, eVTOL&) { throw std::logic_error("no such model."); }
+
+	template <size_t Model>
+	size_t addTo(ModelTag<Model>, size_t model, eVTOL& evtol)
+	{
+		if (model != Model) return addTo(ModelTag<Model + 1>(), model, evtol);
+		std::get<Model>(aircraft_).emplace_back(locations_.size(), evtol);
+		return std::get<Model>(aircraft_).size() - 1;
+	}
+
+	void beginModels(EndTag) {}
+
+	template <size_t Model>
+	void beginModels(ModelTag<Model>)
+	{
+		for (auto& aircraft : std::get<Model>(aircraft_)) aircraft.begin();
+		beginModels(ModelTag<Model + 1>());
+	}
+
+	void updateModels(EndTag, size_t) {}
+
+	template <size_t Model>
+	void updateModels(ModelTag<Model>, size_t interval)
+	{
+		for (auto& aircraft : std::get<Model>(aircraft_))
+		{
+			if (aircraft.update(interval)) arrivals_.push_back(std::make_pair(aircraft.index(), &aircraft));
+		}
+		updateModels(ModelTag<Model + 1>(), interval);
+	}
+
+	eVTOLAgentState agentStateOf(EndTag, size_t, size_t) const { throw std::logic_error("no such model."); }
+
+	template <size_t Model>
+	eVTOLAgentState agentStateOf(ModelTag<Model>, size_t model, size_t position) const
+	{
+		if (model != Model) return agentStateOf(ModelTag<Model + 1>(), model, position);
+		return std::get<Model>(aircraft_)[position].agentState();
+	}
+
+	void storeTo(EndTag, size_t, size_t, eVTOL&) const { throw std::logic_error("no such model."); }
+
+	template <size_t Model>
+	void storeTo(ModelTag<Model>, size_t model, size_t position, eVTOL& evtol) const
+	{
+		if (model != Model) return storeTo(ModelTag<Model + 1>(), model, position, evtol);
+		std::get<Model>(aircraft_)[position].store(evtol);
+	}
+
+	ChargingService* charging_station_;
+	bool has_begun_;
+	std::vector<eVTOLConfiguration> configurations_;   // of each model, in order
+	std::tuple<std::vector<eVTOLModelAircraft<Models> >...> aircraft_;
+	std::vector<Location> locations_;                  // in fleet order
+	std::vector<std::pair<size_t, ChargeableDevice*> > arrivals_;   // low on battery this timestep, by fleet order
+};
+
+
+
+void test_eVTOLModelFleet()
+{
+	using namespace std;
+
+	struct TestModel
+	{
+		static constexpr const char* company_name() { return "Test Company"; }
+		static constexpr double cruise_speed() { return 120; }
+		static constexpr double battery_capacity() { return 320; }
+		static constexpr double time_to_charge() { return 0.60; }
+		static constexpr double energy_use_at_cruise() { return 1.6; }
+		static constexpr size_t passenger_count() { return 4; }
+		static constexpr double prob_fault_per_hour() { return 0.25; }
+	};
+	struct FaultyTestModel
+	{
+		static constexpr const char* company_name() { return "Faulty Test Company"; }
+		static constexpr double cruise_speed() { return 100; }
+		static constexpr double battery_capacity() { return 100; }
+		static constexpr double time_to_charge() { return 0.20; }
+		static constexpr double energy_use_at_cruise() { return 1.5; }
+		static constexpr size_t passenger_count() { return 5; }
+		static constexpr double prob_fault_per_hour() { return 1.0; }
+	};
+	static_assert(eVTOLModel<TestModel>::chargeRate() > 0.0, "the model's constants are known at compile time");
+	eVTOLConfiguration test_config = eVTOLModel<TestModel>::configuration();
+	eVTOLConfiguration faulty_config = eVTOLModel<FaultyTestModel>::configuration();
+	cout << (test_config.chargeRate() == eVTOLModel<TestModel>::chargeRate()) << "  ";
+
+	// the same eVTOLs as a fleet of models and as eVTOLs, sharing a station with one bay, end up the same
+	ChargingStation station(1);
+	ChargingStation model_station(1);
+	std::vector<eVTOL> evtols;
+	for (int i = 0; i < 4; i++) evtols.push_back(eVTOL(i % 2 ? faulty_config : test_config, &station, RandomSeed(7).child(i)));
+	eVTOLModelFleet<TestModel, FaultyTestModel> fleet(&model_station);
+	for (auto& evtol : evtols) fleet.add(evtol);
+	for (auto& evtol : evtols) evtol.begin();
+	fleet.begin();
+	station.begin();
+	model_station.begin();
+	for (size_t t = 0; t < 4 * 60 * 60; t++)
+	{
+		for (auto& evtol : evtols) evtol.timestepUpdate(t * 1000, t * 1000 + 1000);
+		station.timestepUpdate(t * 1000, t * 1000 + 1000);
+		fleet.timestepUpdate(t * 1000, t * 1000 + 1000);
+		model_station.timestepUpdate(t * 1000, t * 1000 + 1000);
+	}
+	bool same = true;
+	for (size_t i = 0; i < evtols.size(); i++)
+	{
+		eVTOLAgentState a = evtols[i].agentState(), b = fleet.agentState(i);
+		same = same && a.total_flight_time == b.total_flight_time && a.total_wait_time == b.total_wait_time &&
+			a.total_charge_time == b.total_charge_time && a.current_charge == b.current_charge && a.number_of_faults == b.number_of_faults && a.state == b.state;
+	}
+	cout << fleet.size() << fleet.numberOfModel<0>() << fleet.numberOfModel<1>() << "  " << same << "  " << fleet.agentState(1).number_of_faults << endl;
+
+	eVTOLConfiguration other_config("Other Company", 120, 320, 0.60, 1.6, 4, 0.25);
+	eVTOL other(other_config, nullptr);
+	eVTOLModelFleet<TestModel> other_fleet(nullptr);
+	cout << eVTOLModelFleet<TestModel>::hasModel(test_config) << eVTOLModelFleet<TestModel>::hasModel(other_config) << "  ";
+	try { other_fleet.add(other); }
+	catch (const std::invalid_argument& ia) { cout << ia.what() << endl; }
+}
+
+
+#endif  // EVTOL_MODEL
@@ -0,0 +1,311 @@
+#ifndef EVTOL_REGIONS
+#define EVTOL_REGIONS
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <random>
+#include <algorithm>
+#include <stdexcept>
+
+#include "sim_types.h"
+#include "sim_random.h"
+#include "sim_thread_pool.h"
+#include "sim_instrumentation.h"
+#include "charge_network.h"
+#include "evtol.h"
+#include "evtol_faults.h"
+
+
+// An eVTOL that flew a leg ending in another region, posted by the region it left to the one it lands in
+struct eVTOLMigration
+{
+	size_t evtol;          // index of the eVTOL in the fleet
+	size_t destination;    // region it lands in
+};
+
+
+// One region of an eVTOLRegionalFleet: its own charging stations and the eVTOLs in it.
+// An eVTOL in the region hands itself to the region when low on battery.  Its leg ended in the region,
+// and it goes to one of the region's stations, or with the cross region leg probability the leg ended in another
+// region, picked at random, and it is posted to the outbox for that region rather than charged here.
+// The region's random numbers are its own and drawn in the order of its eVTOLs, so the legs of a region don't
+// depend on how many threads update the regions.  Regions share nothing while they update.
+// Usage:
+//     eVTOLRegion region(RandomSeed(42), 0, 4, 0.1);
+//     region.network().addStation(3);
+//     region.addMember(evtol, 0);
+//     region.updateMembers(evtols, prev_time, cur_time);
+//     for (auto& migration : region.outbox()) ...
+class eVTOLRegion : public ChargingService
+{
+public:
+	eVTOLRegion(RandomSeed seed, size_t region_index, size_t number_of_regions, double cross_region_leg_probability)
+	{
+		if (cross_region_leg_probability < 0.0 || cross_region_leg_probability > 1.0) throw std::invalid_argument("cross_region_leg_probability must be between 0 and 1.");
+		random_engine_.seed(seed);
+		region_index_ = region_index;
+		number_of_regions_ = number_of_regions;
+		cross_leg_threshold_ = faultThreshold64(cross_region_leg_probability, always_cross_);
+		migrating_to_ = NOT_MIGRATING;
+	}
+
+	ChargingNetwork& network() { return network_; }
+
+	// the index of every eVTOL in the region, in the order they are updated
+	const std::vector<size_t>& members() { return members_; }
+
+	// the eVTOLs that left the region in the latest update, in the order they left
+	std::vector<eVTOLMigration>& outbox() { return outbox_; }
+
+	// the eVTOL is in the region from now on, it is not charged
+	void addMember(eVTOL* evtol, size_t index)
+	{
+		members_.push_back(index);
+		evtol->setChargingStation(this);
+	}
+
+	// the eVTOL landed in the region at the end of a leg from another and goes to one of its stations
+	void receive(eVTOL* evtol, size_t index)
+	{
+		addMember(evtol, index);
+		network_.addDevice(evtol);
+	}
+
+	// updates every eVTOL of the region, those that flew to another region leave it for the outbox
+	void updateMembers(const std::vector<eVTOL*>& evtols, size_t prev_time, size_t cur_time)
+	{
+		size_t kept = 0;
+		for (size_t m = 0; m < members_.size(); m++)
+		{
+			size_t index = members_[m];
+			evtols[index]->timestepUpdate(prev_time, cur_time);
+			if (migrating_to_ != NOT_MIGRATING)
+			{
+				eVTOLMigration migration = { index, migrating_to_ };
+				outbox_.push_back(migration);
+				migrating_to_ = NOT_MIGRATING;
+			}
+			else
+			{
+				members_[kept++] = index;
+			}
+		}
+		members_.resize(kept);
+	}
+
+	// an eVTOL of the region is low on battery, where did its leg end
+	void addDevice(ChargeableDevice* device) override
+	{
+		if (number_of_regions_ > 1 && (random_engine_() < cross_leg_threshold_ || always_cross_))
+		{
+			// any region but this one, which one this is doesn't matter as the draw is uniform over the rest
+			std::uniform_int_distribution<size_t> other(1, number_of_regions_ - 1);
+			migrating_to_ = (region_index_ + other(random_engine_)) % number_of_regions_;
+			return;
+		}
+		network_.addDevice(device);
+	}
+
+private:
+	static const size_t NOT_MIGRATING = static_cast<size_t>(-1);
+
+	ChargingNetwork network_;
+	std::vector<size_t> members_;
+	std::vector<eVTOLMigration> outbox_;
+	SplitMix64 random_engine_;
+	size_t region_index_;
+	size_t number_of_regions_;
+	uint64_t cross_leg_threshold_;    // a leg ends in another region when a random number is below it
+	bool always_cross_;
+	size_t migrating_to_;             // the destination of the eVTOL being updated, set by addDevice
+};
+
+
+// The fleet and charging stations split into regions, updated in parallel, with eVTOLs migrating between regions.
+// Stations are dealt out to the regions in turn and the fleet in contiguous blocks, region r starting with
+// eVTOLs r * n / R up to (r + 1) * n / R.  Every timestep conservatively synchronizes the regions at its boundary:
+//   every region updates its own eVTOLs, an eVTOL whose leg ended in another region is posted to its outbox
+//   once every region is done, migrations are delivered in order of the region they left, and their eVTOLs
+//     join the queues of their new region's stations
+//   every region updates its own stations
+// Regions only touch their own eVTOLs and stations while they update, so they run on the threads of an optional
+// SimulationThreadPool, and the results are the same for any number of threads.  A single region, or a cross
+// region leg probability of 0, keeps every eVTOL in its home region, and one region is exactly a FIXED_TIMESTEP
+// simulation of all the stations.
+// Usage:
+//     eVTOLRegionalFleet fleet(4, 0.1, RandomSeed(42));
+//     fleet.addStation(3);
+//     fleet.add(evtol);
+//     fleet.begin();
+//     fleet.timestepUpdate(0, 1000);
+class eVTOLRegionalFleet : public SimulationAgent
+{
+public:
+	eVTOLRegionalFleet(size_t number_of_regions, double cross_region_leg_probability = 0.0, RandomSeed seed = RandomSeed())
+	{
+		if (number_of_regions == 0) throw std::invalid_argument("number_of_regions must be greater than 0.");
+		for (size_t r = 0; r < number_of_regions; r++)
+		{
+			regions_.push_back(std::unique_ptr<eVTOLRegion>(new eVTOLRegion(seed.child(r), r, number_of_regions, cross_region_leg_probability)));
+		}
+		number_of_stations_ = 0;
+		migrations_ = 0;
+		has_begun_ = false;
+		thread_pool_ = nullptr;
+	}
+
+	// adds a station to the next region in turn
+	void addStation(size_t number_of_bays, double max_charge_rate_kw = 0.0)
+	{
+		regions_[number_of_stations_++ % regions_.size()]->network().addStation(number_of_bays, max_charge_rate_kw);
+	}
+
+	// every region picks among its own stations with a policy of its own
+	void setPolicy(const std::function<std::unique_ptr<ChargingStationPolicy>()>& make_policy)
+	{
+		for (auto& region : regions_)
+		{
+			region->network().setPolicy(make_policy());
+		}
+	}
+
+	// eVTOLs must be added in order, an eVTOL is identified by its order of creation
+	void add(eVTOL* evtol)
+	{
+		if (has_begun_) throw std::logic_error("eVTOLs cannot be added to a regional fleet after begin().");
+		evtols_.push_back(evtol);
+	}
+
+	// regions are updated in parallel across the pool, nullptr updates them on the calling thread
+	void setThreadPool(SimulationThreadPool* thread_pool)
+	{
+		thread_pool_ = thread_pool;
+	}
+
+	// every eVTOL can end up waiting at any one station
+	void reserveWaiting(size_t number_of_devices)
+	{
+		for (auto& region : regions_)
+		{
+			region->network().reserveWaiting(number_of_devices);
+		}
+	}
+
+	// every eVTOL joins its home region and takes off
+	void begin() override
+	{
+		if (number_of_stations_ < regions_.size()) throw std::invalid_argument("every region needs at least one charging station.");
+		has_begun_ = true;
+		for (size_t r = 0; r < regions_.size(); r++)
+		{
+			for (size_t i = r * evtols_.size() / regions_.size(); i < (r + 1) * evtols_.size() / regions_.size(); i++)
+			{
+				regions_[r]->addMember(evtols_[i], i);
+			}
+		}
+		for (eVTOL* evtol : evtols_)
+		{
+			evtol->begin();
+		}
+		for (auto& region : regions_)
+		{
+			region->network().begin();
+		}
+	}
+
+	void timestepUpdate(size_t prev_time, size_t cur_time) override
+	{
+		forEachRegion([this, prev_time, cur_time](eVTOLRegion& region) { region.updateMembers(evtols_, prev_time, cur_time); });
+
+		// the boundary of the timestep, every region is done with its eVTOLs
+		for (auto& region : regions_)
+		{
+			for (auto& migration : region->outbox())
+			{
+				regions_[migration.destination]->receive(evtols_[migration.evtol], migration.evtol);
+			}
+			migrations_ += region->outbox().size();
+			region->outbox().clear();
+		}
+
+		forEachRegion([prev_time, cur_time](eVTOLRegion& region) { region.network().timestepUpdate(prev_time, cur_time); });
+	}
+
+	size_t numberOfRegions() { return regions_.size(); }
+
+	eVTOLRegion& region(size_t index) { return *regions_[index]; }
+
+	// eVTOLs that have landed in a region other than the one they took off from
+	unsigned long long migrations() { return migrations_; }
+
+	// the counters of every station of every region added up
+	ChargingStationCounters counters()
+	{
+		ChargingStationCounters counters = {};
+		for (auto& region : regions_) accumulateCounters(counters, region->network().counters());
+		return counters;
+	}
+
+private:
+	void forEachRegion(const std::function<void(eVTOLRegion&)>& update)
+	{
+		if (!thread_pool_ || regions_.size() < 2)
+		{
+			for (auto& region : regions_) update(*region);
+			return;
+		}
+		thread_pool_->parallelFor(regions_.size(), [this, &update](size_t begin, size_t end, size_t shard) {
+			for (size_t r = begin; r < end; r++) update(*regions_[r]);
+			});
+	}
+
+	std::vector<std::unique_ptr<eVTOLRegion> > regions_;
+	std::vector<eVTOL*> evtols_;           // not owned, in order of creation
+	size_t number_of_stations_;
+	unsigned long long migrations_;
+	bool has_begun_;
+	SimulationThreadPool* thread_pool_;    // optional, not owned
+};
+
+
+
+void test_eVTOLRegionalFleet()
+{
+	using namespace std;
+
+	// four regions of two stations each, 40 eVTOLs in blocks of 10
+	eVTOLConfiguration config("Test Company", 120, 100, 0.5, 1.5, 4, 0.0);
+	std::vector<eVTOL> evtols(40, eVTOL(config, nullptr));
+	eVTOLRegionalFleet fleet(4, 0.5, RandomSeed(7));
+	for (int s = 0; s < 8; s++) fleet.addStation(2);
+	for (auto& evtol : evtols) fleet.add(&evtol);
+	fleet.reserveWaiting(evtols.size());
+	fleet.begin();
+	cout << fleet.numberOfRegions() << "  " << fleet.region(1).members().size() << " " << fleet.region(1).members()[0] << "  ";
+	cout << fleet.region(3).network().numberOfStations() << "  ";
+
+	// every eVTOL runs low together, about half land in another region, every eVTOL is somewhere and charging or waiting
+	size_t time = 0;
+	while (fleet.migrations() == 0 && time < 4 * 60 * 60 * 1000)
+	{
+		fleet.timestepUpdate(time, time + 1000);
+		time += 1000;
+	}
+	size_t members = 0, at_stations = 0;
+	for (size_t r = 0; r < fleet.numberOfRegions(); r++)
+	{
+		members += fleet.region(r).members().size();
+		at_stations += fleet.region(r).network().numberCharging() + fleet.region(r).network().numberWaiting();
+	}
+	cout << (fleet.migrations() > 10 && fleet.migrations() < 30) << "  " << members << "  " << at_stations << "  " << fleet.counters().arrivals << endl;
+
+	try { eVTOLRegionalFleet few_stations(3); few_stations.addStation(1); few_stations.begin(); }
+	catch (const std::invalid_argument& ia) { cout << ia.what() << endl; }
+	try { eVTOLRegionalFleet bad_probability(2, 1.5); }
+	catch (const std::invalid_argument& ia) { cout << ia.what() << endl; }
+}
+
+
+#endif  // EVTOL_REGIONS
@@ -0,0 +1,317 @@
+#ifndef EVTOL_REPLICATION
+#define EVTOL_REPLICATION
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <stdexcept>
+#include <functional>
+
+#include "sim_random.h"
+#include "evtol_simulation.h"
+
+
+// Summary of one measurement across many replications of a simulation
+struct ReplicationStatistics
+{
+	size_t samples;
+	double mean;
+	double stddev;                   // sample standard deviation
+	double confidence_half_width;    // half width of the 95% confidence interval of the mean
+	double min;
+	double p5;
+	double p50;
+	double p95;
+	double max;
+};
+
+// returns the percentile, in [0,100], of sorted samples by linear interpolation between closest ranks
+inline double percentileOfSorted(const std::vector<double>& sorted_samples, double percentile)
+{
+	if (sorted_samples.empty()) return 0.0;
+	double rank = percentile / 100.0 * (sorted_samples.size() - 1);
+	size_t lower = static_cast<size_t>(rank);
+	size_t upper = std::min(lower + 1, sorted_samples.size() - 1);
+	double fraction = rank - lower;
+	return sorted_samples[lower] + (sorted_samples[upper] - sorted_samples[lower]) * fraction;
+}
+
+ReplicationStatistics replicationStatistics(std::vector<double> samples)
+{
+	ReplicationStatistics stats = {};
+	stats.samples = samples.size();
+	if (samples.empty()) return stats;
+
+	std::sort(samples.begin(), samples.end());
+	double total = 0.0;
+	for (double sample : samples) total += sample;
+	stats.mean = total / samples.size();
+	double sum_squares = 0.0;
+	for (double sample : samples) sum_squares += (sample - stats.mean) * (sample - stats.mean);
+	stats.stddev = samples.size() > 1 ? std::sqrt(sum_squares / (samples.size() - 1)) : 0.0;
+	stats.confidence_half_width = 1.96 * stats.stddev / std::sqrt(static_cast<double>(samples.size()));
+	stats.min = samples.front();
+	stats.p5 = percentileOfSorted(samples, 5);
+	stats.p50 = percentileOfSorted(samples, 50);
+	stats.p95 = percentileOfSorted(samples, 95);
+	stats.max = samples.back();
+	return stats;
+}
+
+
+// The per company results of printCompanyGroupResults summarized across replications.
+// count includes replications in which the company had no eVTOLs,
+// the other measurements only include replications in which it had at least one.
+struct eVTOLCompanyReplicationResults
+{
+	std::string company;
+	ReplicationStatistics count;
+	ReplicationStatistics avg_flight_time_minutes;
+	ReplicationStatistics avg_charge_time_minutes;
+	ReplicationStatistics avg_wait_time_minutes;
+	ReplicationStatistics max_faults;
+	ReplicationStatistics total_passenger_miles;
+};
+
+
+// summarizes the per company results of many replications, one entry per company in order of company name
+inline std::vector<eVTOLCompanyReplicationResults> summarizeCompanyResults(const std::vector<std::vector<eVTOLCompanyResults> >& replication_results)
+{
+	// gather the samples for each company
+	std::map<std::string, std::vector<std::vector<double> > > samples;
+	for (auto& company_results : replication_results)
+	{
+		for (auto& results : company_results)
+		{
+			std::vector<std::vector<double> >& company_samples = samples[results.company];
+			company_samples.resize(6);
+			company_samples[0].push_back(static_cast<double>(results.count));
+			company_samples[1].push_back(results.avg_flight_time_minutes);
+			company_samples[2].push_back(results.avg_charge_time_minutes);
+			company_samples[3].push_back(results.avg_wait_time_minutes);
+			company_samples[4].push_back(static_cast<double>(results.max_faults));
+			company_samples[5].push_back(static_cast<double>(results.total_passenger_miles));
+		}
+	}
+
+	std::vector<eVTOLCompanyReplicationResults> summary;
+	for (auto& company_samples : samples)
+	{
+		// replications in which the company had no eVTOLs count as a count of 0
+		std::vector<double>& counts = company_samples.second[0];
+		counts.resize(replication_results.size(), 0.0);
+
+		eVTOLCompanyReplicationResults results;
+		results.company = company_samples.first;
+		results.count = replicationStatistics(counts);
+		results.avg_flight_time_minutes = replicationStatistics(company_samples.second[1]);
+		results.avg_charge_time_minutes = replicationStatistics(company_samples.second[2]);
+		results.avg_wait_time_minutes = replicationStatistics(company_samples.second[3]);
+		results.max_faults = replicationStatistics(company_samples.second[4]);
+		results.total_passenger_miles = replicationStatistics(company_samples.second[5]);
+		summary.push_back(results);
+	}
+	return summary;
+}
+
+
+// Runs a batch of simulations and returns the per company results of each, in the order of the simulations,
+// e.g. eVTOLDistributedCoordinator::batchRunner shares them out across many nodes
+typedef std::function<std::vector<std::vector<eVTOLCompanyResults> >(const std::vector<eVTOLSimulationParameters>&)> SimulationBatchRunner;
+
+
+// Runs many independent replications of an eVTOLSimulation across a pool of threads
+// and summarizes the per company results with mean, standard deviation, confidence interval and percentiles.
+// Each replication is a completely separate eVTOLSimulation with its own factory, charging station and fleet.
+// Replication i is seeded with a seed derived from the master seed and i, so a run is reproducible
+// for a given master seed and the results do not depend on the number of threads.
+// A master seed of 0 picks one from the clock.
+// Replications always run free running and quietly, whatever the parameters say.
+// Usage:
+//     eVTOLReplicationRunner runner(eVTOLSimulationParameters(), 100);
+//     runner.run();
+//     runner.printResults();
+// or, to run the replications somewhere else,
+//     runner.run(coordinator.batchRunner());
+class eVTOLReplicationRunner
+{
+public:
+	// number_of_threads of 0 uses one thread per hardware thread
+	eVTOLReplicationRunner(const eVTOLSimulationParameters& parameters, size_t number_of_replications, size_t number_of_threads = 0)
+	{
+		if (number_of_replications == 0) throw std::invalid_argument("number_of_replications must be greater than 0.");
+
+		parameters_ = parameters;
+		parameters_.timer_mode = SimulationTimerMode::FREE_RUNNING;
+		parameters_.verbose = false;
+		master_seed_ = parameters.seed ? RandomSeed(parameters.seed) : RandomSeed::fromClock();
+		number_of_replications_ = number_of_replications;
+		number_of_threads_ = number_of_threads ? number_of_threads : std::max(1u, std::thread::hardware_concurrency());
+		number_of_threads_ = std::min(number_of_threads_, number_of_replications_);
+		distributed_ = false;
+	}
+
+	// runs all of the replications, returns once they are all finished
+	void run()
+	{
+		replication_results_.assign(number_of_replications_, std::vector<eVTOLCompanyResults>());
+		std::atomic<size_t> next_replication(0);
+		std::vector<std::exception_ptr> errors(number_of_threads_);
+
+		// each worker takes the next replication not yet started until there are none left
+		auto worker = [this, &next_replication, &errors](size_t thread_index) {
+			try
+			{
+				size_t replication;
+				while ((replication = next_replication++) < number_of_replications_)
+				{
+					eVTOLSimulation simulation(replicationParameters(replication));
+					simulation.run();
+					replication_results_[replication] = simulation.companyResults();
+				}
+			}
+			catch (...)
+			{
+				errors[thread_index] = std::current_exception();
+				next_replication = number_of_replications_;
+			}
+		};
+
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < number_of_threads_; i++)
+		{
+			threads.push_back(std::thread(worker, i));
+		}
+		for (auto& thread : threads)
+		{
+			thread.join();
+		}
+		for (auto& error : errors)
+		{
+			if (error) std::rethrow_exception(error);
+		}
+		distributed_ = false;
+	}
+
+	// runs all of the replications as one batch of run_simulations, the same results as run()
+	void run(const SimulationBatchRunner& run_simulations)
+	{
+		std::vector<eVTOLSimulationParameters> simulations;
+		for (size_t replication = 0; replication < number_of_replications_; replication++)
+		{
+			simulations.push_back(replicationParameters(replication));
+		}
+		std::vector<std::vector<eVTOLCompanyResults> > results = run_simulations(simulations);
+		if (results.size() != number_of_replications_) throw std::runtime_error("the batch runner returned the wrong number of results.");
+		replication_results_.swap(results);
+		distributed_ = true;
+	}
+
+	// the parameters of a single replication, identical to the runner's parameters except for the seed
+	eVTOLSimulationParameters replicationParameters(size_t replication)
+	{
+		eVTOLSimulationParameters parameters = parameters_;
+		parameters.seed = master_seed_.child(RandomStream::REPLICATION).child(replication).value();
+		if (parameters.seed == 0) parameters.seed = 1;  // 0 would mean seed from the clock
+		return parameters;
+	}
+
+	// per company results summarized across replications, in order of company name
+	std::vector<eVTOLCompanyReplicationResults> companyResults()
+	{
+		return summarizeCompanyResults(replication_results_);
+	}
+
+	// results of each replication, in order of replication
+	std::vector<std::vector<eVTOLCompanyResults> > replicationResults() { return replication_results_; }
+
+	void printResults()
+	{
+		using namespace std;
+		cout << endl << endl << "******************************** R E S U L T S ********************************" << endl;
+		cout << endl << "Replication Parameters" << endl;
+		cout << "  Number of Replications:      " << number_of_replications_ << endl;
+		if (distributed_) cout << "  Number of Threads:           run by a batch runner" << endl;
+		else cout << "  Number of Threads:           " << number_of_threads_ << endl;
+		cout << "  Master Seed:                 " << master_seed_.value() << endl;
+		cout << "  Number of eVTOLS:            " << parameters_.number_of_evtols << endl;
+		cout << "  Number of Charging Stations: " << parameters_.number_of_charging_stations << endl;
+		cout << "  Charging Bays per Station:   " << parameters_.number_of_charging_bays << endl;
+		cout << "  Total Simulation Time:       " << parameters_.simulation_time_minutes << " minutes" << endl;
+		cout << "  Timestep Interval:           " << parameters_.timestep_milliseconds << " milliseconds" << endl;
+		cout << "  Simulation Engine:           " << simulationEngineName(parameters_.engine) << endl;
+
+		cout << endl << "Company Stats Across Replications" << endl;
+		for (auto& results : companyResults())
+		{
+			cout << endl << "  " << results.company << endl;
+			cout << setw(20) << "" << setw(8) << "SAMPLES" << setw(10) << "MEAN" << setw(10) << "STDDEV" << setw(10) << "95% CI +-" << setw(10) << "P5" << setw(10) << "P50" << setw(10) << "P95" << endl;
+			cout << setw(20) << "" << setw(8) << "-------" << setw(10) << "--------" << setw(10) << "--------" << setw(10) << "--------" << setw(10) << "--------" << setw(10) << "--------" << setw(10) << "--------" << endl;
+			printStatisticsRow("COUNT", results.count);
+			printStatisticsRow("AVG FLT TIME MIN", results.avg_flight_time_minutes);
+			printStatisticsRow("AVG CHG TIME MIN", results.avg_charge_time_minutes);
+			printStatisticsRow("AVG WAT TIME MIN", results.avg_wait_time_minutes);
+			printStatisticsRow("MAX NUMBER FAULTS", results.max_faults);
+			printStatisticsRow("TOTAL PASSNGR MILES", results.total_passenger_miles);
+		}
+		cout << endl;
+	}
+
+private:
+	void printStatisticsRow(const std::string& name, const ReplicationStatistics& stats)
+	{
+		using namespace std;
+		cout << setw(20) << name << setw(8) << stats.samples;
+		cout << fixed << setprecision(2);
+		cout << setw(10) << stats.mean << setw(10) << stats.stddev << setw(10) << stats.confidence_half_width;
+		cout << setw(10) << stats.p5 << setw(10) << stats.p50 << setw(10) << stats.p95 << endl;
+	}
+
+	eVTOLSimulationParameters parameters_;
+	RandomSeed master_seed_;
+	size_t number_of_replications_;
+	size_t number_of_threads_;
+	bool distributed_;                                                   // the last run was by a batch runner
+	std::vector<std::vector<eVTOLCompanyResults> > replication_results_;  // one entry per replication
+};
+
+
+
+void test_eVTOLReplicationRunner()
+{
+	using namespace std;
+
+	try { eVTOLReplicationRunner runner(eVTOLSimulationParameters(), 0); }
+	catch (const std::invalid_argument& ia) { cout << ia.what() << endl; }
+
+	ReplicationStatistics stats = replicationStatistics({ 4.0, 1.0, 3.0, 2.0, 5.0 });
+	cout << stats.samples << "  " << stats.mean << "  " << stats.stddev << "  " << stats.p50 << "  " << stats.p95 << endl;
+
+	// same master seed gives the same results, whatever the number of threads
+	eVTOLSimulationParameters parameters;
+	parameters.seed = 1234;
+	parameters.engine = SimulationEngine::DISCRETE_EVENT;
+	eVTOLReplicationRunner one_thread(parameters, 8, 1);
+	one_thread.run();
+	eVTOLReplicationRunner four_threads(parameters, 8, 4);
+	four_threads.run();
+	std::vector<eVTOLCompanyReplicationResults> a = one_thread.companyResults();
+	std::vector<eVTOLCompanyReplicationResults> b = four_threads.companyResults();
+	bool same = a.size() == b.size();
+	for (size_t i = 0; same && i < a.size(); i++)
+	{
+		same = a[i].avg_flight_time_minutes.mean == b[i].avg_flight_time_minutes.mean && a[i].max_faults.mean == b[i].max_faults.mean;
+	}
+	cout << same << endl;
+	four_threads.printResults();
+}
+
+
+#endif  // EVTOL_REPLICATION
@@ -0,0 +1,155 @@
+#ifndef EVTOL_RESULTS
+#define EVTOL_RESULTS
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+
+#include "evtol.h"
+
+
+// Results of a simulation for all eVTOLs of one company, as printed by printCompanyGroupResults
+struct eVTOLCompanyResults
+{
+	std::string company;
+	size_t count;
+	double avg_flight_time_minutes;
+	double avg_charge_time_minutes;
+	double avg_wait_time_minutes;
+	size_t max_faults;
+	size_t total_passenger_miles;
+};
+
+
+// Rolls the state of every eVTOL up into per company results in a single pass.
+// Companies are identified by a small integer id, their index in the list of companies given
+// to the constructor, so adding an eVTOL is a handful of additions with no string compares.
+// The totals are held in fixed arrays, so once constructed, aggregating allocates no memory,
+// and results() fills a caller's vector, which only allocates the first time it is filled.
+// Cheap enough to take snapshots of the results part way through a simulation.
+// Usage:
+//     eVTOLCompanyAggregator aggregator({ "Alpha Company", "Beta Company" });
+//     aggregator.reset();
+//     aggregator.add(company_id, evtol.agentState(), evtol.cruise_speed(), evtol.passenger_count());
+//     aggregator.results(company_results);
+class eVTOLCompanyAggregator
+{
+public:
+	eVTOLCompanyAggregator(const std::vector<std::string>& companies = std::vector<std::string>())
+	{
+		companies_ = companies;
+		totals_.resize(companies.size());
+		reset();
+	}
+
+	// clears the totals, ready for the next pass
+	void reset()
+	{
+		std::fill(totals_.begin(), totals_.end(), CompanyTotals());
+	}
+
+	void add(size_t company_id, const eVTOLAgentState& agent_state, double cruise_speed, size_t passenger_count)
+	{
+		if (company_id >= totals_.size()) throw std::out_of_range("unknown company id.");
+
+		CompanyTotals& totals = totals_[company_id];
+		totals.count++;
+		totals.flight_time_minutes += agent_state.total_flight_time / (1000.0 * 60);
+		totals.charge_time_minutes += agent_state.total_charge_time / (1000.0 * 60);
+		totals.wait_time_minutes += agent_state.total_wait_time / (1000.0 * 60);
+		totals.max_faults = std::max(totals.max_faults, agent_state.number_of_faults);
+		// whole passenger miles are added for each eVTOL
+		totals.passenger_miles += static_cast<size_t>(agent_state.total_flight_time / (1000.0 * 60 * 60) * cruise_speed * passenger_count);
+	}
+
+	// fills company_results with one entry per company that has at least one eVTOL, in company id order
+	void results(std::vector<eVTOLCompanyResults>& company_results)
+	{
+		size_t number_of_results = 0;
+		for (auto& totals : totals_)
+		{
+			number_of_results += totals.count > 0;
+		}
+		company_results.resize(number_of_results);
+
+		size_t result = 0;
+		for (size_t id = 0; id < totals_.size(); id++)
+		{
+			CompanyTotals& totals = totals_[id];
+			if (totals.count == 0) continue;
+
+			eVTOLCompanyResults& results = company_results[result++];
+			results.company = companies_[id];
+			results.count = totals.count;
+			results.avg_flight_time_minutes = totals.flight_time_minutes / totals.count;
+			results.avg_charge_time_minutes = totals.charge_time_minutes / totals.count;
+			results.avg_wait_time_minutes = totals.wait_time_minutes / totals.count;
+			results.max_faults = totals.max_faults;
+			results.total_passenger_miles = totals.passenger_miles;
+		}
+	}
+
+	std::vector<eVTOLCompanyResults> results()
+	{
+		std::vector<eVTOLCompanyResults> company_results;
+		results(company_results);
+		return company_results;
+	}
+
+	size_t numberOfCompanies() { return companies_.size(); }
+
+	const std::string& company(size_t company_id) { return companies_[company_id]; }
+
+private:
+	struct CompanyTotals
+	{
+		size_t count = 0;
+		double flight_time_minutes = 0.0;
+		double charge_time_minutes = 0.0;
+		double wait_time_minutes = 0.0;
+		size_t max_faults = 0;
+		size_t passenger_miles = 0;
+	};
+
+	std::vector<std::string> companies_;   // indexed by company id
+	std::vector<CompanyTotals> totals_;    // indexed by company id
+};
+
+
+
+void test_eVTOLCompanyAggregator()
+{
+	using namespace std;
+
+	eVTOLCompanyAggregator aggregator({ "Alpha", "Beta", "Charlie" });
+
+	eVTOLAgentState state = {};
+	state.total_flight_time = 60 * 60 * 1000;  // an hour
+	state.total_charge_time = 30 * 60 * 1000;
+	state.number_of_faults = 2;
+	aggregator.add(0, state, 120, 4);
+	state.number_of_faults = 5;
+	state.total_wait_time = 60 * 1000;
+	aggregator.add(0, state, 120, 4);
+	aggregator.add(2, state, 100, 5);
+
+	// Beta has no eVTOLs so is left out
+	std::vector<eVTOLCompanyResults> results;
+	aggregator.results(results);
+	cout << results.size() << "  " << results[0].company << "  " << results[0].count << "  " << results[0].avg_flight_time_minutes << "  " << results[0].avg_wait_time_minutes;
+	cout << "  " << results[0].max_faults << "  " << results[0].total_passenger_miles << "  " << results[1].company << "  " << results[1].total_passenger_miles << endl;
+
+	// reusing the results vector for the next pass
+	aggregator.reset();
+	aggregator.add(1, state, 100, 5);
+	aggregator.results(results);
+	cout << results.size() << "  " << results[0].company << endl;
+
+	try { aggregator.add(3, state, 100, 5); }
+	catch (const std::out_of_range& oor) { cout << oor.what() << endl; }
+}
+
+
+#endif  // EVTOL_RESULTS
@@ -0,0 +1,648 @@
+#ifndef EVTOL_SCENARIO
+#define EVTOL_SCENARIO
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+
+#include "sim_random.h"
+#include "evtol.h"
+#include "sim_timer.h"
+#include "evtol_simulation.h"
+
+
+// Scenarios are the parameters of an eVTOLSimulation loaded at runtime rather than compiled in.
+//
+// The text form is a subset of TOML, one key = value per line, # starts a comment.
+// Any key left out keeps its default, the basic simulation parameters of evtol_simulation.h.
+// Each [[configuration]] table adds an eVTOL configuration, if there are any they replace the default configurations.
+//     number_of_evtols = 20
+//     engine = "BATCHED_FLEET"
+//     seed = 42
+//
+//     [[configuration]]
+//     company_name = "Alpha Company"
+//     cruise_speed = 120
+//     battery_capacity = 320
+//     time_to_charge = 0.6
+//     energy_use_at_cruise = 1.6
+//     passenger_count = 4
+//     prob_fault_per_hour = 0.25
+//
+// The binary form holds any number of already validated scenarios in fixed size records with no pointers,
+// a header, then one ScenarioRecord per scenario, then every ConfigurationRecord, guarded by a checksum.
+// Loading is a single read and a copy of each record, with no parsing, so a sweep of thousands of
+// scenarios starts almost instantly.  The layout is native byte order, the header records it so a file
+// written on a machine of the other byte order is rejected rather than misread.
+// Usage:
+//     std::vector<eVTOLSimulationParameters> scenarios = loadScenarios("sweep.scenario");
+//     saveScenariosBinary("sweep.bin", scenarios);
+//     scenarios = loadScenarios("sweep.bin");
+
+
+// returns the simulation engine of the given name, see simulationEngineName()
+inline SimulationEngine simulationEngineFromName(const std::string& name)
+{
+	if (name == "FIXED_TIMESTEP") return SimulationEngine::FIXED_TIMESTEP;
+	if (name == "BATCHED_FLEET") return SimulationEngine::BATCHED_FLEET;
+	if (name == "DISCRETE_EVENT") return SimulationEngine::DISCRETE_EVENT;
+	if (name == "ADAPTIVE_TIMESTEP") return SimulationEngine::ADAPTIVE_TIMESTEP;
+	if (name == "ANALYTIC") return SimulationEngine::ANALYTIC;
+	if (name == "COHORT") return SimulationEngine::COHORT;
+	if (name == "SPECIALIZED") return SimulationEngine::SPECIALIZED;
+	if (name == "REGIONAL") return SimulationEngine::REGIONAL;
+	throw std::invalid_argument("unknown simulation engine " + name + ".");
+}
+
+inline std::string timerModeName(SimulationTimerMode mode)
+{
+	return mode == SimulationTimerMode::PACED ? "PACED" : "FREE_RUNNING";
+}
+
+inline SimulationTimerMode timerModeFromName(const std::string& name)
+{
+	if (name == "PACED") return SimulationTimerMode::PACED;
+	if (name == "FREE_RUNNING") return SimulationTimerMode::FREE_RUNNING;
+	throw std::invalid_argument("unknown timer mode " + name + ".");
+}
+
+inline std::string timerCatchUpName(TimerCatchUpPolicy policy)
+{
+	switch (policy)
+	{
+	case TimerCatchUpPolicy::DROP: return "DROP";
+	case TimerCatchUpPolicy::COARSEN: return "COARSEN";
+	default: return "CATCH_UP";
+	}
+}
+
+inline TimerCatchUpPolicy timerCatchUpFromName(const std::string& name)
+{
+	if (name == "CATCH_UP") return TimerCatchUpPolicy::CATCH_UP;
+	if (name == "DROP") return TimerCatchUpPolicy::DROP;
+	if (name == "COARSEN") return TimerCatchUpPolicy::COARSEN;
+	throw std::invalid_argument("unknown timer catch up policy " + name + ".");
+}
+
+inline std::string stationSelectionName(ChargingStationSelection selection)
+{
+	return selection == ChargingStationSelection::PREDICTED_WAIT ? "PREDICTED_WAIT" : "SHORTEST_QUEUE";
+}
+
+inline ChargingStationSelection stationSelectionFromName(const std::string& name)
+{
+	if (name == "SHORTEST_QUEUE") return ChargingStationSelection::SHORTEST_QUEUE;
+	if (name == "PREDICTED_WAIT") return ChargingStationSelection::PREDICTED_WAIT;
+	throw std::invalid_argument("unknown station selection " + name + ".");
+}
+
+
+// throws std::invalid_argument if the parameters can't make a simulation
+inline void validateScenario(const eVTOLSimulationParameters& parameters)
+{
+	if (parameters.configurations.empty()) throw std::invalid_argument("at least one eVTOL configuration is required.");
+	if (parameters.number_of_charging_stations == 0) throw std::invalid_argument("at least one charging station is required.");
+	if (parameters.max_charge_rate_kw < 0.0) throw std::invalid_argument("max_charge_rate_kw must not be negative.");
+	if (parameters.simulation_time_minutes == 0) throw std::invalid_argument("simulation_time_minutes must be greater than 0.");
+	if (parameters.timestep_milliseconds == 0) throw std::invalid_argument("timestep_milliseconds must be greater than 0.");
+	if (parameters.max_timestep_milliseconds == 0) throw std::invalid_argument("max_timestep_milliseconds must be greater than 0.");
+	if (parameters.time_compression == 0) throw std::invalid_argument("time_compression must be greater than 0.");
+	if (parameters.number_of_station_threads == 0) throw std::invalid_argument("number_of_station_threads must be greater than 0.");
+	if (parameters.number_of_fleet_threads == 0) throw std::invalid_argument("number_of_fleet_threads must be greater than 0.");
+	if (parameters.number_of_regions == 0) throw std::invalid_argument("number_of_regions must be greater than 0.");
+	if (parameters.number_of_regions > parameters.number_of_charging_stations) throw std::invalid_argument("number_of_regions must be at most number_of_charging_stations.");
+	if (!(parameters.cross_region_leg_probability >= 0.0 && parameters.cross_region_leg_probability <= 1.0)) throw std::invalid_argument("cross_region_leg_probability must be between 0 and 1.");
+}
+
+
+
+// Reads the text form of a scenario, reports the line of the first error.
+class ScenarioTextParser
+{
+public:
+	eVTOLSimulationParameters parse(std::istream& in)
+	{
+		eVTOLSimulationParameters parameters;
+		std::vector<eVTOLConfiguration> configurations;
+		bool in_configuration = false;
+		std::string line;
+		line_number_ = 0;
+
+		while (std::getline(in, line))
+		{
+			line_number_++;
+			line = trim(stripComment(line));
+			if (line.empty()) continue;
+
+			if (line == "[[configuration]]")
+			{
+				if (in_configuration) configurations.push_back(endConfiguration());
+				in_configuration = true;
+				configuration_values_.assign(7, "");
+				continue;
+			}
+			if (line[0] == '[') fail("unknown table " + line);
+
+			size_t equals = line.find('=');
+			if (equals == std::string::npos) fail("expected key = value");
+			std::string key = trim(line.substr(0, equals));
+			std::string value = unquote(trim(line.substr(equals + 1)));
+
+			if (in_configuration) setConfigurationValue(key, value);
+			else setParameter(parameters, key, value);
+		}
+		if (in_configuration) configurations.push_back(endConfiguration());
+		if (!configurations.empty()) parameters.configurations = configurations;
+
+		validateScenario(parameters);
+		return parameters;
+	}
+
+private:
+	void setParameter(eVTOLSimulationParameters& parameters, const std::string& key, const std::string& value)
+	{
+		if (key == "number_of_evtols") parameters.number_of_evtols = toSize(value);
+		else if (key == "number_of_charging_bays") parameters.number_of_charging_bays = toSize(value);
+		else if (key == "number_of_charging_stations") parameters.number_of_charging_stations = toSize(value);
+		else if (key == "max_charge_rate_kw") parameters.max_charge_rate_kw = toDouble(value);
+		else if (key == "station_selection") parameters.station_selection = convert(stationSelectionFromName, value);
+		else if (key == "number_of_station_threads") parameters.number_of_station_threads = toSize(value);
+		else if (key == "number_of_fleet_threads") parameters.number_of_fleet_threads = toSize(value);
+		else if (key == "simulation_time_minutes") parameters.simulation_time_minutes = toSize(value);
+		else if (key == "time_compression") parameters.time_compression = toSize(value);
+		else if (key == "timestep_milliseconds") parameters.timestep_milliseconds = toSize(value);
+		else if (key == "max_timestep_milliseconds") parameters.max_timestep_milliseconds = toSize(value);
+		else if (key == "timer_mode") parameters.timer_mode = convert(timerModeFromName, value);
+		else if (key == "timer_catch_up") parameters.timer_catch_up = convert(timerCatchUpFromName, value);
+		else if (key == "engine") parameters.engine = convert(simulationEngineFromName, value);
+		else if (key == "fault_sampling") parameters.fault_sampling = convert(faultSamplingFromName, value);
+		else if (key == "number_of_regions") parameters.number_of_regions = toSize(value);
+		else if (key == "cross_region_leg_probability") parameters.cross_region_leg_probability = toDouble(value);
+		else if (key == "seed") parameters.seed = toSize(value);
+		else if (key == "verbose") parameters.verbose = toBool(value);
+		else fail("unknown key " + key);
+	}
+
+	void setConfigurationValue(const std::string& key, const std::string& value)
+	{
+		for (size_t i = 0; i < 7; i++)
+		{
+			if (key == configurationKey(i))
+			{
+				configuration_values_[i] = value;
+				return;
+			}
+		}
+		fail("unknown configuration key " + key);
+	}
+
+	eVTOLConfiguration endConfiguration()
+	{
+		for (size_t i = 0; i < 6; i++)
+		{
+			if (configuration_values_[i].empty()) fail("configuration is missing " + configurationKey(i));
+		}
+		std::string prob_fault_per_hour = configuration_values_[6].empty() ? "0.25" : configuration_values_[6];
+		try
+		{
+			return eVTOLConfiguration(configuration_values_[0], toDouble(configuration_values_[1]), toDouble(configuration_values_[2]),
+				toDouble(configuration_values_[3]), toDouble(configuration_values_[4]), toSize(configuration_values_[5]), toDouble(prob_fault_per_hour));
+		}
+		catch (const std::invalid_argument& ia)
+		{
+			fail(ia.what());
+		}
+		return eVTOLConfiguration();
+	}
+
+	// keys of a configuration table, in order of the eVTOLConfiguration constructor arguments
+	static std::string configurationKey(size_t index)
+	{
+		static const char* keys[] = { "company_name", "cruise_speed", "battery_capacity", "time_to_charge", "energy_use_at_cruise", "passenger_count", "prob_fault_per_hour" };
+		return keys[index];
+	}
+
+	template <typename T>
+	T convert(T (*from_name)(const std::string&), const std::string& value)
+	{
+		try { return from_name(value); }
+		catch (const std::invalid_argument& ia) { fail(ia.what()); }
+		return T();
+	}
+
+	size_t toSize(const std::string& value)
+	{
+		if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos) fail("expected a whole number, not " + value);
+		unsigned long long number = 0;
+		try { number = std::stoull(value); }
+		catch (const std::out_of_range&) { fail("whole number out of range, " + value); }
+		if (number > std::numeric_limits<size_t>::max()) fail("whole number out of range, " + value);
+		return static_cast<size_t>(number);
+	}
+
+	double toDouble(const std::string& value)
+	{
+		size_t end = 0;
+		double number = 0.0;
+		try { number = std::stod(value, &end); }
+		catch (const std::exception&) { end = 0; }
+		if (end == 0 || end != value.size()) fail("expected a number, not " + value);
+		return number;
+	}
+
+	bool toBool(const std::string& value)
+	{
+		if (value == "true") return true;
+		if (value == "false") return false;
+		fail("expected true or false, not " + value);
+		return false;
+	}
+
+	static std::string stripComment(const std::string& line)
+	{
+		bool in_quotes = false;
+		for (size_t i = 0; i < line.size(); i++)
+		{
+			if (line[i] == '"') in_quotes = !in_quotes;
+			if (line[i] == '#' && !in_quotes) return line.substr(0, i);
+		}
+		return line;
+	}
+
+	static std::string trim(const std::string& text)
+	{
+		size_t begin = text.find_first_not_of(" \t\r");
+		if (begin == std::string::npos) return "";
+		size_t end = text.find_last_not_of(" \t\r");
+		return text.substr(begin, end - begin + 1);
+	}
+
+	static std::string unquote(const std::string& text)
+	{
+		if (text.size() >= 2 && text.front() == '"' && text.back() == '"') return text.substr(1, text.size() - 2);
+		return text;
+	}
+
+	void fail(const std::string& message)
+	{
+		throw std::invalid_argument("scenario line " + std::to_string(line_number_) + ": " + message);
+	}
+
+	size_t line_number_ = 0;
+	std::vector<std::string> configuration_values_;  // values of the configuration table being read, by key index
+};
+
+
+inline eVTOLSimulationParameters parseScenarioText(std::istream& in)
+{
+	ScenarioTextParser parser;
+	return parser.parse(in);
+}
+
+// writes the text form of a scenario, every parameter is written so the file documents itself
+inline void writeScenarioText(std::ostream& out, const eVTOLSimulationParameters& parameters)
+{
+	out << std::setprecision(17);
+	out << "number_of_evtols = " << parameters.number_of_evtols << std::endl;
+	out << "number_of_charging_bays = " << parameters.number_of_charging_bays << std::endl;
+	out << "number_of_charging_stations = " << parameters.number_of_charging_stations << std::endl;
+	out << "max_charge_rate_kw = " << parameters.max_charge_rate_kw << std::endl;
+	out << "station_selection = \"" << stationSelectionName(parameters.station_selection) << "\"" << std::endl;
+	out << "number_of_station_threads = " << parameters.number_of_station_threads << std::endl;
+	out << "number_of_fleet_threads = " << parameters.number_of_fleet_threads << std::endl;
+	out << "simulation_time_minutes = " << parameters.simulation_time_minutes << std::endl;
+	out << "time_compression = " << parameters.time_compression << std::endl;
+	out << "timestep_milliseconds = " << parameters.timestep_milliseconds << std::endl;
+	out << "max_timestep_milliseconds = " << parameters.max_timestep_milliseconds << std::endl;
+	out << "timer_mode = \"" << timerModeName(parameters.timer_mode) << "\"" << std::endl;
+	out << "timer_catch_up = \"" << timerCatchUpName(parameters.timer_catch_up) << "\"" << std::endl;
+	out << "engine = \"" << simulationEngineName(parameters.engine) << "\"" << std::endl;
+	out << "fault_sampling = \"" << faultSamplingName(parameters.fault_sampling) << "\"" << std::endl;
+	out << "number_of_regions = " << parameters.number_of_regions << std::endl;
+	out << "cross_region_leg_probability = " << parameters.cross_region_leg_probability << std::endl;
+	out << "seed = " << parameters.seed << std::endl;
+	out << "verbose = " << (parameters.verbose ? "true" : "false") << std::endl;
+	for (auto& config : parameters.configurations)
+	{
+		out << std::endl << "[[configuration]]" << std::endl;
+		out << "company_name = \"" << config.company_name() << "\"" << std::endl;
+		out << "cruise_speed = " << config.cruise_speed() << std::endl;
+		out << "battery_capacity = " << config.battery_capacity() << std::endl;
+		out << "time_to_charge = " << config.time_to_charge() << std::endl;
+		out << "energy_use_at_cruise = " << config.energy_use_at_cruise() << std::endl;
+		out << "passenger_count = " << config.passenger_count() << std::endl;
+		out << "prob_fault_per_hour = " << config.prob_fault_per_hour() << std::endl;
+	}
+}
+
+inline eVTOLSimulationParameters loadScenarioText(const std::string& file_name)
+{
+	std::ifstream in(file_name);
+	if (!in) throw std::runtime_error("unable to open " + file_name + ".");
+	return parseScenarioText(in);
+}
+
+inline void saveScenarioText(const std::string& file_name, const eVTOLSimulationParameters& parameters)
+{
+	std::ofstream out(file_name);
+	if (!out) throw std::runtime_error("unable to open " + file_name + " for writing.");
+	writeScenarioText(out, parameters);
+}
+
+
+
+// the fixed size records of the binary form
+const char SCENARIO_BINARY_MAGIC[8] = { 'E', 'V', 'T', 'O', 'L', 'S', 'C', 'N' };
+const uint32_t SCENARIO_BINARY_VERSION = 5;  // 2 added timer_catch_up, 3 max_timestep_milliseconds, 4 fault_sampling, 5 regions
+const uint32_t SCENARIO_BINARY_BYTE_ORDER = 0x01020304;
+
+struct ScenarioFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t number_of_scenarios;
+	uint32_t number_of_configurations;
+	uint64_t checksum;  // of everything after the header
+};
+
+struct ScenarioRecord
+{
+	uint64_t number_of_evtols;
+	uint64_t number_of_charging_bays;
+	uint64_t number_of_charging_stations;
+	double max_charge_rate_kw;
+	uint64_t max_timestep_milliseconds;
+	uint64_t number_of_station_threads;
+	uint64_t number_of_fleet_threads;
+	uint64_t simulation_time_minutes;
+	uint64_t time_compression;
+	uint64_t timestep_milliseconds;
+	uint64_t seed;
+	uint64_t number_of_regions;
+	double cross_region_leg_probability;
+	uint32_t station_selection;
+	uint32_t timer_mode;
+	uint32_t engine;
+	uint32_t verbose;
+	uint32_t first_configuration;       // index of the scenario's first ConfigurationRecord
+	uint32_t number_of_configurations;
+	uint32_t timer_catch_up;
+	uint32_t fault_sampling;
+};
+
+struct ConfigurationRecord
+{
+	char company_name[64];  // nul terminated
+	double cruise_speed;
+	double battery_capacity;
+	double time_to_charge;
+	double energy_use_at_cruise;
+	uint64_t passenger_count;
+	double prob_fault_per_hour;
+};
+
+
+// writes the binary form of the scenarios, each is validated first so loading needs no checks beyond the checksum
+inline void writeScenariosBinary(std::ostream& out, const std::vector<eVTOLSimulationParameters>& scenarios)
+{
+	std::vector<ScenarioRecord> scenario_records;
+	std::vector<ConfigurationRecord> configuration_records;
+	for (auto& parameters : scenarios)
+	{
+		validateScenario(parameters);
+		ScenarioRecord record = {};
+		record.number_of_evtols = parameters.number_of_evtols;
+		record.number_of_charging_bays = parameters.number_of_charging_bays;
+		record.number_of_charging_stations = parameters.number_of_charging_stations;
+		record.max_charge_rate_kw = parameters.max_charge_rate_kw;
+		record.number_of_station_threads = parameters.number_of_station_threads;
+		record.number_of_fleet_threads = parameters.number_of_fleet_threads;
+		record.simulation_time_minutes = parameters.simulation_time_minutes;
+		record.time_compression = parameters.time_compression;
+		record.timestep_milliseconds = parameters.timestep_milliseconds;
+		record.max_timestep_milliseconds = parameters.max_timestep_milliseconds;
+		record.seed = parameters.seed;
+		record.number_of_regions = parameters.number_of_regions;
+		record.cross_region_leg_probability = parameters.cross_region_leg_probability;
+		record.station_selection = static_cast<uint32_t>(parameters.station_selection);
+		record.timer_mode = static_cast<uint32_t>(parameters.timer_mode);
+		record.timer_catch_up = static_cast<uint32_t>(parameters.timer_catch_up);
+		record.engine = static_cast<uint32_t>(parameters.engine);
+		record.fault_sampling = static_cast<uint32_t>(parameters.fault_sampling);
+		record.verbose = parameters.verbose;
+		record.first_configuration = static_cast<uint32_t>(configuration_records.size());
+		record.number_of_configurations = static_cast<uint32_t>(parameters.configurations.size());
+		scenario_records.push_back(record);
+
+		for (auto& config : parameters.configurations)
+		{
+			if (config.company_name().size() >= sizeof(ConfigurationRecord().company_name)) throw std::invalid_argument("company_name " + config.company_name() + " is too long.");
+			ConfigurationRecord config_record = {};
+			std::strncpy(config_record.company_name, config.company_name().c_str(), sizeof(config_record.company_name) - 1);
+			config_record.cruise_speed = config.cruise_speed();
+			config_record.battery_capacity = config.battery_capacity();
+			config_record.time_to_charge = config.time_to_charge();
+			config_record.energy_use_at_cruise = config.energy_use_at_cruise();
+			config_record.passenger_count = config.passenger_count();
+			config_record.prob_fault_per_hour = config.prob_fault_per_hour();
+			configuration_records.push_back(config_record);
+		}
+	}
+
+	std::string payload(scenario_records.size() * sizeof(ScenarioRecord) + configuration_records.size() * sizeof(ConfigurationRecord), '\0');
+	if (!scenario_records.empty()) std::memcpy(&payload[0], scenario_records.data(), scenario_records.size() * sizeof(ScenarioRecord));
+	if (!configuration_records.empty()) std::memcpy(&payload[scenario_records.size() * sizeof(ScenarioRecord)], configuration_records.data(), configuration_records.size() * sizeof(ConfigurationRecord));
+
+	ScenarioFileHeader header = {};
+	std::memcpy(header.magic, SCENARIO_BINARY_MAGIC, sizeof(header.magic));
+	header.version = SCENARIO_BINARY_VERSION;
+	header.byte_order = SCENARIO_BINARY_BYTE_ORDER;
+	header.number_of_scenarios = static_cast<uint32_t>(scenario_records.size());
+	header.number_of_configurations = static_cast<uint32_t>(configuration_records.size());
+	header.checksum = fnv1a64(payload.data(), payload.size());
+	out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	out.write(payload.data(), payload.size());
+}
+
+// returns the enumerator a binary scenario holds, enumerators run from 0 to last,
+// throws std::invalid_argument for any other value, e.g. from a damaged file
+template <typename Enum>
+inline Enum binaryScenarioEnum(uint32_t value, Enum last, const char* name)
+{
+	if (value > static_cast<uint32_t>(last)) throw std::invalid_argument(std::string("binary scenario ") + name + " out of range.");
+	return static_cast<Enum>(value);
+}
+
+// reads scenarios from the binary form held in memory, e.g. read or mapped from a file
+inline std::vector<eVTOLSimulationParameters> readScenariosBinary(const char* data, size_t size)
+{
+	if (size < sizeof(ScenarioFileHeader)) throw std::invalid_argument("binary scenario is truncated.");
+	ScenarioFileHeader header;
+	std::memcpy(&header, data, sizeof(header));
+	if (std::memcmp(header.magic, SCENARIO_BINARY_MAGIC, sizeof(header.magic)) != 0) throw std::invalid_argument("not a binary scenario.");
+	if (header.version != SCENARIO_BINARY_VERSION) throw std::invalid_argument("unsupported binary scenario version.");
+	if (header.byte_order != SCENARIO_BINARY_BYTE_ORDER) throw std::invalid_argument("binary scenario was written with a different byte order.");
+
+	size_t payload_size = header.number_of_scenarios * sizeof(ScenarioRecord) + header.number_of_configurations * sizeof(ConfigurationRecord);
+	if (size - sizeof(header) != payload_size) throw std::invalid_argument("binary scenario is the wrong size.");
+	const char* payload = data + sizeof(header);
+	if (fnv1a64(payload, payload_size) != header.checksum) throw std::invalid_argument("binary scenario checksum does not match.");
+
+	const char* configuration_data = payload + header.number_of_scenarios * sizeof(ScenarioRecord);
+	std::vector<eVTOLSimulationParameters> scenarios(header.number_of_scenarios);
+	for (size_t i = 0; i < scenarios.size(); i++)
+	{
+		ScenarioRecord record;
+		std::memcpy(&record, payload + i * sizeof(ScenarioRecord), sizeof(record));
+		if (static_cast<uint64_t>(record.first_configuration) + record.number_of_configurations > header.number_of_configurations) throw std::invalid_argument("binary scenario configuration out of range.");
+
+		eVTOLSimulationParameters& parameters = scenarios[i];
+		parameters.number_of_evtols = static_cast<size_t>(record.number_of_evtols);
+		parameters.number_of_charging_bays = static_cast<size_t>(record.number_of_charging_bays);
+		parameters.number_of_charging_stations = static_cast<size_t>(record.number_of_charging_stations);
+		parameters.max_charge_rate_kw = record.max_charge_rate_kw;
+		parameters.number_of_station_threads = static_cast<size_t>(record.number_of_station_threads);
+		parameters.number_of_fleet_threads = static_cast<size_t>(record.number_of_fleet_threads);
+		parameters.simulation_time_minutes = static_cast<size_t>(record.simulation_time_minutes);
+		parameters.time_compression = static_cast<size_t>(record.time_compression);
+		parameters.timestep_milliseconds = static_cast<size_t>(record.timestep_milliseconds);
+		parameters.max_timestep_milliseconds = static_cast<size_t>(record.max_timestep_milliseconds);
+		parameters.seed = record.seed;
+		parameters.number_of_regions = static_cast<size_t>(record.number_of_regions);
+		parameters.cross_region_leg_probability = record.cross_region_leg_probability;
+		parameters.station_selection = binaryScenarioEnum(record.station_selection, ChargingStationSelection::PREDICTED_WAIT, "station_selection");
+		parameters.timer_mode = binaryScenarioEnum(record.timer_mode, SimulationTimerMode::FREE_RUNNING, "timer_mode");
+		parameters.timer_catch_up = binaryScenarioEnum(record.timer_catch_up, TimerCatchUpPolicy::COARSEN, "timer_catch_up");
+		parameters.engine = binaryScenarioEnum(record.engine, SimulationEngine::REGIONAL, "engine");
+		parameters.fault_sampling = binaryScenarioEnum(record.fault_sampling, FaultSampling::GEOMETRIC_SKIP, "fault_sampling");
+		parameters.verbose = record.verbose != 0;
+		parameters.configurations.clear();
+		parameters.configurations.reserve(record.number_of_configurations);
+		for (size_t c = 0; c < record.number_of_configurations; c++)
+		{
+			ConfigurationRecord config;
+			std::memcpy(&config, configuration_data + (record.first_configuration + c) * sizeof(ConfigurationRecord), sizeof(config));
+			config.company_name[sizeof(config.company_name) - 1] = '\0';
+			parameters.configurations.push_back(eVTOLConfiguration(config.company_name, config.cruise_speed, config.battery_capacity,
+				config.time_to_charge, config.energy_use_at_cruise, static_cast<size_t>(config.passenger_count), config.prob_fault_per_hour));
+		}
+	}
+	return scenarios;
+}
+
+inline void saveScenariosBinary(const std::string& file_name, const std::vector<eVTOLSimulationParameters>& scenarios)
+{
+	std::ofstream out(file_name, std::ios::binary);
+	if (!out) throw std::runtime_error("unable to open " + file_name + " for writing.");
+	writeScenariosBinary(out, scenarios);
+}
+
+// returns the contents of a file, read in one go
+inline std::string readScenarioFile(const std::string& file_name)
+{
+	std::ifstream in(file_name, std::ios::binary | std::ios::ate);
+	if (!in) throw std::runtime_error("unable to open " + file_name + ".");
+	std::string contents(static_cast<size_t>(in.tellg()), '\0');
+	in.seekg(0);
+	if (!contents.empty()) in.read(&contents[0], contents.size());
+	return contents;
+}
+
+inline bool isBinaryScenario(const std::string& contents)
+{
+	return contents.size() >= sizeof(SCENARIO_BINARY_MAGIC) && std::memcmp(contents.data(), SCENARIO_BINARY_MAGIC, sizeof(SCENARIO_BINARY_MAGIC)) == 0;
+}
+
+// loads every scenario of a file, binary or text, the form is told from the contents
+inline std::vector<eVTOLSimulationParameters> loadScenarios(const std::string& file_name)
+{
+	std::string contents = readScenarioFile(file_name);
+	if (isBinaryScenario(contents)) return readScenariosBinary(contents.data(), contents.size());
+	std::istringstream in(contents);
+	return std::vector<eVTOLSimulationParameters>(1, parseScenarioText(in));
+}
+
+
+
+void test_eVTOLScenario()
+{
+	using namespace std;
+
+	// text, keys left out keep their defaults
+	std::istringstream text(
+		"# a test scenario\n"
+		"number_of_evtols = 50   # more than the default\n"
+		"engine = \"DISCRETE_EVENT\"\n"
+		"timer_mode = FREE_RUNNING\n"
+		"timer_catch_up = COARSEN\n"
+		"fault_sampling = GEOMETRIC_SKIP\n"
+		"cross_region_leg_probability = 0.25\n"
+		"seed = 42\n"
+		"\n"
+		"[[configuration]]\n"
+		"company_name = \"Test # Company\"\n"
+		"cruise_speed = 120\n"
+		"battery_capacity = 320\n"
+		"time_to_charge = 0.6\n"
+		"energy_use_at_cruise = 1.6\n"
+		"passenger_count = 4\n");
+	eVTOLSimulationParameters parameters = parseScenarioText(text);
+	cout << parameters.number_of_evtols << "  " << simulationEngineName(parameters.engine) << "  " << parameters.seed << "  " << parameters.number_of_charging_bays;
+	cout << "  " << parameters.configurations.size() << "  " << parameters.configurations[0].company_name() << "  " << parameters.configurations[0].prob_fault_per_hour() << endl;
+
+	// errors name the line
+	const char* bad_scenarios[] = { "number_of_evtols = -3\n", "\nengine = WARP\n", "colour = blue\n", "[[configuration]]\ncompany_name = A\n", "simulation_time_minutes = 0\n", "number_of_regions = 2\n", "seed = 99999999999999999999\n" };
+	for (const char* bad : bad_scenarios)
+	{
+		std::istringstream bad_text(bad);
+		try { parseScenarioText(bad_text); }
+		catch (const std::invalid_argument& ia) { cout << ia.what() << endl; }
+	}
+
+	// text round trip
+	std::stringstream written;
+	writeScenarioText(written, parameters);
+	eVTOLSimulationParameters reread = parseScenarioText(written);
+	cout << (reread.configurations[0] == parameters.configurations[0]) << (reread.number_of_evtols == parameters.number_of_evtols) << (reread.engine == parameters.engine) << (reread.timer_catch_up == TimerCatchUpPolicy::COARSEN) << endl;
+
+	// binary round trip of many scenarios, and what happens to a damaged file
+	std::vector<eVTOLSimulationParameters> scenarios(3, parameters);
+	scenarios[1] = eVTOLSimulationParameters();
+	scenarios[2].seed = 7;
+	std::stringstream binary;
+	writeScenariosBinary(binary, scenarios);
+	std::string contents = binary.str();
+	std::vector<eVTOLSimulationParameters> loaded = readScenariosBinary(contents.data(), contents.size());
+	cout << isBinaryScenario(contents) << "  " << loaded.size() << "  " << loaded[1].configurations.size() << "  " << loaded[2].seed << "  " << loaded[0].configurations[0].company_name();
+	cout << "  " << (loaded[1].configurations[4] == echo_config) << "  " << timerCatchUpName(loaded[0].timer_catch_up) << "  " << faultSamplingName(loaded[0].fault_sampling) << "  " << loaded[0].cross_region_leg_probability << endl;
+
+	// an engine no version has, checksummed so only the range check can catch it
+	std::string unknown_engine = contents;
+	ScenarioRecord record;
+	std::memcpy(&record, &unknown_engine[sizeof(ScenarioFileHeader)], sizeof(record));
+	record.engine = 99;
+	std::memcpy(&unknown_engine[sizeof(ScenarioFileHeader)], &record, sizeof(record));
+	ScenarioFileHeader header;
+	std::memcpy(&header, unknown_engine.data(), sizeof(header));
+	header.checksum = fnv1a64(unknown_engine.data() + sizeof(header), unknown_engine.size() - sizeof(header));
+	std::memcpy(&unknown_engine[0], &header, sizeof(header));
+	try { readScenariosBinary(unknown_engine.data(), unknown_engine.size()); }
+	catch (const std::invalid_argument& ia) { cout << ia.what() << endl; }
+
+	contents[contents.size() - 1] ^= 1;
+	try { readScenariosBinary(contents.data(), contents.size()); }
+	catch (const std::invalid_argument& ia) { cout << ia.what() << endl; }
+	try { readScenariosBinary(contents.data(), 10); }
+	catch (const std::invalid_argument& ia) { cout << ia.what() << endl; }
+}
+
+
+#endif  // EVTOL_SCENARIO
@@ -4,16 +4,38 @@
 
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 #include <vector>
 #include <set>
 #include <algorithm>
 #include <numeric>
+#include <cmath>
 #include <stdexcept>
+#include <string>
+#include <functional>
+#include <memory>
 
 #include "evtol.h"
 #include "evtol_factory.h"
+#include "evtol_fleet.h"
+#include "evtol_results.h"
 #include "sim_timer.h"
+#include "sim_event_scheduler.h"
 #include "charge_station.h"
+#include "charge_network.h"
+#include "sim_thread_pool.h"
+#include "sim_random.h"
+#include "sim_memory.h"
+#include "sim_trace.h"
+#include "evtol_checkpoint.h"
+#include "sim_instrumentation.h"
+#include "evtol_analytic.h"
+#include "sim_output.h"
+#include "sim_columnar.h"
+#include "evtol_cohort.h"
+#include "evtol_model.h"
+#include "evtol_regions.h"
+#include "evtol_metrics.h"
 
 
 // basic simulation parameters
@@ -21,31 +43,405 @@
 // As it stands, modifying the parameters of the simulation requires a recompile.
 #define TOTAL_NUMBER_EVTOLS 20
 #define MAX_NUMBER_CHARGING_STALLS 3
+// charging stalls are per station, a charge rate of 0 places no limit on the charge rate of a stall
+#define NUMBER_OF_CHARGING_STATIONS 1
+#define CHARGING_STATION_MAX_CHARGE_RATE_KW 0.0
+// SHORTEST_QUEUE or PREDICTED_WAIT, how an eVTOL low on battery picks a charging station
+#define CHARGING_STATION_POLICY ChargingStationSelection::SHORTEST_QUEUE
+// more than 1 updates charging stations in parallel on that many threads
+#define CHARGING_STATION_THREADS 1
+// more than 1 updates eVTOLs in parallel on that many threads, FIXED_TIMESTEP only
+#define FLEET_UPDATE_THREADS 1
 #define TOTAL_MINUTES_SIMULATION_TIME 180
 #define SIMULATION_TIME_COMPRESSION 60
 #define TIMESTEP_IN_MILLISECONDS 1000
+// ADAPTIVE_TIMESTEP only, the longest a timestep may be, keeps the chance of a fault within a timestep small
+#define MAX_ADAPTIVE_TIMESTEP_IN_MILLISECONDS 60000
+// PACED runs the simulation against real time, FREE_RUNNING runs it as fast as possible
+#define SIMULATION_TIMER_MODE SimulationTimerMode::PACED
+// what a PACED run does when a timestep misses its real time deadline, see TimerCatchUpPolicy
+#define TIMER_CATCH_UP_POLICY TimerCatchUpPolicy::CATCH_UP
+// FIXED_TIMESTEP updates every agent at every timestep, BATCHED_FLEET updates the whole fleet at once,
+// ADAPTIVE_TIMESTEP steps from one state change to the next, DISCRETE_EVENT only processes state changes,
+// ANALYTIC works out the results in closed form until eVTOLs would have to wait for a bay,
+// COHORT updates each group of identical eVTOLs once for all of them,
+// SPECIALIZED updates the compiled in company models with loops specialized for each at compile time,
+// REGIONAL splits the fleet and stations into regions updated in parallel
+#define SIMULATION_ENGINE SimulationEngine::FIXED_TIMESTEP
+// more than 1 runs that many independent replications of the simulation and summarizes them
+#define NUMBER_OF_REPLICATIONS 1
+// PER_TIMESTEP draws a random number every timestep an eVTOL flies, GEOMETRIC_SKIP the number of timesteps to its next fault,
+// see FaultSampling, timestep engines with eVTOL agents only
+#define FAULT_SAMPLING FaultSampling::PER_TIMESTEP
+// REGIONAL only, regions the stations and fleet are split into, and the chance a leg ends in another region
+#define NUMBER_OF_REGIONS 1
+#define CROSS_REGION_LEG_PROBABILITY 0.0
+// true prints the instrumentation, time spent in each phase of a timestep and station counters, after the results
+#define REPORT_INSTRUMENTATION false
+// with --metrics, the simulation time between snapshots published to the metrics region
+#define METRICS_INTERVAL_IN_MILLISECONDS 60000
 
 // These are the eVTOL configurations specified in the problem sheet.
+// Each is a parameter set known at compile time, see eVTOLModel, for the SPECIALIZED engine.
 // TODO:  this should definitely go in a config file!!
-eVTOLConfiguration alpha_config("Alpha Company", 120, 320, 0.60, 1.6, 4, 0.25);
-eVTOLConfiguration beta_config("Beta Company", 100, 100, 0.20, 1.5, 5, 0.10);
-eVTOLConfiguration charlie_config("Charlie Company", 220, 320, 0.80, 2.2, 3, 0.05);
-eVTOLConfiguration delta_config("Delta Company", 90, 120, 0.62, 0.8, 2, 0.22);
-eVTOLConfiguration echo_config("Echo Company", 30, 150, 0.30, 5.8, 2, 0.61);
+struct AlphaCompanyModel
+{
+	static constexpr const char* company_name() { return "Alpha Company"; }
+	static constexpr double cruise_speed() { return 120; }
+	static constexpr double battery_capacity() { return 320; }
+	static constexpr double time_to_charge() { return 0.60; }
+	static constexpr double energy_use_at_cruise() { return 1.6; }
+	static constexpr size_t passenger_count() { return 4; }
+	static constexpr double prob_fault_per_hour() { return 0.25; }
+};
+struct BetaCompanyModel
+{
+	static constexpr const char* company_name() { return "Beta Company"; }
+	static constexpr double cruise_speed() { return 100; }
+	static constexpr double battery_capacity() { return 100; }
+	static constexpr double time_to_charge() { return 0.20; }
+	static constexpr double energy_use_at_cruise() { return 1.5; }
+	static constexpr size_t passenger_count() { return 5; }
+	static constexpr double prob_fault_per_hour() { return 0.10; }
+};
+struct CharlieCompanyModel
+{
+	static constexpr const char* company_name() { return "Charlie Company"; }
+	static constexpr double cruise_speed() { return 220; }
+	static constexpr double battery_capacity() { return 320; }
+	static constexpr double time_to_charge() { return 0.80; }
+	static constexpr double energy_use_at_cruise() { return 2.2; }
+	static constexpr size_t passenger_count() { return 3; }
+	static constexpr double prob_fault_per_hour() { return 0.05; }
+};
+struct DeltaCompanyModel
+{
+	static constexpr const char* company_name() { return "Delta Company"; }
+	static constexpr double cruise_speed() { return 90; }
+	static constexpr double battery_capacity() { return 120; }
+	static constexpr double time_to_charge() { return 0.62; }
+	static constexpr double energy_use_at_cruise() { return 0.8; }
+	static constexpr size_t passenger_count() { return 2; }
+	static constexpr double prob_fault_per_hour() { return 0.22; }
+};
+struct EchoCompanyModel
+{
+	static constexpr const char* company_name() { return "Echo Company"; }
+	static constexpr double cruise_speed() { return 30; }
+	static constexpr double battery_capacity() { return 150; }
+	static constexpr double time_to_charge() { return 0.30; }
+	static constexpr double energy_use_at_cruise() { return 5.8; }
+	static constexpr size_t passenger_count() { return 2; }
+	static constexpr double prob_fault_per_hour() { return 0.61; }
+};
+
+eVTOLConfiguration alpha_config = eVTOLModel<AlphaCompanyModel>::configuration();
+eVTOLConfiguration beta_config = eVTOLModel<BetaCompanyModel>::configuration();
+eVTOLConfiguration charlie_config = eVTOLModel<CharlieCompanyModel>::configuration();
+eVTOLConfiguration delta_config = eVTOLModel<DeltaCompanyModel>::configuration();
+eVTOLConfiguration echo_config = eVTOLModel<EchoCompanyModel>::configuration();
+
+// the fleet of the SPECIALIZED engine, one vector of eVTOLs for each compiled in model
+typedef eVTOLModelFleet<AlphaCompanyModel, BetaCompanyModel, CharlieCompanyModel, DeltaCompanyModel, EchoCompanyModel> CompanyModelFleet;
+
+
+
+// Describes how the simulation advances time.
+//   FIXED_TIMESTEP - a SimulationEventTimer updates every agent at every timestep
+//   BATCHED_FLEET -  as FIXED_TIMESTEP, but eVTOLs are held in an eVTOLFleet and updated in a single batch
+//   DISCRETE_EVENT - a SimulationEventScheduler calls agents back only when their state changes,
+//                    always runs as fast as possible
+//   ADAPTIVE_TIMESTEP - as FIXED_TIMESTEP, but each timestep ends at the next predicted change of state of any eVTOL
+//                       or charging station, a low battery or a full charge, no more than max_timestep_milliseconds on
+//   ANALYTIC - while there are always enough bays, every eVTOL repeats the same flight and charge cycle,
+//              so the results are worked out in closed form, see eVTOLAnalyticCycle, with no simulation at all.
+//              From the last timestep before the first eVTOL would wait, the rest is simulated as FIXED_TIMESTEP.
+//              A single charging station only, the closed form takes no account of the station policy.
+//   COHORT - as FIXED_TIMESTEP, but identical eVTOLs are updated together as a cohort until they go different ways,
+//            see eVTOLCohortFleet, a single charging station only
+//   SPECIALIZED - as FIXED_TIMESTEP, but the eVTOLs are held in a CompanyModelFleet, a vector for each company model
+//                 compiled in, updated by loops with no virtual dispatch, the same results, see eVTOLModelFleet.
+//                 Only eVTOLs with one of the compiled in configurations, not traced.
+//   REGIONAL - as FIXED_TIMESTEP, but the stations and fleet are split into regions, each updating its own eVTOLs and
+//              stations in parallel, eVTOLs migrate between regions on cross region legs, see eVTOLRegionalFleet.
+//              A single region is the same results as FIXED_TIMESTEP.  Not traced.
+enum class SimulationEngine
+{
+	FIXED_TIMESTEP,
+	BATCHED_FLEET,
+	DISCRETE_EVENT,
+	ADAPTIVE_TIMESTEP,
+	ANALYTIC,
+	COHORT,
+	SPECIALIZED,
+	REGIONAL
+};
+
+// returns the name of the simulation engine
+std::string simulationEngineName(SimulationEngine engine)
+{
+	if (engine == SimulationEngine::FIXED_TIMESTEP) return "FIXED_TIMESTEP";
+	if (engine == SimulationEngine::BATCHED_FLEET) return "BATCHED_FLEET";
+	if (engine == SimulationEngine::DISCRETE_EVENT) return "DISCRETE_EVENT";
+	if (engine == SimulationEngine::ADAPTIVE_TIMESTEP) return "ADAPTIVE_TIMESTEP";
+	if (engine == SimulationEngine::ANALYTIC) return "ANALYTIC";
+	if (engine == SimulationEngine::COHORT) return "COHORT";
+	if (engine == SimulationEngine::SPECIALIZED) return "SPECIALIZED";
+	if (engine == SimulationEngine::REGIONAL) return "REGIONAL";
+	return "UNKNOWN";
+}
+
+
+// How an eVTOL low on battery picks one of the charging stations of the simulation.
+//   SHORTEST_QUEUE - the station with the fewest eVTOLs waiting, see ShortestQueuePolicy
+//   PREDICTED_WAIT - the station predicted to have a bay free soonest, see PredictedWaitPolicy
+// The eVTOLs of the simulation have no position, so nearest station is not available here.
+enum class ChargingStationSelection
+{
+	SHORTEST_QUEUE,
+	PREDICTED_WAIT
+};
+
 
+// The parameters of an eVTOLSimulation, defaults are the basic simulation parameters above.
+// All random numbers of the simulation are derived from the master seed,
+// a seed of 0 picks a master seed from the clock, any other seed makes the simulation reproducible.
+// verbose prints progress of the simulation to std::cout.
+struct eVTOLSimulationParameters
+{
+	eVTOLSimulationParameters()
+	{
+		number_of_evtols = TOTAL_NUMBER_EVTOLS;
+		number_of_charging_bays = MAX_NUMBER_CHARGING_STALLS;
+		number_of_charging_stations = NUMBER_OF_CHARGING_STATIONS;
+		max_charge_rate_kw = CHARGING_STATION_MAX_CHARGE_RATE_KW;
+		station_selection = CHARGING_STATION_POLICY;
+		number_of_station_threads = CHARGING_STATION_THREADS;
+		number_of_fleet_threads = FLEET_UPDATE_THREADS;
+		simulation_time_minutes = TOTAL_MINUTES_SIMULATION_TIME;
+		time_compression = SIMULATION_TIME_COMPRESSION;
+		timestep_milliseconds = TIMESTEP_IN_MILLISECONDS;
+		max_timestep_milliseconds = MAX_ADAPTIVE_TIMESTEP_IN_MILLISECONDS;
+		timer_mode = SIMULATION_TIMER_MODE;
+		timer_catch_up = TIMER_CATCH_UP_POLICY;
+		engine = SIMULATION_ENGINE;
+		fault_sampling = FAULT_SAMPLING;
+		number_of_regions = NUMBER_OF_REGIONS;
+		cross_region_leg_probability = CROSS_REGION_LEG_PROBABILITY;
+		seed = 0;
+		verbose = true;
+		configurations.push_back(alpha_config);
+		configurations.push_back(beta_config);
+		configurations.push_back(charlie_config);
+		configurations.push_back(delta_config);
+		configurations.push_back(echo_config);
+	}
+
+	size_t number_of_evtols;
+	size_t number_of_charging_bays;      // per charging station
+	size_t number_of_charging_stations;
+	double max_charge_rate_kw;            // per charging bay, 0 for no limit
+	ChargingStationSelection station_selection;
+	size_t number_of_station_threads;     // threads updating the charging stations, 1 updates them on the timer thread
+	size_t number_of_fleet_threads;       // threads updating the eVTOLs, 1 updates them on the timer thread
+	size_t simulation_time_minutes;
+	size_t time_compression;
+	size_t timestep_milliseconds;
+	size_t max_timestep_milliseconds;     // ADAPTIVE_TIMESTEP only
+	SimulationTimerMode timer_mode;
+	TimerCatchUpPolicy timer_catch_up;    // PACED only
+	SimulationEngine engine;
+	FaultSampling fault_sampling;         // FIXED_TIMESTEP, ADAPTIVE_TIMESTEP, ANALYTIC, SPECIALIZED and REGIONAL
+	size_t number_of_regions;             // REGIONAL only, at most number_of_charging_stations
+	double cross_region_leg_probability;  // REGIONAL only, the chance an eVTOL's leg ends in another region
+	uint64_t seed;
+	bool verbose;
+	std::vector<eVTOLConfiguration> configurations;  // eVTOL prototypes, the fleet is a random mix of these
+};
 
 
 // This is a simulation specifically implementing the Joby eVTOL Simulation problem.
 // Various parameters and configurations of this simulation can be modified.
 // A different simulation, capturing different information, would require a different implementation.
 // Several general simulation components are used however.
+// A snapshot handler receives the per company results at regular intervals of simulation time while it runs.
+// Snapshots are taken between timesteps, or between events, on the simulation thread,
+// so they are consistent and the simulation carries on as soon as the handler returns.
+// The eVTOLs live in an arena owned by the simulation, or one given to setArena, so that many simulations
+// run one after another, e.g. by a sweep, reuse the same storage rather than allocating a fleet each time.
+// Given an EventTraceSink, every change of state of every eVTOL, every fault, and every bay given out or
+// freed is recorded to it, an eVTOL is identified by its order of creation, a station by its index.
+// The timestep engines can checkpoint the whole simulation between timesteps, at intervals while it runs
+// or once it has finished.  A new simulation resumed from a checkpoint carries on exactly where it left off,
+// given the same parameters, or branches off from that state given different ones, e.g. a different policy.
+// Unless compiled out with EVTOL_NO_INSTRUMENTATION, every run is instrumented, see instrumentation().
 class eVTOLSimulation
 {
 public:
-	eVTOLSimulation()
+	eVTOLSimulation(const eVTOLSimulationParameters& parameters = eVTOLSimulationParameters())
 	{
+		if (parameters.configurations.empty()) throw std::invalid_argument("at least one eVTOL configuration is required.");
+
+		parameters_ = parameters;
+		master_seed_ = parameters.seed ? RandomSeed(parameters.seed) : RandomSeed::fromClock();
 		has_already_run_ = false;
-		charging_station_ = nullptr;
+		charging_network_ = nullptr;
+		arena_ = &evtol_arena_;
+		trace_ = nullptr;
+		timer_jitter_ = SimulationTimerJitter();
+		analytic_simulated_from_ = NOT_SIMULATED;
+		snapshot_interval_ = 0;
+		next_snapshot_time_ = 0;
+		metrics_publisher_ = nullptr;
+		metrics_interval_ = 0;
+		next_metrics_time_ = 0;
+		checkpoint_interval_ = 0;
+		next_checkpoint_time_ = 0;
+		current_time_ = 0;
+
+		// companies in order of name, a company's id is its position in the list
+		std::set<std::string> companies;
+		for (auto& config : parameters_.configurations)
+		{
+			companies.insert(config.company_name());
+		}
+		companies_.assign(companies.begin(), companies.end());
+		aggregator_ = eVTOLCompanyAggregator(companies_);
+	}
+
+	// handler is called with the simulation time and the per company results
+	// every interval_milliseconds of simulation time, must be set before run()
+	// the discrete event engine takes no snapshot at the very end of the simulation, companyResults() has the final results
+	void setSnapshotHandler(size_t interval_milliseconds, std::function<void(unsigned long long, const std::vector<eVTOLCompanyResults>&)> handler)
+	{
+		if (has_already_run_) throw std::logic_error("the snapshot handler must be set before the simulation runs.");
+		if (parameters_.engine == SimulationEngine::ANALYTIC) throw std::logic_error("the analytic engine takes no snapshots.");
+		if (interval_milliseconds == 0) throw std::invalid_argument("interval_milliseconds must be greater than 0.");
+		snapshot_interval_ = interval_milliseconds;
+		next_snapshot_time_ = interval_milliseconds;
+		snapshot_handler_ = handler;
+	}
+
+	// publishes the queue depth, bay occupancy and per company totals every interval_milliseconds of simulation time,
+	// and once more with finished set at the end of the run, must be set before run(), the publisher must outlive the run
+	// as with snapshots a metrics snapshot is taken at the first timestep, or event, at or after it is due
+	void setMetricsPublisher(size_t interval_milliseconds, eVTOLMetricsPublisher& publisher)
+	{
+		if (has_already_run_) throw std::logic_error("the metrics publisher must be set before the simulation runs.");
+		if (parameters_.engine == SimulationEngine::ANALYTIC) throw std::logic_error("the analytic engine publishes no metrics.");
+		if (interval_milliseconds == 0) throw std::invalid_argument("interval_milliseconds must be greater than 0.");
+		if (companies_.size() > METRICS_MAX_COMPANIES) throw std::invalid_argument("metrics have room for " + std::to_string(METRICS_MAX_COMPANIES) + " companies.");
+		metrics_interval_ = interval_milliseconds;
+		next_metrics_time_ = interval_milliseconds;
+		metrics_publisher_ = &publisher;
+	}
+
+	// creates the eVTOLs in the given arena rather than the simulation's own, must be set before run()
+	// the arena must outlive the simulation, its eVTOLs are destroyed along with the simulation, its storage is kept
+	void setArena(ObjectArena<eVTOL>& arena)
+	{
+		if (has_already_run_) throw std::logic_error("the arena must be set before the simulation runs.");
+		arena_ = &arena;
+	}
+
+	// records the events of the simulation to trace, must be set before run()
+	// everything is in the trace by the time run() returns, the sink can go on to trace another simulation
+	void setTrace(EventTraceSink* trace)
+	{
+		if (has_already_run_) throw std::logic_error("the trace must be set before the simulation runs.");
+		if (parameters_.engine == SimulationEngine::ANALYTIC && trace) throw std::logic_error("the analytic engine can't be traced.");
+		if (parameters_.engine == SimulationEngine::COHORT && trace) throw std::logic_error("the cohort engine can't be traced, its eVTOLs have no identity.");
+		if (parameters_.engine == SimulationEngine::SPECIALIZED && trace) throw std::logic_error("the specialized engine can't be traced.");
+		if (parameters_.engine == SimulationEngine::REGIONAL && trace) throw std::logic_error("the regional engine can't be traced.");
+		trace_ = trace;
+	}
+
+	// handler is called with a checkpoint of the simulation every interval_milliseconds of simulation time,
+	// must be set before run(), timestep engines only
+	void setCheckpointHandler(size_t interval_milliseconds, std::function<void(const eVTOLSimulationCheckpoint&)> handler)
+	{
+		if (has_already_run_) throw std::logic_error("the checkpoint handler must be set before the simulation runs.");
+		if (!supportsCheckpoints()) throw std::logic_error("checkpoints are only supported by the fixed timestep engines.");
+		if (interval_milliseconds == 0) throw std::invalid_argument("interval_milliseconds must be greater than 0.");
+		checkpoint_interval_ = interval_milliseconds;
+		next_checkpoint_time_ = interval_milliseconds;
+		checkpoint_handler_ = handler;
+	}
+
+	// run() carries on from the checkpoint rather than starting from the beginning, must be set before run()
+	// the checkpoint must be of the same engine, number of eVTOLs, stations, bays, and timestep
+	// simulation_time_minutes is the total time including the time before the checkpoint
+	void resumeFrom(const eVTOLSimulationCheckpoint& checkpoint)
+	{
+		if (has_already_run_) throw std::logic_error("a simulation must be resumed before it runs.");
+		if (!supportsCheckpoints()) throw std::logic_error("checkpoints are only supported by the fixed timestep engines.");
+		const SimulationCheckpointHeader& header = checkpoint.header;
+		if (header.engine != static_cast<uint32_t>(parameters_.engine)) throw std::invalid_argument("the checkpoint is of a different simulation engine.");
+		if (checkpoint.evtols.size() != parameters_.number_of_evtols) throw std::invalid_argument("the checkpoint has a different number of eVTOLs.");
+		if (header.number_of_stations != parameters_.number_of_charging_stations || header.number_of_charging_bays != parameters_.number_of_charging_bays)
+		{
+			throw std::invalid_argument("the checkpoint has different charging stations.");
+		}
+		if (header.timestep_milliseconds != parameters_.timestep_milliseconds) throw std::invalid_argument("the checkpoint has a different timestep.");
+		for (auto& record : checkpoint.evtols)
+		{
+			if (record.configuration >= parameters_.configurations.size()) throw std::invalid_argument("the checkpoint refers to an unknown configuration.");
+		}
+		resume_from_.reset(new eVTOLSimulationCheckpoint(checkpoint));
+	}
+
+	// the state of the simulation at the end of the latest timestep, while running, e.g. from a snapshot handler, or once finished
+	eVTOLSimulationCheckpoint checkpoint()
+	{
+		if (!has_already_run_) throw std::logic_error("a checkpoint can only be taken of a simulation that is running or has run.");
+		if (!supportsCheckpoints()) throw std::logic_error("checkpoints are only supported by the fixed timestep engines.");
+
+		eVTOLSimulationCheckpoint checkpoint = {};
+		checkpoint.header.engine = static_cast<uint32_t>(parameters_.engine);
+		checkpoint.header.time = current_time_;
+		checkpoint.header.timestep_milliseconds = parameters_.timestep_milliseconds;
+		checkpoint.header.fleet_random_key = fleet_ ? fleet_->randomKey() : 0;
+		checkpoint.header.fleet_timestep_count = fleet_ ? fleet_->timestepCount() : 0;
+		checkpoint.header.number_of_stations = charging_network_->numberOfStations();
+		checkpoint.header.number_of_charging_bays = parameters_.number_of_charging_bays;
+
+		checkpoint.evtols.resize(evtols_.size());
+		for (size_t i = 0; i < evtols_.size(); i++)
+		{
+			eVTOLAgentState agent_state = fleet_ ? fleet_->agentState(i) : evtols_[i]->agentState();
+			eVTOLCheckpointRecord& record = checkpoint.evtols[i];
+			record.total_flight_time = agent_state.total_flight_time;
+			record.total_charge_time = agent_state.total_charge_time;
+			record.total_wait_time = agent_state.total_wait_time;
+			record.current_charge = agent_state.current_charge;
+			record.number_of_faults = agent_state.number_of_faults;
+			record.random_state = evtols_[i]->randomState();
+			record.state = static_cast<uint32_t>(agent_state.state);
+			record.configuration = static_cast<uint32_t>(configurationIndex(evtols_[i]->configuration()));
+		}
+
+		// devices are eVTOLs, or stand ins for them, whose trace id is the eVTOL's index
+		std::vector<uint64_t>& words = checkpoint.stations;
+		for (size_t s = 0; s < charging_network_->numberOfStations(); s++)
+		{
+			ChargingStationOccupancy occupancy = charging_network_->station(s).occupancy();
+			words.push_back(occupancy.occupied_bays.size());
+			for (size_t i = 0; i < occupancy.occupied_bays.size(); i++)
+			{
+				words.push_back(occupancy.occupied_bays[i]);
+				words.push_back(occupancy.bay_devices[i]->traceId());
+			}
+			words.push_back(occupancy.free_bays.size());
+			words.insert(words.end(), occupancy.free_bays.begin(), occupancy.free_bays.end());
+			words.push_back(occupancy.waiting.size());
+			for (ChargeableDevice* device : occupancy.waiting)
+			{
+				words.push_back(device->traceId());
+			}
+		}
+		checkpoint.header.number_of_evtols = checkpoint.evtols.size();
+		checkpoint.header.number_of_station_words = words.size();
+		return checkpoint;
 	}
 
 	// constructs and runs the entire simulation
@@ -54,163 +450,1528 @@ public:
 		if (has_already_run_) throw std::logic_error("Each instance of eVTOLSimulation can only run once.");
 		has_already_run_ = true;
 
-		// create the charging station
-		charging_station_ = new ChargingStation(MAX_NUMBER_CHARGING_STALLS);
-
-		// create the eVTOL factory and populate it with the eVTOL prototypes
-		eVTOLFactory factory;
-		factory.addPrototype(eVTOL(alpha_config, charging_station_));
-		factory.addPrototype(eVTOL(beta_config, charging_station_));
-		factory.addPrototype(eVTOL(charlie_config, charging_station_));
-		factory.addPrototype(eVTOL(delta_config, charging_station_));
-		factory.addPrototype(eVTOL(echo_config, charging_station_));
-
-		// create the population eVTOLs and make them agents of the simulation 
-		int num_evtols = TOTAL_NUMBER_EVTOLS;
-		while (num_evtols-- > 0)
+		// create the charging stations
+		if (parameters_.number_of_charging_stations == 0) throw std::invalid_argument("at least one charging station is required.");
+		charging_network_ = new ChargingNetwork();
+		for (size_t i = 0; i < parameters_.number_of_charging_stations; i++)
 		{
-			eVTOL* evtol = factory.create_eVTOL();
-			evtol->begin();
-			evtols_.push_back(evtol);
+			charging_network_->addStation(parameters_.number_of_charging_bays, parameters_.max_charge_rate_kw);
+		}
+		if (parameters_.station_selection == ChargingStationSelection::PREDICTED_WAIT)
+		{
+			charging_network_->setPolicy(std::unique_ptr<ChargingStationPolicy>(new PredictedWaitPolicy()));
 		}
-		charging_station_->begin();
 
-		// create the timer and timestep event handler
-		auto timestep_handler = [this](size_t prev_time, size_t cur_time) {
-			// simply forward the timestep event to each of the simulation agents - evtols and charging station
-			std::for_each(evtols_.begin(), evtols_.end(), [prev_time, cur_time](eVTOL* evtol) {
-				evtol->timestepUpdate(prev_time, cur_time);
-				});
-			charging_station_->timestepUpdate(prev_time, cur_time);
-			// print dot every second in real time for user feedback
-			if (((cur_time / 1000) % SIMULATION_TIME_COMPRESSION) == 0) 
+		// create the population eVTOLs and make them agents of the simulation
+		// the whole fleet is a single allocation, a reused arena is only reallocated when too small
+		arena_->clear();
+		if (arena_->capacity() < parameters_.number_of_evtols) arena_->reserve(parameters_.number_of_evtols);
+		if (resume_from_)
+		{
+			restoreeVTOLs();
+		}
+		else
+		{
+			// create the eVTOL factory and populate it with the eVTOL prototypes
+			eVTOLFactory factory(master_seed_.child(RandomStream::FACTORY));
+			for (auto& config : parameters_.configurations)
 			{
-				std::cout << ".";
-				std::cout.flush();
+				factory.addPrototype(eVTOL(config, charging_network_));
 			}
-		};
-		SimulationEventTimer timer(TIMESTEP_IN_MILLISECONDS, timestep_handler, TOTAL_MINUTES_SIMULATION_TIME, SIMULATION_TIME_COMPRESSION);
+			factory.create_eVTOLs(parameters_.number_of_evtols, *arena_, evtols_);
+		}
+		evtol_company_ids_.reserve(evtols_.size());
+		for (eVTOL* evtol : evtols_)
+		{
+			evtol_company_ids_.push_back(companyId(evtol->company_name()));
+		}
 
-		// start the simulation
-		std::cout << std::endl << "Starting Simulation" << std::endl;
-		std::cout << std::fixed << std::setprecision(2);
-		std::cout << "This will take approximately " << timer.totalSimulationTimeInRealMinutes() << " minutes." << std::endl;
-		timer.start();
-		std::cout << std::endl << "Simulation Finished" << std::endl;
+		// no eVTOL ever has to wait for the waiting queues to grow
+		charging_network_->reserveWaiting(evtols_.size());
+
+		// an eVTOL is identified by its order of creation, in traces and checkpoints
+		current_time_ = resume_from_ ? resume_from_->header.time : 0;
+		for (size_t i = 0; i < evtols_.size(); i++)
+		{
+			evtols_[i]->setTrace(trace_, static_cast<uint32_t>(i));
+			evtols_[i]->setFaultSampling(parameters_.fault_sampling);
+		}
+		if (trace_)
+		{
+			trace_->setTime(current_time_);
+			charging_network_->setTrace(trace_);
+		}
+
+		// a resumed simulation takes its next snapshot and checkpoint after the time it resumed from
+		while (snapshot_handler_ && next_snapshot_time_ <= current_time_) next_snapshot_time_ += snapshot_interval_;
+		while (checkpoint_handler_ && next_checkpoint_time_ <= current_time_) next_checkpoint_time_ += checkpoint_interval_;
+		while (metrics_publisher_ && next_metrics_time_ <= current_time_) next_metrics_time_ += metrics_interval_;
+
+		instrumentation_.start();
+		if (parameters_.engine == SimulationEngine::DISCRETE_EVENT)
+		{
+			runDiscreteEvent();
+		}
+		else if (parameters_.engine == SimulationEngine::BATCHED_FLEET)
+		{
+			runBatchedFleet();
+		}
+		else if (parameters_.engine == SimulationEngine::ADAPTIVE_TIMESTEP)
+		{
+			runAdaptiveTimestep();
+		}
+		else if (parameters_.engine == SimulationEngine::ANALYTIC)
+		{
+			runAnalytic();
+		}
+		else if (parameters_.engine == SimulationEngine::COHORT)
+		{
+			runCohort();
+		}
+		else if (parameters_.engine == SimulationEngine::SPECIALIZED)
+		{
+			runSpecialized();
+		}
+		else if (parameters_.engine == SimulationEngine::REGIONAL)
+		{
+			runRegional();
+		}
+		else
+		{
+			runFixedTimestep();
+		}
+		if (metrics_publisher_)
+		{
+			publishMetrics(parameters_.simulation_time_minutes * 60ULL * 1000ULL, true, [this](size_t i) { return evtols_[i]->agentState(); });
+		}
+		instrumentation_.stop();
+		if (trace_) trace_->flush();
+	}
+
+	// where the time of the run went and what happened at the stations, phases are timed by the timestep engines only
+	SimulationInstrumentationReport instrumentation()
+	{
+		if (!has_already_run_) throw std::logic_error("a simulation must run before it has any instrumentation.");
+		ChargingStationCounters counters = cohort_fleet_ ? cohort_fleet_->counters() : regional_fleet_ ? regional_fleet_->counters() : charging_network_->counters();
+		return instrumentation_.report(counters, parameters_.number_of_charging_bays);
 	}
 
+	void printInstrumentation()
+	{
+		std::ostringstream report;
+		printInstrumentationReport(report, instrumentation());
+		if (parameters_.timer_mode == SimulationTimerMode::PACED && parameters_.engine != SimulationEngine::DISCRETE_EVENT)
+		{
+			report << "  Timer Lateness p50/p99/max:  " << timer_jitter_.p50_lateness_microseconds << " / " << timer_jitter_.p99_lateness_microseconds;
+			report << " / " << timer_jitter_.max_lateness_microseconds << " us\n";
+			report << "  Timer Missed Deadlines:      " << timer_jitter_.missed_deadlines << " of " << timer_jitter_.timesteps_fired << '\n';
+			report << "  Timer Dropped / Coarsened:   " << timer_jitter_.dropped_slots << " / " << timer_jitter_.coarsened_timesteps << '\n';
+		}
+		writeReport(std::cout, report.str());
+	}
 
+	static const unsigned long long NOT_SIMULATED = std::numeric_limits<unsigned long long>::max();
+
+	// ANALYTIC only, the time from which the simulation was simulated rather than worked out, NOT_SIMULATED when none of it was
+	unsigned long long analyticSimulatedFrom() { return analytic_simulated_from_; }
+
+	// how late a PACED run fired its timesteps against real time, all zero when free running or event driven
+	SimulationTimerJitter timerJitter() { return timer_jitter_; }
+
+
+	// prints the results, built up in a buffer and written to std::cout at once
 	void printResults()
 	{
-		using namespace std;
-		cout << endl << endl << "******************************** R E S U L T S ********************************" << endl;
-		printSimulationParameters();
-		printIndividualVTOLResults();
-		printCompanyGroupResults();
-		cout << endl;
+		std::ostringstream report;
+		writeResults(report);
+		writeReport(std::cout, report.str());
 	}
 
 	void printSimulationParameters()
 	{
-		using namespace std;
-		cout << endl << "Simulation Parameters" << endl;
-		cout << "  Number of eVTOLS:            " << TOTAL_NUMBER_EVTOLS << endl;
-		cout << "  Number of Charging Bays:     " << MAX_NUMBER_CHARGING_STALLS << endl;
-		cout << "  Total Simulation Time:       " << TOTAL_MINUTES_SIMULATION_TIME << " minutes" << endl;
-		cout << "  Simulation Time Compression: " << SIMULATION_TIME_COMPRESSION << endl;
-		cout << "  Timestep Interval:           " << TIMESTEP_IN_MILLISECONDS << " milliseconds" << endl;
-
+		std::ostringstream report;
+		writeSimulationParameters(report);
+		writeReport(std::cout, report.str());
 	}
 
 	void printIndividualVTOLResults()
+	{
+		std::ostringstream report;
+		writeIndividualVTOLResults(report);
+		writeReport(std::cout, report.str());
+	}
+
+	void printCompanyGroupResults()
+	{
+		std::ostringstream report;
+		writeCompanyGroupResults(report);
+		writeReport(std::cout, report.str());
+	}
+
+	// the results as printResults prints them
+	void writeResults(std::ostream& out)
+	{
+		out << "\n\n******************************** R E S U L T S ********************************\n";
+		writeSimulationParameters(out);
+		writeIndividualVTOLResults(out);
+		writeCompanyGroupResults(out);
+		out << '\n';
+	}
+
+	void writeSimulationParameters(std::ostream& out)
+	{
+		using namespace std;
+		out << fixed << setprecision(2);
+		out << "\nSimulation Parameters\n";
+		out << "  Number of eVTOLS:            " << parameters_.number_of_evtols << '\n';
+		out << "  Number of Charging Stations: " << parameters_.number_of_charging_stations << '\n';
+		out << "  Charging Bays per Station:   " << parameters_.number_of_charging_bays << '\n';
+		if (parameters_.max_charge_rate_kw > 0.0)
+		{
+			out << "  Max Charge Rate per Bay:     " << parameters_.max_charge_rate_kw << " kW\n";
+		}
+		if (parameters_.number_of_charging_stations > 1)
+		{
+			out << "  Charging Station Policy:     " << charging_network_->policy().name() << '\n';
+		}
+		out << "  Total Simulation Time:       " << parameters_.simulation_time_minutes << " minutes\n";
+		out << "  Simulation Time Compression: " << parameters_.time_compression << '\n';
+		out << "  Timestep Interval:           " << parameters_.timestep_milliseconds << " milliseconds\n";
+		if (parameters_.engine == SimulationEngine::ANALYTIC)
+		{
+			out << "  Simulated From:              ";
+			if (analytic_simulated_from_ == NOT_SIMULATED) out << "none, closed form throughout\n";
+			else out << analytic_simulated_from_ / (60.0 * 1000) << " minutes\n";
+		}
+		if (parameters_.engine == SimulationEngine::COHORT && cohort_fleet_)
+		{
+			out << "  Cohorts at End / Most:       " << cohort_fleet_->numberOfCohorts() << " / " << cohort_fleet_->maxCohorts() << '\n';
+		}
+		if (parameters_.engine == SimulationEngine::REGIONAL)
+		{
+			out << "  Number of Regions:           " << parameters_.number_of_regions << '\n';
+			out << "  Cross Region Leg Chance:     " << parameters_.cross_region_leg_probability << '\n';
+			if (regional_fleet_) out << "  Migrations:                  " << regional_fleet_->migrations() << '\n';
+		}
+		if (parameters_.engine == SimulationEngine::ADAPTIVE_TIMESTEP)
+		{
+			out << "  Max Adaptive Timestep:       " << parameters_.max_timestep_milliseconds << " milliseconds\n";
+		}
+		out << "  Timer Mode:                  " << (parameters_.timer_mode == SimulationTimerMode::PACED ? "PACED" : "FREE_RUNNING") << '\n';
+		if (parameters_.timer_mode == SimulationTimerMode::PACED && parameters_.timer_catch_up != TimerCatchUpPolicy::CATCH_UP)
+		{
+			out << "  Timer Catch Up Policy:       " << (parameters_.timer_catch_up == TimerCatchUpPolicy::DROP ? "DROP" : "COARSEN") << '\n';
+		}
+		out << "  Simulation Engine:           " << simulationEngineName(parameters_.engine) << '\n';
+		if (parameters_.fault_sampling != FaultSampling::PER_TIMESTEP)
+		{
+			out << "  Fault Sampling:              " << faultSamplingName(parameters_.fault_sampling) << '\n';
+		}
+		if (parameters_.number_of_fleet_threads > 1 && (parameters_.engine == SimulationEngine::FIXED_TIMESTEP || parameters_.engine == SimulationEngine::REGIONAL))
+		{
+			out << "  Fleet Update Threads:        " << parameters_.number_of_fleet_threads << '\n';
+		}
+		out << "  Random Seed:                 " << master_seed_.value() << '\n';
+	}
+
+	void writeIndividualVTOLResults(std::ostream& out)
 	{
 		using namespace std;
-		cout << endl << "Individual eVTOL Stats" << endl;
-		cout << setw(20) << "COMPANY" << setw(10) << "FLIGHT" << setw(10) << "CHARGE" << setw(10) << "WAIT" << setw(10) << "ENDING" << setw(11) << "CHARGE" << endl;
-		cout << setw(20) << "" << setw(10) << "TIME" << setw(10) << "TIME" << setw(10) << "TIME" << setw(10) << "STATE" << setw(11) << "REMAINING" << endl;
-		cout << setw(20) << "------------------" << setw(10) << "--------" << setw(10) << "--------" << setw(10) << "--------" << setw(10) << "--------" << setw(11) << "---------" << endl;
-		std::for_each(evtols_.begin(), evtols_.end(), [](eVTOL* evtol) {
-			cout << setw(20) << evtol->company_name();
-			cout << fixed << setprecision(2);
-			cout << setw(10) << (evtol->total_flight_time() / (1000.0 * 60));
-			cout << setw(10) << (evtol->total_charge_time() / (1000.0 * 60));
-			cout << setw(10) << (evtol->total_wait_time() / (1000.0 * 60));
-			cout << setw(10) << evtol->stateName();
-			cout << setw(10) << evtol->percentChargeRemaining() << "%" << endl;
+		out << "\nIndividual eVTOL Stats\n";
+		out << setw(20) << "COMPANY" << setw(10) << "FLIGHT" << setw(10) << "CHARGE" << setw(10) << "WAIT" << setw(10) << "ENDING" << setw(11) << "CHARGE" << '\n';
+		out << setw(20) << "" << setw(10) << "TIME" << setw(10) << "TIME" << setw(10) << "TIME" << setw(10) << "STATE" << setw(11) << "REMAINING" << '\n';
+		out << setw(20) << "------------------" << setw(10) << "--------" << setw(10) << "--------" << setw(10) << "--------" << setw(10) << "--------" << setw(11) << "---------" << '\n';
+		std::for_each(evtols_.begin(), evtols_.end(), [&out](eVTOL* evtol) {
+			out << setw(20) << evtol->company_name();
+			out << fixed << setprecision(2);
+			out << setw(10) << (evtol->total_flight_time() / (1000.0 * 60));
+			out << setw(10) << (evtol->total_charge_time() / (1000.0 * 60));
+			out << setw(10) << (evtol->total_wait_time() / (1000.0 * 60));
+			out << setw(10) << evtol->stateName();
+			out << setw(10) << evtol->percentChargeRemaining() << "%\n";
 			});
 	}
 
-	void printCompanyGroupResults()
+	void writeCompanyGroupResults(std::ostream& out)
 	{
 		using namespace std;
-		cout << endl << "Company Stats" << endl;
-		cout << setw(20) << "COMPANY" << setw(10) << "COUNT" << setw(10) << "AVERAGE" << setw(10) << "AVERAGE" << setw(10) << "AVERAGE" << setw(10) << "MAX" << setw(10) << "TOTAL" << endl;
-		cout << setw(20) << "" << setw(10) << "" << setw(10) << "FLT TIME" << setw(10) << "CHG TIME" << setw(10) << "WAT TIME" << setw(10) << "NUMBER" << setw(10) << "PASSENGR" << endl;
-		cout << setw(20) << "" << setw(10) << "" << setw(10) << "MINUTES" << setw(10) << "MINUTES" << setw(10) << "MINUTES" << setw(10) << "FAULTS" << setw(10) << "MILES" << endl;
-		cout << setw(20) << "------------------" << setw(10) << "--------" << setw(10) << "--------" << setw(10) << "--------" << setw(10) << "--------" << setw(10) << "--------" << setw(10) << "--------" << endl;
+		out << "\nCompany Stats\n";
+		out << setw(20) << "COMPANY" << setw(10) << "COUNT" << setw(10) << "AVERAGE" << setw(10) << "AVERAGE" << setw(10) << "AVERAGE" << setw(10) << "MAX" << setw(10) << "TOTAL" << '\n';
+		out << setw(20) << "" << setw(10) << "" << setw(10) << "FLT TIME" << setw(10) << "CHG TIME" << setw(10) << "WAT TIME" << setw(10) << "NUMBER" << setw(10) << "PASSENGR" << '\n';
+		out << setw(20) << "" << setw(10) << "" << setw(10) << "MINUTES" << setw(10) << "MINUTES" << setw(10) << "MINUTES" << setw(10) << "FAULTS" << setw(10) << "MILES" << '\n';
+		out << setw(20) << "------------------" << setw(10) << "--------" << setw(10) << "--------" << setw(10) << "--------" << setw(10) << "--------" << setw(10) << "--------" << setw(10) << "--------" << '\n';
 
-		// get a list of companies from evtols list
-		std::set<std::string> companies;
-		for (auto evtol : evtols_)
+		for (auto& results : companyResults())
+		{
+			out << setw(20) << results.company;
+			out << setw(10) << results.count;
+			out << fixed << setprecision(2);
+			out << setw(10) << results.avg_flight_time_minutes;
+			out << setw(10) << results.avg_charge_time_minutes;
+			out << setw(10) << results.avg_wait_time_minutes;
+			out << setw(10) << results.max_faults;
+			out << setw(10) << results.total_passenger_miles;
+			out << '\n';
+		}
+	}
+
+	// one row per eVTOL in order of creation, the results of printIndividualVTOLResults, times in minutes
+	void writeResultsCsv(std::ostream& out)
+	{
+		CsvWriter csv;
+		csv.field("evtol").field("company").field("flight_time_minutes").field("charge_time_minutes").field("wait_time_minutes");
+		csv.field("number_of_faults").field("ending_state").field("charge_remaining_percent").endRow();
+		for (size_t i = 0; i < evtols_.size(); i++)
 		{
-			companies.insert(evtol->company_name());
+			eVTOL* evtol = evtols_[i];
+			csv.field(i).field(evtol->company_name());
+			csv.field(evtol->total_flight_time() / (1000.0 * 60)).field(evtol->total_charge_time() / (1000.0 * 60)).field(evtol->total_wait_time() / (1000.0 * 60));
+			csv.field(evtol->number_of_faults()).field(evtol->stateName()).field(evtol->percentChargeRemaining()).endRow();
 		}
+		writeReport(out, csv.str());
+	}
 
-		// for each company, calculate stats and print them out in one row
-		for (std::string company : companies)
+	// one row per company in order of company name, the results of printCompanyGroupResults
+	void writeCompanyResultsCsv(std::ostream& out)
+	{
+		CsvWriter csv;
+		csv.field("company").field("count").field("avg_flight_time_minutes").field("avg_charge_time_minutes").field("avg_wait_time_minutes");
+		csv.field("max_faults").field("total_passenger_miles").endRow();
+		for (auto& results : companyResults())
 		{
-			// get all vtols for current company
-			std::vector<eVTOL*> company_evtols;
-			std::copy_if(evtols_.begin(), evtols_.end(), std::back_inserter(company_evtols), [company](eVTOL* evtol) {return evtol->company_name() == company; });
+			csv.field(results.company).field(results.count);
+			csv.field(results.avg_flight_time_minutes).field(results.avg_charge_time_minutes).field(results.avg_wait_time_minutes);
+			csv.field(results.max_faults).field(results.total_passenger_miles).endRow();
+		}
+		writeReport(out, csv.str());
+	}
 
-			// calculate average flight time in minutes
-			double avg_flight_time_minutes = std::accumulate(company_evtols.begin(), company_evtols.end(), 0.0, [](double total, eVTOL* evtol) { return total + evtol->total_flight_time() / (1000.0 * 60); });
-			avg_flight_time_minutes /= company_evtols.size();
+	// the parameters and the per company and per eVTOL results as a single JSON object
+	void writeResultsJson(std::ostream& out)
+	{
+		JsonWriter json;
+		json.beginObject().key("parameters").beginObject();
+		json.key("number_of_evtols").value(parameters_.number_of_evtols);
+		json.key("number_of_charging_stations").value(parameters_.number_of_charging_stations);
+		json.key("number_of_charging_bays").value(parameters_.number_of_charging_bays);
+		json.key("max_charge_rate_kw").value(parameters_.max_charge_rate_kw);
+		json.key("simulation_time_minutes").value(parameters_.simulation_time_minutes);
+		json.key("timestep_milliseconds").value(parameters_.timestep_milliseconds);
+		json.key("engine").value(simulationEngineName(parameters_.engine));
+		json.key("seed").value(master_seed_.value());
+		json.endObject();
+
+		json.key("companies").beginArray();
+		for (auto& results : companyResults())
+		{
+			json.beginObject().key("company").value(results.company).key("count").value(results.count);
+			json.key("avg_flight_time_minutes").value(results.avg_flight_time_minutes);
+			json.key("avg_charge_time_minutes").value(results.avg_charge_time_minutes);
+			json.key("avg_wait_time_minutes").value(results.avg_wait_time_minutes);
+			json.key("max_faults").value(results.max_faults).key("total_passenger_miles").value(results.total_passenger_miles).endObject();
+		}
+		json.endArray();
 
-			// calculate average charge time in minutes
-			double avg_charge_time_minutes = std::accumulate(company_evtols.begin(), company_evtols.end(), 0.0, [](double total, eVTOL* evtol) { return total + evtol->total_charge_time() / (1000.0 * 60); });
-			avg_charge_time_minutes /= company_evtols.size();
+		json.key("evtols").beginArray();
+		for (eVTOL* evtol : evtols_)
+		{
+			json.beginObject().key("company").value(evtol->company_name());
+			json.key("flight_time_minutes").value(evtol->total_flight_time() / (1000.0 * 60));
+			json.key("charge_time_minutes").value(evtol->total_charge_time() / (1000.0 * 60));
+			json.key("wait_time_minutes").value(evtol->total_wait_time() / (1000.0 * 60));
+			json.key("number_of_faults").value(evtol->number_of_faults());
+			json.key("ending_state").value(evtol->stateName());
+			json.key("charge_remaining_percent").value(evtol->percentChargeRemaining()).endObject();
+		}
+		json.endArray().endObject();
+		writeReport(out, json.str() + "\n");
+	}
 
-			// calculate averate wait time in minutes
-			double avg_wait_time_minutes = std::accumulate(company_evtols.begin(), company_evtols.end(), 0.0, [](double total, eVTOL* evtol) { return total + evtol->total_wait_time() / (1000.0 * 60); });
-			avg_wait_time_minutes /= company_evtols.size();
+	// The per eVTOL and per company results as a columnar file, see ColumnarFileWriter, of three tables:
+	//   evtols      company, flight/charge/wait_time_milliseconds, number_of_faults, ending_state, charge_remaining_percent
+	//   companies   name, count, avg_flight/charge/wait_time_minutes, max_faults, total_passenger_miles, of every company
+	//   states      name
+	// company and ending_state are the rows of their company and state, times are whole milliseconds.
+	// The eVTOL totals are written straight from the fleet's arrays with no copies for BATCHED_FLEET,
+	// otherwise a chunk at a time from the eVTOLs.
+	void writeResultsColumnar(std::ostream& out)
+	{
+		// every company, with or without eVTOLs, so a company is its id
+		std::vector<eVTOLCompanyResults> results = companyResults();
+		std::vector<eVTOLCompanyResults> companies(companies_.size());
+		for (size_t id = 0, r = 0; id < companies_.size(); id++)
+		{
+			if (r < results.size() && results[r].company == companies_[id]) companies[id] = results[r++];
+			companies[id].company = companies_[id];
+		}
 
-			// calculate max faults
-			std::vector<size_t> faults;
-			std::transform(company_evtols.begin(), company_evtols.end(), std::back_inserter(faults), [](eVTOL* evtol) { return evtol->number_of_faults(); });
-			auto max_faults_itr = std::max_element(faults.begin(), faults.end());
-			size_t max_faults = *max_faults_itr;
+		ColumnarFileWriter writer;
+		size_t evtols = writer.addTable("evtols", evtols_.size());
+		writer.addColumn(evtols, "company", evtol_company_ids_.data());
+		typedef size_t (eVTOL::*eVTOLTotal)();
+		auto add_total = [this, &writer, evtols](const std::string& name, eVTOLTotal total, const size_t* fleet_totals) {
+			if (fleet_totals)
+			{
+				writer.addColumn(evtols, name, fleet_totals);
+				return;
+			}
+			writer.addColumn<uint64_t>(evtols, name, [this, total](size_t first, size_t count, uint64_t* values) {
+				for (size_t i = 0; i < count; i++) values[i] = (evtols_[first + i]->*total)();
+				});
+		};
+		eVTOLFleet* fleet = fleet_.get();
+		add_total("flight_time_milliseconds", &eVTOL::total_flight_time, fleet ? fleet->totalFlightTimes() : nullptr);
+		add_total("charge_time_milliseconds", &eVTOL::total_charge_time, fleet ? fleet->totalChargeTimes() : nullptr);
+		add_total("wait_time_milliseconds", &eVTOL::total_wait_time, fleet ? fleet->totalWaitTimes() : nullptr);
+		add_total("number_of_faults", &eVTOL::number_of_faults, fleet ? fleet->numberOfFaults() : nullptr);
+		writer.addColumn<uint8_t>(evtols, "ending_state", [this](size_t first, size_t count, uint8_t* values) {
+			for (size_t i = 0; i < count; i++) values[i] = static_cast<uint8_t>(evtols_[first + i]->state());
+			});
+		writer.addColumn<double>(evtols, "charge_remaining_percent", [this](size_t first, size_t count, double* values) {
+			for (size_t i = 0; i < count; i++) values[i] = evtols_[first + i]->percentChargeRemaining();
+			});
 
-			// calculate total passenger miles
-			size_t total_passenger_miles = std::accumulate(company_evtols.begin(), company_evtols.end(), 0, [](double total, eVTOL* evtol) {
-				return total + (evtol->total_flight_time() / (1000.0 * 60 * 60) * evtol->cruise_speed() * evtol->passenger_count());
+		size_t company_table = writer.addTable("companies", companies.size());
+		writer.addStringColumn(company_table, "name", 64, [&companies](size_t row) { return companies[row].company; });
+		auto add_company_column = [&writer, &companies, company_table](const std::string& name, double eVTOLCompanyResults::*average) {
+			writer.addColumn<double>(company_table, name, [&companies, average](size_t first, size_t count, double* values) {
+				for (size_t i = 0; i < count; i++) values[i] = companies[first + i].*average;
 				});
+		};
+		auto add_company_count = [&writer, &companies, company_table](const std::string& name, size_t eVTOLCompanyResults::*total) {
+			writer.addColumn<uint64_t>(company_table, name, [&companies, total](size_t first, size_t count, uint64_t* values) {
+				for (size_t i = 0; i < count; i++) values[i] = companies[first + i].*total;
+				});
+		};
+		add_company_count("count", &eVTOLCompanyResults::count);
+		add_company_column("avg_flight_time_minutes", &eVTOLCompanyResults::avg_flight_time_minutes);
+		add_company_column("avg_charge_time_minutes", &eVTOLCompanyResults::avg_charge_time_minutes);
+		add_company_column("avg_wait_time_minutes", &eVTOLCompanyResults::avg_wait_time_minutes);
+		add_company_count("max_faults", &eVTOLCompanyResults::max_faults);
+		add_company_count("total_passenger_miles", &eVTOLCompanyResults::total_passenger_miles);
 
-			// print out the current company's stats
-			cout << setw(20) << company;
-			cout << setw(10) << company_evtols.size();
-			cout << fixed << setprecision(2);
-			cout << setw(10) << avg_flight_time_minutes;
-			cout << setw(10) << avg_charge_time_minutes;
-			cout << setw(10) << avg_wait_time_minutes;
-			cout << setw(10) << max_faults;
-			cout << setw(10) << total_passenger_miles;
-			cout << endl;
-		}
+		size_t states = writer.addTable("states", static_cast<size_t>(eVTOLState::WAITING) + 1);
+		writer.addStringColumn(states, "name", 16, [](size_t row) { return eVTOLStateName(static_cast<eVTOLState>(row)); });
+
+		writer.write(out);
+	}
+
+	// calculates the per company stats, one entry per company in order of company name
+	std::vector<eVTOLCompanyResults> companyResults()
+	{
+		aggregate([this](size_t i) { return evtols_[i]->agentState(); });
+		return aggregator_.results();
 	}
 
+	eVTOLSimulationParameters parameters() { return parameters_; }
+
 
 	~eVTOLSimulation()
 	{
-		// destroy all of the heap allocated simulation agents - the evtols and charging station
-		std::for_each(evtols_.begin(), evtols_.end(), [](eVTOL* evtol) {delete evtol; });
-		delete charging_station_;
+		// destroy the heap allocated charging stations, the evtols go with their arena
+		if (arena_ != &evtol_arena_) arena_->clear();
+		delete charging_network_;
 	}
 
 private:
-	std::vector<eVTOL*> evtols_;
-	ChargingStation* charging_station_;
+	// the fixed timestep engines only, the others have no fixed grid of timesteps to resume on
+	bool supportsCheckpoints()
+	{
+		return parameters_.engine == SimulationEngine::FIXED_TIMESTEP || parameters_.engine == SimulationEngine::BATCHED_FLEET;
+	}
+
+	// returns the index of the configuration in the parameters' list of configurations
+	size_t configurationIndex(const eVTOLConfiguration& config)
+	{
+		for (size_t i = 0; i < parameters_.configurations.size(); i++)
+		{
+			if (parameters_.configurations[i] == config) return i;
+		}
+		throw std::logic_error("eVTOL configuration is not one of the simulation's configurations.");
+	}
+
+	// creates the eVTOLs of the checkpoint being resumed from, in their checkpointed state
+	void restoreeVTOLs()
+	{
+		for (auto& record : resume_from_->evtols)
+		{
+			eVTOL* evtol = arena_->create(parameters_.configurations[record.configuration], charging_network_);
+			eVTOLAgentState agent_state;
+			agent_state.total_flight_time = static_cast<size_t>(record.total_flight_time);
+			agent_state.total_charge_time = static_cast<size_t>(record.total_charge_time);
+			agent_state.total_wait_time = static_cast<size_t>(record.total_wait_time);
+			agent_state.current_charge = record.current_charge;
+			agent_state.number_of_faults = static_cast<size_t>(record.number_of_faults);
+			agent_state.state = static_cast<eVTOLState>(record.state);
+			evtol->setAgentState(agent_state);
+			evtol->setRandomState(record.random_state);
+			evtols_.push_back(evtol);
+		}
+	}
+
+	// puts every station's bays and queue back as checkpointed, device gives the device of each eVTOL by index
+	void restoreStations(const std::function<ChargeableDevice*(size_t)>& device)
+	{
+		const std::vector<uint64_t>& words = resume_from_->stations;
+		size_t position = 0;
+		auto next = [&words, &position]() {
+			if (position >= words.size()) throw std::invalid_argument("the checkpoint's charging stations are truncated.");
+			return static_cast<size_t>(words[position++]);
+		};
+		auto next_device = [this, &next, &device]() {
+			size_t index = next();
+			if (index >= evtols_.size()) throw std::invalid_argument("the checkpoint refers to an unknown eVTOL.");
+			return device(index);
+		};
+
+		for (size_t s = 0; s < charging_network_->numberOfStations(); s++)
+		{
+			ChargingStationOccupancy occupancy;
+			for (size_t i = next(); i > 0; i--)
+			{
+				occupancy.occupied_bays.push_back(next());
+				occupancy.bay_devices.push_back(next_device());
+			}
+			for (size_t i = next(); i > 0; i--)
+			{
+				occupancy.free_bays.push_back(next());
+			}
+			for (size_t i = next(); i > 0; i--)
+			{
+				occupancy.waiting.push_back(next_device());
+			}
+			charging_network_->station(s).setOccupancy(occupancy);
+		}
+	}
+
+	// calls the checkpoint handler for every checkpoint due by the given time
+	void takeCheckpoints(unsigned long long time)
+	{
+		if (!checkpoint_handler_ || time < next_checkpoint_time_) return;
+		while (next_checkpoint_time_ <= time)
+		{
+			next_checkpoint_time_ += checkpoint_interval_;
+		}
+		checkpoint_handler_(checkpoint());
+	}
+
+	// returns the id of the company, its position in the list of companies
+	size_t companyId(const std::string& company)
+	{
+		return std::lower_bound(companies_.begin(), companies_.end(), company) - companies_.begin();
+	}
+
+	// rolls the state of every eVTOL, as given by agent_state, up into the aggregator in a single pass
+	void aggregate(const std::function<eVTOLAgentState(size_t)>& agent_state)
+	{
+		aggregator_.reset();
+		for (size_t i = 0; i < evtols_.size(); i++)
+		{
+			aggregator_.add(evtol_company_ids_[i], agent_state(i), evtols_[i]->cruise_speed(), evtols_[i]->passenger_count());
+		}
+	}
+
+	// calls the snapshot handler for every snapshot due by the given time
+	void takeSnapshots(unsigned long long time, const std::function<eVTOLAgentState(size_t)>& agent_state)
+	{
+		if (!snapshot_handler_ || time < next_snapshot_time_) return;
+		aggregate(agent_state);
+		aggregator_.results(snapshot_results_);
+		while (next_snapshot_time_ <= time)
+		{
+			next_snapshot_time_ += snapshot_interval_;
+		}
+		snapshot_handler_(time, snapshot_results_);
+	}
+
+	// publishes a metrics snapshot if one is due by the given time
+	void takeMetrics(unsigned long long time, const std::function<eVTOLAgentState(size_t)>& agent_state)
+	{
+		if (!metrics_publisher_ || time < next_metrics_time_) return;
+		while (next_metrics_time_ <= time)
+		{
+			next_metrics_time_ += metrics_interval_;
+		}
+		publishMetrics(time, false, agent_state);
+	}
+
+	void publishMetrics(unsigned long long time, bool finished, const std::function<eVTOLAgentState(size_t)>& agent_state)
+	{
+		aggregate(agent_state);
+		aggregator_.results(metrics_results_);
+
+		// the cohort and regional engines charge at stations of their own, the simulation's stand empty
+		size_t bays_occupied = charging_network_->numberCharging();
+		size_t queue_depth = charging_network_->numberWaiting();
+		if (cohort_fleet_)
+		{
+			bays_occupied = cohort_fleet_->numberCharging();
+			queue_depth = cohort_fleet_->numberWaiting();
+		}
+		else if (regional_fleet_)
+		{
+			for (size_t r = 0; r < regional_fleet_->numberOfRegions(); r++)
+			{
+				bays_occupied += regional_fleet_->region(r).network().numberCharging();
+				queue_depth += regional_fleet_->region(r).network().numberWaiting();
+			}
+		}
+		metrics_publisher_->publish(makeMetricsSnapshot(time, finished, charging_network_->numberOfBays(), bays_occupied, queue_depth, metrics_results_));
+	}
+
+	// runs the simulation by updating every agent at every timestep
+	void runFixedTimestep()
+	{
+		if (!resume_from_)
+		{
+			std::for_each(evtols_.begin(), evtols_.end(), [](eVTOL* evtol) { evtol->begin(); });
+		}
+		charging_network_->begin();
+		if (resume_from_)
+		{
+			restoreStations([this](size_t i) -> ChargeableDevice* { return evtols_[i]; });
+		}
+
+		size_t number_of_threads = std::min(parameters_.number_of_fleet_threads, evtols_.size());
+		if (number_of_threads > 1)
+		{
+			runParallelFixedTimestep(number_of_threads);
+			return;
+		}
+
+		runTimer([this](size_t prev_time, size_t cur_time) {
+			std::for_each(evtols_.begin(), evtols_.end(), [prev_time, cur_time](eVTOL* evtol) {
+				evtol->timestepUpdate(prev_time, cur_time);
+				});
+			}, [this](size_t i) { return evtols_[i]->agentState(); });
+	}
+
+	// As runFixedTimestep, but the eVTOLs are split into one contiguous shard per thread and updated in parallel.
+	// eVTOLs don't go straight to the charging stations, which are shared, every shard hands eVTOLs low on
+	// battery to one ConcurrentChargingQueue, without locks.  Once every shard is done the queue is flushed
+	// sorted by address, which is eVTOL order as the eVTOLs sit in the arena in order of creation, so the stations
+	// see exactly what they would from a serial update, and the results are identical for any number of threads.
+	void runParallelFixedTimestep(size_t number_of_threads)
+	{
+		SimulationThreadPool fleet_threads(number_of_threads);
+		// every eVTOL can land in the same timestep
+		ConcurrentChargingQueue arrivals(std::max<size_t>(evtols_.size(), 1));
+		std::for_each(evtols_.begin(), evtols_.end(), [&arrivals](eVTOL* evtol) { evtol->setChargingStation(&arrivals); });
+
+		runTimer([this, &fleet_threads, &arrivals](size_t prev_time, size_t cur_time) {
+			fleet_threads.parallelFor(evtols_.size(), [this, prev_time, cur_time](size_t begin, size_t end, size_t shard) {
+				for (size_t i = begin; i < end; i++)
+				{
+					evtols_[i]->timestepUpdate(prev_time, cur_time);
+				}
+				});
+			arrivals.flushSorted(charging_network_, std::less<ChargeableDevice*>());
+			}, [this](size_t i) { return evtols_[i]->agentState(); });
+
+		std::for_each(evtols_.begin(), evtols_.end(), [this](eVTOL* evtol) { evtol->setChargingStation(charging_network_); });
+	}
+
+	// As runFixedTimestep, but each timestep ends at the next predicted change of state of any eVTOL or station.
+	// Between changes of state every battery charges or drains linearly, so a timestep of any length accounts
+	// for the time and charge exactly, and a low battery or full charge is found to the millisecond rather than the timestep.
+	// The chance of a fault grows with the length of the timestep, at most one fault is counted per timestep,
+	// so timesteps are kept to max_timestep_milliseconds to make two faults in one timestep vanishingly unlikely.
+	void runAdaptiveTimestep()
+	{
+		std::for_each(evtols_.begin(), evtols_.end(), [](eVTOL* evtol) { evtol->begin(); });
+		charging_network_->setVariableTimesteps(true);
+		charging_network_->begin();
+
+		runTimer([this](size_t prev_time, size_t cur_time) {
+			std::for_each(evtols_.begin(), evtols_.end(), [prev_time, cur_time](eVTOL* evtol) {
+				evtol->timestepUpdate(prev_time, cur_time);
+				});
+			}, [this](size_t i) { return evtols_[i]->agentState(); },
+			[this](unsigned long long time) { return nextTransitionTime(time); });
+	}
+
+	// ADAPTIVE_TIMESTEP only, the end of the timestep starting at time, snapshots are taken on time
+	unsigned long long nextTransitionTime(unsigned long long time)
+	{
+		unsigned long long next_time = time + parameters_.max_timestep_milliseconds;
+		for (eVTOL* evtol : evtols_)
+		{
+			next_time = std::min(next_time, evtol->nextTransitionTime(time));
+		}
+		next_time = std::min(next_time, charging_network_->nextFullChargeTime(time));
+		if (snapshot_handler_) next_time = std::min(next_time, next_snapshot_time_);
+		return next_time;
+	}
+
+	// Works out the state of every eVTOL at the end of the simulation from its eVTOLAnalyticCycle,
+	// or, if at some point there would not be enough bays, its state at the last timestep before then,
+	// and simulates the rest as FIXED_TIMESTEP by resuming from a checkpoint of that state.
+	void runAnalytic()
+	{
+		if (charging_network_->numberOfStations() != 1) throw std::invalid_argument("the analytic engine supports a single charging station.");
+		std::vector<eVTOLAnalyticCycle> cycles;
+		cycles.reserve(evtols_.size());
+		for (eVTOL* evtol : evtols_)
+		{
+			cycles.push_back(eVTOLAnalyticCycle(evtol->configuration(), parameters_.max_charge_rate_kw));
+		}
+		unsigned long long end_time = parameters_.simulation_time_minutes * 60ULL * 1000ULL;
+		unsigned long long contended_time = firstContendedTime(cycles, charging_network_->numberOfBays(), end_time);
+		if (contended_time == NOT_SIMULATED)
+		{
+			for (size_t i = 0; i < evtols_.size(); i++)
+			{
+				SplitMix64 random_engine;
+				random_engine.setState(evtols_[i]->randomState());
+				eVTOLAgentState agent_state = cycles[i].stateAt(end_time);
+				agent_state.number_of_faults = cycles[i].sampleFaults(agent_state.total_flight_time, random_engine);
+				evtols_[i]->setAgentState(agent_state);
+				evtols_[i]->setRandomState(random_engine.state());
+			}
+			return;
+		}
+
+		// the last timestep before anyone lands to find no bay, nobody has waited yet
+		analytic_simulated_from_ = (contended_time - 1) / parameters_.timestep_milliseconds * parameters_.timestep_milliseconds;
+		eVTOLSimulationCheckpoint checkpoint = analyticCheckpoint(cycles, analytic_simulated_from_);
+		eVTOLSimulationParameters parameters = parameters_;
+		parameters.engine = SimulationEngine::FIXED_TIMESTEP;
+		eVTOLSimulation simulation(parameters);
+		simulation.resumeFrom(checkpoint);
+		simulation.run();
+
+		checkpoint = simulation.checkpoint();
+		for (size_t i = 0; i < evtols_.size(); i++)
+		{
+			const eVTOLCheckpointRecord& record = checkpoint.evtols[i];
+			eVTOLAgentState agent_state;
+			agent_state.total_flight_time = static_cast<size_t>(record.total_flight_time);
+			agent_state.total_charge_time = static_cast<size_t>(record.total_charge_time);
+			agent_state.total_wait_time = static_cast<size_t>(record.total_wait_time);
+			agent_state.current_charge = record.current_charge;
+			agent_state.number_of_faults = static_cast<size_t>(record.number_of_faults);
+			agent_state.state = static_cast<eVTOLState>(record.state);
+			evtols_[i]->setAgentState(agent_state);
+			evtols_[i]->setRandomState(record.random_state);
+		}
+	}
+
+	// ANALYTIC only, a FIXED_TIMESTEP checkpoint of every eVTOL at the given time, eVTOLs charging fill the bays of the one station
+	eVTOLSimulationCheckpoint analyticCheckpoint(const std::vector<eVTOLAnalyticCycle>& cycles, unsigned long long time)
+	{
+		eVTOLSimulationCheckpoint checkpoint = {};
+		checkpoint.header.engine = static_cast<uint32_t>(SimulationEngine::FIXED_TIMESTEP);
+		checkpoint.header.time = time;
+		checkpoint.header.timestep_milliseconds = parameters_.timestep_milliseconds;
+		checkpoint.header.number_of_stations = charging_network_->numberOfStations();
+		checkpoint.header.number_of_charging_bays = parameters_.number_of_charging_bays;
+
+		std::vector<size_t> charging;
+		checkpoint.evtols.resize(evtols_.size());
+		for (size_t i = 0; i < evtols_.size(); i++)
+		{
+			SplitMix64 random_engine;
+			random_engine.setState(evtols_[i]->randomState());
+			eVTOLAgentState agent_state = cycles[i].stateAt(time);
+			eVTOLCheckpointRecord& record = checkpoint.evtols[i];
+			record.total_flight_time = agent_state.total_flight_time;
+			record.total_charge_time = agent_state.total_charge_time;
+			record.current_charge = agent_state.current_charge;
+			record.number_of_faults = cycles[i].sampleFaults(agent_state.total_flight_time, random_engine);
+			record.random_state = random_engine.state();
+			record.state = static_cast<uint32_t>(agent_state.state);
+			record.configuration = static_cast<uint32_t>(configurationIndex(evtols_[i]->configuration()));
+			if (agent_state.state == eVTOLState::CHARGING) charging.push_back(i);
+		}
+
+		// see eVTOLSimulationCheckpoint for the layout, free bays are a stack, the lowest bay is given out first
+		size_t bays = charging_network_->station(0).numberOfBays();
+		size_t occupied = std::min(bays, charging.size());
+		checkpoint.stations.push_back(occupied);
+		for (size_t bay = 0; bay < occupied; bay++)
+		{
+			checkpoint.stations.push_back(bay);
+			checkpoint.stations.push_back(charging[bay]);
+		}
+		checkpoint.stations.push_back(bays - occupied);
+		for (size_t bay = bays; bay-- > occupied;)
+		{
+			checkpoint.stations.push_back(bay);
+		}
+		checkpoint.stations.push_back(0);
+		checkpoint.header.number_of_evtols = checkpoint.evtols.size();
+		checkpoint.header.number_of_station_words = checkpoint.stations.size();
+		return checkpoint;
+	}
+
+	// runs the simulation as cohorts of identical eVTOLs sharing the one charging station, see eVTOLCohortFleet
+	void runCohort()
+	{
+		if (charging_network_->numberOfStations() != 1) throw std::invalid_argument("the cohort engine supports a single charging station.");
+		cohort_fleet_.reset(new eVTOLCohortFleet(parameters_.number_of_charging_bays, parameters_.max_charge_rate_kw, master_seed_.child(RandomStream::COHORT)));
+		eVTOLCohortFleet& fleet = *cohort_fleet_;
+		std::for_each(evtols_.begin(), evtols_.end(), [&fleet](eVTOL* evtol) { fleet.add(*evtol); });
+		fleet.begin();
+		charging_network_->begin();
+
+		// a snapshot asks for every eVTOL in turn from the first, they are matched to the cohorts once per snapshot
+		std::vector<eVTOLAgentState> agent_states;
+		runTimer([&fleet](size_t prev_time, size_t cur_time) {
+			fleet.timestepUpdate(prev_time, cur_time);
+			}, [&fleet, &agent_states](size_t i) {
+				if (i == 0) fleet.agentStates(agent_states);
+				return agent_states[i];
+			});
+
+		// copy the final state of the cohorts back out for reporting
+		fleet.agentStates(agent_states);
+		for (size_t i = 0; i < evtols_.size(); i++)
+		{
+			evtols_[i]->setAgentState(agent_states[i]);
+		}
+	}
+
+	// runs the simulation as a fleet specialized at compile time for the company models, see CompanyModelFleet
+	void runSpecialized()
+	{
+		for (auto& config : parameters_.configurations)
+		{
+			if (!CompanyModelFleet::hasModel(config)) throw std::invalid_argument("the specialized engine only runs the compiled in company models, not " + config.company_name() + ".");
+		}
+		// the fleet lives as long as the simulation, the stations hold its devices
+		model_fleet_.reset(new CompanyModelFleet(charging_network_));
+		CompanyModelFleet& fleet = *model_fleet_;
+		std::for_each(evtols_.begin(), evtols_.end(), [&fleet](eVTOL* evtol) { fleet.add(*evtol); });
+		fleet.begin();
+		charging_network_->begin();
+
+		runTimer([&fleet](size_t prev_time, size_t cur_time) {
+			fleet.timestepUpdate(prev_time, cur_time);
+			}, [&fleet](size_t i) { return fleet.agentState(i); });
+
+		// copy the final state of the fleet back out for reporting
+		for (size_t i = 0; i < evtols_.size(); i++)
+		{
+			fleet.store(i, *evtols_[i]);
+		}
+	}
+
+	// Runs the simulation as regions, each with its own share of the stations and fleet, see eVTOLRegionalFleet.
+	// The regions are updated in parallel on up to number_of_fleet_threads threads, the simulation's own
+	// stations stand empty.  The fleet update phase of the instrumentation includes the regions' stations.
+	void runRegional()
+	{
+		if (parameters_.number_of_regions > parameters_.number_of_charging_stations) throw std::invalid_argument("every region needs at least one charging station.");
+		regional_fleet_.reset(new eVTOLRegionalFleet(parameters_.number_of_regions, parameters_.cross_region_leg_probability, master_seed_.child(RandomStream::REGION)));
+		eVTOLRegionalFleet& fleet = *regional_fleet_;
+		for (size_t i = 0; i < parameters_.number_of_charging_stations; i++)
+		{
+			fleet.addStation(parameters_.number_of_charging_bays, parameters_.max_charge_rate_kw);
+		}
+		if (parameters_.station_selection == ChargingStationSelection::PREDICTED_WAIT)
+		{
+			fleet.setPolicy([] { return std::unique_ptr<ChargingStationPolicy>(new PredictedWaitPolicy()); });
+		}
+		std::for_each(evtols_.begin(), evtols_.end(), [&fleet](eVTOL* evtol) { fleet.add(evtol); });
+		fleet.reserveWaiting(evtols_.size());
+
+		std::unique_ptr<SimulationThreadPool> region_threads;
+		if (parameters_.number_of_fleet_threads > 1 && parameters_.number_of_regions > 1)
+		{
+			region_threads.reset(new SimulationThreadPool(std::min(parameters_.number_of_fleet_threads, parameters_.number_of_regions)));
+			fleet.setThreadPool(region_threads.get());
+		}
+		fleet.begin();
+		charging_network_->begin();
+
+		runTimer([&fleet](size_t prev_time, size_t cur_time) {
+			fleet.timestepUpdate(prev_time, cur_time);
+			}, [this](size_t i) { return evtols_[i]->agentState(); });
+		fleet.setThreadPool(nullptr);
+	}
+
+	// runs the simulation by updating the whole fleet in a single batch at every timestep
+	void runBatchedFleet()
+	{
+		// the fleet lives as long as the simulation, the stations hold its devices
+		fleet_.reset(new eVTOLFleet(charging_network_, master_seed_.child(RandomStream::FLEET)));
+		eVTOLFleet& fleet = *fleet_;
+		std::for_each(evtols_.begin(), evtols_.end(), [&fleet](eVTOL* evtol) { fleet.add(*evtol); });
+		fleet.setTrace(trace_);
+		fleet.begin();
+		charging_network_->begin();
+		if (resume_from_)
+		{
+			for (size_t i = 0; i < evtols_.size(); i++)
+			{
+				fleet.setAgentState(i, evtols_[i]->agentState());
+			}
+			fleet.setRandomState(resume_from_->header.fleet_random_key, resume_from_->header.fleet_timestep_count);
+			restoreStations([&fleet](size_t i) { return fleet.device(i); });
+		}
+
+		runTimer([&fleet](size_t prev_time, size_t cur_time) {
+			fleet.timestepUpdate(prev_time, cur_time);
+			}, [&fleet](size_t i) { return fleet.agentState(i); });
+
+		// copy the final state of the fleet back out for reporting
+		for (size_t i = 0; i < evtols_.size(); i++)
+		{
+			fleet.store(i, *evtols_[i]);
+		}
+	}
+
+	// runs the timer, at each timestep the eVTOLs are updated by the given function followed by the charging stations
+	// agent_state gives the current state of each eVTOL for snapshots
+	// next_time, if given, makes the timesteps variable, see SimulationEventTimer::setNextTime
+	void runTimer(std::function<void(size_t, size_t)> evtols_update, std::function<eVTOLAgentState(size_t)> agent_state,
+		std::function<unsigned long long(unsigned long long)> next_time = nullptr)
+	{
+		// the pool lives for the whole run so its threads are only created once
+		std::unique_ptr<SimulationThreadPool> station_threads;
+		if (parameters_.number_of_station_threads > 1 && charging_network_->numberOfStations() > 1)
+		{
+			station_threads.reset(new SimulationThreadPool(std::min(parameters_.number_of_station_threads, charging_network_->numberOfStations())));
+			charging_network_->setThreadPool(station_threads.get());
+		}
+
+		// progress is printed on a thread of its own, the timesteps only tell it the time reached
+		std::unique_ptr<SimulationProgress> progress;
+		if (parameters_.verbose) progress.reset(new SimulationProgress(std::cout, parameters_.time_compression * 1000ULL));
+		SimulationProgress* reporter = progress.get();
+
+		// create the timer and timestep event handler
+		auto timestep_handler = [this, evtols_update, agent_state, reporter](size_t prev_time, size_t cur_time) {
+			// forward the timestep event to each of the simulation agents - evtols and charging stations
+			instrumentation_.beginTimestep();
+			if (trace_) trace_->setTime(cur_time);
+			evtols_update(prev_time, cur_time);
+			instrumentation_.endPhase(SimulationPhase::FLEET_UPDATE);
+			charging_network_->timestepUpdate(prev_time, cur_time);
+			instrumentation_.endPhase(SimulationPhase::STATION_UPDATE);
+			current_time_ = cur_time;
+			takeSnapshots(cur_time, agent_state);
+			takeMetrics(cur_time, agent_state);
+			takeCheckpoints(cur_time);
+			instrumentation_.endPhase(SimulationPhase::SNAPSHOTS);
+			// a dot every second in real time for user feedback, timesteps may be shorter or longer than a second
+			if (reporter) reporter->tick(cur_time);
+			instrumentation_.endPhase(SimulationPhase::OUTPUT);
+			instrumentation_.endTimestep();
+		};
+		SimulationEventTimer timer(parameters_.timestep_milliseconds, timestep_handler, parameters_.simulation_time_minutes, parameters_.time_compression, parameters_.timer_mode);
+		timer.setCatchUpPolicy(parameters_.timer_catch_up);
+		if (next_time) timer.setNextTime(next_time);
+
+		// start the simulation
+		if (parameters_.verbose)
+		{
+			std::cout << std::endl << "Starting Simulation" << std::endl;
+			std::cout << std::fixed << std::setprecision(2);
+			if (timer.mode() == SimulationTimerMode::PACED)
+			{
+				std::cout << "This will take approximately " << timer.totalSimulationTimeInRealMinutes() << " minutes." << std::endl;
+			}
+			else
+			{
+				std::cout << "Running as fast as possible." << std::endl;
+			}
+		}
+		if (progress) progress->start(current_time_);
+		timer.start(current_time_ / parameters_.timestep_milliseconds);
+		if (progress) progress->stop();
+		timer_jitter_ = timer.jitter();
+		charging_network_->setThreadPool(nullptr);
+		if (parameters_.verbose) std::cout << std::endl << "Simulation Finished" << std::endl;
+	}
+
+	// runs the simulation by processing only the state changes of the agents
+	void runDiscreteEvent()
+	{
+		SimulationEventScheduler scheduler(parameters_.simulation_time_minutes);
+		charging_network_->attachScheduler(&scheduler);
+		charging_network_->begin();
+		std::for_each(evtols_.begin(), evtols_.end(), [&scheduler](eVTOL* evtol) {
+			evtol->attachScheduler(&scheduler);
+			evtol->begin();
+			});
+
+		// snapshots are events of their own, each eVTOL contributes its state as of the snapshot time
+		std::function<void(unsigned long long)> snapshot_event = [this, &scheduler, &snapshot_event](unsigned long long event_time) {
+			takeSnapshots(event_time, [this, event_time](size_t i) { return evtols_[i]->agentStateAt(event_time); });
+			scheduler.schedule(next_snapshot_time_, snapshot_event);
+		};
+		if (snapshot_handler_)
+		{
+			scheduler.schedule(next_snapshot_time_, snapshot_event);
+		}
+		std::function<void(unsigned long long)> metrics_event = [this, &scheduler, &metrics_event](unsigned long long event_time) {
+			takeMetrics(event_time, [this, event_time](size_t i) { return evtols_[i]->agentStateAt(event_time); });
+			scheduler.schedule(next_metrics_time_, metrics_event);
+		};
+		if (metrics_publisher_)
+		{
+			scheduler.schedule(next_metrics_time_, metrics_event);
+		}
+
+		// start the simulation
+		if (parameters_.verbose)
+		{
+			std::cout << std::endl << "Starting Simulation" << std::endl;
+			std::cout << "Running discrete event simulation." << std::endl;
+		}
+		scheduler.start();
+		charging_network_->finishEvents();
+		std::for_each(evtols_.begin(), evtols_.end(), [](eVTOL* evtol) { evtol->finishEvents(); });
+		if (parameters_.verbose) std::cout << "Simulation Finished, " << scheduler.eventsProcessed() << " events processed." << std::endl;
+	}
+
+	eVTOLSimulationParameters parameters_;
+	RandomSeed master_seed_;  // root of all random numbers used by the simulation
+	ObjectArena<eVTOL> evtol_arena_;          // owns the eVTOLs, unless another arena is set
+	ObjectArena<eVTOL>* arena_;               // holds the eVTOLs, evtol_arena_ or a reused arena
+	std::vector<eVTOL*> evtols_;              // in order of creation, held by arena_
+	std::vector<size_t> evtol_company_ids_;   // one entry per eVTOL
+	std::vector<std::string> companies_;      // in order of name, indexed by company id
+	eVTOLCompanyAggregator aggregator_;
+	size_t snapshot_interval_;                // in milliseconds, 0 for no snapshots
+	unsigned long long next_snapshot_time_;   // in milliseconds
+	std::function<void(unsigned long long, const std::vector<eVTOLCompanyResults>&)> snapshot_handler_;
+	std::vector<eVTOLCompanyResults> snapshot_results_;  // reused by every snapshot
+	eVTOLMetricsPublisher* metrics_publisher_;  // nullptr for no metrics, not owned
+	size_t metrics_interval_;                 // in milliseconds
+	unsigned long long next_metrics_time_;    // in milliseconds
+	std::vector<eVTOLCompanyResults> metrics_results_;   // reused by every metrics snapshot
+	size_t checkpoint_interval_;              // in milliseconds, 0 for no checkpoints
+	unsigned long long next_checkpoint_time_; // in milliseconds
+	std::function<void(const eVTOLSimulationCheckpoint&)> checkpoint_handler_;
+	std::unique_ptr<eVTOLSimulationCheckpoint> resume_from_;  // nullptr unless resuming
+	unsigned long long current_time_;         // end of the latest timestep in milliseconds
+	SimulationInstrumentation instrumentation_;
+	SimulationTimerJitter timer_jitter_;      // of the latest PACED run
+	unsigned long long analytic_simulated_from_;  // ANALYTIC only
+	ChargingNetwork* charging_network_;
+	std::unique_ptr<eVTOLFleet> fleet_;       // batched fleet engine only
+	std::unique_ptr<eVTOLCohortFleet> cohort_fleet_;  // cohort engine only
+	std::unique_ptr<CompanyModelFleet> model_fleet_;  // specialized engine only
+	std::unique_ptr<eVTOLRegionalFleet> regional_fleet_;  // regional engine only
+	EventTraceSink* trace_;                   // nullptr when not traced
 	bool has_already_run_;
 };
 
+
+
+void test_eVTOLSimulationSnapshots()
+{
+	using namespace std;
+
+	// snapshots every 30 minutes of a 2 hour simulation, each a consistent live view of the results
+	for (SimulationEngine engine : { SimulationEngine::FIXED_TIMESTEP, SimulationEngine::BATCHED_FLEET, SimulationEngine::DISCRETE_EVENT })
+	{
+		eVTOLSimulationParameters parameters;
+		parameters.simulation_time_minutes = 120;
+		parameters.timer_mode = SimulationTimerMode::FREE_RUNNING;
+		parameters.engine = engine;
+		parameters.seed = 42;
+		parameters.verbose = false;
+		eVTOLSimulation simulation(parameters);
+		simulation.setSnapshotHandler(30 * 60 * 1000, [](unsigned long long time, const std::vector<eVTOLCompanyResults>& results) {
+			size_t count = 0;
+			double minutes = 0.0;
+			for (auto& company : results)
+			{
+				count += company.count;
+				minutes += company.count * (company.avg_flight_time_minutes + company.avg_charge_time_minutes + company.avg_wait_time_minutes);
+			}
+			// every eVTOL has been accounted for up to the snapshot time
+			cout << time / (60 * 1000) << ":" << count << ":" << static_cast<size_t>(minutes / count + 0.5) << "  ";
+			});
+		simulation.run();
+		cout << simulationEngineName(engine) << endl;
+	}
+
+	eVTOLSimulation simulation;
+	try { simulation.setSnapshotHandler(0, [](unsigned long long time, const std::vector<eVTOLCompanyResults>& results) {}); }
+	catch (const std::invalid_argument& ia) { cout << ia.what() << endl; }
+}
+
+
+void test_eVTOLSimulationTrace()
+{
+	using namespace std;
+
+	// every engine traces the same kinds of events, one sink traces one simulation after another
+	EventTraceSink trace("test_simulation_trace.bin", 256);
+	unsigned long long records_before = 0;
+	for (SimulationEngine engine : { SimulationEngine::FIXED_TIMESTEP, SimulationEngine::BATCHED_FLEET, SimulationEngine::DISCRETE_EVENT })
+	{
+		eVTOLSimulationParameters parameters;
+		parameters.simulation_time_minutes = 120;
+		parameters.timer_mode = SimulationTimerMode::FREE_RUNNING;
+		parameters.engine = engine;
+		parameters.seed = 42;
+		parameters.verbose = false;
+		eVTOLSimulation simulation(parameters);
+		simulation.setTrace(&trace);
+		simulation.run();
+
+		// everything is in the file once run() returns
+		cout << simulationEngineName(engine) << ":" << trace.recordsWritten() - records_before << "  ";
+		records_before = trace.recordsWritten();
+	}
+	trace.close();
+
+	// state changes, faults, bays assigned and bays released
+	std::vector<TraceRecord> records = readTraceFile("test_simulation_trace.bin");
+	size_t counts[5] = {};
+	for (auto& trace_record : records) counts[trace_record.event]++;
+	cout << records.size() << "  " << counts[1] << "  " << counts[2] << "  " << counts[3] << "  " << counts[4] << endl;
+
+	// the first events after take off
+	auto first_waiting = std::find_if(records.begin(), records.end(), [](const TraceRecord& trace_record) { return trace_record.time > 0; });
+	writeTraceCsv(cout, std::vector<TraceRecord>(first_waiting, first_waiting + 3), [](uint8_t state) { return eVTOLStateName(static_cast<eVTOLState>(state)); });
+	std::remove("test_simulation_trace.bin");
+}
+
+
+void test_eVTOLSimulationCheckpoint()
+{
+	using namespace std;
+
+	auto total_wait_minutes = [](eVTOLSimulation& simulation) {
+		double minutes = 0.0;
+		for (auto& company : simulation.companyResults()) minutes += company.count * company.avg_wait_time_minutes;
+		return minutes;
+	};
+
+	// a one hour checkpoint of a 3 hour simulation, resumed, gives the same results as running straight through
+	for (SimulationEngine engine : { SimulationEngine::FIXED_TIMESTEP, SimulationEngine::BATCHED_FLEET })
+	{
+		eVTOLSimulationParameters parameters;
+		parameters.number_of_evtols = 200;
+		parameters.number_of_charging_stations = 4;
+		parameters.number_of_charging_bays = 5;
+		parameters.simulation_time_minutes = 180;
+		parameters.timer_mode = SimulationTimerMode::FREE_RUNNING;
+		parameters.engine = engine;
+		parameters.seed = 42;
+		parameters.verbose = false;
+
+		eVTOLSimulationCheckpoint one_hour = {};
+		eVTOLSimulation straight_through(parameters);
+		straight_through.setCheckpointHandler(60 * 60 * 1000, [&one_hour](const eVTOLSimulationCheckpoint& checkpoint) {
+			if (checkpoint.header.time == 60 * 60 * 1000) one_hour = checkpoint;
+			});
+		straight_through.run();
+
+		std::stringstream image;
+		writeCheckpoint(image, one_hour);
+		std::string contents = image.str();
+		eVTOLSimulation resumed(parameters);
+		resumed.resumeFrom(readCheckpoint(contents.data(), contents.size()));
+		resumed.run();
+
+		// what if, from the same hour on, the bays charged at no more than 100 kW
+		parameters.max_charge_rate_kw = 100.0;
+		eVTOLSimulation what_if(parameters);
+		what_if.resumeFrom(one_hour);
+		what_if.run();
+
+		std::vector<eVTOLCompanyResults> straight_results = straight_through.companyResults();
+		std::vector<eVTOLCompanyResults> resumed_results = resumed.companyResults();
+		bool same = straight_results.size() == resumed_results.size();
+		for (size_t i = 0; same && i < straight_results.size(); i++)
+		{
+			const eVTOLCompanyResults& a = straight_results[i];
+			const eVTOLCompanyResults& b = resumed_results[i];
+			same = a.avg_flight_time_minutes == b.avg_flight_time_minutes && a.avg_charge_time_minutes == b.avg_charge_time_minutes &&
+				a.avg_wait_time_minutes == b.avg_wait_time_minutes && a.max_faults == b.max_faults && a.total_passenger_miles == b.total_passenger_miles;
+		}
+		cout << simulationEngineName(engine) << ":" << contents.size() << ":" << same << ":";
+		cout << static_cast<size_t>(total_wait_minutes(straight_through) + 0.5) << ":" << static_cast<size_t>(total_wait_minutes(what_if) + 0.5) << "  ";
+	}
+	cout << endl;
+
+	eVTOLSimulationParameters parameters;
+	parameters.engine = SimulationEngine::DISCRETE_EVENT;
+	eVTOLSimulation simulation(parameters);
+	try { simulation.resumeFrom(eVTOLSimulationCheckpoint()); }
+	catch (const std::logic_error& le) { cout << le.what() << endl; }
+}
+
+
+void test_eVTOLSimulationInstrumentation()
+{
+	using namespace std;
+
+	// the counters are the same for every engine, the phases are timed by the timestep engines
+	for (SimulationEngine engine : { SimulationEngine::FIXED_TIMESTEP, SimulationEngine::BATCHED_FLEET, SimulationEngine::DISCRETE_EVENT })
+	{
+		eVTOLSimulationParameters parameters;
+		parameters.simulation_time_minutes = 120;
+		parameters.timer_mode = SimulationTimerMode::FREE_RUNNING;
+		parameters.engine = engine;
+		parameters.seed = 42;
+		parameters.verbose = false;
+		eVTOLSimulation simulation(parameters);
+		simulation.run();
+
+		SimulationInstrumentationReport report = simulation.instrumentation();
+		unsigned long long histogram_total = 0;
+		for (auto count : report.timestep_latency_histogram) histogram_total += count;
+		cout << simulationEngineName(engine) << ":" << report.timesteps << ":" << histogram_total << ":";
+		cout << report.stations.arrivals << ":" << report.stations.bays_assigned << ":" << report.stations.bays_released << ":";
+		cout << report.stations.max_queue_length << ":" << report.stations.max_bays_occupied << "  ";
+	}
+	cout << endl;
+
+	// a paced minute at 6000 times real time measures how late each timestep fired
+	eVTOLSimulationParameters paced;
+	paced.simulation_time_minutes = 1;
+	paced.time_compression = 6000;
+	paced.timer_catch_up = TimerCatchUpPolicy::DROP;
+	paced.seed = 42;
+	paced.verbose = false;
+	eVTOLSimulation paced_simulation(paced);
+	paced_simulation.run();
+	SimulationTimerJitter jitter = paced_simulation.timerJitter();
+	cout << jitter.timesteps_fired << "  " << (jitter.p50_lateness_microseconds <= jitter.max_lateness_microseconds) << endl;
+
+	eVTOLSimulation simulation;
+	try { simulation.instrumentation(); }
+	catch (const std::logic_error& le) { cout << le.what() << endl; }
+}
+
+
+void test_eVTOLSimulationAdaptiveTimestep()
+{
+	using namespace std;
+
+	// a fraction of the timesteps, every eVTOL is still accounted for the whole 3 hours to the millisecond
+	for (SimulationEngine engine : { SimulationEngine::FIXED_TIMESTEP, SimulationEngine::ADAPTIVE_TIMESTEP })
+	{
+		eVTOLSimulationParameters parameters;
+		parameters.timer_mode = SimulationTimerMode::FREE_RUNNING;
+		parameters.engine = engine;
+		parameters.seed = 42;
+		parameters.verbose = false;
+		eVTOLSimulation simulation(parameters);
+		simulation.run();
+
+		double minutes = 0.0;
+		size_t count = 0;
+		for (auto& company : simulation.companyResults())
+		{
+			count += company.count;
+			minutes += company.count * (company.avg_flight_time_minutes + company.avg_charge_time_minutes + company.avg_wait_time_minutes);
+		}
+		SimulationInstrumentationReport report = simulation.instrumentation();
+		cout << simulationEngineName(engine) << ":" << report.timesteps << ":" << static_cast<size_t>(minutes / count + 0.5) << ":" << report.stations.arrivals << "  ";
+	}
+	cout << endl;
+}
+
+
+void test_eVTOLSimulationAnalytic()
+{
+	using namespace std;
+
+	// with a bay for every eVTOL the analytic results are the discrete event results, without simulating at all
+	// with the default 3 bays it simulates from the last timestep before the first eVTOL would wait
+	for (size_t number_of_bays : { 20, 3 })
+	{
+		for (SimulationEngine engine : { SimulationEngine::DISCRETE_EVENT, SimulationEngine::ANALYTIC })
+		{
+			eVTOLSimulationParameters parameters;
+			parameters.number_of_charging_bays = number_of_bays;
+			parameters.timer_mode = SimulationTimerMode::FREE_RUNNING;
+			parameters.engine = engine;
+			parameters.seed = 42;
+			parameters.verbose = false;
+			eVTOLSimulation simulation(parameters);
+			simulation.run();
+
+			double flight_minutes = 0.0;
+			double wait_minutes = 0.0;
+			for (auto& company : simulation.companyResults())
+			{
+				flight_minutes += company.count * company.avg_flight_time_minutes;
+				wait_minutes += company.count * company.avg_wait_time_minutes;
+			}
+			cout << simulationEngineName(engine) << ":" << static_cast<size_t>(flight_minutes + 0.5) << ":" << static_cast<size_t>(wait_minutes + 0.5);
+			if (engine == SimulationEngine::ANALYTIC)
+			{
+				if (simulation.analyticSimulatedFrom() == eVTOLSimulation::NOT_SIMULATED) cout << ":none";
+				else cout << ":" << simulation.analyticSimulatedFrom();
+			}
+			cout << "  ";
+		}
+		cout << endl;
+	}
+
+	eVTOLSimulationParameters parameters;
+	parameters.engine = SimulationEngine::ANALYTIC;
+	eVTOLSimulation simulation(parameters);
+	try { simulation.setSnapshotHandler(60, [](unsigned long long, const std::vector<eVTOLCompanyResults>&) {}); }
+	catch (const std::logic_error& le) { cout << le.what() << endl; }
+
+	// several stations would need the station policy, which the closed form can't follow, FIXED_TIMESTEP runs them
+	for (SimulationEngine engine : { SimulationEngine::FIXED_TIMESTEP, SimulationEngine::ANALYTIC })
+	{
+		eVTOLSimulationParameters stations_parameters;
+		stations_parameters.number_of_charging_stations = 3;
+		stations_parameters.timer_mode = SimulationTimerMode::FREE_RUNNING;
+		stations_parameters.engine = engine;
+		stations_parameters.seed = 42;
+		stations_parameters.verbose = false;
+		eVTOLSimulation stations_simulation(stations_parameters);
+		try
+		{
+			stations_simulation.run();
+			cout << simulationEngineName(engine) << ":" << stations_simulation.companyResults().size() << "  ";
+		}
+		catch (const std::invalid_argument& ia) { cout << simulationEngineName(engine) << ": " << ia.what() << endl; }
+	}
+}
+
+
+void test_eVTOLSimulationOutput()
+{
+	using namespace std;
+
+	eVTOLSimulationParameters parameters;
+	parameters.number_of_evtols = 3;
+	parameters.simulation_time_minutes = 10;
+	parameters.timer_mode = SimulationTimerMode::FREE_RUNNING;
+	parameters.seed = 42;
+	parameters.verbose = false;
+	eVTOLSimulation simulation(parameters);
+	simulation.run();
+
+	std::ostringstream report;
+	simulation.writeCompanyGroupResults(report);
+	std::ostringstream csv;
+	simulation.writeResultsCsv(csv);
+	std::string lines = report.str();
+	cout << std::count(lines.begin(), lines.end(), '\n') << "  " << csv.str();
+	std::ostringstream json;
+	simulation.writeResultsJson(json);
+	cout << json.str().substr(0, 60) << endl;
+}
+
+
+void test_eVTOLSimulationCohort()
+{
+	using namespace std;
+
+	// a large fleet of a few configurations is a handful of cohorts, with the same results as every eVTOL on its own
+	for (SimulationEngine engine : { SimulationEngine::FIXED_TIMESTEP, SimulationEngine::COHORT })
+	{
+		eVTOLSimulationParameters parameters;
+		parameters.number_of_evtols = 10000;
+		parameters.number_of_charging_bays = 1500;
+		parameters.timer_mode = SimulationTimerMode::FREE_RUNNING;
+		parameters.engine = engine;
+		parameters.seed = 42;
+		parameters.verbose = false;
+		eVTOLSimulation simulation(parameters);
+		simulation.run();
+
+		double flight_minutes = 0.0;
+		double wait_minutes = 0.0;
+		for (auto& company : simulation.companyResults())
+		{
+			flight_minutes += company.count * company.avg_flight_time_minutes;
+			wait_minutes += company.count * company.avg_wait_time_minutes;
+		}
+		cout << simulationEngineName(engine) << ":" << static_cast<size_t>(flight_minutes / parameters.number_of_evtols + 0.5);
+		cout << ":" << static_cast<size_t>(wait_minutes / parameters.number_of_evtols + 0.5) << ":" << simulation.instrumentation().stations.arrivals << "  ";
+	}
+	cout << endl;
+
+	eVTOLSimulationParameters parameters;
+	parameters.number_of_charging_stations = 2;
+	parameters.engine = SimulationEngine::COHORT;
+	parameters.verbose = false;
+	eVTOLSimulation simulation(parameters);
+	try { simulation.run(); }
+	catch (const std::invalid_argument& ia) { cout << ia.what() << endl; }
+}
+
+
+void test_eVTOLSimulationSpecialized()
+{
+	using namespace std;
+
+	// the same seed gives the same results, eVTOL by eVTOL, with the company models specialized at compile time
+	std::string results[2];
+	SimulationEngine engines[] = { SimulationEngine::FIXED_TIMESTEP, SimulationEngine::SPECIALIZED };
+	for (int e = 0; e < 2; e++)
+	{
+		eVTOLSimulationParameters parameters;
+		parameters.number_of_evtols = 200;
+		parameters.number_of_charging_bays = 20;
+		parameters.number_of_charging_stations = 2;
+		parameters.timer_mode = SimulationTimerMode::FREE_RUNNING;
+		parameters.engine = engines[e];
+		parameters.seed = 42;
+		parameters.verbose = false;
+		eVTOLSimulation simulation(parameters);
+		size_t snapshot_faults = 0;
+		simulation.setSnapshotHandler(60 * 60 * 1000, [&snapshot_faults](unsigned long long, const std::vector<eVTOLCompanyResults>& companies) {
+			for (auto& company : companies) snapshot_faults += company.max_faults;
+			});
+		simulation.run();
+		std::ostringstream csv;
+		simulation.writeResultsCsv(csv);
+		results[e] = csv.str();
+		cout << simulationEngineName(engines[e]) << ":" << simulation.instrumentation().stations.arrivals << ":" << snapshot_faults << "  ";
+	}
+	cout << (results[0] == results[1]) << endl;
+
+	eVTOLSimulationParameters parameters;
+	parameters.configurations.push_back(eVTOLConfiguration("Foxtrot Company", 100, 100, 0.5, 1.0, 2, 0.1));
+	parameters.engine = SimulationEngine::SPECIALIZED;
+	parameters.verbose = false;
+	eVTOLSimulation simulation(parameters);
+	try { simulation.run(); }
+	catch (const std::invalid_argument& ia) { cout << ia.what() << endl; }
+}
+
+void test_eVTOLSimulationRegional()
+{
+	using namespace std;
+
+	// a single region is FIXED_TIMESTEP, eVTOL by eVTOL, and many regions give the same results on any number of threads
+	std::string results[4];
+	SimulationEngine engines[] = { SimulationEngine::FIXED_TIMESTEP, SimulationEngine::REGIONAL, SimulationEngine::REGIONAL, SimulationEngine::REGIONAL };
+	size_t regions[] = { 1, 1, 4, 4 };
+	size_t threads[] = { 1, 1, 1, 3 };
+	for (int e = 0; e < 4; e++)
+	{
+		eVTOLSimulationParameters parameters;
+		parameters.number_of_evtols = 200;
+		parameters.number_of_charging_bays = 5;
+		parameters.number_of_charging_stations = 4;
+		parameters.number_of_regions = regions[e];
+		parameters.cross_region_leg_probability = 0.3;
+		parameters.number_of_fleet_threads = threads[e];
+		parameters.timer_mode = SimulationTimerMode::FREE_RUNNING;
+		parameters.engine = engines[e];
+		parameters.seed = 42;
+		parameters.verbose = false;
+		eVTOLSimulation simulation(parameters);
+		simulation.run();
+		std::ostringstream csv;
+		simulation.writeResultsCsv(csv);
+		results[e] = csv.str();
+		cout << simulationEngineName(engines[e]) << ":" << regions[e] << ":" << simulation.instrumentation().stations.arrivals << "  ";
+	}
+	cout << (results[0] == results[1]) << (results[1] != results[2]) << (results[2] == results[3]) << endl;
+
+	eVTOLSimulationParameters parameters;
+	parameters.engine = SimulationEngine::REGIONAL;
+	parameters.number_of_regions = 2;
+	parameters.verbose = false;
+	eVTOLSimulation simulation(parameters);
+	try { simulation.run(); }
+	catch (const std::invalid_argument& ia) { cout << ia.what() << endl; }
+}
+
+void test_eVTOLSimulationMetrics()
+{
+	using namespace std;
+
+	// metrics every 30 minutes of a 2 hour simulation and at the end, the last holds the final totals
+	eVTOLMetricsPublisher publisher("evtol_test_simulation_metrics");
+	eVTOLMetricsReader reader("evtol_test_simulation_metrics");
+	for (SimulationEngine engine : { SimulationEngine::FIXED_TIMESTEP, SimulationEngine::DISCRETE_EVENT, SimulationEngine::COHORT, SimulationEngine::REGIONAL })
+	{
+		eVTOLSimulationParameters parameters;
+		parameters.simulation_time_minutes = 120;
+		parameters.engine = engine;
+		parameters.number_of_charging_stations = engine == SimulationEngine::COHORT ? 1 : 2;
+		parameters.number_of_regions = engine == SimulationEngine::REGIONAL ? 2 : 1;
+		parameters.timer_mode = SimulationTimerMode::FREE_RUNNING;
+		parameters.seed = 7;
+		parameters.verbose = false;
+		eVTOLSimulation simulation(parameters);
+		uint64_t before = reader.snapshots();
+		size_t waiting_seen = 0;
+		simulation.setSnapshotHandler(30 * 60 * 1000, [&reader, &waiting_seen](unsigned long long, const std::vector<eVTOLCompanyResults>&) {
+			eVTOLMetricsSnapshot snapshot;
+			if (reader.read(snapshot)) waiting_seen = std::max<size_t>(waiting_seen, snapshot.queue_depth + snapshot.bays_occupied);
+			});
+		simulation.setMetricsPublisher(30 * 60 * 1000, publisher);
+		simulation.run();
+
+		eVTOLMetricsSnapshot snapshot;
+		reader.read(snapshot);
+		std::vector<eVTOLCompanyResults> results = simulation.companyResults();
+		uint64_t evtols = 0;
+		bool totals_match = snapshot.number_of_companies == results.size();
+		for (size_t c = 0; c < results.size() && totals_match; c++)
+		{
+			evtols += snapshot.companies[c].evtols;
+			totals_match = results[c].company == snapshot.companies[c].company && results[c].total_passenger_miles == snapshot.companies[c].passenger_miles &&
+				std::abs(results[c].avg_flight_time_minutes * results[c].count - snapshot.companies[c].flight_time_minutes) < 1e-6;
+		}
+		cout << simulationEngineName(engine) << ":" << reader.snapshots() - before << ":" << snapshot.finished << snapshot.number_of_bays << ":";
+		cout << totals_match << (evtols == parameters.number_of_evtols) << (waiting_seen > 0) << "  ";
+	}
+	cout << endl;
+
+	eVTOLSimulationParameters parameters;
+	parameters.engine = SimulationEngine::ANALYTIC;
+	eVTOLSimulation analytic(parameters);
+	try { analytic.setMetricsPublisher(1000, publisher); }
+	catch (const std::logic_error& le) { cout << le.what() << endl; }
+}
+
+void test_eVTOLSimulationColumnar()
+{
+	using namespace std;
+
+	// the columns agree with the per company results, written from the eVTOLs or from the batched fleet's arrays
+	for (SimulationEngine engine : { SimulationEngine::FIXED_TIMESTEP, SimulationEngine::BATCHED_FLEET })
+	{
+		eVTOLSimulationParameters parameters;
+		parameters.number_of_evtols = 20000;
+		parameters.number_of_charging_bays = 3000;
+		parameters.simulation_time_minutes = 30;
+		parameters.timer_mode = SimulationTimerMode::FREE_RUNNING;
+		parameters.engine = engine;
+		parameters.seed = 42;
+		parameters.verbose = false;
+		eVTOLSimulation simulation(parameters);
+		simulation.run();
+		std::stringstream file;
+		simulation.writeResultsColumnar(file);
+		std::vector<uint64_t> image((file.str().size() + 7) / 8);
+		std::memcpy(image.data(), file.str().data(), file.str().size());
+		ColumnarFileView view(reinterpret_cast<const char*>(image.data()), file.str().size());
+
+		const uint64_t* company = view.column<uint64_t>("evtols", "company");
+		const uint64_t* flight = view.column<uint64_t>("evtols", "flight_time_milliseconds");
+		const uint8_t* state = view.column<uint8_t>("evtols", "ending_state");
+		std::vector<double> flight_minutes(view.rows("companies"));
+		size_t flying = 0;
+		for (uint64_t i = 0; i < view.rows("evtols"); i++)
+		{
+			flight_minutes[company[i]] += flight[i] / (1000.0 * 60);
+			flying += view.stringValue("states", "name", state[i]) == "FLYING";
+		}
+		const uint64_t* count = view.column<uint64_t>("companies", "count");
+		const double* average = view.column<double>("companies", "avg_flight_time_minutes");
+		bool matches = true;
+		for (uint64_t c = 0; c < view.rows("companies"); c++)
+		{
+			matches = matches && std::abs(flight_minutes[c] - average[c] * count[c]) < 1e-3 * count[c];
+		}
+		cout << simulationEngineName(engine) << ":" << view.rows("evtols") << ":" << view.stringValue("companies", "name", 2) << ":";
+		cout << view.columnNames("evtols").size() << ":" << matches << (flying > 0) << "  ";
+	}
+	cout << endl;
+}
+
 #endif  // EVTOL_SIMULATION
\ No newline at end of file
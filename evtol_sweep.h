@@ -0,0 +1,412 @@
+#ifndef EVTOL_SWEEP
+#define EVTOL_SWEEP
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include <atomic>
+#include <stdexcept>
+
+#include "sim_random.h"
+#include "sim_memory.h"
+#include "sim_thread_pool.h"
+#include "evtol.h"
+#include "evtol_results.h"
+#include "evtol_simulation.h"
+#include "evtol_replication.h"
+
+
+// One parameter of a sweep and the values it takes
+struct eVTOLSweepAxis
+{
+	std::string parameter;        // name of a numeric eVTOLSimulationParameters member, see setSweepParameter
+	std::vector<double> values;
+};
+
+// returns first, first + step, ... up to and including last
+inline std::vector<double> sweepRange(double first, double last, double step)
+{
+	if (step <= 0.0) throw std::invalid_argument("step must be greater than 0.");
+	std::vector<double> values;
+	for (size_t i = 0; first + i * step <= last + step * 1e-9; i++)
+	{
+		values.push_back(first + i * step);
+	}
+	return values;
+}
+
+// sets the named parameter, throws std::invalid_argument for a parameter that can't be swept
+inline void setSweepParameter(eVTOLSimulationParameters& parameters, const std::string& parameter, double value)
+{
+	if (value < 0.0) throw std::invalid_argument(parameter + " must not be negative.");
+	size_t whole = static_cast<size_t>(value + 0.5);
+	if (parameter == "number_of_evtols") parameters.number_of_evtols = whole;
+	else if (parameter == "number_of_charging_bays") parameters.number_of_charging_bays = whole;
+	else if (parameter == "number_of_charging_stations") parameters.number_of_charging_stations = whole;
+	else if (parameter == "max_charge_rate_kw") parameters.max_charge_rate_kw = value;
+	else if (parameter == "simulation_time_minutes") parameters.simulation_time_minutes = whole;
+	else if (parameter == "time_compression") parameters.time_compression = whole;
+	else if (parameter == "timestep_milliseconds") parameters.timestep_milliseconds = whole;
+	else if (parameter == "number_of_regions") parameters.number_of_regions = whole;
+	else if (parameter == "cross_region_leg_probability") parameters.cross_region_leg_probability = value;
+	else throw std::invalid_argument("unknown sweep parameter " + parameter + ".");
+}
+
+// the default measure a sweep converges on, passenger miles of the whole fleet
+inline double totalPassengerMiles(const std::vector<eVTOLCompanyResults>& company_results)
+{
+	double total = 0.0;
+	for (auto& results : company_results)
+	{
+		total += static_cast<double>(results.total_passenger_miles);
+	}
+	return total;
+}
+
+
+// How many replications each grid point gets
+struct eVTOLSweepOptions
+{
+	eVTOLSweepOptions()
+	{
+		min_replications = 5;
+		max_replications = 30;
+		batch_size = 5;
+		target_relative_half_width = 0.0;
+		number_of_threads = 0;
+		measure = totalPassengerMiles;
+	}
+
+	size_t min_replications;              // every grid point runs at least this many
+	size_t max_replications;              // and no more than this many
+	size_t batch_size;                    // replications added to an unconverged grid point in each round
+	double target_relative_half_width;    // a grid point stops once the 95% confidence half width of the measure is within this fraction of its mean, 0 never stops early
+	size_t number_of_threads;             // 0 uses one thread per hardware thread
+	std::function<double(const std::vector<eVTOLCompanyResults>&)> measure;  // the single number whose confidence interval decides convergence
+};
+
+
+// Results of one grid point of a sweep
+struct eVTOLSweepPointResults
+{
+	std::vector<double> values;           // one per axis
+	size_t replications;
+	bool converged;                       // stopped early as the confidence interval was tight enough
+	ReplicationStatistics measure;
+	std::vector<eVTOLCompanyReplicationResults> companies;
+};
+
+
+// Runs a grid of simulations, every combination of the values of each axis, each with many replications.
+// Rather than one replication runner per grid point, every replication of every grid point is a task
+// for one shared pool of threads, so small grid points don't leave threads idle while large ones finish.
+// Each thread keeps its own eVTOL arena and reuses it for every simulation it runs.
+// The sweep runs in rounds: the first gives every grid point min_replications, each later round gives
+// batch_size more to the grid points whose confidence interval is still wider than the target,
+// until they converge or reach max_replications.
+// Replication r of every grid point is seeded as replication r of an eVTOLReplicationRunner with the
+// same master seed, so grid points are compared under common random numbers, and because convergence is
+// only checked between rounds the results do not depend on the number of threads.
+// Simulations always run free running and quietly, whatever the parameters say.
+// Usage:
+//     eVTOLParameterSweep sweep(eVTOLSimulationParameters(), {
+//         { "number_of_charging_bays", sweepRange(1, 5, 1) },
+//         { "number_of_evtols", { 20, 40, 80 } } });
+//     sweep.run();
+//     sweep.printResults();
+//     sweep.writeCsv("sweep.csv");
+// sweep.run(coordinator.batchRunner()) runs each round's simulations on the workers of an eVTOLDistributedCoordinator.
+class eVTOLParameterSweep
+{
+public:
+	eVTOLParameterSweep(const eVTOLSimulationParameters& parameters, const std::vector<eVTOLSweepAxis>& axes, const eVTOLSweepOptions& options = eVTOLSweepOptions())
+	{
+		if (options.min_replications == 0) throw std::invalid_argument("min_replications must be greater than 0.");
+		if (options.max_replications < options.min_replications) throw std::invalid_argument("max_replications must be at least min_replications.");
+		if (options.batch_size == 0) throw std::invalid_argument("batch_size must be greater than 0.");
+		if (!options.measure) throw std::invalid_argument("a measure is required.");
+
+		parameters_ = parameters;
+		parameters_.timer_mode = SimulationTimerMode::FREE_RUNNING;
+		parameters_.verbose = false;
+		master_seed_ = parameters.seed ? RandomSeed(parameters.seed) : RandomSeed::fromClock();
+		axes_ = axes;
+		options_ = options;
+
+		// every combination of the axis values, the last axis varies fastest
+		size_t number_of_points = 1;
+		for (auto& axis : axes_)
+		{
+			if (axis.values.empty()) throw std::invalid_argument("sweep axis " + axis.parameter + " has no values.");
+			eVTOLSimulationParameters check = parameters_;
+			setSweepParameter(check, axis.parameter, axis.values[0]);
+			number_of_points *= axis.values.size();
+		}
+		points_.resize(number_of_points);
+		for (size_t point = 0; point < number_of_points; point++)
+		{
+			size_t index = point;
+			points_[point].values.resize(axes_.size());
+			for (size_t axis = axes_.size(); axis-- > 0; )
+			{
+				points_[point].values[axis] = axes_[axis].values[index % axes_[axis].values.size()];
+				index /= axes_[axis].values.size();
+			}
+		}
+	}
+
+	// runs every grid point, returns once they have all converged or reached max_replications
+	void run()
+	{
+		SimulationThreadPool threads(options_.number_of_threads);
+		std::vector<ObjectArena<eVTOL> > arenas(threads.size());
+		runRounds([&threads, &arenas](const std::vector<eVTOLSimulationParameters>& simulations) {
+			std::vector<std::vector<eVTOLCompanyResults> > results(simulations.size());
+			// each thread takes the next simulation not yet started until there are none left
+			std::atomic<size_t> next_simulation(0);
+			threads.parallelFor(threads.size(), [&simulations, &results, &next_simulation, &arenas](size_t begin, size_t end, size_t shard) {
+				size_t task;
+				while ((task = next_simulation++) < simulations.size())
+				{
+					eVTOLSimulation simulation(simulations[task]);
+					simulation.setArena(arenas[shard]);
+					simulation.run();
+					results[task] = simulation.companyResults();
+				}
+				});
+			return results;
+			});
+	}
+
+	// as run(), but each round's simulations are one batch of run_simulations, e.g. on many nodes, the same results
+	void run(const SimulationBatchRunner& run_simulations)
+	{
+		runRounds(run_simulations);
+	}
+
+	// the parameters of one replication of one grid point
+	eVTOLSimulationParameters replicationParameters(size_t point, size_t replication)
+	{
+		eVTOLSimulationParameters parameters = parameters_;
+		for (size_t axis = 0; axis < axes_.size(); axis++)
+		{
+			setSweepParameter(parameters, axes_[axis].parameter, points_[point].values[axis]);
+		}
+		parameters.seed = master_seed_.child(RandomStream::REPLICATION).child(replication).value();
+		if (parameters.seed == 0) parameters.seed = 1;  // 0 would mean seed from the clock
+		return parameters;
+	}
+
+	// one entry per grid point, the last axis varies fastest
+	std::vector<eVTOLSweepPointResults> results() { return points_; }
+
+	size_t numberOfPoints() { return points_.size(); }
+
+	// total simulations run by the last run(), at most number of points x max_replications
+	size_t simulationsRun() { return simulations_run_; }
+
+	void printResults()
+	{
+		using namespace std;
+		cout << endl << endl << "******************************** R E S U L T S ********************************" << endl;
+		cout << endl << "Sweep Parameters" << endl;
+		cout << "  Number of Grid Points:       " << points_.size() << endl;
+		cout << "  Replications per Point:      " << options_.min_replications << " to " << options_.max_replications << endl;
+		if (options_.target_relative_half_width > 0.0)
+		{
+			cout << "  Target 95% CI Half Width:    " << options_.target_relative_half_width * 100 << "% of the mean" << endl;
+		}
+		cout << "  Simulations Run:             " << simulations_run_ << endl;
+		cout << "  Master Seed:                 " << master_seed_.value() << endl;
+
+		cout << endl << "Sweep Results" << endl;
+		for (auto& axis : axes_)
+		{
+			cout << setw(axis.parameter.size() + 2) << axis.parameter;
+		}
+		cout << setw(8) << "REPS" << setw(6) << "CONV" << setw(14) << "MEASURE" << setw(12) << "95% CI +-" << setw(12) << "AVG WAIT" << endl;
+		for (auto& results : points_)
+		{
+			for (size_t axis = 0; axis < axes_.size(); axis++)
+			{
+				cout << setw(axes_[axis].parameter.size() + 2) << results.values[axis];
+			}
+			double wait_minutes = 0.0;
+			double count = 0.0;
+			for (auto& company : results.companies)
+			{
+				wait_minutes += company.avg_wait_time_minutes.mean * company.count.mean;
+				count += company.count.mean;
+			}
+			cout << setw(8) << results.replications << setw(6) << (results.converged ? "yes" : "no");
+			cout << fixed << setprecision(2);
+			cout << setw(14) << results.measure.mean << setw(12) << results.measure.confidence_half_width << setw(12) << (count > 0.0 ? wait_minutes / count : 0.0) << endl;
+			cout.unsetf(ios::fixed);
+			cout << setprecision(6);
+		}
+		cout << endl;
+	}
+
+	// writes one row per grid point and company, the mean and 95% confidence half width of each measurement
+	void writeCsv(std::ostream& out)
+	{
+		const char* measurements[] = { "count", "avg_flight_time_minutes", "avg_charge_time_minutes", "avg_wait_time_minutes", "max_faults", "total_passenger_miles" };
+		for (auto& axis : axes_)
+		{
+			out << axis.parameter << ",";
+		}
+		out << "replications,converged,company";
+		for (const char* measurement : measurements)
+		{
+			out << "," << measurement << "," << measurement << "_ci";
+		}
+		out << std::endl;
+
+		out << std::setprecision(10);
+		for (auto& results : points_)
+		{
+			for (auto& company : results.companies)
+			{
+				for (double value : results.values)
+				{
+					out << value << ",";
+				}
+				out << results.replications << "," << results.converged << "," << company.company;
+				const ReplicationStatistics* stats[] = { &company.count, &company.avg_flight_time_minutes, &company.avg_charge_time_minutes,
+					&company.avg_wait_time_minutes, &company.max_faults, &company.total_passenger_miles };
+				for (const ReplicationStatistics* stat : stats)
+				{
+					out << "," << stat->mean << "," << stat->confidence_half_width;
+				}
+				out << std::endl;
+			}
+		}
+	}
+
+	void writeCsv(const std::string& file_name)
+	{
+		std::ofstream out(file_name);
+		if (!out) throw std::runtime_error("unable to open " + file_name + " for writing.");
+		writeCsv(out);
+	}
+
+private:
+	void runRounds(const SimulationBatchRunner& run_simulations)
+	{
+		std::vector<std::vector<std::vector<eVTOLCompanyResults> > > replication_results(points_.size());
+		std::vector<bool> active(points_.size(), true);
+		simulations_run_ = 0;
+
+		for (size_t round = 0; ; round++)
+		{
+			// the replications of this round, as (grid point, replication)
+			std::vector<std::pair<size_t, size_t> > tasks;
+			std::vector<eVTOLSimulationParameters> simulations;
+			for (size_t point = 0; point < points_.size(); point++)
+			{
+				if (!active[point]) continue;
+				size_t first = replication_results[point].size();
+				size_t last = std::min(round == 0 ? options_.min_replications : first + options_.batch_size, options_.max_replications);
+				replication_results[point].resize(last);
+				for (size_t replication = first; replication < last; replication++)
+				{
+					tasks.push_back(std::make_pair(point, replication));
+					simulations.push_back(replicationParameters(point, replication));
+				}
+			}
+			if (tasks.empty()) break;
+
+			std::vector<std::vector<eVTOLCompanyResults> > results = run_simulations(simulations);
+			if (results.size() != tasks.size()) throw std::runtime_error("the batch runner returned the wrong number of results.");
+			for (size_t task = 0; task < tasks.size(); task++)
+			{
+				replication_results[tasks[task].first][tasks[task].second].swap(results[task]);
+			}
+			simulations_run_ += tasks.size();
+
+			for (size_t point = 0; point < points_.size(); point++)
+			{
+				if (!active[point]) continue;
+				eVTOLSweepPointResults& results = points_[point];
+				std::vector<double> samples;
+				for (auto& company_results : replication_results[point])
+				{
+					samples.push_back(options_.measure(company_results));
+				}
+				results.replications = samples.size();
+				results.measure = replicationStatistics(samples);
+				results.converged = options_.target_relative_half_width > 0.0 && samples.size() > 1 &&
+					results.measure.confidence_half_width <= options_.target_relative_half_width * std::fabs(results.measure.mean);
+				if (results.converged || results.replications >= options_.max_replications)
+				{
+					active[point] = false;
+				}
+			}
+		}
+
+		for (size_t point = 0; point < points_.size(); point++)
+		{
+			points_[point].companies = summarizeCompanyResults(replication_results[point]);
+		}
+	}
+
+	eVTOLSimulationParameters parameters_;
+	RandomSeed master_seed_;
+	std::vector<eVTOLSweepAxis> axes_;
+	eVTOLSweepOptions options_;
+	std::vector<eVTOLSweepPointResults> points_;   // one entry per grid point
+	size_t simulations_run_ = 0;
+};
+
+
+
+void test_eVTOLParameterSweep()
+{
+	using namespace std;
+
+	std::vector<double> range = sweepRange(1, 2, 0.5);
+	cout << range.size() << "  " << range.back() << endl;
+	try { eVTOLParameterSweep bad(eVTOLSimulationParameters(), { { "colour", { 1 } } }); }
+	catch (const std::invalid_argument& ia) { cout << ia.what() << endl; }
+
+	eVTOLSimulationParameters parameters;
+	parameters.seed = 1234;
+	parameters.simulation_time_minutes = 60;
+	parameters.engine = SimulationEngine::DISCRETE_EVENT;
+
+	// a grid point runs the same replications as a replication runner with the same seed
+	eVTOLSweepOptions options;
+	options.min_replications = 4;
+	options.max_replications = 4;
+	options.number_of_threads = 2;
+	eVTOLParameterSweep sweep(parameters, { { "number_of_charging_bays", { 1, 3 } }, { "number_of_evtols", { 10, 20 } } }, options);
+	sweep.run();
+	std::vector<eVTOLSweepPointResults> results = sweep.results();
+	parameters.number_of_charging_bays = 3;
+	eVTOLReplicationRunner runner(parameters, 4, 1);
+	runner.run();
+	cout << sweep.numberOfPoints() << "  " << sweep.simulationsRun() << "  " << results[3].values[0] << "," << results[3].values[1] << "  ";
+	cout << (results[3].companies[0].avg_wait_time_minutes.mean == runner.companyResults()[0].avg_wait_time_minutes.mean) << endl;
+
+	// early termination, a loose target converges at the first check, the same with one thread or many
+	options.max_replications = 40;
+	options.target_relative_half_width = 0.5;
+	options.number_of_threads = 1;
+	eVTOLParameterSweep one_thread(parameters, { { "number_of_evtols", { 20, 40 } } }, options);
+	one_thread.run();
+	options.number_of_threads = 3;
+	eVTOLParameterSweep three_threads(parameters, { { "number_of_evtols", { 20, 40 } } }, options);
+	three_threads.run();
+	cout << one_thread.simulationsRun() << "  " << one_thread.results()[1].converged << "  ";
+	cout << (one_thread.results()[1].measure.mean == three_threads.results()[1].measure.mean) << endl;
+	one_thread.printResults();
+	one_thread.writeCsv(cout);
+}
+
+
+#endif  // EVTOL_SWEEP
@@ -1,12 +1,227 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <memory>
+#include <thread>
+#include <chrono>
 
 #include "evtol_simulation.h"
+#include "evtol_replication.h"
+#include "evtol_scenario.h"
+#include "evtol_distributed.h"
 
 
+// Files the results of each simulation are written to, none when empty
+struct ResultsFiles
+{
+	std::string csv_file;       // one row per eVTOL, see eVTOLSimulation::writeResultsCsv
+	std::string json_file;      // see eVTOLSimulation::writeResultsJson
+	std::string columns_file;   // see eVTOLSimulation::writeResultsColumnar
+};
+
+
+// Where a single simulation publishes its live metrics, none when there is no region name
+struct MetricsOptions
+{
+	std::string region;      // shared memory the snapshots are published to, see eVTOLMetricsPublisher
+	uint16_t port = 0;       // serves the region over HTTP for Prometheus while the simulation runs, none when 0
+};
+
 
-int main()
+// with more than one scenario, scenario n of the file name results.csv is written to results.n.csv
+std::string scenarioFileName(const std::string& file_name, size_t scenario, size_t number_of_scenarios)
 {
-	eVTOLSimulation simulation;
+	if (number_of_scenarios <= 1) return file_name;
+	size_t dot = file_name.find_last_of('.');
+	size_t slash = file_name.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) dot = file_name.size();
+	return file_name.substr(0, dot) + "." + std::to_string(scenario + 1) + file_name.substr(dot);
+}
+
+
+// runs one simulation, or NUMBER_OF_REPLICATIONS of it, results files are written for a single simulation only.
+// With a coordinator the replications, however many, are run by its workers and only the company results are printed.
+// A single simulation publishes metrics when asked to, replications don't.
+void runScenario(const eVTOLSimulationParameters& parameters, const ResultsFiles& files, const MetricsOptions& metrics, eVTOLDistributedCoordinator* coordinator)
+{
+	if (coordinator)
+	{
+		eVTOLReplicationRunner runner(parameters, NUMBER_OF_REPLICATIONS);
+		runner.run(coordinator->batchRunner());
+		runner.printResults();
+		return;
+	}
+
+	if (NUMBER_OF_REPLICATIONS > 1)
+	{
+		eVTOLReplicationRunner runner(parameters, NUMBER_OF_REPLICATIONS);
+		runner.run();
+		runner.printResults();
+		return;
+	}
+
+	eVTOLSimulation simulation(parameters);
+	std::unique_ptr<eVTOLMetricsPublisher> publisher;
+	std::unique_ptr<eVTOLMetricsExporter> exporter;
+	if (!metrics.region.empty())
+	{
+		publisher.reset(new eVTOLMetricsPublisher(metrics.region));
+		simulation.setMetricsPublisher(METRICS_INTERVAL_IN_MILLISECONDS, *publisher);
+		if (metrics.port) exporter.reset(new eVTOLMetricsExporter(metrics.region, metrics.port));
+	}
 	simulation.run();
 	simulation.printResults();
-} 
+	if (REPORT_INSTRUMENTATION) simulation.printInstrumentation();
+	if (!files.csv_file.empty())
+	{
+		std::ofstream out(files.csv_file);
+		if (!out) throw std::runtime_error("unable to open " + files.csv_file + " for writing.");
+		simulation.writeResultsCsv(out);
+	}
+	if (!files.json_file.empty())
+	{
+		std::ofstream out(files.json_file);
+		if (!out) throw std::runtime_error("unable to open " + files.json_file + " for writing.");
+		simulation.writeResultsJson(out);
+	}
+	if (!files.columns_file.empty())
+	{
+		std::ofstream out(files.columns_file, std::ios::binary);
+		if (!out) throw std::runtime_error("unable to open " + files.columns_file + " for writing.");
+		simulation.writeResultsColumnar(out);
+	}
+}
+
+
+// returns the port of a port number argument, 0 if it isn't one
+uint16_t portArgument(const std::string& arg)
+{
+	if (arg.empty() || arg.find_first_not_of("0123456789") != std::string::npos || arg.size() > 5) return 0;
+	unsigned long port = std::stoul(arg);
+	return port <= 65535 ? static_cast<uint16_t>(port) : 0;
+}
+
+// splits a name:port argument, the port is 0 if there is none or it isn't one
+void splitAddress(const std::string& arg, std::string& name, uint16_t& port)
+{
+	size_t colon = arg.find_last_of(':');
+	name = arg.substr(0, colon == std::string::npos ? arg.size() : colon);
+	port = colon == std::string::npos ? 0 : portArgument(arg.substr(colon + 1));
+}
+
+
+// with no scenario runs the compiled in parameters, otherwise every scenario of the given file, text or binary.
+// --coordinator runs the replications of each scenario on the workers that connect to the port,
+// --worker runs a coordinator's simulations, one per hardware thread, until it has no more.
+// --metrics publishes a single simulation's live metrics to shared memory, and with a port serves them over HTTP,
+// --serve-metrics serves the metrics another process publishes until stopped.
+// Usage:
+//     sim.out [scenario file] [--csv results.csv] [--json results.json] [--columns results.columns] [--coordinator port] [--metrics name[:port]]
+//     sim.out --worker host:port
+//     sim.out --serve-metrics name:port
+int main(int argc, char* argv[])
+{
+	std::string scenario_file;
+	ResultsFiles files;
+	uint16_t coordinator_port = 0;
+	std::string worker_host;
+	uint16_t worker_port = 0;
+	MetricsOptions metrics;
+	std::string served_metrics;
+	uint16_t served_metrics_port = 0;
+	bool usage = false;
+	for (int i = 1; i < argc; i++)
+	{
+		std::string arg = argv[i];
+		if (arg == "--csv" && i + 1 < argc) files.csv_file = argv[++i];
+		else if (arg == "--json" && i + 1 < argc) files.json_file = argv[++i];
+		else if (arg == "--columns" && i + 1 < argc) files.columns_file = argv[++i];
+		else if (arg == "--coordinator" && i + 1 < argc) usage = usage || !(coordinator_port = portArgument(argv[++i]));
+		else if (arg == "--worker" && i + 1 < argc)
+		{
+			splitAddress(argv[++i], worker_host, worker_port);
+			usage = usage || worker_host.empty() || !worker_port;
+		}
+		else if (arg == "--metrics" && i + 1 < argc)
+		{
+			std::string address = argv[++i];
+			splitAddress(address, metrics.region, metrics.port);
+			usage = usage || metrics.region.empty() || (address.find(':') != std::string::npos && !metrics.port);
+		}
+		else if (arg == "--serve-metrics" && i + 1 < argc)
+		{
+			splitAddress(argv[++i], served_metrics, served_metrics_port);
+			usage = usage || served_metrics.empty() || !served_metrics_port;
+		}
+		else if (scenario_file.empty() && arg.compare(0, 2, "--") != 0) scenario_file = arg;
+		else usage = true;
+	}
+	bool runs_scenarios = !scenario_file.empty() || coordinator_port || !metrics.region.empty();
+	if (usage || (!worker_host.empty() && (runs_scenarios || !served_metrics.empty())) || (!served_metrics.empty() && runs_scenarios))
+	{
+		std::cerr << "usage: " << argv[0] << " [scenario file] [--csv results.csv] [--json results.json] [--columns results.columns] [--coordinator port] [--metrics name[:port]]" << std::endl;
+		std::cerr << "       " << argv[0] << " --worker host:port" << std::endl;
+		std::cerr << "       " << argv[0] << " --serve-metrics name:port" << std::endl;
+		return 1;
+	}
+
+	if (!served_metrics.empty())
+	{
+		try
+		{
+			eVTOLMetricsExporter exporter(served_metrics, served_metrics_port);
+			std::cout << "Serving the metrics of " << served_metrics << " on port " << exporter.port() << std::endl;
+			for (;;) std::this_thread::sleep_for(std::chrono::seconds(1));
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << e.what() << std::endl;
+			return 1;
+		}
+	}
+
+	if (!worker_host.empty())
+	{
+		try
+		{
+			size_t units_run = eVTOLDistributedWorker(worker_host, worker_port).run();
+			std::cout << "Ran " << units_run << " simulations for " << worker_host << ":" << worker_port << std::endl;
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << e.what() << std::endl;
+			return 1;
+		}
+		return 0;
+	}
 
+	std::vector<eVTOLSimulationParameters> scenarios(1);
+	try
+	{
+		std::unique_ptr<eVTOLDistributedCoordinator> coordinator;
+		if (coordinator_port)
+		{
+			eVTOLDistributedOptions options;
+			options.port = coordinator_port;
+			coordinator.reset(new eVTOLDistributedCoordinator(options));
+			std::cout << "Coordinating on port " << coordinator->port() << ", waiting for workers" << std::endl;
+		}
+		if (!scenario_file.empty()) scenarios = loadScenarios(scenario_file);
+		for (size_t i = 0; i < scenarios.size(); i++)
+		{
+			ResultsFiles scenario_files;
+			if (!files.csv_file.empty()) scenario_files.csv_file = scenarioFileName(files.csv_file, i, scenarios.size());
+			if (!files.json_file.empty()) scenario_files.json_file = scenarioFileName(files.json_file, i, scenarios.size());
+			if (!files.columns_file.empty()) scenario_files.columns_file = scenarioFileName(files.columns_file, i, scenarios.size());
+			runScenario(scenarios[i], scenario_files, metrics, coordinator.get());
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,273 @@
+#ifndef SIM_BENCHMARK
+#define SIM_BENCHMARK
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <thread>
+#include <utility>
+#include <stdexcept>
+
+
+// The work done by one run of a benchmark and the time it took.
+// items is whatever the benchmark counts, e.g. aircraft-timesteps or eVTOLs created.
+struct BenchmarkMeasurement
+{
+	unsigned long long items;
+	double nanoseconds;
+};
+
+
+// Result of a benchmark across all of its repetitions
+struct BenchmarkResult
+{
+	std::string name;
+	std::string unit;            // what an item is
+	size_t repetitions;
+	unsigned long long items;    // per repetition
+	double ns_per_item;          // median over the repetitions
+	double min_ns_per_item;
+	double max_ns_per_item;
+	double items_per_second;     // from the median
+};
+
+
+// Times a section of a benchmark, can be started and stopped many times to leave out setup between sections.
+// Usage:
+//     BenchmarkStopwatch stopwatch;
+//     stopwatch.start();
+//     work();
+//     stopwatch.stop();
+//     double ns = stopwatch.nanoseconds();
+class BenchmarkStopwatch
+{
+public:
+	BenchmarkStopwatch() : nanoseconds_(0.0) {}
+
+	void start() { start_time_ = std::chrono::steady_clock::now(); }
+
+	void stop()
+	{
+		nanoseconds_ += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start_time_).count();
+	}
+
+	double nanoseconds() { return nanoseconds_; }
+
+private:
+	std::chrono::steady_clock::time_point start_time_;
+	double nanoseconds_;
+};
+
+
+// A minimal, self contained benchmark harness.
+// Each benchmark is a function that does some work, times it and reports the number of items processed.
+// Every benchmark is run a number of times and the median time per item is reported, along with min and max,
+// so a single slow repetition, e.g. from the OS, does not skew the result.
+// Results are printed as a table and can be written as JSON to track regressions between releases.
+// The JSON follows the layout of Google Benchmark, a context object and a list of benchmarks,
+// so the same tools can compare runs.
+// Usage:
+//     SimulationBenchmark benchmark(5);
+//     benchmark.add("create_evtol", "eVTOL", [&factory]() {
+//         BenchmarkStopwatch stopwatch;
+//         stopwatch.start();
+//         for (int i = 0; i < 1000; i++) delete factory.create_eVTOL();
+//         stopwatch.stop();
+//         return BenchmarkMeasurement{ 1000, stopwatch.nanoseconds() };
+//     });
+//     benchmark.run();
+//     benchmark.writeJson("results.json");
+class SimulationBenchmark
+{
+public:
+	SimulationBenchmark(size_t repetitions = 3)
+	{
+		if (repetitions == 0) throw std::invalid_argument("repetitions must be greater than 0.");
+		repetitions_ = repetitions;
+	}
+
+	void add(const std::string& name, const std::string& unit, std::function<BenchmarkMeasurement()> benchmark)
+	{
+		names_.push_back(name);
+		units_.push_back(unit);
+		benchmarks_.push_back(benchmark);
+	}
+
+	// runs every benchmark in the order added, printing each result as it completes
+	void run(bool verbose = true)
+	{
+		using namespace std;
+		results_.clear();
+		if (verbose)
+		{
+			cout << setw(48) << left << "BENCHMARK" << right << setw(14) << "NS/ITEM" << setw(14) << "MIN" << setw(14) << "MAX" << setw(16) << "ITEMS/SEC" << "  UNIT" << endl;
+		}
+		for (size_t i = 0; i < benchmarks_.size(); i++)
+		{
+			results_.push_back(runBenchmark(i));
+			if (verbose) printResult(results_.back());
+		}
+	}
+
+	std::vector<BenchmarkResult> results() { return results_; }
+
+	// writes the results as JSON, context describes the machine and build the results came from
+	void writeJson(std::ostream& out)
+	{
+		out << "{" << std::endl;
+		out << "  \"context\": {" << std::endl;
+		out << "    \"date\": \"" << currentDate() << "\"," << std::endl;
+		out << "    \"compiler\": \"" << jsonEscape(compilerName()) << "\"," << std::endl;
+		out << "    \"num_cpus\": " << std::thread::hardware_concurrency() << "," << std::endl;
+		out << "    \"repetitions\": " << repetitions_;
+		for (auto& entry : context_)
+		{
+			out << "," << std::endl << "    \"" << jsonEscape(entry.first) << "\": \"" << jsonEscape(entry.second) << "\"";
+		}
+		out << std::endl << "  }," << std::endl;
+		out << "  \"benchmarks\": [";
+		out << std::setprecision(6);
+		for (size_t i = 0; i < results_.size(); i++)
+		{
+			BenchmarkResult& result = results_[i];
+			out << (i ? "," : "") << std::endl << "    {" << std::endl;
+			out << "      \"name\": \"" << jsonEscape(result.name) << "\"," << std::endl;
+			out << "      \"unit\": \"" << jsonEscape(result.unit) << "\"," << std::endl;
+			out << "      \"repetitions\": " << result.repetitions << "," << std::endl;
+			out << "      \"items\": " << result.items << "," << std::endl;
+			out << "      \"ns_per_item\": " << result.ns_per_item << "," << std::endl;
+			out << "      \"min_ns_per_item\": " << result.min_ns_per_item << "," << std::endl;
+			out << "      \"max_ns_per_item\": " << result.max_ns_per_item << "," << std::endl;
+			out << "      \"items_per_second\": " << result.items_per_second << std::endl;
+			out << "    }";
+		}
+		out << std::endl << "  ]" << std::endl << "}" << std::endl;
+	}
+
+	void writeJson(const std::string& file_name)
+	{
+		std::ofstream out(file_name);
+		if (!out) throw std::runtime_error("unable to open " + file_name + " for writing.");
+		writeJson(out);
+	}
+
+	// extra information recorded in the JSON context, e.g. the instruction set of a kernel
+	void addContext(const std::string& key, const std::string& value)
+	{
+		context_.push_back(std::make_pair(key, value));
+	}
+
+private:
+	BenchmarkResult runBenchmark(size_t index)
+	{
+		std::vector<double> ns_per_item;
+		unsigned long long items = 0;
+		for (size_t repetition = 0; repetition < repetitions_; repetition++)
+		{
+			BenchmarkMeasurement measurement = benchmarks_[index]();
+			items = measurement.items;
+			ns_per_item.push_back(measurement.items ? measurement.nanoseconds / measurement.items : 0.0);
+		}
+		std::sort(ns_per_item.begin(), ns_per_item.end());
+
+		BenchmarkResult result;
+		result.name = names_[index];
+		result.unit = units_[index];
+		result.repetitions = repetitions_;
+		result.items = items;
+		result.ns_per_item = ns_per_item[ns_per_item.size() / 2];
+		result.min_ns_per_item = ns_per_item.front();
+		result.max_ns_per_item = ns_per_item.back();
+		result.items_per_second = result.ns_per_item > 0.0 ? 1.0e9 / result.ns_per_item : 0.0;
+		return result;
+	}
+
+	void printResult(const BenchmarkResult& result)
+	{
+		using namespace std;
+		cout << setw(48) << left << result.name << right;
+		cout << fixed << setprecision(2);
+		cout << setw(14) << result.ns_per_item << setw(14) << result.min_ns_per_item << setw(14) << result.max_ns_per_item;
+		cout << setprecision(0) << setw(16) << result.items_per_second << "  " << result.unit << endl;
+	}
+
+	static std::string currentDate()
+	{
+		std::time_t now = std::time(nullptr);
+		char buffer[32];
+		std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+		return buffer;
+	}
+
+	static std::string compilerName()
+	{
+#if defined(__clang__)
+		return std::string("clang ") + __clang_version__;
+#elif defined(__GNUC__)
+		return std::string("gcc ") + __VERSION__;
+#elif defined(_MSC_VER)
+		return "msvc " + std::to_string(_MSC_VER);
+#else
+		return "unknown";
+#endif
+	}
+
+	static std::string jsonEscape(const std::string& text)
+	{
+		std::string escaped;
+		for (char c : text)
+		{
+			if (c == '"' || c == '\\') escaped += '\\';
+			escaped += c;
+		}
+		return escaped;
+	}
+
+	size_t repetitions_;
+	std::vector<std::string> names_;                       // one entry per benchmark
+	std::vector<std::string> units_;                       // one entry per benchmark
+	std::vector<std::function<BenchmarkMeasurement()> > benchmarks_;
+	std::vector<BenchmarkResult> results_;
+	std::vector<std::pair<std::string, std::string> > context_;
+};
+
+
+
+void test_SimulationBenchmark()
+{
+	using namespace std;
+
+	try { SimulationBenchmark bad(0); }
+	catch (const std::invalid_argument& ia) { cout << ia.what() << endl; }
+
+	// each repetition reports 1000 items in 2000 ns, so 2 ns per item
+	SimulationBenchmark benchmark(3);
+	int runs = 0;
+	benchmark.add("fixed", "item", [&runs]() {
+		runs++;
+		return BenchmarkMeasurement{ 1000, 2000.0 };
+		});
+	benchmark.add("timed \"sum\"", "addition", []() {
+		BenchmarkStopwatch stopwatch;
+		volatile unsigned long long total = 0;
+		stopwatch.start();
+		for (unsigned long long i = 0; i < 100000; i++) total = total + i;
+		stopwatch.stop();
+		return BenchmarkMeasurement{ 100000, stopwatch.nanoseconds() };
+		});
+	benchmark.addContext("purpose", "test");
+	benchmark.run();
+	std::vector<BenchmarkResult> results = benchmark.results();
+	cout << runs << "  " << results[0].ns_per_item << "  " << results[0].items_per_second << "  " << (results[1].ns_per_item > 0.0) << endl;
+	benchmark.writeJson(cout);
+}
+
+
+#endif  // SIM_BENCHMARK
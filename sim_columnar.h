@@ -0,0 +1,438 @@
+#ifndef SIM_COLUMNAR
+#define SIM_COLUMNAR
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+
+#include "sim_random.h"
+#include "sim_shared_memory.h"
+
+
+// What a column holds, a column's width is the bytes of each value
+enum class ColumnType : uint32_t
+{
+	UNSIGNED = 1,   // unsigned integers
+	SIGNED = 2,     // signed integers
+	FLOAT = 3,      // IEEE floating point
+	STRING = 4      // text of up to width bytes, nul padded
+};
+
+// the column type of the values of a plain array of T
+template<class T>
+inline ColumnType columnTypeOf()
+{
+	static_assert(std::is_arithmetic<T>::value, "columns hold numbers or strings only.");
+	return std::is_floating_point<T>::value ? ColumnType::FLOAT : std::is_signed<T>::value ? ColumnType::SIGNED : ColumnType::UNSIGNED;
+}
+
+const char COLUMNAR_FILE_MAGIC[8] = { 'E', 'V', 'T', 'O', 'L', 'C', 'O', 'L' };
+const uint32_t COLUMNAR_FILE_VERSION = 1;
+const uint32_t COLUMNAR_FILE_BYTE_ORDER = 0x01020304;
+const uint64_t COLUMNAR_ALIGNMENT = 64;   // every column starts on a cache line
+
+struct ColumnarFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t number_of_tables;
+	uint32_t number_of_columns;
+	uint64_t file_size;
+	uint64_t checksum;   // of the tables and columns that follow the header
+};
+
+struct ColumnarTableRecord
+{
+	char name[48];       // nul terminated
+	uint64_t rows;
+};
+
+struct ColumnarColumnRecord
+{
+	char name[48];       // nul terminated
+	uint32_t table;      // index of its ColumnarTableRecord
+	uint32_t type;       // a ColumnType
+	uint64_t width;      // bytes of each value
+	uint64_t offset;     // of the first value from the start of the file
+};
+
+
+// Writes tables of columns to a flat binary file, every column as one contiguous array that can be used
+// where it lies once the file is mapped into memory, see ColumnarFileView.
+// The file is a header, a directory of every table and column, then the columns, each aligned to 64 bytes.
+// A column is either a plain array, written as it is with no copy, or a fill function that gathers values
+// a chunk at a time into a buffer of CHUNK_BYTES, so values held in objects are written without a copy of the
+// whole column.  The file is written front to back in one pass, to any stream.  Native byte order,
+// as the binary scenarios, so a file is read on the kind of machine that wrote it.
+// Arrays and fill functions must stay valid until write().
+// Usage:
+//     ColumnarFileWriter writer;
+//     size_t evtols = writer.addTable("evtols", fleet_size);
+//     writer.addColumn(evtols, "faults", faults.data());
+//     writer.addColumn<double>(evtols, "charge", [](size_t first, size_t count, double* values) { ... });
+//     writer.write(out);
+class ColumnarFileWriter
+{
+public:
+	static const size_t CHUNK_BYTES = 64 * 1024;
+	static const size_t MAX_STRING_WIDTH = 4096;
+
+	// returns the index of the table
+	size_t addTable(const std::string& name, uint64_t rows)
+	{
+		ColumnarTableRecord table = {};
+		copyName(table.name, sizeof(table.name), name);
+		for (auto& other : tables_)
+		{
+			if (std::strcmp(other.name, table.name) == 0) throw std::invalid_argument("there is already a table named " + name + ".");
+		}
+		table.rows = rows;
+		tables_.push_back(table);
+		return tables_.size() - 1;
+	}
+
+	// the values are written as they are, values must hold the table's rows
+	template<class T>
+	void addColumn(size_t table, const std::string& name, const T* values)
+	{
+		if (!values && rows(table) > 0) throw std::invalid_argument("column " + name + " has no values.");
+		addColumn(table, name, columnTypeOf<T>(), sizeof(T), reinterpret_cast<const char*>(values), nullptr);
+	}
+
+	// size_t values are written as 64 bit unsigned, as they are when size_t is 64 bits, so files are alike on every build
+	void addColumn(size_t table, const std::string& name, const size_t* values)
+	{
+		if (!values && rows(table) > 0) throw std::invalid_argument("column " + name + " has no values.");
+		if (sizeof(size_t) == sizeof(uint64_t))
+		{
+			addColumn(table, name, ColumnType::UNSIGNED, sizeof(uint64_t), reinterpret_cast<const char*>(values), nullptr);
+			return;
+		}
+		addColumn<uint64_t>(table, name, [values](size_t first, size_t count, uint64_t* chunk) {
+			for (size_t i = 0; i < count; i++) chunk[i] = values[first + i];
+			});
+	}
+
+	// fill puts the values from row first to first + count - 1 in values, count is at most a chunk
+	template<class T>
+	void addColumn(size_t table, const std::string& name, const std::function<void(size_t first, size_t count, T* values)>& fill)
+	{
+		if (!fill) throw std::invalid_argument("column " + name + " has no fill function.");
+		addColumn(table, name, columnTypeOf<T>(), sizeof(T), nullptr, [fill](size_t first, size_t count, char* chunk) {
+			fill(first, count, reinterpret_cast<T*>(chunk));
+			});
+	}
+
+	// value gives the string of a row, longer strings are cut to width
+	void addStringColumn(size_t table, const std::string& name, size_t width, const std::function<std::string(size_t row)>& value)
+	{
+		if (width == 0 || width > MAX_STRING_WIDTH) throw std::invalid_argument("string columns are 1 to " + std::to_string(MAX_STRING_WIDTH) + " bytes wide.");
+		if (!value) throw std::invalid_argument("column " + name + " has no values.");
+		addColumn(table, name, ColumnType::STRING, width, nullptr, [value, width](size_t first, size_t count, char* chunk) {
+			std::memset(chunk, 0, count * width);
+			for (size_t row = first; row < first + count; row++)
+			{
+				std::string text = value(row);
+				std::memcpy(chunk + (row - first) * width, text.data(), std::min(text.size(), width));
+			}
+			});
+	}
+
+	void write(std::ostream& out)
+	{
+		// the directory, with each column's place in the file
+		uint64_t offset = align(sizeof(ColumnarFileHeader) + tables_.size() * sizeof(ColumnarTableRecord) + columns_.size() * sizeof(ColumnarColumnRecord));
+		uint64_t file_size = offset;
+		for (auto& column : columns_)
+		{
+			column.record.offset = offset;
+			file_size = offset + tables_[column.record.table].rows * column.record.width;
+			offset = align(file_size);
+		}
+		std::string directory(tables_.size() * sizeof(ColumnarTableRecord) + columns_.size() * sizeof(ColumnarColumnRecord), '\0');
+		if (!tables_.empty()) std::memcpy(&directory[0], tables_.data(), tables_.size() * sizeof(ColumnarTableRecord));
+		for (size_t c = 0; c < columns_.size(); c++)
+		{
+			std::memcpy(&directory[tables_.size() * sizeof(ColumnarTableRecord) + c * sizeof(ColumnarColumnRecord)], &columns_[c].record, sizeof(ColumnarColumnRecord));
+		}
+
+		ColumnarFileHeader header = {};
+		std::memcpy(header.magic, COLUMNAR_FILE_MAGIC, sizeof(header.magic));
+		header.version = COLUMNAR_FILE_VERSION;
+		header.byte_order = COLUMNAR_FILE_BYTE_ORDER;
+		header.number_of_tables = static_cast<uint32_t>(tables_.size());
+		header.number_of_columns = static_cast<uint32_t>(columns_.size());
+		header.file_size = file_size;
+		header.checksum = fnv1a64(directory.data(), directory.size());
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(directory.data(), directory.size());
+		uint64_t written = sizeof(header) + directory.size();
+
+		// the columns, a chunk at a time when gathered, the buffer is words so any values are aligned in it
+		std::vector<uint64_t> buffer;
+		for (auto& column : columns_)
+		{
+			pad(out, written, column.record.offset);
+			uint64_t rows = tables_[column.record.table].rows;
+			size_t width = static_cast<size_t>(column.record.width);
+			if (column.values)
+			{
+				out.write(column.values, rows * width);
+			}
+			else
+			{
+				size_t chunk_rows = std::max<size_t>(CHUNK_BYTES / width, 1);
+				buffer.resize((chunk_rows * width + sizeof(uint64_t) - 1) / sizeof(uint64_t));
+				char* chunk = reinterpret_cast<char*>(buffer.data());
+				for (uint64_t first = 0; first < rows; first += chunk_rows)
+				{
+					size_t count = static_cast<size_t>(std::min<uint64_t>(chunk_rows, rows - first));
+					column.fill(static_cast<size_t>(first), count, chunk);
+					out.write(chunk, count * width);
+				}
+			}
+			written += rows * width;
+		}
+		if (!out) throw std::runtime_error("unable to write the columnar file.");
+	}
+
+	// writes the file, see write(std::ostream&)
+	void save(const std::string& file_name)
+	{
+		std::ofstream out(file_name, std::ios::binary);
+		if (!out) throw std::runtime_error("unable to open " + file_name + " for writing.");
+		write(out);
+	}
+
+private:
+	struct Column
+	{
+		ColumnarColumnRecord record;
+		const char* values;                                          // nullptr when filled
+		std::function<void(size_t, size_t, char*)> fill;
+	};
+
+	uint64_t rows(size_t table)
+	{
+		if (table >= tables_.size()) throw std::out_of_range("unknown table.");
+		return tables_[table].rows;
+	}
+
+	void addColumn(size_t table, const std::string& name, ColumnType type, size_t width, const char* values, const std::function<void(size_t, size_t, char*)>& fill)
+	{
+		rows(table);
+		Column column = {};
+		copyName(column.record.name, sizeof(column.record.name), name);
+		for (auto& other : columns_)
+		{
+			if (other.record.table == table && std::strcmp(other.record.name, column.record.name) == 0) throw std::invalid_argument("there is already a column named " + name + ".");
+		}
+		column.record.table = static_cast<uint32_t>(table);
+		column.record.type = static_cast<uint32_t>(type);
+		column.record.width = width;
+		column.values = values;
+		column.fill = fill;
+		columns_.push_back(column);
+	}
+
+	static void copyName(char* destination, size_t size, const std::string& name)
+	{
+		if (name.empty() || name.size() >= size) throw std::invalid_argument("names are 1 to " + std::to_string(size - 1) + " characters, not " + name + ".");
+		std::memcpy(destination, name.c_str(), name.size() + 1);
+	}
+
+	static uint64_t align(uint64_t offset)
+	{
+		return (offset + COLUMNAR_ALIGNMENT - 1) / COLUMNAR_ALIGNMENT * COLUMNAR_ALIGNMENT;
+	}
+
+	static void pad(std::ostream& out, uint64_t& written, uint64_t offset)
+	{
+		static const char zeros[COLUMNAR_ALIGNMENT] = {};
+		out.write(zeros, offset - written);
+		written = offset;
+	}
+
+	std::vector<ColumnarTableRecord> tables_;
+	std::vector<Column> columns_;
+};
+
+
+// The tables and columns of a columnar file in memory, read or mapped, its columns are used where they lie.
+// The header and directory are checked, values are not, so a mapped file of any size opens at once.
+// The memory must be 8 byte aligned, as mapped files and new are, and outlive the view.
+// Usage:
+//     MappedFile file("results.columns");
+//     ColumnarFileView view(file.data(), file.size());
+//     const uint64_t* faults = view.column<uint64_t>("evtols", "faults");
+//     for (uint64_t i = 0; i < view.rows("evtols"); i++) total += faults[i];
+class ColumnarFileView
+{
+public:
+	ColumnarFileView(const char* data, size_t size)
+	{
+		if (reinterpret_cast<uintptr_t>(data) % sizeof(uint64_t) != 0) throw std::invalid_argument("a columnar file must be 8 byte aligned in memory.");
+		if (size < sizeof(ColumnarFileHeader)) throw std::invalid_argument("columnar file is truncated.");
+		ColumnarFileHeader header;
+		std::memcpy(&header, data, sizeof(header));
+		if (std::memcmp(header.magic, COLUMNAR_FILE_MAGIC, sizeof(header.magic)) != 0) throw std::invalid_argument("not a columnar file.");
+		if (header.version != COLUMNAR_FILE_VERSION) throw std::invalid_argument("unsupported columnar file version.");
+		if (header.byte_order != COLUMNAR_FILE_BYTE_ORDER) throw std::invalid_argument("columnar file was written with a different byte order.");
+		if (header.file_size != size) throw std::invalid_argument("columnar file is the wrong size.");
+		size_t directory_size = header.number_of_tables * sizeof(ColumnarTableRecord) + header.number_of_columns * sizeof(ColumnarColumnRecord);
+		if (size - sizeof(header) < directory_size) throw std::invalid_argument("columnar file is truncated.");
+		const char* directory = data + sizeof(header);
+		if (fnv1a64(directory, directory_size) != header.checksum) throw std::invalid_argument("columnar file checksum does not match.");
+
+		tables_.resize(header.number_of_tables);
+		columns_.resize(header.number_of_columns);
+		if (!tables_.empty()) std::memcpy(tables_.data(), directory, tables_.size() * sizeof(ColumnarTableRecord));
+		if (!columns_.empty()) std::memcpy(columns_.data(), directory + tables_.size() * sizeof(ColumnarTableRecord), columns_.size() * sizeof(ColumnarColumnRecord));
+		for (auto& column : columns_)
+		{
+			if (column.table >= tables_.size() || column.width == 0 || column.offset % COLUMNAR_ALIGNMENT != 0 ||
+				column.offset > size || (size - column.offset) / column.width < tables_[column.table].rows)
+			{
+				throw std::invalid_argument("columnar file has a column outside the file.");
+			}
+		}
+		data_ = data;
+	}
+
+	size_t numberOfTables() const { return tables_.size(); }
+
+	std::string tableName(size_t table) const { return tables_.at(table).name; }
+
+	uint64_t rows(const std::string& table) const { return tables_[tableIndex(table)].rows; }
+
+	bool hasColumn(const std::string& table, const std::string& column) const
+	{
+		return findColumn(tableIndex(table), column) != nullptr;
+	}
+
+	// the names of the table's columns, in the order they were written
+	std::vector<std::string> columnNames(const std::string& table) const
+	{
+		size_t index = tableIndex(table);
+		std::vector<std::string> names;
+		for (auto& column : columns_)
+		{
+			if (column.table == index) names.push_back(column.name);
+		}
+		return names;
+	}
+
+	// the values of a column, which must be of type T
+	template<class T>
+	const T* column(const std::string& table, const std::string& column) const
+	{
+		const ColumnarColumnRecord& record = checkedColumn(table, column);
+		if (record.type != static_cast<uint32_t>(columnTypeOf<T>()) || record.width != sizeof(T)) throw std::invalid_argument("column " + column + " holds another type.");
+		return reinterpret_cast<const T*>(data_ + record.offset);
+	}
+
+	// a value of a string column
+	std::string stringValue(const std::string& table, const std::string& column, uint64_t row) const
+	{
+		const ColumnarColumnRecord& record = checkedColumn(table, column);
+		if (record.type != static_cast<uint32_t>(ColumnType::STRING)) throw std::invalid_argument("column " + column + " does not hold strings.");
+		if (row >= tables_[record.table].rows) throw std::out_of_range("row is past the end of table " + table + ".");
+		const char* value = data_ + record.offset + row * record.width;
+		const void* end = std::memchr(value, '\0', static_cast<size_t>(record.width));
+		return std::string(value, end ? static_cast<const char*>(end) - value : static_cast<size_t>(record.width));
+	}
+
+private:
+	size_t tableIndex(const std::string& table) const
+	{
+		for (size_t t = 0; t < tables_.size(); t++)
+		{
+			if (table == tables_[t].name) return t;
+		}
+		throw std::out_of_range("no table named " + table + ".");
+	}
+
+	const ColumnarColumnRecord* findColumn(size_t table, const std::string& column) const
+	{
+		for (auto& record : columns_)
+		{
+			if (record.table == table && column == record.name) return &record;
+		}
+		return nullptr;
+	}
+
+	const ColumnarColumnRecord& checkedColumn(const std::string& table, const std::string& column) const
+	{
+		const ColumnarColumnRecord* record = findColumn(tableIndex(table), column);
+		if (!record) throw std::out_of_range("no column named " + column + " in table " + table + ".");
+		return *record;
+	}
+
+	const char* data_;   // not owned
+	std::vector<ColumnarTableRecord> tables_;
+	std::vector<ColumnarColumnRecord> columns_;
+};
+
+
+
+void test_ColumnarFile()
+{
+	using namespace std;
+
+	// a plain array, a gathered column spanning several chunks and strings, in two tables
+	std::vector<uint64_t> ids(100000);
+	for (size_t i = 0; i < ids.size(); i++) ids[i] = i * 3;
+	ColumnarFileWriter writer;
+	size_t rows = writer.addTable("rows", ids.size());
+	size_t names = writer.addTable("names", 3);
+	writer.addColumn(rows, "id", ids.data());
+	writer.addColumn<double>(rows, "half", [](size_t first, size_t count, double* values) {
+		for (size_t i = 0; i < count; i++) values[i] = (first + i) / 2.0;
+		});
+	writer.addColumn<uint8_t>(rows, "odd", [](size_t first, size_t count, uint8_t* values) {
+		for (size_t i = 0; i < count; i++) values[i] = (first + i) % 2;
+		});
+	const char* words[] = { "alpha", "beta", "a string cut short" };
+	writer.addStringColumn(names, "word", 8, [&words](size_t row) { return std::string(words[row]); });
+	writer.save("test_columns.bin");
+
+	{
+		MappedFile file("test_columns.bin");
+		ColumnarFileView view(file.data(), file.size());
+		const uint64_t* id = view.column<uint64_t>("rows", "id");
+		const double* half = view.column<double>("rows", "half");
+		const uint8_t* odd = view.column<uint8_t>("rows", "odd");
+		cout << view.numberOfTables() << "  " << view.rows("rows") << "  " << view.columnNames("rows").size() << "  ";
+		cout << id[99999] << " " << half[70001] << " " << int(odd[70001]) << "  " << (reinterpret_cast<uintptr_t>(half) % COLUMNAR_ALIGNMENT) << "  ";
+		cout << view.stringValue("names", "word", 1) << " " << view.stringValue("names", "word", 2) << "  " << view.hasColumn("names", "id") << endl;
+		try { view.column<double>("rows", "id"); }
+		catch (const std::invalid_argument& ia) { cout << ia.what() << endl; }
+		try { view.column<double>("rows", "third"); }
+		catch (const std::out_of_range& oor) { cout << oor.what() << endl; }
+	}
+	std::remove("test_columns.bin");
+
+	// the directory is checked, an image with a byte of it changed is refused
+	std::stringstream image;
+	writer.write(image);
+	std::vector<uint64_t> words_image((image.str().size() + 7) / 8);
+	std::memcpy(words_image.data(), image.str().data(), image.str().size());
+	reinterpret_cast<char*>(words_image.data())[sizeof(ColumnarFileHeader) + 1] ^= 1;
+	try { ColumnarFileView corrupt(reinterpret_cast<const char*>(words_image.data()), image.str().size()); }
+	catch (const std::invalid_argument& ia) { cout << ia.what() << endl; }
+	try { writer.addTable("rows", 1); }
+	catch (const std::invalid_argument& ia) { cout << ia.what() << endl; }
+}
+
+
+#endif  // SIM_COLUMNAR
@@ -0,0 +1,145 @@
+#ifndef SIM_EVENT_SCHEDULER
+#define SIM_EVENT_SCHEDULER
+
+
+#include <iostream>
+#include <functional>
+#include <queue>
+#include <vector>
+#include <stdexcept>
+
+
+// Provides discrete events for a simulation.
+// An alternative to SimulationEventTimer for simulations whose state changes are rare and predictable.
+// Rather than every agent receiving an update at every timestep, each agent schedules the
+// simulation time of its own next state change and is called back at exactly that time.
+// Events are processed in order of simulation time, events scheduled for the same time are
+// processed in the order they were scheduled.
+// Runs for a predetermined amount of simulation time, events at or after the end time are never fired.
+// Runs as fast as possible, the cost of a run is proportional to the number of events processed.
+// An event is a function with signature:
+//     void(unsigned long long event_time)
+// where event_time is the time since start of simulation as measured in milliseconds
+// Usage:
+//     SimulationEventScheduler scheduler(180);
+//     scheduler.schedule(1000, [](unsigned long long event_time) {});
+//     scheduler.start();
+class SimulationEventScheduler
+{
+public:
+	SimulationEventScheduler(size_t total_simulation_time_minutes)
+	{
+		if (total_simulation_time_minutes == 0) throw std::invalid_argument("total_simulation_time_minutes must be greater than 0.");
+
+		end_time_ = total_simulation_time_minutes * 60ULL * 1000ULL;
+		current_time_ = 0;
+		next_sequence_number_ = 0;
+		events_processed_ = 0;
+	}
+
+	// schedules an event to be fired at the given simulation time in milliseconds
+	void schedule(unsigned long long event_time, std::function<void(unsigned long long)> event_handler)
+	{
+		if (!event_handler) throw std::invalid_argument("event_handler function is required.");
+		if (event_time < current_time_) throw std::invalid_argument("event_time cannot be in the past.");
+
+		// events past the end of the simulation can never fire, so don't bother queueing them
+		if (event_time >= end_time_) return;
+
+		ScheduledEvent event;
+		event.time = event_time;
+		event.sequence_number = next_sequence_number_++;
+		event.handler = event_handler;
+		events_.push(event);
+	}
+
+	// starts the scheduler, fires events in time order until there are no more events
+	// or the end of the simulation is reached
+	void start()
+	{
+		while (!events_.empty())
+		{
+			ScheduledEvent event = events_.top();
+			events_.pop();
+			current_time_ = event.time;
+			events_processed_++;
+			event.handler(current_time_);
+		}
+		current_time_ = end_time_;
+	}
+
+	// current simulation time in milliseconds, the time of the event currently being processed
+	unsigned long long now() { return current_time_; }
+
+	// simulation time in milliseconds at which the simulation ends
+	unsigned long long endTime() { return end_time_; }
+
+	size_t eventsProcessed() { return events_processed_; }
+
+	size_t eventsPending() { return events_.size(); }
+
+private:
+	struct ScheduledEvent
+	{
+		unsigned long long time;               // simulation time in milliseconds
+		unsigned long long sequence_number;    // breaks ties between events scheduled for the same time
+		std::function<void(unsigned long long)> handler;
+	};
+
+	// orders the priority queue so that the earliest event is on top
+	struct LaterEvent
+	{
+		bool operator()(const ScheduledEvent& a, const ScheduledEvent& b) const
+		{
+			if (a.time != b.time) return a.time > b.time;
+			return a.sequence_number > b.sequence_number;
+		}
+	};
+
+	std::priority_queue<ScheduledEvent, std::vector<ScheduledEvent>, LaterEvent> events_;
+	unsigned long long current_time_;           // in milliseconds
+	unsigned long long end_time_;               // in milliseconds
+	unsigned long long next_sequence_number_;
+	size_t events_processed_;
+};
+
+
+
+
+void test_SimulationEventScheduler()
+{
+	using namespace std;
+
+	try
+	{
+		SimulationEventScheduler s(0);
+	}
+	catch (const std::invalid_argument& ia)
+	{
+		cout << ia.what() << endl;
+	}
+
+	SimulationEventScheduler scheduler(1);
+	auto event_handler = [&scheduler](unsigned long long event_time) {
+		cout << event_time << "  " << scheduler.now() << endl;
+	};
+
+	// fired out of order of scheduling, in order of time
+	scheduler.schedule(3000, event_handler);
+	scheduler.schedule(1000, event_handler);
+	scheduler.schedule(2000, event_handler);
+
+	// an event that schedules a follow up event
+	scheduler.schedule(1500, [&scheduler, event_handler](unsigned long long event_time) {
+		scheduler.schedule(event_time + 250, event_handler);
+		});
+
+	// never fires, past the end of the simulation
+	scheduler.schedule(60000, event_handler);
+
+	scheduler.start();
+	cout << scheduler.eventsProcessed() << "  " << scheduler.now() << endl;
+}
+
+
+#endif  // SIM_EVENT_SCHEDULER
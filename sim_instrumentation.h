@@ -0,0 +1,298 @@
+#ifndef SIM_INSTRUMENTATION
+#define SIM_INSTRUMENTATION
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdint>
+#include <stdexcept>
+
+// Instrumentation is compiled in unless EVTOL_NO_INSTRUMENTATION is defined,
+// when it is every counter and timer compiles away to nothing.
+#if !defined(EVTOL_NO_INSTRUMENTATION)
+#define EVTOL_INSTRUMENTATION
+#endif
+
+#if defined(EVTOL_INSTRUMENTATION) && defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define EVTOL_INSTRUMENTATION_TSC
+#elif defined(EVTOL_INSTRUMENTATION) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#define EVTOL_INSTRUMENTATION_TSC
+#endif
+
+// EVTOL_INSTRUMENT(statement) runs the statement only when instrumentation is compiled in
+#if defined(EVTOL_INSTRUMENTATION)
+#define EVTOL_INSTRUMENT(statement) statement
+#else
+#define EVTOL_INSTRUMENT(statement)
+#endif
+
+
+// A cheap, monotonic count of ticks, the time stamp counter on x86, nanoseconds of the steady clock elsewhere
+inline uint64_t instrumentationTicks()
+{
+#if defined(EVTOL_INSTRUMENTATION_TSC)
+	return __rdtsc();
+#else
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
+
+
+// The parts of a timestep that are timed separately
+enum class SimulationPhase
+{
+	FLEET_UPDATE,
+	STATION_UPDATE,
+	SNAPSHOTS,      // snapshot and checkpoint handlers
+	OUTPUT          // progress printed to the console
+};
+
+const size_t NUMBER_OF_SIMULATION_PHASES = 4;
+
+inline std::string simulationPhaseName(SimulationPhase phase)
+{
+	switch (phase)
+	{
+	case SimulationPhase::FLEET_UPDATE: return "Fleet Update";
+	case SimulationPhase::STATION_UPDATE: return "Station Update";
+	case SimulationPhase::SNAPSHOTS: return "Snapshots";
+	case SimulationPhase::OUTPUT: return "Output";
+	}
+	return "unknown";
+}
+
+
+// Counts of what happened at one or more charging stations.
+// Every eVTOL state transition passes through a station: running out of charge, FLYING to WAITING, is an arrival,
+// getting a bay, WAITING to CHARGING, is a bay assigned, and leaving with a full charge, CHARGING to FLYING, is a bay released.
+struct ChargingStationCounters
+{
+	unsigned long long arrivals;
+	unsigned long long bays_assigned;
+	unsigned long long bays_released;
+	size_t max_queue_length;     // most devices waiting at once at any one station
+	size_t max_bays_occupied;    // most bays occupied at once at any one station
+};
+
+// adds the counts of other into counters, high water marks are the highest of the two
+inline void accumulateCounters(ChargingStationCounters& counters, const ChargingStationCounters& other)
+{
+	counters.arrivals += other.arrivals;
+	counters.bays_assigned += other.bays_assigned;
+	counters.bays_released += other.bays_released;
+	if (other.max_queue_length > counters.max_queue_length) counters.max_queue_length = other.max_queue_length;
+	if (other.max_bays_occupied > counters.max_bays_occupied) counters.max_bays_occupied = other.max_bays_occupied;
+}
+
+
+// What the instrumentation measured over a whole run
+struct SimulationInstrumentationReport
+{
+	bool enabled;                          // false when instrumentation is compiled out, everything else is zero
+	double run_nanoseconds;                // the whole run, including what is not in any phase
+	double phase_nanoseconds[NUMBER_OF_SIMULATION_PHASES];
+	unsigned long long timesteps;
+	std::vector<unsigned long long> timestep_latency_histogram;  // entry b counts timesteps that took [2^b, 2^(b+1)) ns
+	ChargingStationCounters stations;
+	size_t number_of_bays;                 // per station, for the bay utilization
+};
+
+inline void printInstrumentationReport(std::ostream& out, const SimulationInstrumentationReport& report)
+{
+	using namespace std;
+	out << endl << "Instrumentation" << endl;
+	if (!report.enabled)
+	{
+		out << "  compiled out, EVTOL_NO_INSTRUMENTATION is defined" << endl;
+		return;
+	}
+
+	out << fixed << setprecision(2);
+	out << "  Run Time:                    " << report.run_nanoseconds / 1.0e6 << " ms" << endl;
+	for (size_t phase = 0; phase < NUMBER_OF_SIMULATION_PHASES; phase++)
+	{
+		std::string name = simulationPhaseName(static_cast<SimulationPhase>(phase));
+		double share = report.run_nanoseconds > 0.0 ? 100.0 * report.phase_nanoseconds[phase] / report.run_nanoseconds : 0.0;
+		out << "  " << left << setw(29) << (name + ":") << right << report.phase_nanoseconds[phase] / 1.0e6 << " ms  " << share << "%" << endl;
+	}
+	out << "  Timesteps by Latency:        " << report.timesteps << endl;
+	for (size_t b = 0; b < report.timestep_latency_histogram.size(); b++)
+	{
+		if (report.timestep_latency_histogram[b] == 0) continue;
+		out << "    " << left << setw(25) << (">= " + std::to_string(1ULL << b) + " ns:") << right << report.timestep_latency_histogram[b] << endl;
+	}
+	out << "  Arrivals, to WAITING:        " << report.stations.arrivals << endl;
+	out << "  Bays Assigned, to CHARGING:  " << report.stations.bays_assigned << endl;
+	out << "  Bays Released, to FLYING:    " << report.stations.bays_released << endl;
+	out << "  Max Queue Length:            " << report.stations.max_queue_length << endl;
+	double utilization = report.number_of_bays ? 100.0 * report.stations.max_bays_occupied / report.number_of_bays : 0.0;
+	out << "  Max Bays Occupied:           " << report.stations.max_bays_occupied << "  " << utilization << "%" << endl;
+}
+
+
+// Times the phases of each timestep of a simulation, and the timesteps themselves, on the simulation thread.
+// A phase is timed from the end of the previous phase, or the start of the timestep, with two reads of the time stamp counter,
+// ticks are converted to nanoseconds once, at the end of the run, against the steady clock.
+// Compiled out, every method is empty.
+// Usage:
+//     SimulationInstrumentation instrumentation;
+//     instrumentation.start();
+//     instrumentation.beginTimestep();
+//     fleet.timestepUpdate(prev_time, cur_time);
+//     instrumentation.endPhase(SimulationPhase::FLEET_UPDATE);
+//     instrumentation.endTimestep();
+//     instrumentation.stop();
+//     SimulationInstrumentationReport report = instrumentation.report();
+class SimulationInstrumentation
+{
+public:
+	static const size_t NUMBER_OF_LATENCY_BUCKETS = 40;
+
+	SimulationInstrumentation()
+	{
+		start_ticks_ = 0;
+		run_ticks_ = 0;
+		timestep_start_ = 0;
+		phase_start_ = 0;
+		timesteps_ = 0;
+		ticks_per_nanosecond_ = 1.0;
+		for (size_t phase = 0; phase < NUMBER_OF_SIMULATION_PHASES; phase++) phase_ticks_[phase] = 0;
+		for (size_t b = 0; b < NUMBER_OF_LATENCY_BUCKETS; b++) latency_ticks_[b] = 0;
+	}
+
+	void start()
+	{
+#if defined(EVTOL_INSTRUMENTATION)
+		start_time_ = std::chrono::steady_clock::now();
+		start_ticks_ = instrumentationTicks();
+#endif
+	}
+
+	void stop()
+	{
+#if defined(EVTOL_INSTRUMENTATION)
+		run_ticks_ = instrumentationTicks() - start_ticks_;
+		double nanoseconds = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start_time_).count();
+		ticks_per_nanosecond_ = (nanoseconds > 0.0 && run_ticks_ > 0) ? run_ticks_ / nanoseconds : 1.0;
+#endif
+	}
+
+	void beginTimestep()
+	{
+#if defined(EVTOL_INSTRUMENTATION)
+		timestep_start_ = instrumentationTicks();
+		phase_start_ = timestep_start_;
+#endif
+	}
+
+	void endPhase(SimulationPhase phase)
+	{
+#if defined(EVTOL_INSTRUMENTATION)
+		uint64_t now = instrumentationTicks();
+		phase_ticks_[static_cast<size_t>(phase)] += now - phase_start_;
+		phase_start_ = now;
+#else
+		(void)phase;
+#endif
+	}
+
+	// the histogram is kept in ticks, a bucket per power of two, and rebucketed in nanoseconds for the report
+	void endTimestep()
+	{
+#if defined(EVTOL_INSTRUMENTATION)
+		uint64_t ticks = phase_start_ - timestep_start_;
+		size_t bucket = 0;
+		while (ticks > 1 && bucket + 1 < NUMBER_OF_LATENCY_BUCKETS)
+		{
+			ticks >>= 1;
+			bucket++;
+		}
+		latency_ticks_[bucket]++;
+		timesteps_++;
+#endif
+	}
+
+	// stations are the counters of the stations of the simulation, bays the number of bays per station
+	SimulationInstrumentationReport report(const ChargingStationCounters& stations = ChargingStationCounters(), size_t bays = 0) const
+	{
+		SimulationInstrumentationReport report = {};
+#if defined(EVTOL_INSTRUMENTATION)
+		report.enabled = true;
+		report.run_nanoseconds = run_ticks_ / ticks_per_nanosecond_;
+		for (size_t phase = 0; phase < NUMBER_OF_SIMULATION_PHASES; phase++)
+		{
+			report.phase_nanoseconds[phase] = phase_ticks_[phase] / ticks_per_nanosecond_;
+		}
+		report.timesteps = timesteps_;
+		report.timestep_latency_histogram.assign(NUMBER_OF_LATENCY_BUCKETS, 0);
+		for (size_t b = 0; b < NUMBER_OF_LATENCY_BUCKETS; b++)
+		{
+			if (latency_ticks_[b] == 0) continue;
+			double nanoseconds = static_cast<double>(1ULL << b) / ticks_per_nanosecond_;
+			size_t bucket = 0;
+			while (nanoseconds >= 2.0 && bucket + 1 < NUMBER_OF_LATENCY_BUCKETS)
+			{
+				nanoseconds /= 2.0;
+				bucket++;
+			}
+			report.timestep_latency_histogram[bucket] += latency_ticks_[b];
+		}
+		report.stations = stations;
+		report.number_of_bays = bays;
+#else
+		(void)stations;
+		(void)bays;
+#endif
+		return report;
+	}
+
+private:
+	std::chrono::steady_clock::time_point start_time_;
+	uint64_t start_ticks_;
+	uint64_t run_ticks_;
+	uint64_t timestep_start_;
+	uint64_t phase_start_;
+	unsigned long long timesteps_;
+	double ticks_per_nanosecond_;
+	uint64_t phase_ticks_[NUMBER_OF_SIMULATION_PHASES];
+	unsigned long long latency_ticks_[NUMBER_OF_LATENCY_BUCKETS];
+};
+
+
+
+void test_SimulationInstrumentation()
+{
+	using namespace std;
+
+	SimulationInstrumentation instrumentation;
+	instrumentation.start();
+	volatile double sink = 0.0;
+	for (int t = 0; t < 100; t++)
+	{
+		instrumentation.beginTimestep();
+		for (int i = 0; i < 1000; i++) sink = sink + i;
+		instrumentation.endPhase(SimulationPhase::FLEET_UPDATE);
+		instrumentation.endPhase(SimulationPhase::STATION_UPDATE);
+		instrumentation.endTimestep();
+	}
+	instrumentation.stop();
+
+	ChargingStationCounters stations = { 10, 8, 7, 2, 3 };
+	ChargingStationCounters more = { 1, 1, 1, 4, 1 };
+	accumulateCounters(stations, more);
+	SimulationInstrumentationReport report = instrumentation.report(stations, 3);
+
+	// timings vary run to run, check what is consistent about them
+	unsigned long long histogram_total = 0;
+	for (auto count : report.timestep_latency_histogram) histogram_total += count;
+	cout << report.enabled << "  " << report.timesteps << "  " << histogram_total << "  ";
+	cout << (report.phase_nanoseconds[0] > report.phase_nanoseconds[1]) << "  " << (report.run_nanoseconds >= report.phase_nanoseconds[0]) << "  ";
+	cout << report.stations.arrivals << "  " << report.stations.max_queue_length << "  " << report.stations.max_bays_occupied << endl;
+}
+
+
+#endif  // SIM_INSTRUMENTATION
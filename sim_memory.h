@@ -0,0 +1,344 @@
+#ifndef SIM_MEMORY
+#define SIM_MEMORY
+
+#include <iostream>
+#include <vector>
+#include <new>
+#include <utility>
+#include <stdexcept>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <thread>
+
+
+// Fixed capacity storage for many objects of one type, allocated in one go and freed in one go.
+// Objects are constructed in place, one after another, and are all destroyed together,
+// in reverse order of construction, when the arena is cleared or destroyed.
+// An arena never grows, so objects never move and pointers to them stay valid for the life of the arena.
+// Usage:
+//     ObjectArena<eVTOL> arena(number_of_evtols);
+//     eVTOL* evtol = arena.create(alpha_config, &charging_station);
+template <typename T>
+class ObjectArena
+{
+public:
+	explicit ObjectArena(size_t capacity = 0)
+	{
+		storage_ = nullptr;
+		capacity_ = 0;
+		size_ = 0;
+		reserve(capacity);
+	}
+
+	~ObjectArena()
+	{
+		clear();
+		::operator delete(storage_);
+	}
+
+	ObjectArena(const ObjectArena&) = delete;
+	ObjectArena& operator=(const ObjectArena&) = delete;
+
+	// allocates room for capacity objects, the arena must be empty
+	void reserve(size_t capacity)
+	{
+		if (size_ > 0) throw std::logic_error("an arena can only be reserved while empty.");
+		if (capacity == capacity_) return;
+		::operator delete(storage_);
+		storage_ = capacity ? static_cast<T*>(::operator new(capacity * sizeof(T))) : nullptr;
+		capacity_ = capacity;
+	}
+
+	// constructs an object in the next free slot of the arena
+	template <typename... Args>
+	T* create(Args&&... args)
+	{
+		if (size_ == capacity_) throw std::length_error("arena is full.");
+		T* object = new (storage_ + size_) T(std::forward<Args>(args)...);
+		size_++;
+		return object;
+	}
+
+	// destroys every object, keeps the storage for reuse
+	void clear()
+	{
+		while (size_ > 0)
+		{
+			storage_[--size_].~T();
+		}
+	}
+
+	T& operator[](size_t index) { return storage_[index]; }
+
+	size_t size() { return size_; }
+
+	size_t capacity() { return capacity_; }
+
+private:
+	T* storage_;
+	size_t capacity_;
+	size_t size_;
+};
+
+
+// A first in, first out queue held in a circular buffer.
+// Reserved with enough capacity up front, e.g. the size of the fleet, pushing and popping never allocate.
+// If it does fill up, the capacity doubles, so an under sized buffer is slower but still correct.
+// Usage:
+//     RingBuffer<ChargeableDevice*> waiting(number_of_evtols);
+//     waiting.pushBack(device);
+//     ChargeableDevice* next = waiting.front();
+//     waiting.popFront();
+template <typename T>
+class RingBuffer
+{
+public:
+	explicit RingBuffer(size_t capacity = 0)
+	{
+		head_ = 0;
+		size_ = 0;
+		buffer_.resize(capacity);
+	}
+
+	// makes room for at least capacity entries
+	void reserve(size_t capacity)
+	{
+		if (capacity <= buffer_.size()) return;
+		std::vector<T> buffer(capacity);
+		for (size_t i = 0; i < size_; i++)
+		{
+			buffer[i] = (*this)[i];
+		}
+		buffer_.swap(buffer);
+		head_ = 0;
+	}
+
+	void pushBack(const T& value)
+	{
+		if (size_ == buffer_.size()) reserve(buffer_.empty() ? 16 : buffer_.size() * 2);
+		buffer_[(head_ + size_) % buffer_.size()] = value;
+		size_++;
+	}
+
+	T& front()
+	{
+		if (size_ == 0) throw std::out_of_range("ring buffer is empty.");
+		return buffer_[head_];
+	}
+
+	void popFront()
+	{
+		if (size_ == 0) throw std::out_of_range("ring buffer is empty.");
+		head_ = (head_ + 1) % buffer_.size();
+		size_--;
+	}
+
+	// index 0 is the front, the oldest entry
+	T& operator[](size_t index) { return buffer_[(head_ + index) % buffer_.size()]; }
+
+	void clear()
+	{
+		head_ = 0;
+		size_ = 0;
+	}
+
+	size_t size() { return size_; }
+
+	bool empty() { return size_ == 0; }
+
+	size_t capacity() { return buffer_.size(); }
+
+private:
+	std::vector<T> buffer_;
+	size_t head_;   // position of the front
+	size_t size_;
+};
+
+
+// A fixed capacity first in, first out queue that any number of threads can push to at once, without locks,
+// and a single thread pops from.  Each slot has a sequence number that says whether it is free to write or ready
+// to read, producers claim a slot by advancing the tail with a compare and swap, so a push never waits on another.
+// Entries are popped in the order their slots were claimed.  An entry whose producer has claimed its slot
+// but not yet written it is not ready, so the queue reads as empty up to it; drain once the producers are done.
+// The capacity is rounded up to a power of two and never grows, a push to a full queue fails.
+// Usage:
+//     BoundedMPSCQueue<ChargeableDevice*> arrivals(number_of_evtols);
+//     arrivals.tryPush(device);     // from any thread
+//     ChargeableDevice* next;
+//     while (arrivals.tryPop(next)) station.addDevice(next);
+template <typename T>
+class BoundedMPSCQueue
+{
+public:
+	explicit BoundedMPSCQueue(size_t capacity)
+	{
+		if (capacity == 0) throw std::invalid_argument("the queue capacity must be greater than 0.");
+		size_t slots = 1;
+		while (slots < capacity) slots *= 2;
+		mask_ = slots - 1;
+		slots_ = std::unique_ptr<Slot[]>(new Slot[slots]);
+		for (size_t i = 0; i < slots; i++)
+		{
+			slots_[i].sequence.store(i, std::memory_order_relaxed);
+		}
+		tail_.store(0, std::memory_order_relaxed);
+		head_ = 0;
+	}
+
+	// any thread, false if the queue is full
+	bool tryPush(const T& value)
+	{
+		size_t position = tail_.load(std::memory_order_relaxed);
+		Slot* slot;
+		for (;;)
+		{
+			slot = &slots_[position & mask_];
+			size_t sequence = slot->sequence.load(std::memory_order_acquire);
+			intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+			if (difference == 0)
+			{
+				// a failed compare and swap reloads position with the tail another producer moved on
+				if (tail_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+			}
+			else if (difference < 0)
+			{
+				return false;  // the slot still holds an entry from a lap ago
+			}
+			else
+			{
+				position = tail_.load(std::memory_order_relaxed);
+			}
+		}
+		slot->value = value;
+		slot->sequence.store(position + 1, std::memory_order_release);
+		return true;
+	}
+
+	// the consumer thread only, false if there is no entry ready
+	bool tryPop(T& value)
+	{
+		Slot& slot = slots_[head_ & mask_];
+		if (slot.sequence.load(std::memory_order_acquire) != head_ + 1) return false;
+		value = slot.value;
+		// free for the producer one lap on
+		slot.sequence.store(head_ + mask_ + 1, std::memory_order_release);
+		head_++;
+		return true;
+	}
+
+	size_t capacity() const { return mask_ + 1; }
+
+private:
+	struct Slot
+	{
+		std::atomic<size_t> sequence;   // position + 1 once written, position + capacity once read
+		T value;
+	};
+
+	std::unique_ptr<Slot[]> slots_;
+	size_t mask_;
+	// the tail, written by every producer, and the head, by the consumer alone, on cache lines of their own
+	char padding_before_[64];
+	std::atomic<size_t> tail_;
+	char padding_between_[64];
+	size_t head_;
+	char padding_after_[64];
+};
+
+
+
+void test_ObjectArena()
+{
+	using namespace std;
+
+	static int alive = 0;
+	struct Counted
+	{
+		Counted(int value) : value(value) { alive++; }
+		~Counted() { alive--; }
+		int value;
+	};
+
+	{
+		ObjectArena<Counted> arena(3);
+		Counted* first = arena.create(1);
+		arena.create(2);
+		arena.create(3);
+		try { arena.create(4); }
+		catch (const std::length_error& le) { cout << le.what() << "  "; }
+		try { arena.reserve(10); }
+		catch (const std::logic_error& le) { cout << le.what() << "  "; }
+		cout << alive << "  " << first->value << "  " << arena[2].value << "  " << arena.size() << arena.capacity() << endl;
+
+		// clearing keeps the storage for the next set of objects
+		arena.clear();
+		cout << alive << "  " << (arena.create(5) == first) << "  ";
+	}
+	cout << alive << endl;
+}
+
+
+void test_RingBuffer()
+{
+	using namespace std;
+
+	RingBuffer<int> ring(3);
+	ring.pushBack(1);
+	ring.pushBack(2);
+	ring.pushBack(3);
+	ring.popFront();
+	ring.pushBack(4);  // wraps around
+	cout << ring.size() << ring.capacity() << "  " << ring.front() << ring[1] << ring[2] << "  ";
+
+	// full, so grows, keeping the order
+	ring.pushBack(5);
+	cout << ring.size() << ring.capacity() << "  ";
+	while (!ring.empty())
+	{
+		cout << ring.front();
+		ring.popFront();
+	}
+	cout << endl;
+
+	try { ring.popFront(); }
+	catch (const std::out_of_range& oor) { cout << oor.what() << endl; }
+}
+
+
+void test_BoundedMPSCQueue()
+{
+	using namespace std;
+
+	BoundedMPSCQueue<int> queue(3);
+	cout << queue.capacity() << "  ";
+	for (int i = 1; i <= 5; i++) cout << queue.tryPush(i);
+	int value;
+	while (queue.tryPop(value)) cout << value;
+	cout << queue.tryPop(value) << "  ";
+
+	// four producers, each of whose entries come out in the order it pushed them
+	const int per_producer = 10000;
+	BoundedMPSCQueue<int> shared(4 * per_producer);
+	std::vector<std::thread> producers;
+	for (int producer = 0; producer < 4; producer++)
+	{
+		producers.push_back(std::thread([&shared, producer]() {
+			for (int i = 0; i < per_producer; i++) shared.tryPush(producer * per_producer + i);
+			}));
+	}
+	for (auto& producer : producers) producer.join();
+	std::vector<int> last(4, -1);
+	bool in_order = true;
+	int popped = 0;
+	while (shared.tryPop(value))
+	{
+		popped++;
+		in_order = in_order && value > last[value / per_producer];
+		last[value / per_producer] = value;
+	}
+	cout << popped << "  " << in_order << endl;
+}
+
+
+#endif  // SIM_MEMORY
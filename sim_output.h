@@ -0,0 +1,361 @@
+#ifndef SIM_OUTPUT
+#define SIM_OUTPUT
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <limits>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <type_traits>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <stdexcept>
+
+
+// writes a report built up in a buffer to out with a single write and a single flush
+inline void writeReport(std::ostream& out, const std::string& report)
+{
+	out.write(report.data(), static_cast<std::streamsize>(report.size()));
+	out.flush();
+}
+
+
+// Prints a dot for every milliseconds_per_dot of simulation time, on a thread of its own.
+// The simulation thread only stores the time it has reached in an atomic counter with tick(),
+// the reporting thread wakes every poll interval, prints whatever dots are due and flushes,
+// so a slow or synced console never holds up a timestep.
+// stop() prints any dots still due, so the number of dots depends only on the simulation time reached.
+// Usage:
+//     SimulationProgress progress(std::cout, 10 * 1000);
+//     progress.start(0);
+//     progress.tick(cur_time);
+//     progress.stop();
+class SimulationProgress
+{
+public:
+	SimulationProgress(std::ostream& out, unsigned long long milliseconds_per_dot,
+		std::chrono::milliseconds poll_interval = std::chrono::milliseconds(50)) : out_(out)
+	{
+		if (milliseconds_per_dot == 0) throw std::invalid_argument("milliseconds_per_dot must be greater than 0.");
+		milliseconds_per_dot_ = milliseconds_per_dot;
+		poll_interval_ = poll_interval;
+		start_time_ = 0;
+		time_.store(0);
+		dots_printed_ = 0;
+		stopping_ = false;
+	}
+
+	~SimulationProgress()
+	{
+		stop();
+	}
+
+	// time is the simulation time the run starts from, e.g. that of a checkpoint
+	void start(unsigned long long time)
+	{
+		if (reporter_.joinable()) throw std::logic_error("progress is already being reported.");
+		start_time_ = time;
+		time_.store(time, std::memory_order_relaxed);
+		dots_printed_ = 0;
+		stopping_ = false;
+		reporter_ = std::thread(&SimulationProgress::reportLoop, this);
+	}
+
+	// called by the simulation thread, time is the simulation time reached in milliseconds
+	void tick(unsigned long long time)
+	{
+		time_.store(time, std::memory_order_relaxed);
+	}
+
+	void stop()
+	{
+		if (!reporter_.joinable()) return;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stopping_ = true;
+		}
+		stopped_.notify_all();
+		reporter_.join();
+		printDots();
+	}
+
+	unsigned long long dotsPrinted() const { return dots_printed_; }
+
+private:
+	void reportLoop()
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		while (!stopping_)
+		{
+			stopped_.wait_for(lock, poll_interval_, [this] { return stopping_; });
+			printDots();
+		}
+	}
+
+	void printDots()
+	{
+		unsigned long long dots = time_.load(std::memory_order_relaxed) / milliseconds_per_dot_ - start_time_ / milliseconds_per_dot_;
+		if (dots <= dots_printed_) return;
+		out_ << std::string(static_cast<size_t>(dots - dots_printed_), '.');
+		out_.flush();
+		dots_printed_ = dots;
+	}
+
+	std::ostream& out_;
+	unsigned long long milliseconds_per_dot_;
+	std::chrono::milliseconds poll_interval_;
+	unsigned long long start_time_;
+	std::atomic<unsigned long long> time_;   // simulation time reached, in milliseconds
+	unsigned long long dots_printed_;        // reporting thread only, until it is joined
+	bool stopping_;
+	std::mutex mutex_;
+	std::condition_variable stopped_;
+	std::thread reporter_;
+};
+
+
+// Builds a table of comma separated values in a buffer, fields are quoted only when they need to be.
+// Doubles are written with enough digits to read back exactly.
+// Usage:
+//     CsvWriter csv;
+//     csv.field("company").field("count").endRow();
+//     csv.field(results.company).field(results.count).endRow();
+//     writeReport(out, csv.str());
+class CsvWriter
+{
+public:
+	CsvWriter()
+	{
+		row_started_ = false;
+	}
+
+	CsvWriter& field(const std::string& text)
+	{
+		separate();
+		if (text.find_first_of(",\"\r\n") == std::string::npos)
+		{
+			buffer_ += text;
+			return *this;
+		}
+		buffer_ += '"';
+		for (char c : text)
+		{
+			if (c == '"') buffer_ += '"';
+			buffer_ += c;
+		}
+		buffer_ += '"';
+		return *this;
+	}
+
+	CsvWriter& field(double value)
+	{
+		separate();
+		buffer_ += formatDouble(value);
+		return *this;
+	}
+
+	template <typename Integer>
+	typename std::enable_if<std::is_integral<Integer>::value, CsvWriter&>::type field(Integer value)
+	{
+		separate();
+		buffer_ += std::to_string(value);
+		return *this;
+	}
+
+	void endRow()
+	{
+		buffer_ += '\n';
+		row_started_ = false;
+	}
+
+	const std::string& str() const { return buffer_; }
+
+	// shortest form that reads back as the same double, non-finite values as nan, inf and -inf
+	static std::string formatDouble(double value)
+	{
+		if (std::isnan(value)) return "nan";
+		if (std::isinf(value)) return value > 0 ? "inf" : "-inf";
+		char text[32];
+		for (int precision = 6; precision < std::numeric_limits<double>::max_digits10; precision++)
+		{
+			std::snprintf(text, sizeof(text), "%.*g", precision, value);
+			if (std::strtod(text, nullptr) == value) return text;
+		}
+		std::snprintf(text, sizeof(text), "%.*g", std::numeric_limits<double>::max_digits10, value);
+		return text;
+	}
+
+private:
+	void separate()
+	{
+		if (row_started_) buffer_ += ',';
+		row_started_ = true;
+	}
+
+	std::string buffer_;
+	bool row_started_;
+};
+
+
+// Builds a JSON document in a buffer, commas between members and elements are put in as it goes.
+// A member is a key() followed by a value(), or by the begin of an object or array.
+// Non-finite doubles, which JSON has no way to write, are written as null.
+// Usage:
+//     JsonWriter json;
+//     json.beginObject().key("companies").beginArray();
+//     json.beginObject().key("company").value(results.company).key("count").value(results.count).endObject();
+//     json.endArray().endObject();
+//     writeReport(out, json.str());
+class JsonWriter
+{
+public:
+	JsonWriter()
+	{
+		after_key_ = false;
+	}
+
+	JsonWriter& beginObject() { open('{'); return *this; }
+
+	JsonWriter& endObject() { close('}'); return *this; }
+
+	JsonWriter& beginArray() { open('['); return *this; }
+
+	JsonWriter& endArray() { close(']'); return *this; }
+
+	JsonWriter& key(const std::string& name)
+	{
+		if (first_.empty() || after_key_) throw std::logic_error("a JSON key must be a member of an object.");
+		separate();
+		writeString(name);
+		buffer_ += ':';
+		after_key_ = true;
+		return *this;
+	}
+
+	JsonWriter& value(const std::string& text)
+	{
+		separate();
+		writeString(text);
+		return *this;
+	}
+
+	JsonWriter& value(const char* text) { return value(std::string(text)); }
+
+	JsonWriter& value(bool flag)
+	{
+		separate();
+		buffer_ += flag ? "true" : "false";
+		return *this;
+	}
+
+	JsonWriter& value(double number)
+	{
+		separate();
+		buffer_ += std::isfinite(number) ? CsvWriter::formatDouble(number) : "null";
+		return *this;
+	}
+
+	template <typename Integer>
+	typename std::enable_if<std::is_integral<Integer>::value && !std::is_same<Integer, bool>::value, JsonWriter&>::type value(Integer number)
+	{
+		separate();
+		buffer_ += std::to_string(number);
+		return *this;
+	}
+
+	// the finished document, every object and array must have been ended
+	const std::string& str() const
+	{
+		if (!first_.empty()) throw std::logic_error("the JSON document is not finished.");
+		return buffer_;
+	}
+
+private:
+	void open(char bracket)
+	{
+		separate();
+		buffer_ += bracket;
+		first_.push_back(true);
+	}
+
+	void close(char bracket)
+	{
+		if (first_.empty() || after_key_) throw std::logic_error("nothing to end in the JSON document.");
+		first_.pop_back();
+		buffer_ += bracket;
+	}
+
+	// a comma before every member or element but the first, none between a key and its value
+	void separate()
+	{
+		if (after_key_)
+		{
+			after_key_ = false;
+			return;
+		}
+		if (first_.empty()) return;
+		if (!first_.back()) buffer_ += ',';
+		first_.back() = false;
+	}
+
+	void writeString(const std::string& text)
+	{
+		buffer_ += '"';
+		for (char c : text)
+		{
+			if (c == '"') buffer_ += "\\\"";
+			else if (c == '\\') buffer_ += "\\\\";
+			else if (c == '\n') buffer_ += "\\n";
+			else if (c == '\t') buffer_ += "\\t";
+			else if (static_cast<unsigned char>(c) < 0x20)
+			{
+				char escaped[8];
+				std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(static_cast<unsigned char>(c)));
+				buffer_ += escaped;
+			}
+			else buffer_ += c;
+		}
+		buffer_ += '"';
+	}
+
+	std::string buffer_;
+	std::vector<bool> first_;   // per open object or array, true until it has a member or element
+	bool after_key_;
+};
+
+
+
+void test_SimulationOutput()
+{
+	using namespace std;
+
+	std::ostringstream dots;
+	{
+		SimulationProgress progress(dots, 10000, std::chrono::milliseconds(1));
+		progress.start(5000);
+		for (unsigned long long time = 6000; time <= 60000; time += 1000) progress.tick(time);
+		progress.stop();
+		cout << dots.str() << "  " << progress.dotsPrinted() << "  ";
+	}
+
+	CsvWriter csv;
+	csv.field("company").field("count").field("minutes").endRow();
+	csv.field("Alpha, \"A\" Company").field(size_t(6)).field(107.0 / 3.0).endRow();
+	cout << csv.str();
+
+	JsonWriter json;
+	json.beginObject().key("name").value("tab\there").key("values").beginArray().value(1).value(0.1).value(std::nan("")).value(true).endArray();
+	json.key("empty").beginObject().endObject().endObject();
+	cout << json.str() << endl;
+	try { JsonWriter().beginArray().str(); }
+	catch (const std::logic_error& le) { cout << le.what() << endl; }
+}
+
+
+#endif  // SIM_OUTPUT
@@ -0,0 +1,227 @@
+#ifndef SIM_RANDOM
+#define SIM_RANDOM
+
+#include <iostream>
+#include <cstdint>
+#include <chrono>
+#include <limits>
+#include <random>
+
+
+// Counter based random numbers.
+// Rather than advancing the internal state of a generator, each random number is a pure function of
+// a key, a stream and a counter.  Numbers can therefore be drawn in any order, or many at once in parallel,
+// and are always reproducible, with no state shared between the consumers of different streams.
+// The mixing uses only 32 bit multiply, xor and shift so it has an exact SIMD equivalent.
+// Usage:
+//     uint32_t bits = counterRandom32(key, aircraft_index, timestep_count);
+//     double observation = counterRandomToUnit(bits);  // [0.0, 1.0)
+
+// finalizer from MurmurHash3, every input bit affects every output bit
+inline uint32_t mix32(uint32_t h)
+{
+	h ^= h >> 16;
+	h *= 0x85ebca6bU;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35U;
+	h ^= h >> 16;
+	return h;
+}
+
+// the part of a counter based random number that depends only on the counter,
+// the same for every stream so it can be computed once and shared across a batch
+inline uint32_t counterRandomCounterTerm(uint32_t counter)
+{
+	return counter * 0x9e3779b9U;
+}
+
+// the part of a counter based random number that depends only on the key, shared across a batch like the counter term.
+// The key is mixed on its own before it meets the stream, so keys that differ in a few bits don't
+// just swap streams around, as stream ^ key would, stream i of key k being stream i ^ k ^ k' of key k'.
+inline uint32_t counterRandomKeyTerm(uint32_t key)
+{
+	return mix32(key);
+}
+
+// returns 32 random bits for the given key, stream and counter
+inline uint32_t counterRandom32(uint32_t key, uint32_t stream, uint32_t counter)
+{
+	return mix32(mix32(stream ^ counterRandomKeyTerm(key)) ^ counterRandomCounterTerm(counter));
+}
+
+// converts 32 random bits to a double uniformly distributed in [0.0, 1.0)
+inline double counterRandomToUnit(uint32_t bits)
+{
+	return bits * (1.0 / 4294967296.0);
+}
+
+// finalizer from SplitMix64, every input bit affects every output bit
+inline uint64_t mix64(uint64_t z)
+{
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+// 64 bit FNV-1a hash of a block of memory, used as the checksum of binary files
+inline uint64_t fnv1a64(const char* data, size_t size)
+{
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash = (hash ^ static_cast<unsigned char>(data[i])) * 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+// returns the threshold t such that counterRandom32() < t occurs with the given probability
+inline uint32_t probabilityThreshold32(double probability)
+{
+	if (probability <= 0.0) return 0;
+	if (probability >= 1.0) return 0xffffffffU;
+	return static_cast<uint32_t>(probability * 4294967296.0);
+}
+
+
+
+// The purposes random numbers are used for, each is given its own branch of the seed hierarchy
+enum class RandomStream : uint64_t
+{
+	FACTORY = 1,      // selection of prototypes by eVTOLFactory
+	AIRCRAFT = 2,     // one stream per eVTOL, indexed by order of creation
+	FLEET = 3,        // counter based random numbers of eVTOLFleet
+	REPLICATION = 4,  // one master seed per replication, indexed by replication
+	COHORT = 5,       // faults of every cohort of eVTOLCohortFleet
+	REGION = 6        // cross region legs of eVTOLRegionalFleet, one stream per region
+};
+
+
+// A node in a hierarchy of seeds.
+// A master seed is split into independent child seeds, which can in turn be split again, e.g.
+//     master -> factory stream -> one stream per eVTOL
+// A child seed is a pure function of its parent seed and its index, so any part of the hierarchy
+// can be recreated independently and in parallel, with no shared state or locking,
+// and a simulation is fully reproducible from its master seed.
+// Usage:
+//     RandomSeed master(1234);
+//     RandomSeed evtol_seed = master.child(RandomStream::AIRCRAFT).child(evtol_index);
+//     SplitMix64 random_engine(evtol_seed);
+class RandomSeed
+{
+public:
+	explicit RandomSeed(uint64_t value = 0) : value_(value) {}
+
+	// a master seed taken from the clock, for when reproducibility is not wanted
+	static RandomSeed fromClock()
+	{
+		return RandomSeed(mix64(static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count())));
+	}
+
+	// the index'th child of this seed
+	RandomSeed child(uint64_t index) const
+	{
+		return RandomSeed(mix64(value_ ^ mix64(index + 0x9e3779b97f4a7c15ULL)));
+	}
+
+	RandomSeed child(RandomStream stream) const
+	{
+		return child(static_cast<uint64_t>(stream));
+	}
+
+	uint64_t value() const { return value_; }
+
+	// 32 bit version of the seed, e.g. for the key of counterRandom32()
+	uint32_t value32() const { return static_cast<uint32_t>(value_ ^ (value_ >> 32)); }
+
+private:
+	uint64_t value_;
+};
+
+
+// SplitMix64 random number generator.
+// A counter advanced by a constant and passed through mix64(), so it is fast, statistically strong,
+// and its entire state is a single 64 bit integer.
+// Meets the requirements of a uniform random bit generator, so it can be used with the std distributions.
+// Usage:
+//     SplitMix64 random_engine(RandomSeed(1234));
+//     std::uniform_real_distribution<double> dist(0.0, 1.0);
+//     double observation = dist(random_engine);
+class SplitMix64
+{
+public:
+	typedef uint64_t result_type;
+
+	explicit SplitMix64(RandomSeed seed = RandomSeed()) : state_(seed.value()) {}
+
+	void seed(RandomSeed seed) { state_ = seed.value(); }
+
+	static constexpr result_type min() { return 0; }
+
+	static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+	result_type operator()()
+	{
+		state_ += 0x9e3779b97f4a7c15ULL;
+		return mix64(state_);
+	}
+
+	uint64_t state() const { return state_; }
+
+	void setState(uint64_t state) { state_ = state; }
+
+private:
+	uint64_t state_;
+};
+
+
+
+void test_counterRandom()
+{
+	using namespace std;
+
+	// reproducible
+	cout << (counterRandom32(1, 2, 3) == counterRandom32(1, 2, 3)) << endl;
+
+	// streams, counters and keys all give different numbers
+	cout << counterRandom32(1, 2, 3) << "  " << counterRandom32(1, 3, 3) << "  " << counterRandom32(1, 2, 4) << "  " << counterRandom32(2, 2, 3) << endl;
+
+	// keys a bit apart don't share streams, stream 1 of key 0 is not stream 0 of key 1
+	cout << (counterRandom32(0, 1, 3) != counterRandom32(1, 0, 3)) << (counterRandom32(4, 2, 3) != counterRandom32(6, 0, 3)) << endl;
+
+	// mean of a uniform [0,1) should be close to 0.5, and threshold probability should be honored
+	double total = 0.0;
+	size_t below_threshold = 0;
+	uint32_t threshold = probabilityThreshold32(0.1);
+	for (uint32_t i = 0; i < 100000; i++)
+	{
+		uint32_t bits = counterRandom32(42, i % 100, i / 100);
+		total += counterRandomToUnit(bits);
+		below_threshold += bits < threshold;
+	}
+	cout << total / 100000 << "  " << below_threshold / 100000.0 << endl;
+}
+
+
+void test_RandomSeed()
+{
+	using namespace std;
+
+	// children are reproducible, distinct from each other and from their parent
+	RandomSeed master(1234);
+	cout << (master.child(3).value() == RandomSeed(1234).child(3).value()) << endl;
+	cout << master.value() << "  " << master.child(0).value() << "  " << master.child(1).value() << "  " << master.child(RandomStream::AIRCRAFT).child(0).value() << endl;
+
+	// two engines with the same seed produce the same stream, sibling seeds produce different streams
+	SplitMix64 a(master.child(7));
+	SplitMix64 b(master.child(7));
+	SplitMix64 c(master.child(8));
+	cout << (a() == b()) << (a() != c()) << endl;
+
+	std::uniform_real_distribution<double> dist(0.0, 1.0);
+	double total = 0.0;
+	for (int i = 0; i < 100000; i++) total += dist(a);
+	cout << total / 100000 << endl;
+}
+
+
+#endif  // SIM_RANDOM
@@ -0,0 +1,465 @@
+#ifndef SIM_SHARED_MEMORY
+#define SIM_SHARED_MEMORY
+
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <atomic>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN    // leaves winsock.h out, so winsock2.h can still be included
+#endif
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+// A named region of memory shared between processes, POSIX shared memory or a Windows file mapping.
+// The process that creates a region owns its name, which is removed when the owner is destroyed,
+// any process that opened it keeps its mapping until it is destroyed in turn.  A name is a plain word,
+// e.g. "evtol_metrics", made into "/evtol_metrics" or "Local\evtol_metrics" for the platform.
+// Move only, the memory is unmapped on destruction.  Older glibc needs -lrt for shm_open.
+// Usage:
+//     SharedMemoryRegion region = SharedMemoryRegion::create("evtol_metrics", 4096);
+//     SharedMemoryRegion view = SharedMemoryRegion::open("evtol_metrics");
+//     read(view.data(), view.size());
+class SharedMemoryRegion
+{
+public:
+	SharedMemoryRegion() : data_(nullptr), size_(0), owner_(false)
+	{
+#ifdef _WIN32
+		mapping_ = nullptr;
+#endif
+	}
+
+	SharedMemoryRegion(SharedMemoryRegion&& other)
+	{
+		take(other);
+	}
+
+	SharedMemoryRegion& operator=(SharedMemoryRegion&& other)
+	{
+		if (this != &other)
+		{
+			close();
+			take(other);
+		}
+		return *this;
+	}
+
+	SharedMemoryRegion(const SharedMemoryRegion&) = delete;
+	SharedMemoryRegion& operator=(const SharedMemoryRegion&) = delete;
+
+	~SharedMemoryRegion()
+	{
+		close();
+	}
+
+	// creates the region zero filled, replacing any left behind by an owner that did not exit cleanly
+	static SharedMemoryRegion create(const std::string& name, size_t size)
+	{
+		if (size == 0) throw std::invalid_argument("a shared memory region must have a size.");
+		SharedMemoryRegion region;
+		region.name_ = checkedName(name);
+		region.owner_ = true;
+#ifdef _WIN32
+		HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+			static_cast<DWORD>(static_cast<unsigned long long>(size) >> 32), static_cast<DWORD>(size), platformName(name).c_str());
+		if (!mapping) throw std::runtime_error("unable to create shared memory " + name + ".");
+		region.map(mapping, size);
+#else
+		shm_unlink(platformName(name).c_str());
+		int fd = shm_open(platformName(name).c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+		if (fd < 0) throw std::runtime_error("unable to create shared memory " + name + ".");
+		if (ftruncate(fd, static_cast<off_t>(size)) != 0)
+		{
+			::close(fd);
+			shm_unlink(platformName(name).c_str());
+			throw std::runtime_error("unable to size shared memory " + name + ".");
+		}
+		region.map(fd, size, PROT_READ | PROT_WRITE);
+#endif
+		return region;
+	}
+
+	// opens a region another process created, the whole of it is mapped
+	static SharedMemoryRegion open(const std::string& name)
+	{
+		SharedMemoryRegion region;
+		region.name_ = checkedName(name);
+#ifdef _WIN32
+		HANDLE mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, platformName(name).c_str());
+		if (!mapping) throw std::runtime_error("unable to open shared memory " + name + ".");
+		region.map(mapping, 0);
+#else
+		int fd = shm_open(platformName(name).c_str(), O_RDWR, 0);
+		if (fd < 0) throw std::runtime_error("unable to open shared memory " + name + ".");
+		struct stat status;
+		if (fstat(fd, &status) != 0 || status.st_size <= 0)
+		{
+			::close(fd);
+			throw std::runtime_error("unable to open shared memory " + name + ".");
+		}
+		region.map(fd, static_cast<size_t>(status.st_size), PROT_READ | PROT_WRITE);
+#endif
+		return region;
+	}
+
+	bool isOpen() const { return data_ != nullptr; }
+
+	void* data() const { return data_; }
+
+	size_t size() const { return size_; }
+
+	const std::string& name() const { return name_; }
+
+	void close()
+	{
+		if (!data_) return;
+#ifdef _WIN32
+		UnmapViewOfFile(data_);
+		CloseHandle(mapping_);
+		mapping_ = nullptr;
+#else
+		munmap(data_, size_);
+		if (owner_) shm_unlink(platformName(name_).c_str());
+#endif
+		data_ = nullptr;
+		size_ = 0;
+		owner_ = false;
+	}
+
+private:
+	static const std::string& checkedName(const std::string& name)
+	{
+		if (name.empty() || name.find_first_of("/\\") != std::string::npos) throw std::invalid_argument("a shared memory name must be a plain word, not " + name + ".");
+		return name;
+	}
+
+	static std::string platformName(const std::string& name)
+	{
+#ifdef _WIN32
+		return "Local\\" + name;
+#else
+		return "/" + name;
+#endif
+	}
+
+#ifdef _WIN32
+	// a size of 0 maps the whole of the mapping, whatever its creator made it
+	void map(HANDLE mapping, size_t size)
+	{
+		void* data = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+		if (!data)
+		{
+			CloseHandle(mapping);
+			throw std::runtime_error("unable to map shared memory " + name_ + ".");
+		}
+		MEMORY_BASIC_INFORMATION information;
+		VirtualQuery(data, &information, sizeof(information));
+		mapping_ = mapping;
+		data_ = data;
+		size_ = size ? size : information.RegionSize;
+	}
+#else
+	// the descriptor is not needed once mapped
+	void map(int fd, size_t size, int protection)
+	{
+		void* data = mmap(nullptr, size, protection, MAP_SHARED, fd, 0);
+		::close(fd);
+		if (data == MAP_FAILED)
+		{
+			if (owner_) shm_unlink(platformName(name_).c_str());
+			throw std::runtime_error("unable to map shared memory " + name_ + ".");
+		}
+		data_ = data;
+		size_ = size;
+	}
+#endif
+
+	void take(SharedMemoryRegion& other)
+	{
+		data_ = other.data_;
+		size_ = other.size_;
+		owner_ = other.owner_;
+		name_ = other.name_;
+#ifdef _WIN32
+		mapping_ = other.mapping_;
+		other.mapping_ = nullptr;
+#endif
+		other.data_ = nullptr;
+		other.size_ = 0;
+		other.owner_ = false;
+	}
+
+	void* data_;
+	size_t size_;
+	bool owner_;        // created the region, its name goes with it
+	std::string name_;
+#ifdef _WIN32
+	HANDLE mapping_;
+#endif
+};
+
+
+// A whole file mapped read only into memory, so a file of flat records or columns loads without reading it.
+// An empty file maps to no memory.  Move only, the file is unmapped on destruction.
+// Usage:
+//     MappedFile file("results.columns");
+//     ColumnarFileView view(file.data(), file.size());
+class MappedFile
+{
+public:
+	explicit MappedFile(const std::string& file_name) : data_(nullptr), size_(0)
+	{
+#ifdef _WIN32
+		mapping_ = nullptr;
+		HANDLE file = CreateFileA(file_name.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) throw std::runtime_error("unable to open " + file_name + ".");
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size))
+		{
+			CloseHandle(file);
+			throw std::runtime_error("unable to open " + file_name + ".");
+		}
+		size_ = static_cast<size_t>(size.QuadPart);
+		if (size_ > 0)
+		{
+			mapping_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			data_ = mapping_ ? MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0) : nullptr;
+		}
+		CloseHandle(file);
+		if (size_ > 0 && !data_)
+		{
+			if (mapping_) CloseHandle(mapping_);
+			throw std::runtime_error("unable to map " + file_name + ".");
+		}
+#else
+		int fd = ::open(file_name.c_str(), O_RDONLY);
+		if (fd < 0) throw std::runtime_error("unable to open " + file_name + ".");
+		struct stat status;
+		if (fstat(fd, &status) != 0)
+		{
+			::close(fd);
+			throw std::runtime_error("unable to open " + file_name + ".");
+		}
+		size_ = static_cast<size_t>(status.st_size);
+		if (size_ > 0)
+		{
+			void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+			data_ = data == MAP_FAILED ? nullptr : data;
+		}
+		::close(fd);
+		if (size_ > 0 && !data_) throw std::runtime_error("unable to map " + file_name + ".");
+#endif
+	}
+
+	MappedFile(MappedFile&& other) : data_(other.data_), size_(other.size_)
+	{
+#ifdef _WIN32
+		mapping_ = other.mapping_;
+		other.mapping_ = nullptr;
+#endif
+		other.data_ = nullptr;
+		other.size_ = 0;
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	MappedFile& operator=(MappedFile&&) = delete;
+
+	~MappedFile()
+	{
+		if (!data_) return;
+#ifdef _WIN32
+		UnmapViewOfFile(data_);
+		CloseHandle(mapping_);
+#else
+		munmap(data_, size_);
+#endif
+	}
+
+	const char* data() const { return static_cast<const char*>(data_); }
+
+	size_t size() const { return size_; }
+
+private:
+	void* data_;
+	size_t size_;
+#ifdef _WIN32
+	HANDLE mapping_;
+#endif
+};
+
+
+// A value of type T published by one writer to any number of readers, in memory they share, with no locks.
+// Two slots are written in turn, a write always goes to the slot readers are not directed to, so readers
+// only retry when they are still copying a value two writes old.  Every slot has a sequence number, odd
+// while it is being written, a reader copies the slot the latest write went to and keeps the copy only if
+// the sequence number was even and unchanged across it.  The writer never waits for readers and readers
+// never write, so a reader in another process can't hold up or corrupt the writer.
+// The value is held as 64 bit atomic words, T must be trivially copyable and is copied word by word,
+// and the memory must be 8 byte aligned, as shared memory and new are.  64 bit atomics must be lock free,
+// as they are on every platform the simulation builds for, to work between processes.
+// Usage:
+//     SeqlockBuffer<Metrics> writer(region.data(), true);
+//     writer.write(metrics);
+//     SeqlockBuffer<Metrics> reader(view.data(), false);
+//     if (reader.read(metrics)) show(metrics);
+template<class T>
+class SeqlockBuffer
+{
+	static_assert(std::is_trivially_copyable<T>::value, "a seqlock buffer holds trivially copyable values only.");
+
+	static const size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+	static const uint32_t MAGIC = 0x51C0C4u;
+
+	struct Slot
+	{
+		std::atomic<uint64_t> sequence;
+		std::atomic<uint64_t> words[WORDS];
+	};
+
+	struct Layout
+	{
+		uint32_t magic;
+		uint32_t value_size;          // sizeof(T), so a reader built for another T is refused
+		std::atomic<uint64_t> writes; // how many values have been written, the latest is in slot writes % 2
+		Slot slots[2];
+	};
+
+public:
+	// the bytes of shared memory the buffer needs
+	static size_t bytes() { return sizeof(Layout); }
+
+	// initialize lays the buffer out in memory, for the writer, otherwise the memory must hold one already
+	SeqlockBuffer(void* memory, bool initialize)
+	{
+		if (!memory) throw std::invalid_argument("a seqlock buffer needs memory.");
+		if (initialize)
+		{
+			layout_ = new (memory) Layout();
+			layout_->value_size = sizeof(T);
+			layout_->writes.store(0, std::memory_order_relaxed);
+			for (Slot& slot : layout_->slots)
+			{
+				slot.sequence.store(0, std::memory_order_relaxed);
+				for (auto& word : slot.words) word.store(0, std::memory_order_relaxed);
+			}
+			std::atomic_thread_fence(std::memory_order_release);
+			layout_->magic = MAGIC;
+		}
+		else
+		{
+			layout_ = static_cast<Layout*>(memory);
+			if (layout_->magic != MAGIC || layout_->value_size != sizeof(T)) throw std::runtime_error("the memory does not hold a seqlock buffer of this type.");
+		}
+	}
+
+	// one writer only
+	void write(const T& value)
+	{
+		uint64_t words[WORDS] = {};
+		std::memcpy(words, &value, sizeof(T));
+		uint64_t writes = layout_->writes.load(std::memory_order_relaxed) + 1;
+		Slot& slot = layout_->slots[writes % 2];
+		uint64_t sequence = slot.sequence.load(std::memory_order_relaxed);
+		slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		for (size_t w = 0; w < WORDS; w++) slot.words[w].store(words[w], std::memory_order_relaxed);
+		slot.sequence.store(sequence + 2, std::memory_order_release);
+		layout_->writes.store(writes, std::memory_order_release);
+	}
+
+	// copies the latest value into value and returns which write it was, from 1, or 0 with value untouched if none yet
+	uint64_t read(T& value) const
+	{
+		uint64_t words[WORDS];
+		for (;;)
+		{
+			uint64_t writes = layout_->writes.load(std::memory_order_acquire);
+			if (writes == 0) return 0;
+			const Slot& slot = layout_->slots[writes % 2];
+			uint64_t before = slot.sequence.load(std::memory_order_acquire);
+			if (before % 2 != 0) continue;
+			for (size_t w = 0; w < WORDS; w++) words[w] = slot.words[w].load(std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.sequence.load(std::memory_order_relaxed) != before) continue;
+			std::memcpy(&value, words, sizeof(T));
+			return writes;
+		}
+	}
+
+	// how many values have been written
+	uint64_t writes() const { return layout_->writes.load(std::memory_order_acquire); }
+
+private:
+	Layout* layout_;   // not owned
+};
+
+
+
+void test_SeqlockBuffer()
+{
+	using namespace std;
+
+	struct Pair { uint64_t a; double b; char c[3]; };
+
+	// a shared region opened a second time maps the same memory
+	SharedMemoryRegion region = SharedMemoryRegion::create("sim_test_seqlock", SeqlockBuffer<Pair>::bytes());
+	SharedMemoryRegion view = SharedMemoryRegion::open("sim_test_seqlock");
+	SeqlockBuffer<Pair> writer(region.data(), true);
+	SeqlockBuffer<Pair> reader(view.data(), false);
+	Pair pair = { 0, 0.0, "" };
+	cout << view.size() << "  " << reader.read(pair) << "  ";
+	Pair first = { 1, 1.5, "ab" };
+	Pair second = { 2, 2.5, "cd" };
+	writer.write(first);
+	writer.write(second);
+	cout << reader.read(pair) << " " << pair.a << " " << pair.b << " " << pair.c << "  ";
+
+	// a reader on another thread only ever sees whole values, a and b always agree
+	std::atomic<bool> done(false);
+	std::atomic<size_t> torn(0);
+	std::thread thread([&reader, &done, &torn]() {
+		Pair seen;
+		while (!done.load())
+		{
+			if (reader.read(seen) && seen.b != seen.a + 0.5) torn++;
+		}
+		});
+	for (uint64_t i = 3; i < 200000; i++)
+	{
+		Pair value = { i, i + 0.5, "ef" };
+		writer.write(value);
+	}
+	done = true;
+	thread.join();
+	cout << torn << " " << writer.writes() << endl;
+
+	try { SeqlockBuffer<uint64_t> wrong_type(view.data(), false); }
+	catch (const std::runtime_error& re) { cout << re.what() << endl; }
+	region.close();
+	try { SharedMemoryRegion::open("sim_test_seqlock"); }
+	catch (const std::runtime_error& re) { cout << re.what() << endl; }
+	try { SharedMemoryRegion::create("no/slashes", 8); }
+	catch (const std::invalid_argument& ia) { cout << ia.what() << endl; }
+}
+
+
+#endif  // SIM_SHARED_MEMORY
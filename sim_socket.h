@@ -0,0 +1,337 @@
+#ifndef SIM_SOCKET
+#define SIM_SOCKET
+
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "Ws2_32.lib")
+#endif
+typedef SOCKET SocketHandle;
+const SocketHandle NO_SOCKET = INVALID_SOCKET;
+#else
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cerrno>
+typedef int SocketHandle;
+const SocketHandle NO_SOCKET = -1;
+#endif
+
+
+// Starts the platform's socket library the first time a socket is made, Winsock needs it, POSIX does not
+inline void startSockets()
+{
+#ifdef _WIN32
+	struct Winsock
+	{
+		Winsock()
+		{
+			WSADATA data;
+			if (WSAStartup(MAKEWORD(2, 2), &data) != 0) throw std::runtime_error("unable to start Winsock.");
+		}
+		~Winsock() { WSACleanup(); }
+	};
+	static Winsock winsock;
+#endif
+}
+
+inline void closeSocket(SocketHandle handle)
+{
+#ifdef _WIN32
+	closesocket(handle);
+#else
+	::close(handle);
+#endif
+}
+
+// waits up to timeout_milliseconds, or forever when negative, for the socket to have something to read or to be closed
+inline bool waitReadable(SocketHandle handle, int timeout_milliseconds)
+{
+#ifdef _WIN32
+	WSAPOLLFD poll_fd = { handle, POLLRDNORM, 0 };
+	int ready = WSAPoll(&poll_fd, 1, timeout_milliseconds);
+#else
+	pollfd poll_fd = { handle, POLLIN, 0 };
+	int ready;
+	do { ready = ::poll(&poll_fd, 1, timeout_milliseconds); } while (ready < 0 && errno == EINTR);
+#endif
+	if (ready < 0) throw std::runtime_error("unable to wait on a socket.");
+	return ready > 0;
+}
+
+
+// A connected TCP socket that sends and receives length prefixed messages.
+// A message is a 32 bit type and a payload of any bytes, the frame is in network byte order,
+// a payload is written and read as it is.  Every failure, including the other end closing, throws std::runtime_error,
+// so a lost peer is found at the next send or receive.  Move only, the socket is closed on destruction.
+// Usage:
+//     SocketConnection connection = SocketConnection::connect("localhost", 5400);
+//     connection.sendMessage(HELLO, "");
+//     uint32_t type;
+//     std::string payload;
+//     if (connection.receiveMessage(type, payload, 10000)) handle(type, payload);
+class SocketConnection
+{
+public:
+	SocketConnection() : handle_(NO_SOCKET) {}
+
+	explicit SocketConnection(SocketHandle handle) : handle_(handle)
+	{
+		// messages are small and answered at once, don't hold them back
+		int no_delay = 1;
+		setsockopt(handle_, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&no_delay), sizeof(no_delay));
+	}
+
+	SocketConnection(SocketConnection&& other) : handle_(other.handle_)
+	{
+		other.handle_ = NO_SOCKET;
+	}
+
+	SocketConnection& operator=(SocketConnection&& other)
+	{
+		if (this != &other)
+		{
+			close();
+			handle_ = other.handle_;
+			other.handle_ = NO_SOCKET;
+		}
+		return *this;
+	}
+
+	SocketConnection(const SocketConnection&) = delete;
+	SocketConnection& operator=(const SocketConnection&) = delete;
+
+	~SocketConnection()
+	{
+		close();
+	}
+
+	// connects to the port of the host, a name or a numeric address
+	static SocketConnection connect(const std::string& host, uint16_t port)
+	{
+		startSockets();
+		addrinfo hints = {};
+		hints.ai_family = AF_UNSPEC;
+		hints.ai_socktype = SOCK_STREAM;
+		addrinfo* addresses = nullptr;
+		if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0 || !addresses)
+		{
+			throw std::runtime_error("unable to find host " + host + ".");
+		}
+		SocketHandle handle = NO_SOCKET;
+		for (addrinfo* address = addresses; address && handle == NO_SOCKET; address = address->ai_next)
+		{
+			handle = socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+			if (handle == NO_SOCKET) continue;
+			if (::connect(handle, address->ai_addr, static_cast<int>(address->ai_addrlen)) != 0)
+			{
+				closeSocket(handle);
+				handle = NO_SOCKET;
+			}
+		}
+		freeaddrinfo(addresses);
+		if (handle == NO_SOCKET) throw std::runtime_error("unable to connect to " + host + ":" + std::to_string(port) + ".");
+		return SocketConnection(handle);
+	}
+
+	bool isOpen() const { return handle_ != NO_SOCKET; }
+
+	void close()
+	{
+		if (handle_ == NO_SOCKET) return;
+		closeSocket(handle_);
+		handle_ = NO_SOCKET;
+	}
+
+	void sendMessage(uint32_t type, const std::string& payload)
+	{
+		if (payload.size() > MAX_PAYLOAD) throw std::invalid_argument("message payload is too large.");
+		unsigned char frame[8];
+		encode32(frame, type);
+		encode32(frame + 4, static_cast<uint32_t>(payload.size()));
+		std::string message(reinterpret_cast<const char*>(frame), sizeof(frame));
+		message += payload;
+		sendAll(message.data(), message.size());
+	}
+
+	// waits up to timeout_milliseconds, or forever when negative, for a message to start arriving, false if none did
+	bool receiveMessage(uint32_t& type, std::string& payload, int timeout_milliseconds = -1)
+	{
+		if (!waitReadable(checkedHandle(), timeout_milliseconds)) return false;
+		unsigned char frame[8];
+		receiveAll(frame, sizeof(frame));
+		type = decode32(frame);
+		uint32_t size = decode32(frame + 4);
+		if (size > MAX_PAYLOAD) throw std::runtime_error("message payload is too large.");
+		payload.assign(size, '\0');
+		if (size > 0) receiveAll(&payload[0], size);
+		return true;
+	}
+
+	// sends the bytes as they are, with no frame, for protocols of their own such as HTTP
+	void sendBytes(const std::string& bytes)
+	{
+		sendAll(bytes.data(), bytes.size());
+	}
+
+	// waits up to timeout_milliseconds, or forever when negative, and appends whatever has arrived to bytes,
+	// false if nothing did, throws when the other end has closed
+	bool receiveBytes(std::string& bytes, int timeout_milliseconds = -1)
+	{
+		if (!waitReadable(checkedHandle(), timeout_milliseconds)) return false;
+		char buffer[4096];
+		int received = static_cast<int>(::recv(checkedHandle(), buffer, sizeof(buffer), 0));
+		if (received <= 0) throw std::runtime_error("the connection was lost while receiving.");
+		bytes.append(buffer, received);
+		return true;
+	}
+
+	static const uint32_t MAX_PAYLOAD = 64 * 1024 * 1024;
+
+private:
+	SocketHandle checkedHandle()
+	{
+		if (handle_ == NO_SOCKET) throw std::runtime_error("the connection is closed.");
+		return handle_;
+	}
+
+	void sendAll(const char* data, size_t size)
+	{
+		int flags = 0;
+#ifdef MSG_NOSIGNAL
+		flags = MSG_NOSIGNAL;  // a closed peer is an error, not a signal
+#endif
+		while (size > 0)
+		{
+			int sent = static_cast<int>(::send(checkedHandle(), data, static_cast<int>(size), flags));
+			if (sent <= 0) throw std::runtime_error("the connection was lost while sending.");
+			data += sent;
+			size -= sent;
+		}
+	}
+
+	void receiveAll(void* buffer, size_t size)
+	{
+		char* data = static_cast<char*>(buffer);
+		while (size > 0)
+		{
+			int received = static_cast<int>(::recv(checkedHandle(), data, static_cast<int>(size), 0));
+			if (received <= 0) throw std::runtime_error("the connection was lost while receiving.");
+			data += received;
+			size -= received;
+		}
+	}
+
+	static void encode32(unsigned char* bytes, uint32_t value)
+	{
+		for (int i = 0; i < 4; i++) bytes[i] = static_cast<unsigned char>(value >> (24 - 8 * i));
+	}
+
+	static uint32_t decode32(const unsigned char* bytes)
+	{
+		return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | uint32_t(bytes[3]);
+	}
+
+	SocketHandle handle_;
+};
+
+
+// Listens for TCP connections on a port of every local address.
+// Usage:
+//     SocketListener listener(5400);
+//     SocketConnection connection = listener.accept(100);
+//     if (connection.isOpen()) serve(std::move(connection));
+class SocketListener
+{
+public:
+	// a port of 0 listens on any free port, see port()
+	explicit SocketListener(uint16_t port)
+	{
+		startSockets();
+		handle_ = socket(AF_INET, SOCK_STREAM, 0);
+		if (handle_ == NO_SOCKET) throw std::runtime_error("unable to create a socket.");
+		int reuse = 1;
+		setsockopt(handle_, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+		sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_addr.s_addr = htonl(INADDR_ANY);
+		address.sin_port = htons(port);
+		if (bind(handle_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(handle_, SOMAXCONN) != 0)
+		{
+			closeSocket(handle_);
+			throw std::runtime_error("unable to listen on port " + std::to_string(port) + ".");
+		}
+		socklen_t length = sizeof(address);
+		getsockname(handle_, reinterpret_cast<sockaddr*>(&address), &length);
+		port_ = ntohs(address.sin_port);
+	}
+
+	SocketListener(const SocketListener&) = delete;
+	SocketListener& operator=(const SocketListener&) = delete;
+
+	~SocketListener()
+	{
+		closeSocket(handle_);
+	}
+
+	uint16_t port() const { return port_; }
+
+	// the next connection, or a closed one if none arrives within timeout_milliseconds
+	SocketConnection accept(int timeout_milliseconds)
+	{
+		if (!waitReadable(handle_, timeout_milliseconds)) return SocketConnection();
+		SocketHandle handle = ::accept(handle_, nullptr, nullptr);
+		if (handle == NO_SOCKET) return SocketConnection();
+		return SocketConnection(handle);
+	}
+
+private:
+	SocketHandle handle_;
+	uint16_t port_;
+};
+
+
+
+void test_SocketConnection()
+{
+	using namespace std;
+
+	SocketListener listener(0);
+	SocketConnection client = SocketConnection::connect("127.0.0.1", listener.port());
+	SocketConnection server = listener.accept(1000);
+	client.sendMessage(7, "hello");
+	client.sendMessage(8, std::string(100000, 'x'));
+	uint32_t type;
+	std::string payload;
+	server.receiveMessage(type, payload, 1000);
+	cout << server.isOpen() << "  " << type << " " << payload << "  ";
+	server.receiveMessage(type, payload, 1000);
+	cout << type << " " << payload.size() << "  " << server.receiveMessage(type, payload, 10) << "  ";
+	client.sendBytes("GET / HTTP/1.0\r\n\r\n");
+	std::string bytes;
+	while (bytes.size() < 18 && server.receiveBytes(bytes, 1000)) {}
+	cout << bytes.substr(0, 14) << "  ";
+
+	// the other end going away is an error at the next receive
+	client.close();
+	try { server.receiveMessage(type, payload, 1000); }
+	catch (const std::runtime_error& re) { cout << re.what() << endl; }
+	try { SocketConnection::connect("127.0.0.1", 0); }
+	catch (const std::runtime_error& re) { cout << re.what() << endl; }
+}
+
+
+#endif  // SIM_SOCKET
@@ -0,0 +1,180 @@
+#ifndef SIM_THREAD_POOL
+#define SIM_THREAD_POOL
+
+#include <iostream>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <stdexcept>
+#include <algorithm>
+
+
+// A fixed pool of threads for running the work of a single timestep in parallel.
+// The threads are created once and wait between timesteps, so handing out work costs
+// a wake up rather than a thread creation.
+// parallelFor splits a range into one contiguous shard per thread, shard k is always the same part
+// of the range for the same count, so the partition of work is deterministic.
+// The calling thread runs shard 0 itself, a pool of 1 thread runs everything on the calling thread.
+// Usage:
+//     SimulationThreadPool pool(4);
+//     pool.parallelFor(items.size(), [&items](size_t begin, size_t end, size_t shard) {
+//         for (size_t i = begin; i < end; i++) update(items[i]);
+//     });
+class SimulationThreadPool
+{
+public:
+	// number_of_threads of 0 uses one thread per hardware thread
+	SimulationThreadPool(size_t number_of_threads = 0)
+	{
+		number_of_threads_ = number_of_threads ? number_of_threads : std::max(1u, std::thread::hardware_concurrency());
+		generation_ = 0;
+		shards_remaining_ = 0;
+		count_ = 0;
+		stopping_ = false;
+		for (size_t shard = 1; shard < number_of_threads_; shard++)
+		{
+			workers_.push_back(std::thread(&SimulationThreadPool::workerLoop, this, shard));
+		}
+	}
+
+	~SimulationThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stopping_ = true;
+		}
+		work_ready_.notify_all();
+		for (auto& worker : workers_)
+		{
+			worker.join();
+		}
+	}
+
+	// runs task(begin, end, shard) for each shard of [0, count) and returns once all shards are done
+	// rethrows the first exception thrown by a task
+	void parallelFor(size_t count, const std::function<void(size_t, size_t, size_t)>& task)
+	{
+		if (number_of_threads_ == 1)
+		{
+			task(0, count, 0);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			task_ = task;
+			count_ = count;
+			error_ = nullptr;
+			shards_remaining_ = number_of_threads_ - 1;
+			generation_++;
+		}
+		work_ready_.notify_all();
+
+		runShard(0);
+
+		std::unique_lock<std::mutex> lock(mutex_);
+		work_done_.wait(lock, [this] { return shards_remaining_ == 0; });
+		task_ = nullptr;
+		if (error_) std::rethrow_exception(error_);
+	}
+
+	size_t size() { return number_of_threads_; }
+
+	// the part of [0, count) that belongs to a shard
+	static size_t shardBegin(size_t count, size_t shard, size_t number_of_shards)
+	{
+		return count / number_of_shards * shard + std::min(shard, count % number_of_shards);
+	}
+
+private:
+	void workerLoop(size_t shard)
+	{
+		unsigned long long seen_generation = 0;
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				work_ready_.wait(lock, [this, seen_generation] { return stopping_ || generation_ != seen_generation; });
+				if (stopping_) return;
+				seen_generation = generation_;
+			}
+
+			runShard(shard);
+
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				shards_remaining_--;
+			}
+			work_done_.notify_one();
+		}
+	}
+
+	void runShard(size_t shard)
+	{
+		size_t begin = shardBegin(count_, shard, number_of_threads_);
+		size_t end = shardBegin(count_, shard + 1, number_of_threads_);
+		try
+		{
+			if (begin < end) task_(begin, end, shard);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (!error_) error_ = std::current_exception();
+		}
+	}
+
+	size_t number_of_threads_;
+	std::vector<std::thread> workers_;
+	std::mutex mutex_;
+	std::condition_variable work_ready_;
+	std::condition_variable work_done_;
+	std::function<void(size_t, size_t, size_t)> task_;  // the work of the current parallelFor
+	size_t count_;                                      // size of the range of the current parallelFor
+	unsigned long long generation_;                     // incremented for each parallelFor
+	size_t shards_remaining_;                           // worker shards of the current parallelFor not yet done
+	std::exception_ptr error_;
+	bool stopping_;
+};
+
+
+
+void test_SimulationThreadPool()
+{
+	using namespace std;
+
+	// every item is visited exactly once, for any number of threads
+	for (size_t threads = 1; threads <= 4; threads++)
+	{
+		SimulationThreadPool pool(threads);
+		std::vector<int> visits(1001, 0);
+		for (int repeat = 0; repeat < 100; repeat++)
+		{
+			pool.parallelFor(visits.size(), [&visits](size_t begin, size_t end, size_t shard) {
+				for (size_t i = begin; i < end; i++) visits[i]++;
+				});
+		}
+		bool all_100 = true;
+		for (int v : visits) all_100 = all_100 && v == 100;
+		cout << pool.size() << "  " << all_100 << endl;
+	}
+
+	// exceptions are passed back to the caller
+	SimulationThreadPool pool(3);
+	try
+	{
+		pool.parallelFor(3, [](size_t begin, size_t end, size_t shard) {
+			if (shard == 2) throw std::runtime_error("shard 2 failed.");
+			});
+	}
+	catch (const std::runtime_error& re)
+	{
+		cout << re.what() << endl;
+	}
+}
+
+
+#endif  // SIM_THREAD_POOL
@@ -3,14 +3,56 @@
 
 
 #include <iostream>
+#include <vector>
+#include <algorithm>
 #include <functional>
 #include <chrono>
 #include <stdexcept>
+#include <thread>
+
+
+// Describes how the timer relates simulation time to real time.
+//   PACED - timesteps are spread out in real time according to the time compression ratio,
+//           the timer sleeps between timesteps
+//   FREE_RUNNING - timesteps are fired back to back as fast as possible, time compression is ignored
+enum class SimulationTimerMode
+{
+	PACED,
+	FREE_RUNNING
+};
+
+
+// What a paced timer does once a timestep has missed its deadline, fired a whole real time interval or more late.
+//   CATCH_UP - fires the late timesteps back to back until it is back on schedule, simulation time keeps pace overall
+//   DROP - gives up the missed real time slots and paces the following timesteps from now,
+//          simulation time falls behind real time but timesteps stay evenly spaced
+//   COARSEN - fires one wider timestep covering every timestep missed, up to a maximum,
+//             simulation time keeps pace and there is no burst, at the cost of coarser timesteps while behind
+enum class TimerCatchUpPolicy
+{
+	CATCH_UP,
+	DROP,
+	COARSEN
+};
+
+
+// How late a paced timer fired its timesteps, lateness is from each timestep's real time deadline
+struct SimulationTimerJitter
+{
+	unsigned long long timesteps_fired;       // coarsened timesteps count once
+	unsigned long long missed_deadlines;      // fired a whole real time interval or more late
+	unsigned long long dropped_slots;         // DROP, real time slots given up
+	unsigned long long coarsened_timesteps;   // COARSEN, timesteps merged into wider ones
+	double p50_lateness_microseconds;
+	double p99_lateness_microseconds;
+	double max_lateness_microseconds;
+};
 
 
 // Provides timesteps for a simulation.
 // Runs for a predetermined amount of simulation time.
-// Runs at a configured time compression ratio of simulation time to real time.
+// Runs at a configured time compression ratio of simulation time to real time,
+// or free running with no real time pacing at all.
 // Fires off an event at each timestep by calling a function with signature:
 //     void(size_t prev_time, size_t cur_time)
 // where both arguments are the time since start of simulation as measured in milliseconds
@@ -19,6 +61,14 @@
 //     auto event_handler = [](size_t prev_time, size_t cur_time) {};
 //     SimulationEventTimer timer(1000, event_handler, 1, 1);
 //     timer.start();
+// or, to run as fast as possible:
+//     SimulationEventTimer timer(1000, event_handler, 1, 1, SimulationTimerMode::FREE_RUNNING);
+//     timer.start();
+// A paced timer measures how late it fires each timestep, see jitter(), and follows its TimerCatchUpPolicy
+// once a timestep has missed its deadline:
+//     timer.setCatchUpPolicy(TimerCatchUpPolicy::COARSEN, 4);
+// Timesteps can instead be of variable size, each ending at a time chosen by the client, e.g. the next state change:
+//     timer.setNextTime([](unsigned long long cur_time) { return cur_time + 60000; });
 class SimulationEventTimer
 {
 public:
@@ -26,7 +76,8 @@ public:
 		size_t timestep_size_milliseconds_, 
 		std::function<void(unsigned long long, unsigned long long)> timestep_event,
 		size_t total_simulation_time_minutes_, 
-		size_t simulation_to_real_time_ = 1)
+		size_t simulation_to_real_time_ = 1,
+		SimulationTimerMode mode = SimulationTimerMode::PACED)
 	{
 		if (timestep_size_milliseconds_ == 0) throw std::invalid_argument("timestep_size_milliseconds must be greater than 0.");
 		if(!timestep_event) throw std::invalid_argument("timestep_event function is required.");
@@ -36,42 +87,184 @@ public:
 		this->timestep_event_ = timestep_event;
 		this->total_simulation_time_minutes_ = total_simulation_time_minutes_;
 		this->simulation_to_real_time_ = simulation_to_real_time_;
+		this->mode_ = mode;
+		this->catch_up_policy_ = TimerCatchUpPolicy::CATCH_UP;
+		this->max_coarsening_ = DEFAULT_MAX_COARSENING;
+		this->jitter_ = SimulationTimerJitter();
+	}
+
+	static const size_t DEFAULT_MAX_COARSENING = 8;
+
+	// paced only, max_coarsening is the most timesteps COARSEN merges into one
+	void setCatchUpPolicy(TimerCatchUpPolicy policy, size_t max_coarsening = DEFAULT_MAX_COARSENING)
+	{
+		if (max_coarsening == 0) throw std::invalid_argument("max_coarsening must be greater than 0.");
+		catch_up_policy_ = policy;
+		max_coarsening_ = max_coarsening;
+	}
+
+	// Variable timesteps.  Each timestep runs from the end of the one before to next_time(prev_time),
+	// at least a millisecond later and at most the end of the simulation time, which is not rounded up to a whole timestep.
+	// A paced timer fires each timestep once real time reaches its start, catching up after a missed deadline
+	// as CATCH_UP or DROP, COARSEN catches up as CATCH_UP since the timesteps are already as wide as the client allows.
+	void setNextTime(std::function<unsigned long long(unsigned long long)> next_time)
+	{
+		next_time_ = next_time;
 	}
 
 	// starts the timer.
-	void start()
+	// first_update resumes part way through, the first timestep fired runs from first_update timesteps in
+	void start(unsigned long long first_update = 0)
 	{
+		// total number of timesteps that fit within the simulation time
+		unsigned long long total_simulation_time_milliseconds = total_simulation_time_minutes_ * 60ULL * 1000ULL;
+		unsigned long long total_updates = (total_simulation_time_milliseconds + timestep_size_milliseconds_ - 1) / timestep_size_milliseconds_;
+		if (next_time_)
+		{
+			startVariable(first_update * timestep_size_milliseconds_, total_simulation_time_milliseconds);
+			return;
+		}
+
+		if (mode_ == SimulationTimerMode::FREE_RUNNING)
+		{
+			// no wall clock pacing, fire timesteps back to back
+			for (unsigned long long update_count = first_update; update_count < total_updates; update_count++)
+			{
+				fireTimestep(update_count);
+			}
+			return;
+		}
+
 		// timer reports time in milliseconds but operates in microseconds for precison purposes
-		std::chrono::microseconds total_simulation_time = std::chrono::seconds(total_simulation_time_minutes_ * 60);
-		std::chrono::microseconds current_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch());;
-		std::chrono::microseconds next_update_time = current_time;
-		std::chrono::microseconds stop_time = current_time + total_simulation_time / simulation_to_real_time_;
-		std::chrono::microseconds update_interval = std::chrono::microseconds(1000) * timestep_size_milliseconds_ / simulation_to_real_time_; ///(1000000us / simulation_to_real_time)
-		int update_count = 0;
-
-		while (current_time < stop_time)
+		// steady_clock is used so that wall clock adjustments do not disturb the pacing
+		std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+		unsigned long long first_paced_update = first_update;  // the timestep start_time is the deadline of
+		double interval_microseconds = timestep_size_milliseconds_ * 1000.0 / simulation_to_real_time_;
+		jitter_ = SimulationTimerJitter();
+		lateness_.clear();
+		lateness_.reserve(static_cast<size_t>(total_updates - first_update));
+
+		unsigned long long update_count = first_update;
+		while (update_count < total_updates)
 		{
-			if (current_time >= next_update_time)
+			// deadline is computed from the start time each timestep so rounding errors do not accumulate
+			std::chrono::microseconds deadline((update_count - first_paced_update) * timestep_size_milliseconds_ * 1000ULL / simulation_to_real_time_);
+			// sleep until the deadline of this timestep rather than spinning on the clock
+			std::this_thread::sleep_until(start_time + deadline);
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+			double lateness = std::chrono::duration<double, std::micro>(now - (start_time + deadline)).count();
+			lateness_.push_back(lateness);
+
+			unsigned long long number_of_timesteps = 1;
+			if (lateness >= interval_microseconds)
 			{
-				long prev_simulation_time = update_count++ * timestep_size_milliseconds_;
-				long cur_simulation_time = update_count * timestep_size_milliseconds_;
-				timestep_event_(prev_simulation_time, cur_simulation_time);
-				next_update_time += update_interval;
+				jitter_.missed_deadlines++;
+				unsigned long long missed = static_cast<unsigned long long>(lateness / interval_microseconds);
+				if (catch_up_policy_ == TimerCatchUpPolicy::DROP)
+				{
+					// this timestep is due now, the ones after it a whole interval apart from now
+					jitter_.dropped_slots += missed;
+					start_time = now;
+					first_paced_update = update_count;
+				}
+				else if (catch_up_policy_ == TimerCatchUpPolicy::COARSEN)
+				{
+					number_of_timesteps = std::min<unsigned long long>(std::min<unsigned long long>(missed + 1, max_coarsening_), total_updates - update_count);
+					jitter_.coarsened_timesteps += number_of_timesteps - 1;
+				}
 			}
-			current_time = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch());
+			fireTimesteps(update_count, number_of_timesteps);
+			jitter_.timesteps_fired++;
+			update_count += number_of_timesteps;
 		}
+		summarizeLateness();
 	}
 
+	// how late the timesteps of the latest paced start() fired, all zero when free running
+	SimulationTimerJitter jitter() { return jitter_; }
+
+	// returns approximate real time the timer will run, 0 when free running
 	double totalSimulationTimeInRealMinutes()
 	{
+		if (mode_ == SimulationTimerMode::FREE_RUNNING) return 0.0;
 		return total_simulation_time_minutes_ * 1.0 / simulation_to_real_time_;
 	}
 
+	SimulationTimerMode mode() { return mode_; }
+
 private:
+	// fires the timestep event for the given zero based update count
+	void fireTimestep(unsigned long long update_count)
+	{
+		fireTimesteps(update_count, 1);
+	}
+
+	// fires one timestep event covering number_of_timesteps timesteps from the given update count
+	void fireTimesteps(unsigned long long update_count, unsigned long long number_of_timesteps)
+	{
+		unsigned long long prev_simulation_time = update_count * timestep_size_milliseconds_;
+		unsigned long long cur_simulation_time = (update_count + number_of_timesteps) * timestep_size_milliseconds_;
+		timestep_event_(prev_simulation_time, cur_simulation_time);
+	}
+
+	// the loop of start() for variable timesteps, times are in milliseconds of simulation time
+	void startVariable(unsigned long long first_time, unsigned long long end_time)
+	{
+		std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+		unsigned long long first_paced_time = first_time;  // the time start_time is the deadline of
+		double interval_microseconds = timestep_size_milliseconds_ * 1000.0 / simulation_to_real_time_;
+		jitter_ = SimulationTimerJitter();
+		lateness_.clear();
+
+		unsigned long long prev_time = first_time;
+		while (prev_time < end_time)
+		{
+			unsigned long long cur_time = std::min(std::max(next_time_(prev_time), prev_time + 1), end_time);
+			if (mode_ == SimulationTimerMode::PACED)
+			{
+				std::chrono::microseconds deadline((prev_time - first_paced_time) * 1000ULL / simulation_to_real_time_);
+				std::this_thread::sleep_until(start_time + deadline);
+				std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+				double lateness = std::chrono::duration<double, std::micro>(now - (start_time + deadline)).count();
+				lateness_.push_back(lateness);
+				if (lateness >= interval_microseconds)
+				{
+					jitter_.missed_deadlines++;
+					if (catch_up_policy_ == TimerCatchUpPolicy::DROP)
+					{
+						jitter_.dropped_slots += static_cast<unsigned long long>(lateness / interval_microseconds);
+						start_time = now;
+						first_paced_time = prev_time;
+					}
+				}
+				jitter_.timesteps_fired++;
+			}
+			timestep_event_(prev_time, cur_time);
+			prev_time = cur_time;
+		}
+		summarizeLateness();
+	}
+
+	// percentiles of the lateness of every timestep by the nearest rank
+	void summarizeLateness()
+	{
+		if (lateness_.empty()) return;
+		std::sort(lateness_.begin(), lateness_.end());
+		jitter_.p50_lateness_microseconds = lateness_[(lateness_.size() - 1) / 2];
+		jitter_.p99_lateness_microseconds = lateness_[(lateness_.size() - 1) * 99 / 100];
+		jitter_.max_lateness_microseconds = lateness_.back();
+	}
+
 	std::function<void(unsigned long long, unsigned long long)> timestep_event_;  // function that gets called at each timestep
+	std::function<unsigned long long(unsigned long long)> next_time_;            // variable timesteps only, the end of the timestep from its start
 	size_t simulation_to_real_time_;				// how many units of simulation time passes for every 1 unit of real time
 	size_t total_simulation_time_minutes_;	// total simulation time in minutes
 	size_t timestep_size_milliseconds_;			// time between timesteps in milliseconds of simulation time
+	SimulationTimerMode mode_;							// paced against real time or free running
+	TimerCatchUpPolicy catch_up_policy_;		// paced only, what to do once a deadline is missed
+	size_t max_coarsening_;									// COARSEN only, the most timesteps merged into one
+	SimulationTimerJitter jitter_;
+	std::vector<double> lateness_;					// paced only, of every timestep in microseconds
 };
 
 
@@ -105,6 +298,32 @@ void test_SimulationEventTimer()
 	SimulationEventTimer timer(1000, event_handler, 1, 1);
 	//timer.start();
 
+	SimulationEventTimer free_timer(1000, event_handler, 1, 1, SimulationTimerMode::FREE_RUNNING);
+	free_timer.start();
+
+	// resuming after 58 of the 60 timesteps fires only the last 2
+	free_timer.start(58);
+
+	// variable timesteps, a minute runs as timesteps of 25 seconds with a short last one
+	SimulationEventTimer variable_timer(1000, event_handler, 1, 1, SimulationTimerMode::FREE_RUNNING);
+	variable_timer.setNextTime([](unsigned long long cur_time) { return cur_time + 25000; });
+	variable_timer.start();
+
+	// a 10 ms stall at the 10th of 60 timesteps, 1 ms apart in real time, under each catch up policy
+	for (TimerCatchUpPolicy policy : { TimerCatchUpPolicy::CATCH_UP, TimerCatchUpPolicy::DROP, TimerCatchUpPolicy::COARSEN })
+	{
+		unsigned long long last_time = 0;
+		SimulationEventTimer stalled_timer(1000, [&last_time](unsigned long long prev_time, unsigned long long cur_time) {
+			if (prev_time == 9000) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			last_time = cur_time;
+			}, 1, 1000);
+		stalled_timer.setCatchUpPolicy(policy, 4);
+		stalled_timer.start();
+		SimulationTimerJitter jitter = stalled_timer.jitter();
+		// every policy finishes the simulation time, DROP gives up slots, COARSEN fires fewer, wider timesteps
+		cout << last_time << "  " << (jitter.missed_deadlines > 0) << "  " << (jitter.dropped_slots > 0) << "  " << (jitter.timesteps_fired < 60);
+		cout << "  " << (jitter.max_lateness_microseconds >= 9000.0) << "  " << (jitter.p50_lateness_microseconds <= jitter.p99_lateness_microseconds) << endl;
+	}
 }
 
 
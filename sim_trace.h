@@ -0,0 +1,368 @@
+#ifndef SIM_TRACE
+#define SIM_TRACE
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <map>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <stdexcept>
+
+
+// What a trace record records
+enum class TraceEvent : uint8_t
+{
+	STATE_CHANGE = 1,   // an agent went from_state -> to_state
+	FAULT = 2,          // an agent had a fault
+	BAY_ASSIGNED = 3,   // a device was given a bay of a station
+	BAY_RELEASED = 4    // a device left a bay of a station
+};
+
+const uint32_t TRACE_NO_ID = 0xffffffff;
+
+// One event of a trace, fixed width so a trace is an array of records on disk and in memory
+struct TraceRecord
+{
+	uint64_t time;         // simulation time in milliseconds
+	uint32_t agent;        // trace id of the agent or device
+	uint32_t station;      // bay events only, trace id of the station
+	uint32_t bay;          // bay events only
+	uint8_t event;         // a TraceEvent
+	uint8_t from_state;    // state changes only
+	uint8_t to_state;      // state changes only
+	uint8_t reserved;
+};
+
+const char TRACE_FILE_MAGIC[8] = { 'E', 'V', 'T', 'O', 'L', 'T', 'R', 'C' };
+const uint32_t TRACE_FILE_VERSION = 1;
+
+struct TraceFileHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;  // sizeof(TraceRecord), records follow the header
+};
+
+
+// Records the events of a simulation to a binary file of TraceRecords.
+// Each thread that records gets its own buffer, so recording is a copy into memory with no locks or atomics.
+// A full buffer is handed to a writer thread which writes it to the file while the simulation carries on,
+// the thread recording takes an empty buffer from a pool and continues.
+// Agents given no sink record nothing and pay only a null check at each change of state.
+// The time of each record is the time of the event when event driven, otherwise the time of the
+// timestep, set with setTime() by the simulation before each timestep.
+// Records of different threads are interleaved in the file in the order their buffers filled,
+// readTraceFile and writeTraceCsv order them by time.
+// flush() and close() must only be called while no thread is recording, e.g. between timesteps.
+// Usage:
+//     EventTraceSink trace("run.trace");
+//     trace.setTime(cur_time);
+//     trace.record(TraceEvent::FAULT, evtol_id, trace.time());
+//     trace.close();
+//     convertTraceToCsv("run.trace", "run.csv");
+class EventTraceSink
+{
+public:
+	// buffer_records is the number of records each thread buffers before handing them to the writer
+	EventTraceSink(const std::string& file_name, size_t buffer_records = 65536)
+	{
+		if (buffer_records == 0) throw std::invalid_argument("buffer_records must be greater than 0.");
+		file_.open(file_name, std::ios::binary);
+		if (!file_) throw std::runtime_error("unable to open " + file_name + " for writing.");
+
+		TraceFileHeader header = {};
+		std::memcpy(header.magic, TRACE_FILE_MAGIC, sizeof(header.magic));
+		header.version = TRACE_FILE_VERSION;
+		header.record_size = sizeof(TraceRecord);
+		file_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		sink_id_ = nextSinkId()++;
+		buffer_records_ = buffer_records;
+		time_ = 0;
+		records_written_ = 0;
+		pending_ = 0;
+		stopping_ = false;
+		closed_ = false;
+		writer_ = std::thread(&EventTraceSink::writerLoop, this);
+	}
+
+	~EventTraceSink()
+	{
+		close();
+	}
+
+	EventTraceSink(const EventTraceSink&) = delete;
+	EventTraceSink& operator=(const EventTraceSink&) = delete;
+
+	// the simulation time given to records made by agents that don't know the time themselves
+	void setTime(unsigned long long time) { time_ = time; }
+
+	unsigned long long time() { return time_; }
+
+	void record(const TraceRecord& trace_record)
+	{
+		ThreadBuffer& buffer = threadBuffer();
+		buffer.records.push_back(trace_record);
+		if (buffer.records.size() == buffer_records_) submit(buffer);
+	}
+
+	void record(TraceEvent event, uint32_t agent, unsigned long long time, uint8_t from_state = 0, uint8_t to_state = 0)
+	{
+		TraceRecord trace_record = { time, agent, TRACE_NO_ID, TRACE_NO_ID, static_cast<uint8_t>(event), from_state, to_state, 0 };
+		record(trace_record);
+	}
+
+	void recordBay(TraceEvent event, uint32_t agent, uint32_t station, uint32_t bay, unsigned long long time)
+	{
+		TraceRecord trace_record = { time, agent, station, bay, static_cast<uint8_t>(event), 0, 0, 0 };
+		record(trace_record);
+	}
+
+	// hands every partly filled buffer to the writer and waits until everything recorded is in the file
+	void flush()
+	{
+		if (closed_) return;
+		std::vector<ThreadBuffer*> buffers;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			for (auto& buffer : thread_buffers_) buffers.push_back(buffer.second.get());
+		}
+		for (ThreadBuffer* buffer : buffers)
+		{
+			if (!buffer->records.empty()) submit(*buffer);
+		}
+		std::unique_lock<std::mutex> lock(mutex_);
+		written_.wait(lock, [this] { return pending_ == 0; });
+		file_.flush();
+	}
+
+	// flushes and closes the file, nothing more can be recorded
+	void close()
+	{
+		if (closed_) return;
+		flush();
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stopping_ = true;
+		}
+		work_ready_.notify_one();
+		writer_.join();
+		file_.close();
+		closed_ = true;
+	}
+
+	// records in the file so far
+	unsigned long long recordsWritten() { return records_written_; }
+
+private:
+	struct ThreadBuffer
+	{
+		std::vector<TraceRecord> records;
+	};
+
+	// the buffer of the calling thread, a thread's first record registers its buffer
+	ThreadBuffer& threadBuffer()
+	{
+		// a one entry cache per thread, sinks are told apart by id as a new sink may reuse an old one's address
+		struct Cache
+		{
+			uint64_t sink_id;
+			ThreadBuffer* buffer;
+		};
+		static thread_local Cache cache = { 0, nullptr };
+		if (cache.sink_id == sink_id_) return *cache.buffer;
+
+		std::lock_guard<std::mutex> lock(mutex_);
+		std::unique_ptr<ThreadBuffer>& buffer = thread_buffers_[std::this_thread::get_id()];
+		if (!buffer)
+		{
+			buffer.reset(new ThreadBuffer());
+			buffer->records.reserve(buffer_records_);
+		}
+		cache.sink_id = sink_id_;
+		cache.buffer = buffer.get();
+		return *buffer;
+	}
+
+	// swaps the buffer's records for an empty vector from the pool and queues them for writing
+	void submit(ThreadBuffer& buffer)
+	{
+		std::vector<TraceRecord> records;
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (!free_.empty())
+			{
+				records.swap(free_.back());
+				free_.pop_back();
+			}
+			queue_.push_back(std::vector<TraceRecord>());
+			queue_.back().swap(buffer.records);
+			pending_++;
+		}
+		records.reserve(buffer_records_);
+		buffer.records.swap(records);
+		work_ready_.notify_one();
+	}
+
+	void writerLoop()
+	{
+		while (true)
+		{
+			std::vector<TraceRecord> records;
+			{
+				std::unique_lock<std::mutex> lock(mutex_);
+				work_ready_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+				if (queue_.empty()) return;
+				records.swap(queue_.front());
+				queue_.erase(queue_.begin());
+			}
+
+			file_.write(reinterpret_cast<const char*>(records.data()), records.size() * sizeof(TraceRecord));
+			records_written_ += records.size();
+			records.clear();
+
+			{
+				std::lock_guard<std::mutex> lock(mutex_);
+				free_.push_back(std::vector<TraceRecord>());
+				free_.back().swap(records);
+				pending_--;
+			}
+			written_.notify_all();
+		}
+	}
+
+	static std::atomic<uint64_t>& nextSinkId()
+	{
+		static std::atomic<uint64_t> next_sink_id(1);
+		return next_sink_id;
+	}
+
+	std::ofstream file_;
+	uint64_t sink_id_;
+	size_t buffer_records_;
+	unsigned long long time_;                     // set between timesteps, read by agents during them
+	std::atomic<unsigned long long> records_written_;
+	std::map<std::thread::id, std::unique_ptr<ThreadBuffer> > thread_buffers_;
+	std::vector<std::vector<TraceRecord> > queue_;   // full buffers waiting to be written, oldest first
+	std::vector<std::vector<TraceRecord> > free_;    // written buffers, storage for reuse
+	size_t pending_;                                 // buffers queued but not yet written
+	std::mutex mutex_;
+	std::condition_variable work_ready_;
+	std::condition_variable written_;
+	std::thread writer_;
+	bool stopping_;
+	bool closed_;
+};
+
+
+// reads every record of a trace file, in order of time, records of the same time keep their order in the file
+inline std::vector<TraceRecord> readTraceFile(const std::string& file_name)
+{
+	std::ifstream in(file_name, std::ios::binary);
+	if (!in) throw std::runtime_error("unable to open " + file_name + ".");
+	TraceFileHeader header;
+	if (!in.read(reinterpret_cast<char*>(&header), sizeof(header)) || std::memcmp(header.magic, TRACE_FILE_MAGIC, sizeof(header.magic)) != 0)
+	{
+		throw std::invalid_argument(file_name + " is not a trace file.");
+	}
+	if (header.version != TRACE_FILE_VERSION || header.record_size != sizeof(TraceRecord))
+	{
+		throw std::invalid_argument(file_name + " is an unsupported trace version.");
+	}
+
+	std::vector<TraceRecord> records;
+	TraceRecord trace_record;
+	while (in.read(reinterpret_cast<char*>(&trace_record), sizeof(trace_record)))
+	{
+		records.push_back(trace_record);
+	}
+	std::stable_sort(records.begin(), records.end(), [](const TraceRecord& a, const TraceRecord& b) { return a.time < b.time; });
+	return records;
+}
+
+inline std::string traceEventName(uint8_t event)
+{
+	switch (static_cast<TraceEvent>(event))
+	{
+	case TraceEvent::STATE_CHANGE: return "STATE_CHANGE";
+	case TraceEvent::FAULT: return "FAULT";
+	case TraceEvent::BAY_ASSIGNED: return "BAY_ASSIGNED";
+	case TraceEvent::BAY_RELEASED: return "BAY_RELEASED";
+	}
+	return "UNKNOWN";
+}
+
+// writes records as CSV, state_name gives the names of states, numbers are written without one
+// ids that don't apply to an event are left empty
+inline void writeTraceCsv(std::ostream& out, const std::vector<TraceRecord>& records, std::function<std::string(uint8_t)> state_name = nullptr)
+{
+	out << "time_ms,event,agent,from_state,to_state,station,bay" << std::endl;
+	for (auto& trace_record : records)
+	{
+		out << trace_record.time << "," << traceEventName(trace_record.event) << "," << trace_record.agent << ",";
+		if (trace_record.event == static_cast<uint8_t>(TraceEvent::STATE_CHANGE))
+		{
+			if (state_name) out << state_name(trace_record.from_state) << "," << state_name(trace_record.to_state);
+			else out << static_cast<int>(trace_record.from_state) << "," << static_cast<int>(trace_record.to_state);
+		}
+		else
+		{
+			out << ",";
+		}
+		out << ",";
+		if (trace_record.station != TRACE_NO_ID) out << trace_record.station;
+		out << ",";
+		if (trace_record.bay != TRACE_NO_ID) out << trace_record.bay;
+		out << std::endl;
+	}
+}
+
+inline void convertTraceToCsv(const std::string& trace_file_name, const std::string& csv_file_name, std::function<std::string(uint8_t)> state_name = nullptr)
+{
+	std::vector<TraceRecord> records = readTraceFile(trace_file_name);
+	std::ofstream out(csv_file_name);
+	if (!out) throw std::runtime_error("unable to open " + csv_file_name + " for writing.");
+	writeTraceCsv(out, records, state_name);
+}
+
+
+
+void test_EventTraceSink()
+{
+	using namespace std;
+
+	// small buffers so records are handed to the writer part way through
+	{
+		EventTraceSink trace("test_trace.bin", 4);
+		trace.setTime(2000);
+		trace.record(TraceEvent::STATE_CHANGE, 7, trace.time(), 1, 3);
+		trace.recordBay(TraceEvent::BAY_ASSIGNED, 7, 0, 2, 2000);
+		std::thread other([&trace]() {
+			for (int i = 0; i < 10; i++) trace.record(TraceEvent::FAULT, 9, 1000);
+			});
+		other.join();
+		trace.flush();
+		cout << trace.recordsWritten() << "  ";
+	}
+
+	std::vector<TraceRecord> records = readTraceFile("test_trace.bin");
+	cout << sizeof(TraceRecord) << "  " << records.size() << "  " << records.front().time << "  " << traceEventName(records.back().event) << endl;
+	writeTraceCsv(cout, std::vector<TraceRecord>(records.end() - 2, records.end()));
+	std::remove("test_trace.bin");
+
+	try { EventTraceSink bad("test_trace.bin", 0); }
+	catch (const std::invalid_argument& ia) { cout << ia.what() << endl; }
+}
+
+
+#endif  // SIM_TRACE
@@ -1,6 +1,9 @@
 #ifndef SIM_TYPES
 #define SIM_TYPES
 
+#include <cstddef>
+#include <cstdint>
+
 
 // Any object that participates in a simulation by receiving timestep updates
 // so it can update its internal state.
@@ -27,6 +30,21 @@ public:
 
 	// returns true if device is fully charged, false otherwise
 	virtual bool hasFullCharge() = 0;
+
+	// returns the kWh still needed to bring the device to a full charge
+	virtual double chargeNeeded() = 0;
+
+	// identifies the device in an event trace
+	virtual uint32_t traceId() { return 0xffffffff; }
+};
+
+
+// Somewhere chargeable devices go to be charged, a single charging station or a network of them.
+class ChargingService
+{
+public:
+	// a device is in need of charge and is handed over to be charged
+	virtual void addDevice(ChargeableDevice* device) = 0;
 };
 
 #endif  // SIM_TYPES
\ No newline at end of file